@@ -1,18 +1,199 @@
 #include "debug.h"
 #include "mycache.h"
+#include "mystorage.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
-static int dbFile = -1;
+#define SNAPSHOT_MAGIC 0x5343594d /* "MYCS" */
+#define SNAPSHOT_CHUNK (64 * 1024)
 
-static MYBUCKET_BUCKET_t *CacheEntries = NULL;
+#define LOG_MAGIC 0x4c43594d /* "MYCL" */
 
-static int *CacheDirty = NULL;
+/* Records read and written at once by MYC_loadTable(). */
+#define LOAD_RECORDS 32768
+
+/* Blocks or chunks a step of a compaction or a backup moves at most. */
+#define JOB_MAXSTEP 1024
+
+/* Records checked at once by the scrubber. */
+#define SCRUB_BATCH 256
+
+/* The cleaner wakes when no more than 1/CLEAN_LOW of the entries are clean
+ * or unused and writes back until 1/CLEAN_HIGH of them are, CLEAN_BATCH at
+ * most with the table lock held and for about CLEAN_BUDGET nanoseconds. */
+#define CLEAN_LOW 8
+#define CLEAN_HIGH 4
+#define CLEAN_BATCH 32
+#define CLEAN_BUDGET 10000
+
+/* Entries written back at once by a flush, and the size of the ring of a
+ * table with MYC_OPT_URING. */
+#define WRITE_BATCH 64
+
+/* Accesses in the miss curve of a table before it is worth resizing. */
+#define RESIZE_MINACCESSES 10000
+/* Slice of the sleep of the resizer, to stop it quickly. */
+#define RESIZE_SLICE 10
+
+/* Idle I/O class for the scrubber, see ioprio_set(2). */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+/* Options that select the format of the table file. */
+#define MYC_OPT_FORMATS (MYC_OPT_PAGED | MYC_OPT_COMPRESSED)
+
+/* Header of the file written by MYC_closeCache() for the next warm start. It
+ * is followed by "count" file indices in ascending order and, if the payload
+ * option is set, by the "count" records in the same order. */
+typedef struct {
+  unsigned int magic;
+  unsigned int recordSize;
+  unsigned int count;
+  unsigned int options;
+} SNAPSHOT_HEADER_t;
+
+/* Every transaction committed is appended to the redo log of its table as a
+ * header followed by "count" entries. The checksum covers the entries, so a
+ * record torn by a crash ends the replay. The log is emptied once the table
+ * file holds everything in it. */
+typedef struct {
+  unsigned int magic;
+  unsigned int count;
+  unsigned int checksum;
+  unsigned int reserved;
+} LOG_HEADER_t;
+
+typedef struct {
+  unsigned int index;
+  unsigned char record[MYBUCKET_RECORDSIZE];
+} LOG_ENTRY_t;
+
+#define VERSION_BUCKETS 1024
+#define VERSION_RECLAIM 256 /* Versions kept between two reclaims. */
+
+/* Before-image of a record overwritten while snapshots were open. The
+ * versions of all the indices of a hash bucket form a list, newest first,
+ * that snapshot readers walk without the table lock. A version is only
+ * linked and unlinked with the table lock held and it is freed once no
+ * reader can still be walking over it (epoch-based reclamation). */
+typedef struct VERSION {
+  struct VERSION *next;    /* Older versions of the bucket. */
+  struct VERSION *retired; /* Unlinked versions waiting to be freed. */
+  uint64_t until;          /* Epoch of the write that replaced the record. */
+  uint64_t stamp;          /* reclaimEpoch when it was unlinked. */
+  unsigned int index;
+  int present; /* 0 if the record was absent, its bytes are zeros. */
+  unsigned char record[MYBUCKET_RECORDSIZE];
+} VERSION_t;
+
+/* One table: its file, its entries and everything needed to serve them. */
+typedef struct {
+  int id;
+  char name[MYC_TABLENAMELENGTH];
+  char file[MYC_TABLENAMELENGTH + 8];
+  char snapshot[MYC_TABLENAMELENGTH + 8];
+  char log[MYC_TABLENAMELENGTH + 8];
+  int options;
+  MYSTORAGE_t storage;
+
+  /* Redo log of the transactions. While it is not empty, dirty entries are
+   * only written back by flushTable(), otherwise a replay could put an older
+   * logged record over a newer one written back. */
+  int logFd;
+  off_t logSize;
+  int applying; /* A transaction is being applied, see MYC_commit(). */
+
+  MYBUCKET_BUCKET_t *entries;
+  int *dirty;
+  unsigned int numDirty;   /* Entries with "dirty" set, see setDirty(). */
+  unsigned int numEntries; /* Entries of the cache, up to the quota. */
+  unsigned int quota;      /* Taken from the budget, with tablesLock. */
+  unsigned int resizes;    /* Counts resizeEntries(), which moves entries. */
+
+  /* Misses the table would have with other sizes, see MYMRC_access(). */
+  MYMRC_t mrc;
+
+  /* Updated with the table lock held, except the histogram. */
+  MYC_STATS_t stats;
+
+  /* Serializes the public functions and the warm start thread. */
+  pthread_mutex_t lock;
+
+  pthread_t warmThread;
+  int warmRunning;
+  volatile int warmStop;
+
+  /* Writes dirty entries back before the misses need them, see
+   * cleanTable(). "cleanCursor" is the file index its sweep goes on from. */
+  pthread_t cleanThread;
+  int cleanRunning;
+  int cleanStop;
+  pthread_cond_t cleanWake;
+  unsigned int cleanCursor;
+
+  /* Sizes the cache for the hit target, with MYC_OPT_AUTOSIZE. */
+  pthread_t sizeThread;
+  int sizeRunning;
+  volatile int sizeStop;
+
+  /* Checks the checksums of the file, with MYC_OPT_SCRUB. */
+  pthread_t scrubThread;
+  int scrubRunning;
+  volatile int scrubStop;
+
+  /* Background job, a compaction or a backup, see runJob(). */
+  pthread_t jobThread;
+  int jobRunning;
+  volatile int jobStop;
+  volatile int jobDone;
+  uint64_t jobBudget; /* Nanoseconds a step may hold the table. */
+  int (*jobStep)(MYSTORAGE_t *storage, unsigned int step);
+  uint64_t *jobCounter; /* Stats counter of the jobs completed. */
+  const char *jobName;
+
+  /* Versions for the snapshots, see MYC_openSnapshot(). "epoch" counts the
+   * writes, a snapshot sees the records as they were at its epoch. */
+  VERSION_t *versions[VERSION_BUCKETS];
+  VERSION_t *retired;
+  uint64_t epoch;
+  unsigned int snapshots;    /* Open snapshots of the table. */
+  unsigned int sinceReclaim; /* Versions kept since the last reclaim. */
+} MYC_TABLE_t;
+
+/* An open snapshot. "announce" is the reclaimEpoch seen by a reader walking
+ * the versions right now, 0 when it is not. */
+typedef struct {
+  MYC_TABLE_t *table; /* NULL if the slot is free. */
+  uint64_t epoch;
+  uint64_t announce;
+  unsigned int records; /* Up to the last record present when opened. */
+} SNAPSHOT_t;
+
+static MYC_TABLE_t *Tables[MYC_MAXTABLES];
+
+/* Protects Tables, budget, reserved, hitTarget and the quotas of the tables.
+ * Never held while waiting for I/O of a table, except to open or close one. */
+static pthread_mutex_t tablesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int budget = MYC_BUDGET;
+static unsigned int reserved = 0; /* Sum of the quotas of the open tables. */
+static unsigned int hitTarget = MYC_HITTARGET;
+
+/* Slots are taken with tablesLock held, then only changed with the lock of
+ * their table, except "announce" that belongs to the reader. */
+static SNAPSHOT_t Snapshots[MYC_MAXSNAPSHOTS];
+static uint64_t reclaimEpoch = 1;
 
 static int debug_level = DEBUG_INIT;
 
@@ -23,7 +204,13 @@ static int debug_level = DEBUG_INIT;
  * NULL means a problem allocating memory.
  */
 static MYBUCKET_BUCKET_t *allocateCache(int n) {
-  return (MYBUCKET_BUCKET_t *)calloc(n, sizeof(MYBUCKET_BUCKET_t));
+  MYBUCKET_BUCKET_t *cache =
+      (MYBUCKET_BUCKET_t *)calloc(n, sizeof(MYBUCKET_BUCKET_t));
+
+  for (int i = 0; cache != NULL && i < n; i++) {
+    cache[i].id = MYBUCKET_UNUSED;
+  }
+  return cache;
 }
 
 /**
@@ -34,6 +221,24 @@ static MYBUCKET_BUCKET_t *allocateCache(int n) {
  */
 static int *allocateDirty(int n) { return (int *)calloc(n, sizeof(int)); }
 
+/** Set the dirty flag of an entry, keeping the count of dirty entries. */
+static void setDirty(MYC_TABLE_t *table, int cacheIndex, int dirty) {
+  table->numDirty += dirty - table->dirty[cacheIndex];
+  table->dirty[cacheIndex] = dirty;
+}
+
+/**
+ * 1 if the record "fileIndex" is present: written to the cache and not
+ * written back yet, or present in the file. Called with the table lock held.
+ * @param cacheIndex Its entry in the cache, -1 if not cached.
+ */
+static int isPresent(MYC_TABLE_t *table, unsigned int fileIndex,
+                     int cacheIndex) {
+  return (cacheIndex >= 0 && table->dirty[cacheIndex] != 0) ||
+         MYS_isPresent(&table->storage, fileIndex);
+}
+
+
 /**
  * Search for an unused entry in the table.
  * If there's no unused one, just one clean entry.
@@ -41,16 +246,16 @@ static int *allocateDirty(int n) { return (int *)calloc(n, sizeof(int)); }
  * @return The index of the selected entry. -1 means that no entry was unused or
  * clean.
  */
-static int searchUnusedOrClean() {
-  for (int i = 0; i < MYC_NUMENTRIES; i++) {
-    if (0 == CacheEntries[i].id) {
+static int searchUnusedOrClean(MYC_TABLE_t *table) {
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    if (MYBUCKET_UNUSED == table->entries[i].id) {
       debug_verbose("returns %d.", i);
       return i;
     }
   }
 
-  for (int i = 0; i < MYC_NUMENTRIES; i++) {
-    if (0 == CacheDirty[i]) {
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    if (0 == table->dirty[i]) {
       debug_verbose("returns %d.", i);
       return i;
     }
@@ -65,9 +270,9 @@ static int searchUnusedOrClean() {
  * @return The index of the entry already containing fileIndex. -1 means that no
  * entry was found.
  */
-static int searchRecord(int fileIndex) {
-  for (int i = 0; i < MYC_NUMENTRIES; i++) {
-    if (fileIndex == CacheEntries[i].id) {
+static int searchRecord(MYC_TABLE_t *table, int fileIndex) {
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    if ((unsigned int)fileIndex == table->entries[i].id) {
       debug_verbose("returns %d.", i);
       return i;
     }
@@ -76,255 +281,2566 @@ static int searchRecord(int fileIndex) {
   return -1;
 }
 
+/**
+ * Count and report a record read from the file that does not match its
+ * checksum, with errno EBADMSG from the storage.
+ */
+static void reportCorrupt(MYC_TABLE_t *table, unsigned int fileIndex) {
+  table->stats.corrupt++;
+  debug_error("Record %u of DB file %s does not match its checksum.",
+              fileIndex, table->file);
+}
+
 /**
  * This function reads one entry from the file into the cache.
- * The entry CachesEntries[cacheIndex] of the cache is read from the position
- * number "CacheEntries[cacheIndex].id" of the file.
+ * The entry entries[cacheIndex] of the table is read from the position
+ * number "entries[cacheIndex].id" of the file.
  * @param cacheIndex The index of the entry in the cache.
  * @return -1 indicates an error reading the entry. 0 success.
  */
-static int readEntry(int cacheIndex) {
-  int offset = CacheEntries[cacheIndex].id *
-               MYBUCKET_RECORDSIZE; /* Replace 0 with calculation */
-
-  do {
-    if (lseek(dbFile, offset, SEEK_SET) == offset) {
-      break;
+static int readEntry(MYC_TABLE_t *table, int cacheIndex) {
+  if (!MYS_isPresent(&table->storage, table->entries[cacheIndex].id)) {
+    memset(table->entries[cacheIndex].record, 0, MYBUCKET_RECORDSIZE);
+    table->stats.absent++;
+  } else if (-1 == MYS_read(&table->storage, table->entries[cacheIndex].id,
+                            1, table->entries[cacheIndex].record)) {
+    if (errno == EBADMSG) {
+      reportCorrupt(table, table->entries[cacheIndex].id);
+    } else {
+      debug_error("Error reading from DB file %s. %s", table->file,
+                  strerror(errno));
     }
+    return -1;
+  }
 
-    debug_error("Error seeking into DB file. %s", strerror(errno));
+  setDirty(table, cacheIndex, 0);
 
-    if (errno != EINTR) {
-      return -1;
-    }
-  } while (1);
+  return 0;
+}
 
-  do {
-    if (read(dbFile, CacheEntries[cacheIndex].record, MYBUCKET_RECORDSIZE) ==
-        MYBUCKET_RECORDSIZE) {
-      break;
-    }
+/**
+ * This function writes one entry of the cache to the file.
+ * The entry entries[cacheIndex] of the table is written on the position
+ * number "entries[cacheIndex].id" of the file.
+ * @param cacheIndex The index of the entry in the cache.
+ * @return -1 indicates an error writing the entry. 0 success.
+ */
+static int writeEntry(MYC_TABLE_t *table, int cacheIndex) {
+  if (-1 == MYS_write(&table->storage, table->entries[cacheIndex].id,
+                     table->entries[cacheIndex].record)) {
+    debug_error("Error writing to DB file %s. %s", table->file,
+                strerror(errno));
+    return -1;
+  }
+  table->storage.generation++;
 
-    debug_error("Error reading from DB file. %s", strerror(errno));
+  setDirty(table, cacheIndex, 0);
+  table->stats.writebacks++;
+  return 0;
+}
 
-    if (errno != EINTR) {
-      return -1;
-    }
-  } while (1);
+/**
+ * Write back the entries "cacheIndices", WRITE_BATCH at most, at the same
+ * time when the storage can, see MYS_writeMany(). Called with the table lock
+ * held.
+ * @return -1 indicates an error writing, the entries stay dirty. 0 success.
+ */
+static int writeEntries(MYC_TABLE_t *table, const int *cacheIndices,
+                        unsigned int count) {
+  MYSTORAGE_WRITE_t writes[WRITE_BATCH] = {{0, NULL}};
 
-  CacheDirty[cacheIndex] = 0;
+  if (count == 1) {
+    return writeEntry(table, cacheIndices[0]);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    writes[i].index = table->entries[cacheIndices[i]].id;
+    writes[i].record = table->entries[cacheIndices[i]].record;
+  }
+  if (-1 == MYS_writeMany(&table->storage, writes, count)) {
+    debug_error("Error writing to DB file %s. %s", table->file,
+                strerror(errno));
+    return -1;
+  }
+  table->storage.generation++;
 
+  for (unsigned int i = 0; i < count; i++) {
+    setDirty(table, cacheIndices[i], 0);
+  }
+  table->stats.writebacks += count;
   return 0;
 }
 
 /**
- * This function writes one entry of the cache to the file.
- * The entry CachesEntries[cacheIndex] of the cache is written on the position
- * number "CachesEntries[cacheIndex].id" of the file.
- * @param cacheIndex The index of the entry in the cache.
- * @return -1 indicates an error writing the entry. 0 success.
+ * Register the entries of a table with the ring of its storage, so that the
+ * records are read and written in place without pinning their pages every
+ * time. The ring works without, only slower.
  */
-static int writeEntry(int cacheIndex) {
+static void registerEntries(MYC_TABLE_t *table) {
+  if (-1 == MYS_setBuffer(&table->storage, table->entries,
+                          table->numEntries * sizeof(MYBUCKET_BUCKET_t))) {
+    debug_info("Entries of table %s not registered with io_uring. %s",
+               table->name, strerror(errno));
+  }
+}
 
-  int offset = CacheEntries[cacheIndex].id *
-               MYBUCKET_RECORDSIZE; /* Replace 0 with calculation */
+static int flushTable(MYC_TABLE_t *table);
 
-  do {
-    if (lseek(dbFile, offset, SEEK_SET) == offset) {
-      break;
-    }
+/**
+ * Write back a dirty entry to reuse it. With transactions in the log the
+ * whole table is flushed instead, which also empties the log.
+ * @return -1 indicates an error writing. 0 success.
+ */
+static int writeBack(MYC_TABLE_t *table, int cacheIndex) {
+  if (table->logSize > 0 && !table->applying) {
+    return flushTable(table);
+  }
+  return writeEntry(table, cacheIndex);
+}
 
-    debug_error("Error seeking into DB file. %s", strerror(errno));
+/**
+ * Read or write a whole file descriptor range in chunks of SNAPSHOT_CHUNK.
+ * @return -1 in case of error or premature end of file. 0 success.
+ */
+static int snapshotIO(int fd, void *buffer, size_t size, int writing) {
+  size_t done = 0;
 
-    if (errno != EINTR) {
+  while (done < size) {
+    size_t chunk = size - done < SNAPSHOT_CHUNK ? size - done : SNAPSHOT_CHUNK;
+    ssize_t n = writing ? write(fd, (char *)buffer + done, chunk)
+                        : read(fd, (char *)buffer + done, chunk);
+
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
       return -1;
     }
-  } while (1);
+    done += n;
+  }
+  return 0;
+}
 
-  do {
-    if (write(dbFile, CacheEntries[cacheIndex].record, MYBUCKET_RECORDSIZE) ==
-        MYBUCKET_RECORDSIZE) {
-      break;
-    }
+static int compareIndex(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+static int compareOrder(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
 
-    debug_error("Error writing to DB file. %s", strerror(errno));
+/**
+ * Write the indices (and, with MYC_OPT_SNAPPAYLOAD, the records) of every
+ * entry resident in the table to its snapshot file. The table must be clean.
+ * The file is written aside and renamed so a crash never leaves half of it.
+ * @return -1 in case of error writing the snapshot. 0 success.
+ */
+static int saveSnapshot(MYC_TABLE_t *table) {
+  SNAPSHOT_HEADER_t header = {
+      SNAPSHOT_MAGIC, MYBUCKET_RECORDSIZE, 0,
+      table->options & (MYC_OPT_SNAPPAYLOAD | MYC_OPT_FORMATS)};
+  unsigned int *indices = calloc(table->numEntries, sizeof(unsigned int));
+  unsigned char *records = calloc(table->numEntries, MYBUCKET_RECORDSIZE);
+  char tmpFile[sizeof(table->snapshot) + 4];
+  int status = -1;
 
-    if (errno != EINTR) {
-      return -1;
+  if (indices == NULL || records == NULL) {
+    debug_error("Not enough memory for the snapshot.");
+    free(indices);
+    free(records);
+    return -1;
+  }
+
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    if (MYBUCKET_UNUSED != table->entries[i].id) {
+      indices[header.count++] = table->entries[i].id;
+    }
+  }
+  qsort(indices, header.count, sizeof(unsigned int), compareIndex);
+
+  if (header.options & MYC_OPT_SNAPPAYLOAD) {
+    for (unsigned int i = 0; i < header.count; i++) {
+      int cacheIndex = searchRecord(table, indices[i]);
+      memcpy(records + i * MYBUCKET_RECORDSIZE,
+             table->entries[cacheIndex].record, MYBUCKET_RECORDSIZE);
     }
-  } while (1);
+  }
 
-  CacheDirty[cacheIndex] = 0;
-  return 0;
+  snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", table->snapshot);
+  int fd = open(tmpFile, O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+  if (fd < 0) {
+    debug_error("Error creating snapshot file. %s", strerror(errno));
+  } else if (-1 == snapshotIO(fd, &header, sizeof(header), 1) ||
+             -1 == snapshotIO(fd, indices, header.count * sizeof(unsigned int),
+                              1) ||
+             ((header.options & MYC_OPT_SNAPPAYLOAD) &&
+              -1 == snapshotIO(fd, records, header.count * MYBUCKET_RECORDSIZE,
+                               1)) ||
+             -1 == fsync(fd)) {
+    debug_error("Error writing snapshot file. %s", strerror(errno));
+    close(fd);
+  } else if (-1 == close(fd) || -1 == rename(tmpFile, table->snapshot)) {
+    debug_error("Error saving snapshot file. %s", strerror(errno));
+  } else {
+    debug_info("Snapshot of %u entries saved. (%s)", header.count,
+               table->snapshot);
+    status = 0;
+  }
+
+  free(indices);
+  free(records);
+  return status;
 }
 
 /**
- * Initialize the cache: allocate RAM, open file, etc.
- * @return -1 in case of error during initialization. 0 means OK.
+ * Put a record read by the warm start thread into an unused entry, unless
+ * the traffic already brought that index into the cache. If the file has been
+ * written since "generation" the record may be stale and it is read again.
+ * Called with the table lock held.
+ * @return -1 if the table has no unused entry left. 1 if the record was
+ * loaded. 0 if it was already resident.
  */
-int MYC_initCache() {
-  CacheEntries = allocateCache(MYC_NUMENTRIES);
+static int preloadEntry(MYC_TABLE_t *table, unsigned int fileIndex,
+                        const unsigned char *record, unsigned long generation) {
+  if (searchRecord(table, fileIndex) >= 0) {
+    return 0;
+  }
 
-  if (CacheEntries == NULL) {
-    debug_error("Not enough memory for the entry table.");
+  int cacheIndex = -1;
+  for (unsigned int i = 0; i < table->numEntries && cacheIndex < 0; i++) {
+    if (MYBUCKET_UNUSED == table->entries[i].id) {
+      cacheIndex = i;
+    }
+  }
+  if (cacheIndex < 0) {
     return -1;
   }
 
-  CacheDirty = allocateDirty(MYC_NUMENTRIES);
+  table->entries[cacheIndex].id = fileIndex;
+  if (generation == table->storage.generation &&
+      -1 == MYS_verify(&table->storage, fileIndex, record)) {
+    reportCorrupt(table, fileIndex);
+    table->entries[cacheIndex].id = MYBUCKET_UNUSED;
+    return 0;
+  } else if (generation == table->storage.generation) {
+    memcpy(table->entries[cacheIndex].record, record, MYBUCKET_RECORDSIZE);
+    setDirty(table, cacheIndex, 0);
+  } else if (-1 == readEntry(table, cacheIndex)) {
+    table->entries[cacheIndex].id = MYBUCKET_UNUSED;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Body of the warm start thread of a table. It loads the snapshot file with
+ * large sequential reads and fills the unused entries of the table with it,
+ * while the caller of MYC_openTable() goes on serving requests. Without
+ * payloads in the snapshot, runs of consecutive indices are read with a
+ * single pread.
+ */
+static void *warmStart(void *arg) {
+  MYC_TABLE_t *table = arg;
+  SNAPSHOT_HEADER_t header;
+  unsigned char *buffer = NULL;
+  int loaded = 0;
 
-  if (CacheDirty == NULL) {
-    debug_error("Not enough memory for the flags table.");
-    return -1;
+  int fd = open(table->snapshot, O_RDONLY);
+  if (fd < 0) {
+    debug_info("No snapshot to warm start from. (%s)", table->snapshot);
+    return NULL;
   }
 
-  dbFile = open(MYC_FILENAME, O_SYNC | O_RDWR | O_CREAT,
-                S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (-1 == snapshotIO(fd, &header, sizeof(header), 0) ||
+      header.magic != SNAPSHOT_MAGIC ||
+      header.recordSize != MYBUCKET_RECORDSIZE ||
+      (header.options & MYC_OPT_FORMATS) !=
+          (table->options & MYC_OPT_FORMATS)) {
+    debug_error("Invalid snapshot file. (%s)", table->snapshot);
+    close(fd);
+    return NULL;
+  }
+  if (header.count > table->numEntries) {
+    header.count = table->numEntries;
+  }
 
-  if (dbFile < 0) {
-    debug_error("Error opening DB file. %s ", strerror(errno));
-    return -1;
+  size_t indicesSize = header.count * sizeof(unsigned int);
+  buffer = malloc(indicesSize + header.count * MYBUCKET_RECORDSIZE);
+  if (buffer == NULL ||
+      -1 == snapshotIO(fd, buffer, indicesSize, 0) ||
+      ((header.options & MYC_OPT_SNAPPAYLOAD) &&
+       -1 == snapshotIO(fd, buffer + indicesSize,
+                        header.count * MYBUCKET_RECORDSIZE, 0))) {
+    debug_error("Error reading snapshot file. (%s)", table->snapshot);
+    close(fd);
+    free(buffer);
+    return NULL;
   }
+  close(fd);
 
-  debug_info("DB file opened. (%s)", MYC_FILENAME);
+  /* A crash would leave this snapshot behind, older than the file. */
+  unlink(table->snapshot);
 
-  return 0;
+  unsigned int *indices = (unsigned int *)buffer;
+  unsigned char *records = buffer + indicesSize;
+  unsigned long generation = 0;
+
+  if (header.options & MYC_OPT_SNAPPAYLOAD) {
+    pthread_mutex_lock(&table->lock);
+    generation = table->storage.generation;
+    pthread_mutex_unlock(&table->lock);
+  }
+
+  unsigned int run = 0;
+  while (run < header.count && !table->warmStop) {
+    unsigned int length = 1;
+
+    while (run + length < header.count &&
+           indices[run + length] == indices[run] + length) {
+      length++;
+    }
+
+    if (!(header.options & MYC_OPT_SNAPPAYLOAD)) {
+      pthread_mutex_lock(&table->lock);
+      generation = table->storage.generation;
+      pthread_mutex_unlock(&table->lock);
+
+      if (-1 == table->storage.ops->read(&table->storage, indices[run], length,
+                                         records + run * MYBUCKET_RECORDSIZE)) {
+        debug_error("Error reading from DB file %s. %s", table->file,
+                    strerror(errno));
+        break;
+      }
+    }
+
+    pthread_mutex_lock(&table->lock);
+    int full = 0;
+    for (unsigned int i = run; i < run + length && !full; i++) {
+      int status = preloadEntry(table, indices[i],
+                                records + i * MYBUCKET_RECORDSIZE, generation);
+      full = (status < 0);
+      loaded += (status > 0);
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    if (full) {
+      break;
+    }
+    run += length;
+  }
+
+  debug_info("Warm start of %s preloaded %d of %u entries.", table->name,
+             loaded, header.count);
+  free(buffer);
+  return NULL;
 }
 
 /**
- * This function finishes the cache. It flushes all the information inside the
- * cache that is not written to the file yet and closes the file.
- * @return
+ * Write every dirty entry of the table and make it durable. Called with the
+ * table lock held.
+ * @return -1 in case of I/O error. 0 is OK.
  */
-int MYC_closeCache() {
-  MYC_flushAll();
-
-  free(CacheEntries);
-  CacheEntries = NULL;
-  free(CacheDirty);
-  CacheDirty = NULL;
+static int flushTable(MYC_TABLE_t *table) {
+  int batch[WRITE_BATCH];
+  unsigned int count = 0;
 
-  if (close(dbFile) < 0) {
-    debug_error("Error closing DB file. %s", strerror(errno));
-    dbFile = -1;
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    if (table->dirty[i] == 1) {
+      batch[count++] = i;
+    }
+    if (count == WRITE_BATCH || (count > 0 && i + 1 == table->numEntries)) {
+      if (-1 == writeEntries(table, batch, count)) {
+        debug_error("Error flushing entry to cache.");
+        return -1;
+      }
+      count = 0;
+    }
+  }
+  if (-1 == MYS_sync(&table->storage)) {
+    debug_error("Error syncing DB file %s. %s", table->file, strerror(errno));
     return -1;
   }
+  if (table->logSize > 0) {
+    if (-1 == ftruncate(table->logFd, 0) || -1 == fsync(table->logFd)) {
+      debug_error("Error emptying log %s. %s", table->log, strerror(errno));
+      return -1;
+    }
+    table->logSize = 0;
+  }
+  return 0;
+}
 
-  debug_info("DB file closed. (%s)", MYC_FILENAME);
-  dbFile = -1;
+/** FNV-1a hash of the entries of a log record. */
+static unsigned int logChecksum(const void *data, size_t size) {
+  const unsigned char *p = data;
+  unsigned int hash = 2166136261U;
 
-  return 0;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+  return hash;
 }
 
 /**
- * This function copies into a record passed as argument from the cache.
- * The cache will be read from the given index of the file if not on the cache.
- * The record structure is property of the user, so we have to copy the content
- * of the cache entry onto it.
- *
- * @param fileIndex This is the index of the record in the file.
- * @param record This is a pointer to a record allocated by the user.
- * @return -1 in case of any error like I/O error when reading. 0 is OK.
+ * Write to the table file the transactions left in the log by a crash, up to
+ * the first incomplete one, and empty the log.
+ * @return -1 in case of I/O error. 0 is OK.
  */
-int MYC_readEntry(int fileIndex, MYRECORD_RECORD_t *record) {
+static int replayLog(MYC_TABLE_t *table) {
+  struct stat st;
+  unsigned char *log;
+  int replayed = 0;
 
-  int cacheIndex = searchRecord(fileIndex);
+  if (-1 == fstat(table->logFd, &st)) {
+    return -1;
+  }
+  if (st.st_size == 0) {
+    return 0;
+  }
+  if (NULL == (log = malloc(st.st_size))) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (-1 == MYS_preadFd(&table->storage, table->logFd, log, st.st_size, 0)) {
+    free(log);
+    return -1;
+  }
 
-  if (cacheIndex < 0) {
-    cacheIndex = searchUnusedOrClean();
+  off_t offset = 0;
+  while (offset + (off_t)sizeof(LOG_HEADER_t) <= st.st_size) {
+    LOG_HEADER_t *header = (LOG_HEADER_t *)(log + offset);
+    LOG_ENTRY_t *entries = (LOG_ENTRY_t *)(header + 1);
+    size_t size = (size_t)header->count * sizeof(LOG_ENTRY_t);
 
-    if (cacheIndex < 0) {
-      cacheIndex = fileIndex % MYC_NUMENTRIES;
-      if (-1 == writeEntry(cacheIndex)) {
-        debug_error("Error flushing entry to cache.");
+    if (header->magic != LOG_MAGIC ||
+        (off_t)size > st.st_size - offset - (off_t)sizeof(LOG_HEADER_t) ||
+        header->checksum != logChecksum(entries, size)) {
+      debug_error("Log %s torn at offset %ld, ignoring the rest.", table->log,
+                  (long)offset);
+      break;
+    }
+    for (unsigned int i = 0; i < header->count; i++) {
+      if (-1 == MYS_write(&table->storage, entries[i].index,
+                          entries[i].record)) {
+        free(log);
         return -1;
       }
     }
-
-    CacheEntries[cacheIndex].id = fileIndex;
-    CacheDirty[cacheIndex] = 1;
+    offset += sizeof(LOG_HEADER_t) + size;
+    replayed++;
   }
+  free(log);
 
-  if (-1 == readEntry(cacheIndex)) {
-    debug_error("Error reading entry from cache.");
+  if (-1 == MYS_sync(&table->storage) ||
+      -1 == ftruncate(table->logFd, 0) || -1 == fsync(table->logFd)) {
     return -1;
   }
+  debug_info("Replayed %d transactions from %s.", replayed, table->log);
+  return 0;
+}
 
-  myb_bucket2record(&CacheEntries[cacheIndex], record);
-  debug_debug("Entry %d read from cache.", fileIndex);
+/**
+ * Version of "fileIndex" seen by a snapshot at "epoch": the oldest one
+ * replaced after that epoch. Safe without the table lock while announced.
+ * @return NULL if the snapshot sees the current record.
+ */
+static VERSION_t *findVersion(MYC_TABLE_t *table, unsigned int fileIndex,
+                              uint64_t epoch) {
+  VERSION_t *found = NULL;
 
-  return 0;
+  for (VERSION_t *v = __atomic_load_n(&table->versions[fileIndex %
+                                                       VERSION_BUCKETS],
+                                      __ATOMIC_ACQUIRE);
+       v != NULL; v = __atomic_load_n(&v->next, __ATOMIC_ACQUIRE)) {
+    if (v->index != fileIndex) {
+      continue;
+    }
+    if (v->until <= epoch) {
+      break;
+    }
+    found = v;
+  }
+  return found;
 }
 
-/*
- * This function copies a record passed as argument into the cache.
- * The record will be written at the given index of the file LATER.
- * This funtions does not write the cache entry to the file inmediately.
- * The record structure is property of the user, so we have to copy its
- * content to the entry as the record can be deallocated by the user.
- *
- * @param fileIndex This is the index of the record in the file.
- * @param record This is a pointer to a record allocated by the user.
- * @return -1 in case of any error like I/O error when writing. 0 is OK.
+/**
+ * Unlink the versions no open snapshot of the table can see any more and
+ * free those that no reader can be walking over. Called with the table lock
+ * held.
  */
-int MYC_writeEntry(int fileIndex, MYRECORD_RECORD_t *record) {
+static void reclaimVersions(MYC_TABLE_t *table) {
+  uint64_t oldest = UINT64_MAX;
+  uint64_t quiet = UINT64_MAX;
+
+  for (int i = 0; i < MYC_MAXSNAPSHOTS; i++) {
+    if (Snapshots[i].table == table && Snapshots[i].epoch < oldest) {
+      oldest = Snapshots[i].epoch;
+    }
+  }
 
-  int cacheIndex = searchRecord(fileIndex);
+  uint64_t stamp = __atomic_load_n(&reclaimEpoch, __ATOMIC_SEQ_CST);
+  for (int b = 0; b < VERSION_BUCKETS; b++) {
+    VERSION_t **link = &table->versions[b];
+    while (*link != NULL) {
+      VERSION_t *v = *link;
+      if (v->until <= oldest) {
+        __atomic_store_n(link, v->next, __ATOMIC_RELEASE);
+        v->stamp = stamp;
+        v->retired = table->retired;
+        table->retired = v;
+        table->stats.versions--;
+      } else {
+        link = &v->next;
+      }
+    }
+  }
+  /* Readers announcing a later epoch started after the unlinking above. */
+  __atomic_add_fetch(&reclaimEpoch, 1, __ATOMIC_SEQ_CST);
 
-  if (0 > cacheIndex) {
-    cacheIndex = searchUnusedOrClean();
-    if (0 > cacheIndex) {
-      cacheIndex = record->registerid % MYC_NUMENTRIES;
+  for (int i = 0; i < MYC_MAXSNAPSHOTS; i++) {
+    uint64_t announce =
+        __atomic_load_n(&Snapshots[i].announce, __ATOMIC_SEQ_CST);
+    if (Snapshots[i].table == table && announce != 0 && announce < quiet) {
+      quiet = announce;
     }
-    if (1 == CacheDirty[cacheIndex]) {
-      if (-1 == writeEntry(cacheIndex)) {
-        debug_error("Error flushing entry to cache.");
-        return -1;
+  }
+
+  VERSION_t **link = &table->retired;
+  while (*link != NULL) {
+    VERSION_t *v = *link;
+    if (v->stamp < quiet) {
+      *link = v->retired;
+      free(v);
+    } else {
+      link = &v->retired;
+    }
+  }
+  table->sinceReclaim = 0;
+}
+
+/**
+ * Keep the current record of "fileIndex" as a version before it is
+ * overwritten by the write of epoch "table->epoch", unless no open snapshot
+ * can see it. Called with the table lock held.
+ * @return -1 in case of error reading the record or allocating. 0 is OK.
+ */
+static int keepVersion(MYC_TABLE_t *table, unsigned int fileIndex) {
+  uint64_t newest = 0;
+  VERSION_t **head = &table->versions[fileIndex % VERSION_BUCKETS];
+
+  for (int i = 0; i < MYC_MAXSNAPSHOTS; i++) {
+    if (Snapshots[i].table == table && Snapshots[i].epoch > newest) {
+      newest = Snapshots[i].epoch;
+    }
+  }
+  for (VERSION_t *v = *head; v != NULL; v = v->next) {
+    if (v->index == fileIndex) {
+      /* The current record was written after the newest snapshot. */
+      if (v->until > newest) {
+        return 0;
       }
+      break;
     }
   }
 
-  CacheEntries[cacheIndex].id = fileIndex;
-  CacheDirty[cacheIndex] = 1;
+  VERSION_t *version = malloc(sizeof(VERSION_t));
+  if (version == NULL) {
+    debug_error("Not enough memory for a version of entry %u.", fileIndex);
+    return -1;
+  }
 
-  myb_record2bucket(record, &CacheEntries[cacheIndex]);
-  debug_debug("Entry %d written to cache.", fileIndex);
+  int cacheIndex = searchRecord(table, fileIndex);
+  version->present = isPresent(table, fileIndex, cacheIndex);
+  if (cacheIndex >= 0) {
+    memcpy(version->record, table->entries[cacheIndex].record,
+           MYBUCKET_RECORDSIZE);
+  } else if (-1 == MYS_read(&table->storage, fileIndex, 1, version->record)) {
+    if (errno == EBADMSG) {
+      reportCorrupt(table, fileIndex);
+    } else {
+      debug_error("Error reading from DB file %s. %s", table->file,
+                  strerror(errno));
+    }
+    free(version);
+    return -1;
+  }
 
+  version->index = fileIndex;
+  version->until = table->epoch;
+  version->next = *head;
+  __atomic_store_n(head, version, __ATOMIC_RELEASE);
+  table->stats.versions++;
+
+  if (++table->sinceReclaim >= VERSION_RECLAIM) {
+    reclaimVersions(table);
+  }
   return 0;
 }
 
 /**
- * Forces the cache to write the contents of the entry containing the record at
- * "fileIndex" in the file.
- * @param fileIndex This is the index of the entry of the file to be flushed.
- * @return -1 in case of I/O error. 0 is OK.
+ * Check the present records of "count" from "first" against their checksums.
+ * They were read without the table lock, so a record that does not match is
+ * read again with the lock held in case a write got in the way. Called with
+ * the table lock held.
  */
-int MYC_flushEntry(int fileIndex) {
+static void scrubBatch(MYC_TABLE_t *table, unsigned int first,
+                       unsigned int count, unsigned char *records,
+                       unsigned long generation) {
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned char *record = records + (size_t)i * MYBUCKET_RECORDSIZE;
 
-  int i = searchRecord(fileIndex);
-  if (0 <= i && 1 == CacheDirty[i]) {
-    if (-1 == writeEntry(i)) {
-      debug_error("Error flushing entry to cache.");
-      return -1;
+    if (!MYS_isPresent(&table->storage, first + i)) {
+      continue;
+    }
+    table->stats.scrubbed++;
+    if (0 == MYS_verify(&table->storage, first + i, record) ||
+        (generation != table->storage.generation &&
+         0 == MYS_read(&table->storage, first + i, 1, record))) {
+      continue;
+    }
+    if (errno == EBADMSG) {
+      table->stats.scrubCorrupt++;
+      reportCorrupt(table, first + i);
+    } else {
+      debug_error("Error scrubbing DB file %s. %s", table->file,
+                  strerror(errno));
     }
   }
-  debug_debug("Entry %d flushed to disk.", fileIndex);
-  return 0;
 }
 
 /**
- * Flush any dirty entry in the cache inmediately.
- * @return
+ * Body of the scrubber thread of a table, with MYC_OPT_SCRUB. It walks the
+ * file again and again checking the present records against their
+ * checksums, at MYC_SCRUBRATE records per second and with the lowest CPU and
+ * I/O priority. The records are read without the table lock, which is only
+ * held to check them, so the idle I/O class never makes a request wait.
  */
-int MYC_flushAll() {
-  for (int i = 0; i < MYC_NUMENTRIES; i++) {
-    if (CacheDirty[i] == 1) {
-      if (-1 == writeEntry(i)) {
-        debug_error("Error flushing entry to cache.");
-        return -1;
-      }
+static void *scrubTable(void *arg) {
+  MYC_TABLE_t *table = arg;
+  unsigned char records[SCRUB_BATCH * MYBUCKET_RECORDSIZE];
+  unsigned int next = 0;
+  pid_t tid = syscall(SYS_gettid);
+
+  setpriority(PRIO_PROCESS, tid, 19);
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+          IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+  while (!table->scrubStop) {
+    pthread_mutex_lock(&table->lock);
+    unsigned int end = table->storage.mapBytes * 8;
+    unsigned long generation = table->storage.generation;
+    pthread_mutex_unlock(&table->lock);
+
+    if (next >= end) {
+      next = 0;
     }
+    unsigned int count = end - next < SCRUB_BATCH ? end - next : SCRUB_BATCH;
+    if (count > 0 &&
+        -1 == table->storage.ops->read(&table->storage, next, count,
+                                       records)) {
+      debug_error("Error scrubbing DB file %s. %s", table->file,
+                  strerror(errno));
+    } else if (count > 0) {
+      pthread_mutex_lock(&table->lock);
+      scrubBatch(table, next, count, records, generation);
+      pthread_mutex_unlock(&table->lock);
+    }
+    next += count;
+
+    uint64_t pause = (uint64_t)SCRUB_BATCH * 1000000000 / MYC_SCRUBRATE;
+    struct timespec wait = {pause / 1000000000, pause % 1000000000};
+    nanosleep(&wait, NULL);
+  }
+  return NULL;
+}
+
+/**
+ * Entries the cache of a table needs to hit "percent" of the accesses of its
+ * miss curve, at least MYC_NUMENTRIES and at most "limit". If the target
+ * cannot be hit within the limit, the smallest size within a point of the
+ * best ratio there. Changes of less than an eighth are not worth a resize.
+ * @return "current" if the cache should keep its size.
+ */
+static unsigned int chooseSize(const MYMRC_CURVE_t *curve,
+                               unsigned int percent, unsigned int current,
+                               unsigned int limit) {
+  double target = percent / 100.0;
+  double best = mymrc_hitRatio(curve, limit);
+  unsigned int low = limit < MYC_NUMENTRIES ? limit : MYC_NUMENTRIES;
+  unsigned int high = limit;
+
+  if (curve->accesses < RESIZE_MINACCESSES) {
+    return current;
+  }
+  if (best < target) {
+    target = best - 0.01;
+  }
+  /* The hit ratio only grows with the entries. */
+  while (low < high) {
+    unsigned int middle = low + (high - low) / 2;
+
+    if (mymrc_hitRatio(curve, middle) >= target) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  if ((low > current ? low - current : current - low) * 8 < current) {
+    return current;
+  }
+  return low;
+}
+
+/**
+ * Give the cache of a table "size" entries. Shrinking moves the used entries
+ * past the new end to unused ones and writes back or drops the rest. Called
+ * with the table lock held.
+ * @return -1 in case of error writing or allocating, with the cache still
+ * usable at its old size. 0 success.
+ */
+static int resizeEntries(MYC_TABLE_t *table, unsigned int size) {
+  unsigned int unused = 0;
+
+  table->resizes++;
+  for (unsigned int i = size; i < table->numEntries; i++) {
+    if (MYBUCKET_UNUSED == table->entries[i].id) {
+      continue;
+    }
+    while (unused < size && MYBUCKET_UNUSED != table->entries[unused].id) {
+      unused++;
+    }
+    if (unused < size) {
+      memcpy(&table->entries[unused], &table->entries[i],
+             sizeof(MYBUCKET_BUCKET_t));
+      setDirty(table, unused, table->dirty[i]);
+    } else {
+      if (1 == table->dirty[i] && -1 == writeBack(table, i)) {
+        return -1;
+      }
+      table->stats.evictions++;
+    }
+    table->entries[i].id = MYBUCKET_UNUSED;
+    setDirty(table, i, 0);
+  }
+
+  /* Shrinking keeps the old arrays if realloc() fails, they are larger. The
+   * entries may move, so they are registered again afterwards. */
+  MYS_setBuffer(&table->storage, NULL, 0);
+  MYBUCKET_BUCKET_t *entries =
+      realloc(table->entries, size * sizeof(MYBUCKET_BUCKET_t));
+  if (entries != NULL) {
+    table->entries = entries;
+  }
+  int *dirty = realloc(table->dirty, size * sizeof(int));
+  if (dirty != NULL) {
+    table->dirty = dirty;
+  }
+  if (size > table->numEntries && (entries == NULL || dirty == NULL)) {
+    registerEntries(table);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  for (unsigned int i = table->numEntries; i < size; i++) {
+    table->entries[i].id = MYBUCKET_UNUSED;
+    table->dirty[i] = 0;
+  }
+  table->numEntries = size;
+  registerEntries(table);
+  return 0;
+}
+
+/**
+ * Size the cache of a table for the hit target, within the entries left in
+ * the budget. They are taken from the budget before the cache grows and
+ * given back after it shrinks, so "reserved" never falls below the entries
+ * in use. A table already being closed is left alone.
+ */
+static void resizeTable(MYC_TABLE_t *table) {
+  MYMRC_CURVE_t curve;
+
+  pthread_mutex_lock(&tablesLock);
+  if (Tables[table->id] != table) {
+    pthread_mutex_unlock(&tablesLock);
+    return;
+  }
+  pthread_mutex_lock(&table->lock);
+  memcpy(&curve, &table->mrc.curve, sizeof(MYMRC_CURVE_t));
+  unsigned int current = table->numEntries;
+  pthread_mutex_unlock(&table->lock);
+
+  unsigned int size = chooseSize(&curve, hitTarget, current,
+                                 table->quota + (budget - reserved));
+  if (size > table->quota) {
+    reserved += size - table->quota;
+    table->quota = size;
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  if (size == current) {
+    return;
+  }
+
+  pthread_mutex_lock(&table->lock);
+  if (-1 == resizeEntries(table, size)) {
+    debug_error("Error resizing the cache of table %s. %s", table->name,
+                strerror(errno));
+  } else {
+    debug_info("Cache of table %s resized from %u to %u entries. (%.1f%% "
+               "hits expected)",
+               table->name, current, size,
+               100.0 * mymrc_hitRatio(&curve, size));
+  }
+  size = table->numEntries;
+  pthread_mutex_unlock(&table->lock);
+
+  pthread_mutex_lock(&tablesLock);
+  if (Tables[table->id] == table && table->quota > size) {
+    reserved -= table->quota - size;
+    table->quota = size;
+  }
+  pthread_mutex_unlock(&tablesLock);
+}
+
+/**
+ * Body of the thread of a table with MYC_OPT_AUTOSIZE: it resizes the cache
+ * every MYC_RESIZEPERIOD milliseconds.
+ */
+static void *autosizeTable(void *arg) {
+  MYC_TABLE_t *table = arg;
+  struct timespec slice = {0, RESIZE_SLICE * 1000000};
+
+  while (!table->sizeStop) {
+    for (int waited = 0; waited < MYC_RESIZEPERIOD && !table->sizeStop;
+         waited += RESIZE_SLICE) {
+      nanosleep(&slice, NULL);
+    }
+    if (!table->sizeStop) {
+      resizeTable(table);
+    }
+  }
+  return NULL;
+}
+
+/** 1 when no more than 1/CLEAN_LOW of the entries are clean or unused. */
+static int cleanLow(const MYC_TABLE_t *table) {
+  return table->numEntries - table->numDirty <= table->numEntries / CLEAN_LOW;
+}
+
+/** 1 when at least 1/CLEAN_HIGH of the entries are clean or unused. */
+static int cleanHigh(const MYC_TABLE_t *table) {
+  return table->numEntries - table->numDirty >= table->numEntries / CLEAN_HIGH;
+}
+
+/**
+ * Write back a run of "count" entries holding consecutive file indices from
+ * "first" with a single large write of their "records". Called with the
+ * table lock held.
+ * @return -1 in case of error writing. 0 success.
+ */
+static int writeRun(MYC_TABLE_t *table, unsigned int first,
+                    const int *cacheIndices, const unsigned char *records,
+                    unsigned int count) {
+  if (count == 1) {
+    return writeEntry(table, cacheIndices[0]);
+  }
+  if (-1 == MYS_load(&table->storage, first, count, records)) {
+    debug_error("Error writing to DB file %s. %s", table->file,
+                strerror(errno));
+    return -1;
+  }
+  table->storage.generation++;
+
+  for (unsigned int i = 0; i < count; i++) {
+    setDirty(table, cacheIndices[i], 0);
+  }
+  table->stats.writebacks += count;
+  return 0;
+}
+
+/**
+ * Write back the entries of "order" that are still dirty, in file order.
+ * Each element is the file index of the entry, minus "cursor", in the high
+ * half and the cache index in the low half. Consecutive file indices go out
+ * in a single write, and the entries left alone together at the end, see
+ * writeEntries(). Called with the table lock held, and the cache not
+ * resized since "order" was made.
+ * @return -1 in case of error writing. 0 success.
+ */
+static int cleanBatch(MYC_TABLE_t *table, const uint64_t *order,
+                      unsigned int count, unsigned int cursor) {
+  int run[CLEAN_BATCH];
+  unsigned char records[CLEAN_BATCH * MYBUCKET_RECORDSIZE];
+  unsigned int length = 0;
+  unsigned int first = 0;
+  int singles[CLEAN_BATCH];
+  unsigned int numSingles = 0;
+
+  /* Dirty entries only leave with the log, see writeBack(). */
+  if (table->logSize > 0) {
+    return flushTable(table);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    int cacheIndex = (uint32_t)order[i];
+    unsigned int fileIndex = (uint32_t)(order[i] >> 32) + cursor;
+
+    if (table->entries[cacheIndex].id != fileIndex ||
+        1 != table->dirty[cacheIndex]) {
+      continue;
+    }
+    if (length > 0 && fileIndex != first + length) {
+      if (length == 1) {
+        singles[numSingles++] = run[0];
+      } else if (-1 == writeRun(table, first, run, records, length)) {
+        return -1;
+      }
+      length = 0;
+    }
+    if (length == 0) {
+      first = fileIndex;
+    }
+    memcpy(records + (size_t)length * MYBUCKET_RECORDSIZE,
+           table->entries[cacheIndex].record, MYBUCKET_RECORDSIZE);
+    run[length++] = cacheIndex;
+  }
+  if (length == 1) {
+    singles[numSingles++] = run[0];
+  } else if (length > 1 &&
+             -1 == writeRun(table, first, run, records, length)) {
+    return -1;
+  }
+  return numSingles > 0 ? writeEntries(table, singles, numSingles) : 0;
+}
+
+/**
+ * Body of the cleaner thread of a table. It sleeps until cleanLow() and then
+ * writes back dirty entries until 1/CLEAN_HIGH of the entries are clean or
+ * unused, so a miss finds one to reuse without writing one back itself. The
+ * entries go out like an elevator: sorted by file index, going up from where
+ * the last sweep stopped. They are written in batches with the table lock
+ * held, sized like the steps of runJob() so that a batch takes CLEAN_BUDGET,
+ * and the lock is left to the requests for as long after each one.
+ */
+static void *cleanTable(void *arg) {
+  MYC_TABLE_t *table = arg;
+  unsigned int batch = 1;
+
+  pthread_mutex_lock(&table->lock);
+  while (!table->cleanStop) {
+    if (!cleanLow(table)) {
+      pthread_cond_wait(&table->cleanWake, &table->lock);
+      continue;
+    }
+
+    uint64_t *order = malloc(table->numDirty * sizeof(uint64_t));
+    unsigned int cursor = table->cleanCursor;
+    unsigned int resizes = table->resizes;
+    unsigned int count = 0;
+    if (order == NULL) {
+      debug_error("Not enough memory to clean table %s.", table->name);
+      pthread_cond_wait(&table->cleanWake, &table->lock);
+      continue;
+    }
+    for (unsigned int i = 0; i < table->numEntries; i++) {
+      if (1 == table->dirty[i]) {
+        order[count++] =
+            (uint64_t)(table->entries[i].id - cursor) << 32 | i;
+      }
+    }
+    qsort(order, count, sizeof(uint64_t), compareOrder);
+
+    /* The cache indices of "order" are only good until the cache is resized
+     * while the lock is left, then the sweep starts again. */
+    int status = 0;
+    for (unsigned int done = 0;
+         done < count && 0 == status && !table->cleanStop &&
+         table->resizes == resizes && !cleanHigh(table);
+         done += batch) {
+      uint64_t start = myh_now();
+
+      if (batch > count - done) {
+        batch = count - done;
+      }
+      status = cleanBatch(table, order + done, batch, cursor);
+      table->cleanCursor =
+          (uint32_t)(order[done + batch - 1] >> 32) + cursor + 1;
+      pthread_mutex_unlock(&table->lock);
+
+      uint64_t took = myh_now() - start;
+      if (took > CLEAN_BUDGET && batch > 1) {
+        batch /= 2;
+      } else if (took < CLEAN_BUDGET / 2 && batch < CLEAN_BATCH) {
+        batch = batch * 2 < CLEAN_BATCH ? batch * 2 : CLEAN_BATCH;
+      }
+      struct timespec pause = {0, took < CLEAN_BUDGET ? took : CLEAN_BUDGET};
+      nanosleep(&pause, NULL);
+      pthread_mutex_lock(&table->lock);
+    }
+    free(order);
+
+    /* Retried on the next write, meanwhile the misses write back. */
+    if (-1 == status) {
+      debug_error("Error cleaning table %s.", table->name);
+      pthread_cond_wait(&table->cleanWake, &table->lock);
+    }
+  }
+  pthread_mutex_unlock(&table->lock);
+  return NULL;
+}
+
+/**
+ * Stop the warm start, flush and snapshot a table that is no longer in
+ * Tables, then release it.
+ * @return -1 in case of error flushing or closing the file. 0 is OK.
+ */
+static int releaseTable(MYC_TABLE_t *table) {
+  int status = 0;
+
+  if (table->cleanRunning) {
+    pthread_mutex_lock(&table->lock);
+    table->cleanStop = 1;
+    pthread_cond_signal(&table->cleanWake);
+    pthread_mutex_unlock(&table->lock);
+    pthread_join(table->cleanThread, NULL);
+    table->cleanRunning = 0;
+  }
+  if (table->sizeRunning) {
+    table->sizeStop = 1;
+    pthread_join(table->sizeThread, NULL);
+    table->sizeRunning = 0;
+  }
+  if (table->warmRunning) {
+    table->warmStop = 1;
+    pthread_join(table->warmThread, NULL);
+    table->warmRunning = 0;
+  }
+  if (table->scrubRunning) {
+    table->scrubStop = 1;
+    pthread_join(table->scrubThread, NULL);
+    table->scrubRunning = 0;
+  }
+  if (table->jobRunning) {
+    table->jobStop = 1;
+    pthread_join(table->jobThread, NULL);
+    table->jobRunning = 0;
+  }
+
+  pthread_mutex_lock(&table->lock);
+  if (0 == flushTable(table)) {
+    saveSnapshot(table);
+  } else {
+    status = -1;
+  }
+  /* Snapshots still open on the table die with it. */
+  for (int i = 0; i < MYC_MAXSNAPSHOTS; i++) {
+    if (Snapshots[i].table == table) {
+      Snapshots[i].table = NULL;
+    }
+  }
+  reclaimVersions(table);
+  pthread_mutex_unlock(&table->lock);
+
+  if (MYS_close(&table->storage) < 0) {
+    debug_error("Error closing DB file %s. %s", table->file, strerror(errno));
+    status = -1;
+  } else {
+    debug_info("DB file closed. (%s)", table->file);
+  }
+  close(table->logFd);
+
+  pthread_cond_destroy(&table->cleanWake);
+  pthread_mutex_destroy(&table->lock);
+  MYMRC_free(&table->mrc);
+  free(table->entries);
+  free(table->dirty);
+  free(table);
+  return status;
+}
+
+/**
+ * Find an open table and lock it. The table cannot be released while its
+ * lock is held, since MYC_closeTable() takes it before releasing.
+ * @return The locked table. NULL if "table" is not open.
+ */
+static MYC_TABLE_t *lockTable(int table) {
+  MYC_TABLE_t *found = NULL;
+
+  pthread_mutex_lock(&tablesLock);
+  if (table >= 0 && table < MYC_MAXTABLES) {
+    found = Tables[table];
+  }
+  if (found != NULL) {
+    pthread_mutex_lock(&found->lock);
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  return found;
+}
+
+/**
+ * lockTable() that does not wait for a table another thread holds.
+ * @return NULL if the table is not open, or with errno EBUSY if it is held.
+ */
+static MYC_TABLE_t *tryLockTable(int table) {
+  MYC_TABLE_t *found = NULL;
+
+  pthread_mutex_lock(&tablesLock);
+  if (table >= 0 && table < MYC_MAXTABLES) {
+    found = Tables[table];
+  }
+  if (found == NULL) {
+    errno = EINVAL;
+  } else if (0 != pthread_mutex_trylock(&found->lock)) {
+    found = NULL;
+    errno = EBUSY;
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  return found;
+}
+
+/**
+ * Set the number of entries shared by the quotas of all the tables.
+ * @param entries Must be at least the sum of the quotas of the open tables.
+ * @return -1 if the open tables already use more. 0 is OK.
+ */
+int MYC_setBudget(unsigned int entries) {
+  int status = 0;
+
+  pthread_mutex_lock(&tablesLock);
+  if (entries < reserved) {
+    debug_error("Budget of %u entries below the %u already in use.", entries,
+                reserved);
+    status = -1;
+  } else {
+    budget = entries;
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  return status;
+}
+
+/**
+ * Set the percent of the accesses the tables opened with MYC_OPT_AUTOSIZE
+ * size their caches to hit.
+ * @param percent From 1 to 100.
+ * @return -1 if out of range. 0 is OK.
+ */
+int MYC_setHitTarget(unsigned int percent) {
+  if (percent < 1 || percent > 100) {
+    debug_error("Invalid hit target %u%%.", percent);
+    return -1;
+  }
+  pthread_mutex_lock(&tablesLock);
+  hitTarget = percent;
+  pthread_mutex_unlock(&tablesLock);
+
+  return 0;
+}
+
+/**
+ * Storage format selected by the options of a table, and the extension of
+ * its file.
+ */
+static const MYSTORAGE_OPS_t *tableFormat(int options, const char **extension) {
+  if (options & MYC_OPT_PAGED) {
+    *extension = ".pag";
+    return &MYS_PAGED;
+  }
+  if (options & MYC_OPT_COMPRESSED) {
+    *extension = ".lz";
+    return &MYS_COMPRESSED;
+  }
+  *extension = ".dat";
+  return &MYS_FILE;
+}
+
+/**
+ * Open a table stored in "<name>.dat" (or .pag, .lz with the format
+ * options) with a cache of its own taken from the global budget.
+ * @param name Name of the table, also the prefix of its files.
+ * @param options Bitwise OR of MYC_OPT_* flags.
+ * @param quota Entries of the cache of the table, 0 for MYC_NUMENTRIES. With
+ * MYC_OPT_AUTOSIZE only the first size, see MYC_setHitTarget().
+ * @return The id of the table. -1 in case of error, like a budget too small.
+ */
+int MYC_openTable(const char *name, int options, unsigned int quota) {
+  const char *extension;
+  const MYSTORAGE_OPS_t *ops = tableFormat(options, &extension);
+  int id = -1;
+
+  if (quota == 0) {
+    quota = MYC_NUMENTRIES;
+  }
+  if (name == NULL || name[0] == '\0' || strchr(name, '/') != NULL ||
+      strlen(name) >= MYC_TABLENAMELENGTH) {
+    debug_error("Invalid table name.");
+    return -1;
+  }
+
+  pthread_mutex_lock(&tablesLock);
+  for (int i = MYC_MAXTABLES - 1; i >= 0; i--) {
+    if (Tables[i] == NULL) {
+      id = i;
+    } else if (0 == strcmp(Tables[i]->name, name)) {
+      debug_error("Table %s is already open.", name);
+      pthread_mutex_unlock(&tablesLock);
+      return -1;
+    }
+  }
+  if (id < 0 || reserved + quota > budget) {
+    debug_error("No room for table %s. (%u of %u entries in use)", name,
+                reserved, budget);
+    pthread_mutex_unlock(&tablesLock);
+    return -1;
+  }
+
+  MYC_TABLE_t *table = calloc(1, sizeof(MYC_TABLE_t));
+  if (table == NULL ||
+      NULL == (table->entries = allocateCache(quota)) ||
+      NULL == (table->dirty = allocateDirty(quota)) ||
+      -1 == MYMRC_init(&table->mrc)) {
+    debug_error("Not enough memory for table %s.", name);
+    if (table != NULL) {
+      free(table->entries);
+      free(table->dirty);
+      free(table);
+    }
+    pthread_mutex_unlock(&tablesLock);
+    return -1;
+  }
+
+  table->id = id;
+  strcpy(table->name, name);
+  snprintf(table->file, sizeof(table->file), "%s%s", name, extension);
+  snprintf(table->snapshot, sizeof(table->snapshot), "%s.snap", name);
+  snprintf(table->log, sizeof(table->log), "%s.log", name);
+  table->numEntries = quota;
+  table->quota = quota;
+  table->options = options;
+  pthread_mutex_init(&table->lock, NULL);
+  pthread_cond_init(&table->cleanWake, NULL);
+
+  if (-1 == MYS_open(&table->storage, ops, table->file,
+                     &table->stats.diskIO)) {
+    debug_error("Error opening DB file %s. %s ", table->file, strerror(errno));
+    pthread_cond_destroy(&table->cleanWake);
+    pthread_mutex_destroy(&table->lock);
+    MYMRC_free(&table->mrc);
+    free(table->entries);
+    free(table->dirty);
+    free(table);
+    pthread_mutex_unlock(&tablesLock);
+    return -1;
+  }
+
+  table->logFd = open(table->log, O_RDWR | O_CREAT | O_APPEND,
+                      S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (table->logFd < 0 || -1 == replayLog(table)) {
+    debug_error("Error recovering log %s. %s", table->log, strerror(errno));
+    if (table->logFd >= 0) {
+      close(table->logFd);
+    }
+    MYS_close(&table->storage);
+    pthread_cond_destroy(&table->cleanWake);
+    pthread_mutex_destroy(&table->lock);
+    MYMRC_free(&table->mrc);
+    free(table->entries);
+    free(table->dirty);
+    free(table);
+    pthread_mutex_unlock(&tablesLock);
+    return -1;
+  }
+
+  if ((options & MYC_OPT_DIRECT) &&
+      -1 == MYS_useDirect(&table->storage, MYC_DIRECTBLOCKS)) {
+    debug_info("No O_DIRECT for %s, using the page cache. %s", table->file,
+               strerror(errno));
+  }
+  if (options & MYC_OPT_URING) {
+    if (-1 == MYS_useUring(&table->storage, WRITE_BATCH)) {
+      debug_info("No io_uring for %s, using pread and pwrite. %s",
+                 table->file, strerror(errno));
+    } else {
+      registerEntries(table);
+    }
+  }
+
+  debug_info("DB file opened. (%s, %s format, table %d, %u entries)",
+             table->file, table->storage.ops->name, id, quota);
+
+  if (0 != pthread_create(&table->cleanThread, NULL, cleanTable, table)) {
+    debug_error("Error starting cleaner thread, the misses write back.");
+  } else {
+    table->cleanRunning = 1;
+  }
+  if (options & MYC_OPT_WARMSTART) {
+    if (0 != pthread_create(&table->warmThread, NULL, warmStart, table)) {
+      debug_error("Error starting warm start thread, starting cold.");
+    } else {
+      table->warmRunning = 1;
+    }
+  }
+  if (options & MYC_OPT_SCRUB) {
+    if (0 != pthread_create(&table->scrubThread, NULL, scrubTable, table)) {
+      debug_error("Error starting scrubber thread, not scrubbing.");
+    } else {
+      table->scrubRunning = 1;
+    }
+  }
+  if (options & MYC_OPT_AUTOSIZE) {
+    if (0 != pthread_create(&table->sizeThread, NULL, autosizeTable, table)) {
+      debug_error("Error starting resizer thread, keeping %u entries.",
+                  quota);
+    } else {
+      table->sizeRunning = 1;
+    }
+  }
+
+  Tables[id] = table;
+  reserved += quota;
+  pthread_mutex_unlock(&tablesLock);
+
+  return id;
+}
+
+/**
+ * Close a table opened with MYC_openTable(): its dirty entries are written,
+ * the resident ones saved for the next warm start and its quota given back.
+ * @return -1 in case of error, like an unknown table. 0 is OK.
+ */
+int MYC_closeTable(int table) {
+  MYC_TABLE_t *found = NULL;
+
+  pthread_mutex_lock(&tablesLock);
+  if (table >= 0 && table < MYC_MAXTABLES) {
+    found = Tables[table];
+    Tables[table] = NULL;
+  }
+  if (found != NULL) {
+    reserved -= found->quota;
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  return releaseTable(found);
+}
+
+/**
+ * Initialize the cache: allocate RAM, open file, etc.
+ * @return -1 in case of error during initialization. 0 means OK.
+ */
+int MYC_initCache() { return MYC_initCacheOpt(0); }
+
+/**
+ * Initialize the cache like MYC_initCache() with some MYC_OPT_* options.
+ * With MYC_OPT_WARMSTART the snapshot saved by the last MYC_closeCache() is
+ * loaded by a background thread, so the caller can serve requests meanwhile.
+ * The default table is table 0, so this must be the first table opened.
+ * @param options Bitwise OR of MYC_OPT_* flags.
+ * @return -1 in case of error during initialization. 0 means OK.
+ */
+int MYC_initCacheOpt(int options) {
+  int table = MYC_openTable(MYC_DEFAULTTABLE, options, MYC_NUMENTRIES);
+
+  if (table > 0) {
+    debug_error("Default table opened after other tables.");
+    MYC_closeTable(table);
+    return -1;
+  }
+  return table;
+}
+
+/**
+ * This function finishes the cache. It closes every table, flushing all the
+ * information that is not written to the files yet. The resident entries are
+ * saved to the snapshot file of each table for the next warm start.
+ * @return -1 in case of error with any table. 0 means OK.
+ */
+int MYC_closeCache() {
+  int status = 0;
+
+  for (int i = 0; i < MYC_MAXTABLES; i++) {
+    MYC_TABLE_t *table;
+
+    pthread_mutex_lock(&tablesLock);
+    table = Tables[i];
+    if (table != NULL) {
+      Tables[i] = NULL;
+      reserved -= table->quota;
+    }
+    pthread_mutex_unlock(&tablesLock);
+
+    if (table != NULL && -1 == releaseTable(table)) {
+      status = -1;
+    }
+  }
+
+  return status;
+}
+
+/**
+ * Body of MYC_readTableEntry(), called with the table lock held. Without
+ * "wait" a record that is not in the cache is not read from the file.
+ * @return MYC_WOULDBLOCK then, with nothing changed.
+ */
+static int cacheRead(MYC_TABLE_t *table, int fileIndex,
+                     MYRECORD_RECORD_t *record, int wait) {
+
+  int cacheIndex = searchRecord(table, fileIndex);
+  if (cacheIndex < 0 && !wait) {
+    return MYC_WOULDBLOCK;
+  }
+  MYMRC_access(&table->mrc, fileIndex);
+
+  if (cacheIndex < 0) {
+    table->stats.misses++;
+    cacheIndex = searchUnusedOrClean(table);
+
+    if (cacheIndex < 0) {
+      cacheIndex = fileIndex % table->numEntries;
+      table->stats.stalls++;
+      if (-1 == writeBack(table, cacheIndex)) {
+        debug_error("Error flushing entry to cache.");
+        return -1;
+      }
+    }
+
+    if (MYBUCKET_UNUSED != table->entries[cacheIndex].id) {
+      table->stats.evictions++;
+    }
+    table->entries[cacheIndex].id = fileIndex;
+
+    if (-1 == readEntry(table, cacheIndex)) {
+      debug_error("Error reading entry from cache.");
+      table->entries[cacheIndex].id = MYBUCKET_UNUSED;
+      return -1;
+    }
+  } else {
+    table->stats.hits++;
+  }
+
+  myb_bucket2record(&table->entries[cacheIndex], record);
+  debug_debug("Entry %d read from cache.", fileIndex);
+
+  return 0;
+}
+
+/**
+ * Body of MYC_writeTableEntry(), called with the table lock held. Without
+ * "wait" it does not write an entry back or read a version from the file.
+ * @return MYC_WOULDBLOCK then, with the record not written.
+ */
+static int cacheWrite(MYC_TABLE_t *table, int fileIndex,
+                      MYRECORD_RECORD_t *record, int wait) {
+
+  /* The version kept for a snapshot may have to be read from the file. */
+  if (table->snapshots > 0 && !wait) {
+    return MYC_WOULDBLOCK;
+  }
+  table->epoch++;
+  if (table->snapshots > 0 && -1 == keepVersion(table, fileIndex)) {
+    return -1;
+  }
+
+  int cacheIndex = searchRecord(table, fileIndex);
+
+  if (0 > cacheIndex) {
+    cacheIndex = searchUnusedOrClean(table);
+    if (0 > cacheIndex && !wait) {
+      return MYC_WOULDBLOCK;
+    }
+    table->stats.misses++;
+    if (0 > cacheIndex) {
+      cacheIndex = fileIndex % table->numEntries;
+      table->stats.stalls++;
+    }
+    if (1 == table->dirty[cacheIndex]) {
+      if (-1 == writeBack(table, cacheIndex)) {
+        debug_error("Error flushing entry to cache.");
+        return -1;
+      }
+    }
+    if (MYBUCKET_UNUSED != table->entries[cacheIndex].id) {
+      table->stats.evictions++;
+    }
+  } else {
+    table->stats.hits++;
+  }
+  MYMRC_access(&table->mrc, fileIndex);
+
+  table->entries[cacheIndex].id = fileIndex;
+  setDirty(table, cacheIndex, 1);
+  if (table->cleanRunning && cleanLow(table)) {
+    pthread_cond_signal(&table->cleanWake);
+  }
+
+  myb_record2bucket(record, &table->entries[cacheIndex]);
+  debug_debug("Entry %d written to cache.", fileIndex);
+
+  return 0;
+}
+
+/**
+ * MYC_readEntry() on the table "table".
+ * @return -1 in case of any error, like an unknown table. 0 is OK.
+ */
+int MYC_readTableEntry(int table, int fileIndex, MYRECORD_RECORD_t *record) {
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  int status = cacheRead(found, fileIndex, record, 1);
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * MYC_writeEntry() on the table "table".
+ * @return -1 in case of any error, like an unknown table. 0 is OK.
+ */
+int MYC_writeTableEntry(int table, int fileIndex, MYRECORD_RECORD_t *record) {
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  int status = cacheWrite(found, fileIndex, record, 1);
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * MYC_readTableEntry() that does not wait: neither for the file nor for
+ * another thread using the table. Lets a caller serve the hits at once and
+ * hand the rest to a thread that may block.
+ * @return MYC_WOULDBLOCK if the record is not in the cache or the table is
+ * busy, -1 in case of error. 0 is OK.
+ */
+int MYC_tryReadTableEntry(int table, int fileIndex,
+                          MYRECORD_RECORD_t *record) {
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+
+  MYC_TABLE_t *found = tryLockTable(table);
+  if (found == NULL) {
+    if (errno == EBUSY) {
+      return MYC_WOULDBLOCK;
+    }
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  int status = cacheRead(found, fileIndex, record, 0);
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * MYC_writeTableEntry() that does not wait, see MYC_tryReadTableEntry().
+ * @return MYC_WOULDBLOCK if it needs the file or the table is busy, -1 in
+ * case of error. 0 is OK.
+ */
+int MYC_tryWriteTableEntry(int table, int fileIndex,
+                           MYRECORD_RECORD_t *record) {
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+
+  MYC_TABLE_t *found = tryLockTable(table);
+  if (found == NULL) {
+    if (errno == EBUSY) {
+      return MYC_WOULDBLOCK;
+    }
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  int status = cacheWrite(found, fileIndex, record, 0);
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * MYC_flushEntry() on the table "table".
+ * @return -1 in case of I/O error or an unknown table. 0 is OK.
+ */
+int MYC_flushTableEntry(int table, int fileIndex) {
+  int status = 0;
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  int i = searchRecord(found, fileIndex);
+  if (0 <= i && 1 == found->dirty[i]) {
+    if (-1 == writeBack(found, i)) {
+      debug_error("Error flushing entry to cache.");
+      status = -1;
+    }
+  }
+  if (0 == status && -1 == MYS_sync(&found->storage)) {
+    debug_error("Error syncing DB file %s. %s", found->file, strerror(errno));
+    status = -1;
+  }
+  pthread_mutex_unlock(&found->lock);
+
+  if (0 == status) {
+    debug_debug("Entry %d flushed to disk.", fileIndex);
+  }
+  return status;
+}
+
+/**
+ * MYC_deleteEntry() on the table "table".
+ * @return -1 in case of I/O error or an unknown table. 0 is OK.
+ */
+int MYC_deleteTableEntry(int table, int fileIndex) {
+  int status = 0;
+
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+
+  /* A replay of the log must not bring the record back. */
+  found->epoch++;
+  if ((found->logSize > 0 && -1 == flushTable(found)) ||
+      (found->snapshots > 0 && -1 == keepVersion(found, fileIndex))) {
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  int cacheIndex = searchRecord(found, fileIndex);
+  if (0 <= cacheIndex) {
+    found->entries[cacheIndex].id = MYBUCKET_UNUSED;
+    setDirty(found, cacheIndex, 0);
+  }
+  if (-1 == MYS_erase(&found->storage, fileIndex)) {
+    debug_error("Error deleting entry %d of %s. %s", fileIndex, found->file,
+                strerror(errno));
+    status = -1;
+  }
+  found->storage.generation++;
+  found->stats.deletes++;
+  pthread_mutex_unlock(&found->lock);
+
+  if (0 == status) {
+    debug_debug("Entry %d deleted.", fileIndex);
+  }
+  return status;
+}
+
+/**
+ * This function copies into a record passed as argument from the cache.
+ * The cache will be read from the given index of the file if not on the cache.
+ * The record structure is property of the user, so we have to copy the content
+ * of the cache entry onto it.
+ *
+ * @param fileIndex This is the index of the record in the file.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return -1 in case of any error like I/O error when reading. 0 is OK.
+ */
+int MYC_readEntry(int fileIndex, MYRECORD_RECORD_t *record) {
+  return MYC_readTableEntry(0, fileIndex, record);
+}
+
+/*
+ * This function copies a record passed as argument into the cache.
+ * The record will be written at the given index of the file LATER.
+ * This funtions does not write the cache entry to the file inmediately.
+ * The record structure is property of the user, so we have to copy its
+ * content to the entry as the record can be deallocated by the user.
+ *
+ * @param fileIndex This is the index of the record in the file.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return -1 in case of any error like I/O error when writing. 0 is OK.
+ */
+int MYC_writeEntry(int fileIndex, MYRECORD_RECORD_t *record) {
+  return MYC_writeTableEntry(0, fileIndex, record);
+}
+
+/**
+ * Forces the cache to write the contents of the entry containing the record at
+ * "fileIndex" in the file.
+ * @param fileIndex This is the index of the entry of the file to be flushed.
+ * @return -1 in case of I/O error. 0 is OK.
+ */
+int MYC_flushEntry(int fileIndex) { return MYC_flushTableEntry(0, fileIndex); }
+
+/**
+ * Removes the record at "fileIndex" from the cache and the file. It reads as
+ * zeros afterwards, without any I/O, and the space of file blocks left
+ * without records is given back to the file system.
+ * @param fileIndex This is the index of the record in the file.
+ * @return -1 in case of I/O error. 0 is OK.
+ */
+int MYC_deleteEntry(int fileIndex) { return MYC_deleteTableEntry(0, fileIndex); }
+
+/**
+ * Flush any dirty entry of every table inmediately.
+ * @return -1 in case of I/O error in any table. 0 is OK.
+ */
+int MYC_flushAll() {
+  int status = 0;
+
+  for (int i = 0; i < MYC_MAXTABLES; i++) {
+    MYC_TABLE_t *table = lockTable(i);
+    if (table != NULL) {
+      if (-1 == flushTable(table)) {
+        status = -1;
+      }
+      pthread_mutex_unlock(&table->lock);
+    }
+  }
+
+  if (0 == status) {
+    debug_debug("All entries flushed to disk.");
+  }
+  return status;
+}
+
+/**
+ * Append the writes of a transaction to the log of the table as one record
+ * and make it durable with a single fdatasync. Called with the table lock
+ * held.
+ * @return -1 in case of I/O error, the log is left as it was. 0 is OK.
+ */
+static int appendLog(MYC_TABLE_t *table, const MYC_TXENTRY_t *entries,
+                     int count, unsigned int writes) {
+  size_t size = sizeof(LOG_HEADER_t) + writes * sizeof(LOG_ENTRY_t);
+  LOG_HEADER_t *header = malloc(size);
+  LOG_ENTRY_t *logged = (LOG_ENTRY_t *)(header + 1);
+  int status = 0;
+
+  if (header == NULL) {
+    debug_error("Not enough memory for the log record.");
+    return -1;
+  }
+
+  header->magic = LOG_MAGIC;
+  header->count = 0;
+  header->reserved = 0;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].op == MYC_TXWRITE) {
+      logged[header->count].index = entries[i].index;
+      memcpy(logged[header->count].record, &entries[i].record,
+             MYBUCKET_RECORDSIZE);
+      header->count++;
+    }
+  }
+  header->checksum = logChecksum(logged, writes * sizeof(LOG_ENTRY_t));
+
+  if (-1 == snapshotIO(table->logFd, header, size, 1) ||
+      -1 == fdatasync(table->logFd)) {
+    debug_error("Error appending to log %s. %s", table->log, strerror(errno));
+    ftruncate(table->logFd, table->logSize);
+    status = -1;
+  } else {
+    table->logSize += size;
+  }
+
+  free(header);
+  return status;
+}
+
+/**
+ * Apply a transaction to a table: every MYC_TXCHECK entry must match the
+ * current record of its index, then all the MYC_TXWRITE entries are logged
+ * with one append and stored in the cache. Nobody sees the table between
+ * the checks and the last write. A compare-and-swap is a check followed by
+ * a write of the same index.
+ * @param current Receives the record that failed a check, or NULL.
+ * @return MYC_CONFLICT if a check fails and nothing is written. -1 in case of
+ * error, nothing written either. 0 if the transaction is durable and visible.
+ */
+int MYC_commit(int table, const MYC_TXENTRY_t *entries, int count,
+               MYRECORD_RECORD_t *current) {
+  unsigned int writes = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (entries[i].index < 0 ||
+        (entries[i].op != MYC_TXWRITE && entries[i].op != MYC_TXCHECK)) {
+      debug_error("Invalid transaction entry %d.", i);
+      return -1;
+    }
+    writes += (entries[i].op == MYC_TXWRITE);
+  }
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    MYRECORD_RECORD_t record;
+
+    if (entries[i].op != MYC_TXCHECK) {
+      continue;
+    }
+    if (-1 == cacheRead(found, entries[i].index, &record, 1)) {
+      pthread_mutex_unlock(&found->lock);
+      return -1;
+    }
+    if (0 != memcmp(&record, &entries[i].record, MYBUCKET_RECORDSIZE)) {
+      found->stats.conflicts++;
+      if (current != NULL) {
+        memcpy(current, &record, sizeof(MYRECORD_RECORD_t));
+      }
+      pthread_mutex_unlock(&found->lock);
+      debug_debug("Transaction conflict on entry %d.", entries[i].index);
+      return MYC_CONFLICT;
+    }
+  }
+
+  /* Once logged the transaction is durable, so everything that can fail is
+   * done before: the versions for the open snapshots are kept, and with
+   * fewer clean or unused entries than writes the table is flushed, so that
+   * applying never writes back an entry nor allocates. */
+  if (writes > found->numEntries) {
+    pthread_mutex_unlock(&found->lock);
+    debug_error("Transaction of %u writes larger than the cache of table %d.",
+                writes, table);
+    return -1;
+  }
+  for (int i = 0; i < count && found->snapshots > 0; i++) {
+    if (entries[i].op == MYC_TXWRITE) {
+      found->epoch++;
+      if (-1 == keepVersion(found, entries[i].index)) {
+        pthread_mutex_unlock(&found->lock);
+        return -1;
+      }
+    }
+  }
+  unsigned int reusable = found->numEntries - found->numDirty;
+  if (reusable < writes && -1 == flushTable(found)) {
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  if (writes > 0 && -1 == appendLog(found, entries, count, writes)) {
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  /* Cannot fail: the versions are there and the entries clean. */
+  int status = 0;
+  found->applying = 1;
+  for (int i = 0; i < count && 0 == status; i++) {
+    if (entries[i].op == MYC_TXWRITE) {
+      MYRECORD_RECORD_t record;
+      memcpy(&record, &entries[i].record, sizeof(MYRECORD_RECORD_t));
+      status = cacheWrite(found, entries[i].index, &record, 1);
+    }
+  }
+  found->applying = 0;
+
+  if (0 == status) {
+    found->stats.commits++;
+    debug_debug("Transaction of %d entries committed.", count);
+  }
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * Open a snapshot of a table: MYC_readSnapshot() returns the records as they
+ * are now, whatever is written afterwards. Writers keep the records they
+ * overwrite while the snapshot is open, so close it as soon as possible.
+ * @return The id of the snapshot. -1 in case of error, like too many open.
+ */
+int MYC_openSnapshot(int table) {
+  int id = -1;
+
+  pthread_mutex_lock(&tablesLock);
+  MYC_TABLE_t *found =
+      (table >= 0 && table < MYC_MAXTABLES) ? Tables[table] : NULL;
+  for (int i = 0; found != NULL && i < MYC_MAXSNAPSHOTS && id < 0; i++) {
+    if (Snapshots[i].table == NULL) {
+      id = i;
+    }
+  }
+  if (id >= 0) {
+    pthread_mutex_lock(&found->lock);
+    Snapshots[id].epoch = found->epoch;
+    Snapshots[id].announce = 0;
+    Snapshots[id].records = MYS_records(&found->storage);
+    for (unsigned int i = 0; i < found->numEntries; i++) {
+      if (found->dirty[i] != 0 &&
+          found->entries[i].id >= Snapshots[id].records) {
+        Snapshots[id].records = found->entries[i].id + 1;
+      }
+    }
+    Snapshots[id].table = found;
+    found->snapshots++;
+    pthread_mutex_unlock(&found->lock);
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  if (id < 0) {
+    debug_error("Cannot open a snapshot of table %d.", table);
+  } else {
+    debug_debug("Snapshot %d of table %d opened.", id, table);
+  }
+  return id;
+}
+
+/**
+ * Read a record as it was when the snapshot was opened, and whether it was
+ * present. The versions are searched without the table lock; only a record
+ * not overwritten since then is read with it, from the cache or from the
+ * file without caching it.
+ * @return -1 in case of error. 0 is OK.
+ */
+static int readSnapshot(SNAPSHOT_t *slot, unsigned int fileIndex,
+                        MYRECORD_RECORD_t *record, int *present) {
+  MYC_TABLE_t *table = slot->table;
+  int status = 0;
+
+  uint64_t epoch;
+  do {
+    epoch = __atomic_load_n(&reclaimEpoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->announce, epoch, __ATOMIC_SEQ_CST);
+  } while (epoch != __atomic_load_n(&reclaimEpoch, __ATOMIC_SEQ_CST));
+
+  VERSION_t *version = findVersion(table, fileIndex, slot->epoch);
+  if (version != NULL) {
+    memcpy(record, version->record, MYBUCKET_RECORDSIZE);
+    *present = version->present;
+  }
+  __atomic_store_n(&slot->announce, 0, __ATOMIC_RELEASE);
+
+  if (version != NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&table->lock);
+  version = findVersion(table, fileIndex, slot->epoch);
+  int cacheIndex = searchRecord(table, fileIndex);
+  if (version != NULL) {
+    memcpy(record, version->record, MYBUCKET_RECORDSIZE);
+    *present = version->present;
+  } else if (cacheIndex >= 0) {
+    myb_bucket2record(&table->entries[cacheIndex], record);
+    *present = isPresent(table, fileIndex, cacheIndex);
+  } else if (-1 == MYS_read(&table->storage, fileIndex, 1, record)) {
+    if (errno == EBADMSG) {
+      reportCorrupt(table, fileIndex);
+    } else {
+      debug_error("Error reading from DB file %s. %s", table->file,
+                  strerror(errno));
+    }
+    status = -1;
+  } else {
+    *present = MYS_isPresent(&table->storage, fileIndex);
+  }
+  pthread_mutex_unlock(&table->lock);
+
+  return status;
+}
+
+/**
+ * Read a record as it was when the snapshot was opened, see readSnapshot().
+ * @param record This is a pointer to a record allocated by the user.
+ * @return -1 in case of error, like a closed snapshot. 0 is OK.
+ */
+int MYC_readSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record) {
+  int present;
+
+  if (snapshot < 0 || snapshot >= MYC_MAXSNAPSHOTS || fileIndex < 0 ||
+      Snapshots[snapshot].table == NULL) {
+    debug_error("Invalid snapshot %d or index %d.", snapshot, fileIndex);
+    return -1;
+  }
+  return readSnapshot(&Snapshots[snapshot], fileIndex, record, &present);
+}
+
+/**
+ * Read a record as it was when the snapshot was opened, telling the absent
+ * ones apart, to copy the whole table from index 0 on.
+ * @param record This is a pointer to a record allocated by the user, zeros
+ * when the record was absent.
+ * @return MYC_ABSENT if the record was absent then, MYC_END when no record
+ * from "fileIndex" on was present. -1 in case of error. 0 is OK.
+ */
+int MYC_scanSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record) {
+  int present;
+
+  if (snapshot < 0 || snapshot >= MYC_MAXSNAPSHOTS || fileIndex < 0 ||
+      Snapshots[snapshot].table == NULL) {
+    debug_error("Invalid snapshot %d or index %d.", snapshot, fileIndex);
+    return -1;
+  }
+  if ((unsigned int)fileIndex >= Snapshots[snapshot].records) {
+    return MYC_END;
+  }
+  if (-1 == readSnapshot(&Snapshots[snapshot], fileIndex, record, &present)) {
+    return -1;
+  }
+  return present ? 0 : MYC_ABSENT;
+}
+
+/**
+ * Close a snapshot and drop the versions only it could see.
+ * @return -1 if the snapshot is not open. 0 is OK.
+ */
+int MYC_closeSnapshot(int snapshot) {
+  int status = -1;
+
+  pthread_mutex_lock(&tablesLock);
+  MYC_TABLE_t *table = (snapshot >= 0 && snapshot < MYC_MAXSNAPSHOTS)
+                           ? Snapshots[snapshot].table
+                           : NULL;
+  if (table != NULL) {
+    pthread_mutex_lock(&table->lock);
+    Snapshots[snapshot].table = NULL;
+    table->snapshots--;
+    reclaimVersions(table);
+    pthread_mutex_unlock(&table->lock);
+    status = 0;
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  if (status < 0) {
+    debug_error("Invalid snapshot %d.", snapshot);
+  }
+  return status;
+}
+
+/**
+ * Write a chunk of a bulk load of "count" records at "fileIndex" and give
+ * their new content to the resident entries of those indices, which stay
+ * where they are and become clean. Called with the table lock held.
+ * @return -1 in case of error writing. 0 is OK.
+ */
+static int loadRecords(MYC_TABLE_t *table, unsigned int fileIndex,
+                       unsigned int count, const unsigned char *records) {
+  /* A replay of the log must not put older records over the loaded ones. */
+  if (table->logSize > 0 && -1 == flushTable(table)) {
+    return -1;
+  }
+
+  table->epoch++;
+  for (unsigned int i = 0; table->snapshots > 0 && i < count; i++) {
+    if (-1 == keepVersion(table, fileIndex + i)) {
+      return -1;
+    }
+  }
+
+  if (-1 == MYS_load(&table->storage, fileIndex, count, records)) {
+    debug_error("Error writing to DB file %s. %s", table->file,
+                strerror(errno));
+    return -1;
+  }
+  table->storage.generation++;
+
+  for (unsigned int i = 0; i < table->numEntries; i++) {
+    unsigned int id = table->entries[i].id;
+    if (MYBUCKET_UNUSED != id && id >= fileIndex && id - fileIndex < count) {
+      memcpy(table->entries[i].record,
+             records + (size_t)(id - fileIndex) * MYBUCKET_RECORDSIZE,
+             MYBUCKET_RECORDSIZE);
+      setDirty(table, i, 0);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Fill "buffer" with up to "size" bytes read from "fd", less only at its end.
+ * @return The bytes read. -1 in case of error.
+ */
+static ssize_t readFull(int fd, unsigned char *buffer, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = read(fd, buffer + done, size - done);
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  return done;
+}
+
+/**
+ * Import the records read from "fd" until its end into a table, bypassing
+ * the cache: the first one is stored at "fileIndex" and the rest at the
+ * indices that follow. They are written in large sequential writes made
+ * durable by a single sync at the end. The resident entries keep their place
+ * and only get the new content of the records loaded over them.
+ * @param fd A file or a stream of MYRECORD_RECORD_t.
+ * @return The number of records loaded. -1 in case of error, the records
+ * written before it stay loaded.
+ */
+int MYC_loadTable(int table, int fileIndex, int fd) {
+  size_t chunk = LOAD_RECORDS * MYBUCKET_RECORDSIZE;
+  unsigned char *buffer;
+  unsigned int loaded = 0;
+  ssize_t got;
+
+  if (fileIndex < 0) {
+    debug_error("Invalid index %d.", fileIndex);
+    return -1;
+  }
+  if (NULL == (buffer = malloc(chunk))) {
+    debug_error("Not enough memory to load table %d.", table);
+    return -1;
+  }
+
+  do {
+    got = readFull(fd, buffer, chunk);
+    if (got < 0) {
+      debug_error("Error reading records to load. %s", strerror(errno));
+      break;
+    }
+    unsigned int count = got / MYBUCKET_RECORDSIZE;
+    if (count == 0) {
+      break;
+    }
+    if (count > (unsigned int)INT_MAX - fileIndex - loaded) {
+      debug_error("Records to load beyond the last index.");
+      got = -1;
+      break;
+    }
+
+    MYC_TABLE_t *found = lockTable(table);
+    if (found == NULL) {
+      debug_error("Invalid table %d.", table);
+      got = -1;
+      break;
+    }
+    int status = loadRecords(found, fileIndex + loaded, count, buffer);
+    pthread_mutex_unlock(&found->lock);
+    if (-1 == status) {
+      got = -1;
+      break;
+    }
+    loaded += count;
+  } while ((size_t)got == chunk);
+  free(buffer);
+
+  if (got > 0 && got % MYBUCKET_RECORDSIZE != 0) {
+    debug_error("Records to load end with %zu bytes of a record.",
+                (size_t)got % MYBUCKET_RECORDSIZE);
+    got = -1;
+  }
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found != NULL) {
+    if (-1 == MYS_sync(&found->storage)) {
+      debug_error("Error syncing DB file %s. %s", found->file,
+                  strerror(errno));
+      got = -1;
+    }
+    pthread_mutex_unlock(&found->lock);
+  }
+
+  if (got < 0) {
+    return -1;
+  }
+  debug_info("%u records loaded in table %d from index %d.", loaded, table,
+             fileIndex);
+  return loaded;
+}
+
+/**
+ * Body of the thread of the background job of a table. Each step holds the
+ * table lock, so a request waits for one step at most: the size of the step
+ * is halved when a step takes longer than the budget and doubled when it
+ * takes less than half of it. After each step the thread sleeps as long as
+ * the step took, leaving the disk to the requests half of the time.
+ */
+static void *runJob(void *arg) {
+  MYC_TABLE_t *table = arg;
+  unsigned int step = 1;
+  int status = 1;
+
+  while (!table->jobStop) {
+    uint64_t start = myh_now();
+
+    pthread_mutex_lock(&table->lock);
+    status = table->jobStop ? 1 : table->jobStep(&table->storage, step);
+    /* A new job may start as soon as the lock is released. */
+    if (status != 1) {
+      table->jobDone = 1;
+      *table->jobCounter += (0 == status);
+    }
+    pthread_mutex_unlock(&table->lock);
+    if (status != 1) {
+      break;
+    }
+
+    uint64_t took = myh_now() - start;
+    if (took > table->jobBudget && step > 1) {
+      step /= 2;
+    } else if (took < table->jobBudget / 2 && step < JOB_MAXSTEP) {
+      step *= 2;
+    }
+    struct timespec pause = {took / 1000000000, took % 1000000000};
+    nanosleep(&pause, NULL);
+  }
+
+  if (status < 0) {
+    debug_error("Error in the %s of DB file %s. %s", table->jobName,
+                table->file, strerror(errno));
+  } else if (0 == status) {
+    debug_info("DB file %s: %s complete.", table->file, table->jobName);
+  }
+  table->jobDone = 1;
+  return NULL;
+}
+
+/**
+ * Start the background job of a table, called with its lock held.
+ * @return -1 if another job is running or the thread cannot start. 0 OK.
+ */
+static int startJob(MYC_TABLE_t *table, const char *name,
+                    int (*step)(MYSTORAGE_t *storage, unsigned int step),
+                    uint64_t *counter, unsigned int budget) {
+  if (table->jobRunning && !table->jobDone) {
+    debug_error("Table %d is busy with a %s.", table->id, table->jobName);
+    return -1;
+  }
+  if (table->jobRunning) {
+    pthread_join(table->jobThread, NULL);
+    table->jobRunning = 0;
+  }
+  table->jobStop = 0;
+  table->jobDone = 0;
+  table->jobBudget = (uint64_t)(budget ? budget : MYC_COMPACTBUDGET) * 1000;
+  table->jobStep = step;
+  table->jobCounter = counter;
+  table->jobName = name;
+  if (0 != pthread_create(&table->jobThread, NULL, runJob, table)) {
+    debug_error("Error starting %s thread.", name);
+    return -1;
+  }
+  table->jobRunning = 1;
+  return 0;
+}
+
+/**
+ * Start compacting a table in the background: its file is rewritten into a
+ * new one without the space of absent records and of old versions, laid out
+ * in order, which then takes its place. Requests are served meanwhile.
+ * @param budget Microseconds a step of the compaction may hold the table,
+ * which bounds the wait of a request. 0 for MYC_COMPACTBUDGET.
+ * @return -1 if the table is not open or is being compacted or backed up
+ * already. 0 OK.
+ */
+int MYC_compactTable(int table, unsigned int budget) {
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+
+  int status = startJob(found, "compaction", MYS_compact,
+                        &found->stats.compacted, budget);
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * Start an online backup of a table into "directory", which must exist: the
+ * dirty entries are written back and the files of the table, with the same
+ * names, get its content at this point while requests go on. The table file
+ * is cloned if the file system can, otherwise copied in the background,
+ * each chunk before a write changes it. The backup is complete once the
+ * "backups" counter of the table goes up. See MYC_restoreTable().
+ * @param budget Microseconds a step of the copy may hold the table, 0 for
+ * MYC_COMPACTBUDGET.
+ * @return -1 if the table is not open, is busy with a compaction or a backup
+ * or in case of I/O error. 0 OK.
+ */
+int MYC_backupTable(int table, const char *directory, unsigned int budget) {
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+
+  /* The thread waits for the lock, it finds the backup started or stops. */
+  int status = startJob(found, "backup", MYS_backup, &found->stats.backups,
+                        budget);
+  if (0 == status && (-1 == flushTable(found) ||
+                      -1 == MYS_backupBegin(&found->storage, directory))) {
+    debug_error("Error starting the backup of %s in %s. %s", found->file,
+                directory, strerror(errno));
+    found->jobStop = 1;
+    status = -1;
+  }
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * Put back the files of a table from a backup made by MYC_backupTable() in
+ * "directory", before the table is opened with the same "options". Its log
+ * and its warm start snapshot are removed, they belong to the files replaced.
+ * @return -1 if the table is open or the backup is missing or incomplete, or
+ * in case of I/O error. 0 OK.
+ */
+int MYC_restoreTable(const char *name, int options, const char *directory) {
+  char file[MYC_TABLENAMELENGTH + 8];
+  char other[MYC_TABLENAMELENGTH + 8];
+  const char *extension;
+  int status = 0;
+
+  if (name == NULL || name[0] == '\0' || strchr(name, '/') != NULL ||
+      strlen(name) >= MYC_TABLENAMELENGTH) {
+    debug_error("Invalid table name.");
+    return -1;
+  }
+  tableFormat(options, &extension);
+  snprintf(file, sizeof(file), "%s%s", name, extension);
+
+  pthread_mutex_lock(&tablesLock);
+  for (int i = 0; i < MYC_MAXTABLES; i++) {
+    if (Tables[i] != NULL && 0 == strcmp(Tables[i]->name, name)) {
+      debug_error("Table %s is open, it cannot be restored.", name);
+      status = -1;
+    }
+  }
+  if (0 == status && -1 == MYS_restore(file, directory)) {
+    debug_error("Error restoring %s from %s. %s", file, directory,
+                strerror(errno));
+    status = -1;
+  }
+  if (0 == status) {
+    snprintf(other, sizeof(other), "%s.log", name);
+    unlink(other);
+    snprintf(other, sizeof(other), "%s.snap", name);
+    unlink(other);
+    debug_info("Table %s restored from %s.", name, directory);
+  }
+  pthread_mutex_unlock(&tablesLock);
+
+  return status;
+}
+
+/**
+ * MYC_readBlob() on the table "table".
+ * @return The length of the payload, 0 if absent. -1 in case of error, like
+ * an unknown table.
+ */
+int MYC_readTableBlob(int table, int fileIndex, void *buffer, size_t size) {
+  int length = -1;
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  if (fileIndex < 0 || found->storage.ops->readBlob == NULL) {
+    debug_error("Cannot read payload %d in %s format.", fileIndex,
+                found->storage.ops->name);
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  int cacheIndex = searchRecord(found, fileIndex);
+  if (0 <= cacheIndex && 1 == found->dirty[cacheIndex] &&
+      -1 == writeBack(found, cacheIndex)) {
+    debug_error("Error flushing entry to cache.");
+  } else {
+    length = found->storage.ops->readBlob(&found->storage, fileIndex, buffer,
+                                          size);
+    if (length < 0) {
+      debug_error("Error reading payload %d. %s", fileIndex, strerror(errno));
+    }
+  }
+  pthread_mutex_unlock(&found->lock);
+
+  return length;
+}
+
+/**
+ * MYC_writeBlob() on the table "table".
+ * @return -1 in case of error, like a payload too large for its page or an
+ * unknown table. 0 OK.
+ */
+int MYC_writeTableBlob(int table, int fileIndex, const void *buffer,
+                       size_t length) {
+  int status;
+
+  MYC_TABLE_t *found = lockTable(table);
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  if (fileIndex < 0 || found->storage.ops->writeBlob == NULL) {
+    debug_error("Cannot write payload %d in %s format.", fileIndex,
+                found->storage.ops->name);
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  /* The payload goes straight to the file, after anything in the log. */
+  found->epoch++;
+  if ((found->logSize > 0 && -1 == flushTable(found)) ||
+      (found->snapshots > 0 && -1 == keepVersion(found, fileIndex))) {
+    pthread_mutex_unlock(&found->lock);
+    return -1;
+  }
+
+  status = MYS_writeBlob(&found->storage, fileIndex, buffer, length);
+  found->storage.generation++;
+  if (status < 0) {
+    debug_error("Error writing payload %d. %s", fileIndex, strerror(errno));
+  } else {
+    int cacheIndex = searchRecord(found, fileIndex);
+    if (0 <= cacheIndex) {
+      found->entries[cacheIndex].id = MYBUCKET_UNUSED;
+      setDirty(found, cacheIndex, 0);
+    }
+  }
+  pthread_mutex_unlock(&found->lock);
+
+  return status;
+}
+
+/**
+ * Read the variable length payload stored at "fileIndex" of the default
+ * table. Only the paged format (MYC_OPT_PAGED) can store them. A record
+ * written with MYC_writeEntry() reads as its fixed fields followed by its name.
+ * @param buffer Buffer allocated by the user for the payload.
+ * @param size Size of the buffer. Longer payloads are truncated.
+ * @return The length of the payload, 0 if absent. -1 in case of error.
+ */
+int MYC_readBlob(int fileIndex, void *buffer, size_t size) {
+  return MYC_readTableBlob(0, fileIndex, buffer, size);
+}
+
+/**
+ * Store a variable length payload of up to MYC_BLOBMAX bytes at "fileIndex"
+ * of the default table, replacing the record. It goes to the page cache of
+ * the storage at once and is durable after the next flush. Only the paged
+ * format (MYC_OPT_PAGED) can store them.
+ * @param length Length of the payload, 0 deletes the record like
+ * MYC_deleteEntry().
+ * @return -1 in case of error, like a payload too large for its page. 0 OK.
+ */
+int MYC_writeBlob(int fileIndex, const void *buffer, size_t length) {
+  return MYC_writeTableBlob(0, fileIndex, buffer, length);
+}
+
+/**
+ * Copy the counters and histogram of a table into "stats". Called with the
+ * table lock held.
+ */
+static void tableStats(MYC_TABLE_t *table, MYC_STATS_t *stats) {
+  memcpy(stats, &table->stats, sizeof(MYC_STATS_t));
+  stats->entries = table->numEntries;
+  memcpy(&stats->mrc, &table->mrc.curve, sizeof(MYMRC_CURVE_t));
+  stats->dirty = table->numDirty;
+  if (-1 == MYS_space(&table->storage, &stats->diskBytes,
+                      &stats->tableBytes)) {
+    stats->diskBytes = stats->tableBytes = 0;
+  }
+}
+
+/**
+ * Copy the counters and histograms of one table into "stats".
+ * @param stats This is a pointer to a structure allocated by the user.
+ * @return -1 if the table is not open. 0 is OK.
+ */
+int MYC_getTableStats(int table, MYC_STATS_t *stats) {
+  MYC_TABLE_t *found = lockTable(table);
+
+  if (found == NULL) {
+    debug_error("Invalid table %d.", table);
+    return -1;
+  }
+  tableStats(found, stats);
+  pthread_mutex_unlock(&found->lock);
+
+  return 0;
+}
+
+/**
+ * Copy the counters and histograms of the cache into "stats", added up over
+ * all the open tables.
+ * @param stats This is a pointer to a structure allocated by the user.
+ * @return 0 is OK.
+ */
+int MYC_getStats(MYC_STATS_t *stats) {
+  memset(stats, 0, sizeof(MYC_STATS_t));
+
+  for (int i = 0; i < MYC_MAXTABLES; i++) {
+    MYC_TABLE_t *table = lockTable(i);
+    MYC_STATS_t one;
+
+    if (table == NULL) {
+      continue;
+    }
+    tableStats(table, &one);
+    pthread_mutex_unlock(&table->lock);
+
+    stats->hits += one.hits;
+    stats->misses += one.misses;
+    stats->evictions += one.evictions;
+    stats->writebacks += one.writebacks;
+    stats->dirty += one.dirty;
+    stats->commits += one.commits;
+    stats->conflicts += one.conflicts;
+    stats->versions += one.versions;
+    stats->deletes += one.deletes;
+    stats->absent += one.absent;
+    stats->compacted += one.compacted;
+    stats->backups += one.backups;
+    stats->corrupt += one.corrupt;
+    stats->scrubbed += one.scrubbed;
+    stats->scrubCorrupt += one.scrubCorrupt;
+    stats->stalls += one.stalls;
+    stats->entries += one.entries;
+    mymrc_merge(&stats->mrc, &one.mrc);
+    stats->diskBytes += one.diskBytes;
+    stats->tableBytes += one.tableBytes;
+    myh_merge(&stats->diskIO, &one.diskIO);
   }
-  debug_debug("All entries flushed to disk.");
 
   return 0;
 }
@@ -0,0 +1,263 @@
+#include "myblock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct MYBLOCK_POOL {
+  pthread_mutex_t lock;
+  int fd;
+  off_t size; /* Of the file when last looked at. */
+  unsigned int count;
+  unsigned int hand;
+  unsigned char *data; /* "count" blocks aligned to MYBLOCK_SIZE. */
+  off_t *block;        /* Block of the file in each slot, -1 if none. */
+  unsigned char *referenced;
+};
+
+/**
+ * Make a pool of "blocks" blocks over "fd", opened with O_DIRECT, which it
+ * closes when it is closed.
+ * @return NULL with errno set, "fd" left open then.
+ */
+MYBLOCK_POOL_t *MYBLOCK_open(int fd, unsigned int blocks) {
+  MYBLOCK_POOL_t *pool;
+  struct stat st;
+  void *data = NULL;
+
+  if (blocks == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (-1 == fstat(fd, &st)) {
+    return NULL;
+  }
+  pool = calloc(1, sizeof(MYBLOCK_POOL_t));
+  if (pool == NULL ||
+      0 != posix_memalign(&data, MYBLOCK_SIZE, (size_t)blocks * MYBLOCK_SIZE) ||
+      NULL == (pool->block = malloc(blocks * sizeof(off_t))) ||
+      NULL == (pool->referenced = calloc(blocks, 1))) {
+    if (pool != NULL) {
+      free(pool->block);
+    }
+    free(data);
+    free(pool);
+    errno = ENOMEM;
+    return NULL;
+  }
+  for (unsigned int i = 0; i < blocks; i++) {
+    pool->block[i] = -1;
+  }
+  pool->data = data;
+  pool->fd = fd;
+  pool->size = st.st_size;
+  pool->count = blocks;
+  pthread_mutex_init(&pool->lock, NULL);
+  return pool;
+}
+
+/** Close the file of a pool and free it. */
+void MYBLOCK_close(MYBLOCK_POOL_t *pool) {
+  if (pool == NULL) {
+    return;
+  }
+  close(pool->fd);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->referenced);
+  free(pool->block);
+  free(pool->data);
+  free(pool);
+}
+
+/**
+ * Make the pool work on "fd" instead, for another file that took the place
+ * of the old one, which is closed. Every block is dropped.
+ */
+void MYBLOCK_setFile(MYBLOCK_POOL_t *pool, int fd) {
+  struct stat st;
+
+  pthread_mutex_lock(&pool->lock);
+  close(pool->fd);
+  pool->fd = fd;
+  pool->size = 0 == fstat(fd, &st) ? st.st_size : 0;
+  for (unsigned int i = 0; i < pool->count; i++) {
+    pool->block[i] = -1;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Drop the blocks with a byte of the "length" bytes at "offset", written to
+ * the file by other means, so that they are read again.
+ */
+void MYBLOCK_drop(MYBLOCK_POOL_t *pool, off_t offset, off_t length) {
+  off_t first = offset / MYBLOCK_SIZE;
+  off_t last = (offset + length - 1) / MYBLOCK_SIZE;
+
+  if (length <= 0) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  for (unsigned int i = 0; i < pool->count; i++) {
+    if (pool->block[i] >= first && pool->block[i] <= last) {
+      pool->block[i] = -1;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Read the block "block" into the slot "slot". The part beyond the end of
+ * the file is zeros, like in MYS_pread().
+ * @return -1 with errno set. 0 means OK.
+ */
+static int readBlock(MYBLOCK_POOL_t *pool, unsigned int slot, off_t block) {
+  unsigned char *data = pool->data + (size_t)slot * MYBLOCK_SIZE;
+  ssize_t n;
+
+  do {
+    n = pread(pool->fd, data, MYBLOCK_SIZE, block * MYBLOCK_SIZE);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -1;
+  }
+  /* A direct read is only short at the end of the file. */
+  memset(data + n, 0, MYBLOCK_SIZE - n);
+  return 0;
+}
+
+/**
+ * Write the slot "slot" to the block "block", where the bytes changed end
+ * at "end". A block past the end of the file makes it grow to "end" only,
+ * or to where it has grown meanwhile through another descriptor.
+ * @return -1 with errno set. 0 means OK.
+ */
+static int writeBlock(MYBLOCK_POOL_t *pool, unsigned int slot, off_t block,
+                      off_t end) {
+  off_t offset = block * MYBLOCK_SIZE;
+  struct stat st;
+  ssize_t n;
+
+  if (offset + MYBLOCK_SIZE > pool->size) {
+    if (-1 == fstat(pool->fd, &st)) {
+      return -1;
+    }
+    pool->size = st.st_size;
+  }
+  do {
+    n = pwrite(pool->fd, pool->data + (size_t)slot * MYBLOCK_SIZE,
+               MYBLOCK_SIZE, offset);
+  } while (n < 0 && errno == EINTR);
+  if (n != MYBLOCK_SIZE) {
+    errno = n < 0 ? errno : EIO;
+    return -1;
+  }
+  if (offset + MYBLOCK_SIZE > pool->size) {
+    off_t size = end > pool->size ? end : pool->size;
+    if (size < offset + MYBLOCK_SIZE && -1 == ftruncate(pool->fd, size)) {
+      return -1;
+    }
+    pool->size = size;
+  }
+  return 0;
+}
+
+/**
+ * The slot of the block "block", taken from the clock if it is not in the
+ * pool, and read unless "load" is 0, adding 1 to "reads".
+ * @return -1 in case of error reading. The slot otherwise.
+ */
+static int findSlot(MYBLOCK_POOL_t *pool, off_t block, int load, int *reads) {
+  for (unsigned int i = 0; i < pool->count; i++) {
+    if (pool->block[i] == block) {
+      pool->referenced[i] = 1;
+      return i;
+    }
+  }
+
+  while (pool->referenced[pool->hand]) {
+    pool->referenced[pool->hand] = 0;
+    pool->hand = (pool->hand + 1) % pool->count;
+  }
+  unsigned int slot = pool->hand;
+  pool->hand = (pool->hand + 1) % pool->count;
+
+  pool->block[slot] = -1;
+  if (load) {
+    if (-1 == readBlock(pool, slot, block)) {
+      return -1;
+    }
+    (*reads)++;
+  }
+  pool->block[slot] = block;
+  pool->referenced[slot] = 1;
+  return slot;
+}
+
+/**
+ * Read "size" bytes at "offset" of the file through the pool.
+ * @return -1 with errno set. The number of blocks read from the file
+ * otherwise, 0 if the pool had them all.
+ */
+int MYBLOCK_read(MYBLOCK_POOL_t *pool, void *buffer, size_t size,
+                 off_t offset) {
+  size_t done = 0;
+  int reads = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (done < size) {
+    off_t block = (offset + done) / MYBLOCK_SIZE;
+    size_t within = (offset + done) % MYBLOCK_SIZE;
+    size_t left = MYBLOCK_SIZE - within;
+    size_t part = size - done < left ? size - done : left;
+    int slot = findSlot(pool, block, 1, &reads);
+
+    if (slot < 0) {
+      pthread_mutex_unlock(&pool->lock);
+      return -1;
+    }
+    memcpy((char *)buffer + done,
+           pool->data + (size_t)slot * MYBLOCK_SIZE + within, part);
+    done += part;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return reads;
+}
+
+/**
+ * Write "size" bytes at "offset" of the file through the pool: each block
+ * they touch is read unless they cover it, changed and written whole.
+ * @return -1 with errno set, some blocks may be written. 0 means OK.
+ */
+int MYBLOCK_write(MYBLOCK_POOL_t *pool, const void *buffer, size_t size,
+                  off_t offset) {
+  size_t done = 0;
+  int reads = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (done < size) {
+    off_t block = (offset + done) / MYBLOCK_SIZE;
+    size_t within = (offset + done) % MYBLOCK_SIZE;
+    size_t left = MYBLOCK_SIZE - within;
+    size_t part = size - done < left ? size - done : left;
+    int slot = findSlot(pool, block, part < MYBLOCK_SIZE, &reads);
+
+    if (slot < 0) {
+      pthread_mutex_unlock(&pool->lock);
+      return -1;
+    }
+    memcpy(pool->data + (size_t)slot * MYBLOCK_SIZE + within,
+           (const char *)buffer + done, part);
+    if (-1 == writeBlock(pool, slot, block, offset + done + part)) {
+      /* It may not be what the file holds now. */
+      pool->block[slot] = -1;
+      pthread_mutex_unlock(&pool->lock);
+      return -1;
+    }
+    done += part;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
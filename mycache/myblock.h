@@ -0,0 +1,39 @@
+#ifndef MYBLOCK_H
+#define MYBLOCK_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pool of aligned blocks over a file opened with O_DIRECT, which bypasses
+ * the page cache. Reads and writes of any size and offset are made with
+ * whole blocks: a block is read into the pool the first time it is needed,
+ * and a write changes it there and writes it back at once, so the pool
+ * never holds anything the file does not. Blocks are replaced with a clock.
+ * A pool is shared by the threads of a table, one call at a time.
+ */
+
+/* Size and alignment of the blocks, a multiple of the logical block size of
+ * any disk. */
+#define MYBLOCK_SIZE 4096
+
+typedef struct MYBLOCK_POOL MYBLOCK_POOL_t;
+
+MYBLOCK_POOL_t *MYBLOCK_open(int fd, unsigned int blocks);
+void MYBLOCK_close(MYBLOCK_POOL_t *pool);
+void MYBLOCK_setFile(MYBLOCK_POOL_t *pool, int fd);
+void MYBLOCK_drop(MYBLOCK_POOL_t *pool, off_t offset, off_t length);
+int MYBLOCK_read(MYBLOCK_POOL_t *pool, void *buffer, size_t size,
+                 off_t offset);
+int MYBLOCK_write(MYBLOCK_POOL_t *pool, const void *buffer, size_t size,
+                  off_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
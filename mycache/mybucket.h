@@ -9,6 +9,7 @@ extern "C" {
 #endif
 
 #define MYBUCKET_RECORDSIZE (sizeof(MYRECORD_RECORD_t))
+#define MYBUCKET_UNUSED ((unsigned int)-1)
 typedef struct {
   unsigned char record[MYBUCKET_RECORDSIZE];
   unsigned int id;
@@ -5,21 +5,139 @@
 #include <sys/types.h>
 
 #include "mybucket.h"
+#include "myhisto.h"
+#include "mymrc.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 #define MYC_NUMENTRIES 64
-#define MYC_FILENAME "myDBtable.dat"
+#define MYC_DEFAULTTABLE "myDBtable"
+#define MYC_FILENAME MYC_DEFAULTTABLE ".dat"
+#define MYC_PAGEDFILENAME MYC_DEFAULTTABLE ".pag"
+#define MYC_COMPRESSEDFILENAME MYC_DEFAULTTABLE ".lz"
+#define MYC_SNAPSHOTFILE MYC_DEFAULTTABLE ".snap"
+#define MYC_LOGFILE MYC_DEFAULTTABLE ".log"
+
+/* Tables served at the same time. Table 0 is the one of MYC_initCache(), the
+ * others are opened by name and use "<name>.dat", "<name>.snap", etc. */
+#define MYC_MAXTABLES 16
+#define MYC_TABLENAMELENGTH 64
+/* Snapshots open at the same time, over all the tables. */
+#define MYC_MAXSNAPSHOTS 16
+/* Default of MYC_setBudget(): entries shared by the quotas of all tables. */
+#define MYC_BUDGET (MYC_NUMENTRIES * MYC_MAXTABLES)
+/* Default of MYC_compactTable() and MYC_backupTable(): microseconds a step
+ * may hold a table. */
+#define MYC_COMPACTBUDGET 1000
+/* Records per second checked by the scrubber of MYC_OPT_SCRUB. */
+#define MYC_SCRUBRATE 50000
+/* Default of MYC_setHitTarget(): percent of hits MYC_OPT_AUTOSIZE aims at. */
+#define MYC_HITTARGET 90
+/* Milliseconds between two resizes of a table with MYC_OPT_AUTOSIZE. */
+#define MYC_RESIZEPERIOD 1000
+/* Blocks of 4 KiB in the pool of a table with MYC_OPT_DIRECT. The records
+ * stay in the entries, the pool only holds the blocks around them. */
+#define MYC_DIRECTBLOCKS 64
+/* Bytes of the largest payload of MYC_writeBlob(). */
+#define MYC_BLOBMAX 1024
+
+/* Options for MYC_initCacheOpt() and MYC_openTable(). */
+#define MYC_OPT_WARMSTART 0x01   /* Preload the snapshot of the last run. */
+#define MYC_OPT_SNAPPAYLOAD 0x02 /* Save records too in the close snapshot. */
+#define MYC_OPT_PAGED 0x04       /* Slotted pages in MYC_PAGEDFILENAME. */
+#define MYC_OPT_COMPRESSED 0x08  /* Compressed blocks, MYC_COMPRESSEDFILENAME. */
+#define MYC_OPT_SCRUB 0x10       /* Check the file in the background. */
+#define MYC_OPT_AUTOSIZE 0x20    /* Resize the cache from its miss curve. */
+#define MYC_OPT_URING 0x40       /* I/O of the table file through io_uring. */
+#define MYC_OPT_DIRECT 0x80      /* O_DIRECT, the page cache keeps no copy. */
+
+typedef struct {
+  uint64_t hits;       /* Accesses to an index already in the cache. */
+  uint64_t misses;     /* Accesses that needed an entry for a new index. */
+  uint64_t evictions;  /* Used entries given to another index. */
+  uint64_t writebacks; /* Entries written to the file. */
+  uint64_t stalls;     /* Misses that found every entry dirty. */
+  uint64_t dirty;      /* Entries currently waiting to be written. */
+  uint64_t commits;    /* Transactions applied. */
+  uint64_t conflicts;  /* Transactions refused by a failed check. */
+  uint64_t versions;   /* Overwritten records kept for open snapshots. */
+  uint64_t deletes;    /* Records deleted. */
+  uint64_t absent;     /* Misses on absent records, answered without I/O. */
+  uint64_t compacted;  /* Compactions of the table file completed. */
+  uint64_t backups;    /* Backups of the table completed. */
+  uint64_t corrupt;    /* Records read that did not match their checksum. */
+  uint64_t scrubbed;   /* Records checked by the scrubber. */
+  uint64_t scrubCorrupt; /* Of them, those that did not match. */
+  uint64_t entries;    /* Entries of the cache of the table now. */
+  MYMRC_CURVE_t mrc;   /* Misses of an LRU cache of each size, estimated. */
+  uint64_t diskBytes;  /* Space allocated on disk by the table. */
+  uint64_t tableBytes; /* Size of the records it holds, uncompressed. */
+  MYHISTO_t diskIO;    /* Latency of each read or write of the file. */
+} MYC_STATS_t;
+
+/* Operations of a transaction entry. */
+#define MYC_TXWRITE 0 /* Store "record" at "index". */
+#define MYC_TXCHECK 1 /* Fail unless "index" holds exactly "record". */
+
+/* Returned by MYC_commit() when a check fails. */
+#define MYC_CONFLICT 1
+/* Returned by MYC_scanSnapshot() for a record absent when the snapshot was
+ * opened, and from the index past the last record present then on. */
+#define MYC_ABSENT 2
+#define MYC_END 3
+/* Returned by MYC_tryReadTableEntry() and MYC_tryWriteTableEntry() when
+ * the call would have to wait. */
+#define MYC_WOULDBLOCK 4
+
+typedef struct {
+  int op;
+  int index;
+  MYRECORD_RECORD_t record;
+} MYC_TXENTRY_t;
 
 int MYC_initCache();
+int MYC_initCacheOpt(int options);
 int MYC_closeCache();
 
+int MYC_setBudget(unsigned int entries);
+int MYC_setHitTarget(unsigned int percent);
+int MYC_openTable(const char *name, int options, unsigned int quota);
+int MYC_closeTable(int table);
+int MYC_readTableEntry(int table, int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_writeTableEntry(int table, int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_tryReadTableEntry(int table, int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_tryWriteTableEntry(int table, int fileIndex,
+                           MYRECORD_RECORD_t *record);
+int MYC_flushTableEntry(int table, int fileIndex);
+int MYC_deleteTableEntry(int table, int fileIndex);
+int MYC_getTableStats(int table, MYC_STATS_t *stats);
+int MYC_commit(int table, const MYC_TXENTRY_t *entries, int count,
+               MYRECORD_RECORD_t *current);
+int MYC_loadTable(int table, int fileIndex, int fd);
+int MYC_compactTable(int table, unsigned int budget);
+int MYC_backupTable(int table, const char *directory, unsigned int budget);
+int MYC_restoreTable(const char *name, int options, const char *directory);
+
+int MYC_openSnapshot(int table);
+int MYC_readSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_scanSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_closeSnapshot(int snapshot);
+
 int MYC_readEntry(int fileIndex, MYRECORD_RECORD_t *record);
+int MYC_deleteEntry(int fileIndex);
 int MYC_writeEntry(int fileIndex, MYRECORD_RECORD_t *record);
 int MYC_flushEntry(int fileIndex);
 int MYC_flushAll();
 
+int MYC_readBlob(int fileIndex, void *buffer, size_t size);
+int MYC_writeBlob(int fileIndex, const void *buffer, size_t length);
+int MYC_readTableBlob(int table, int fileIndex, void *buffer, size_t size);
+int MYC_writeTableBlob(int table, int fileIndex, const void *buffer,
+                       size_t length);
+
+int MYC_getStats(MYC_STATS_t *stats);
+
 void MYC_debuglevel_rotate();
 
 #ifdef __cplusplus
@@ -0,0 +1,314 @@
+#ifndef MYCACHE_HPP
+#define MYCACHE_HPP
+
+/*
+ * C++20 interface of the cache, header only over libmycache.
+ *
+ * Table<Record> stores any trivially copyable record type that fits in the
+ * entries of the cache, checked at compile time: the record goes in the
+ * first sizeof(Record) bytes of an entry, zeroed past them. Every storage
+ * format keeps all the bytes of an entry, so the core does not look inside.
+ * Table<MYRECORD_RECORD_t> is the MYC_* API as it is.
+ *
+ * A Scheduler runs coroutines, Tasks, on the calling thread. A Task awaiting
+ * a read or a write of a Table goes on at once when the cache can serve it
+ * without the file; otherwise it is suspended, the call is made by one of the
+ * threads of the Scheduler, and the Task is resumed when it returns. The
+ * other Tasks are served meanwhile, but a table does its I/O with its lock
+ * held: those on the same table wait too, so misses overlap across tables.
+ *
+ * Only programs of their own use them: the store server and its messages
+ * carry MYRECORD_RECORD_t, and its loop does not run on a Scheduler.
+ */
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mycache.h>
+
+namespace mycache {
+
+template <typename Record>
+concept Storable = std::is_trivially_copyable_v<Record> &&
+                   sizeof(Record) <= MYBUCKET_RECORDSIZE;
+
+class Scheduler;
+
+/* A coroutine run by a Scheduler, which owns it once spawned. */
+class Task {
+public:
+  struct promise_type {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+private:
+  friend class Scheduler;
+  explicit Task(std::coroutine_handle<promise_type> coroutine)
+      : handle(coroutine) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/* A call a suspended Task left to the threads of the Scheduler. */
+class Blocking {
+public:
+  virtual void call() = 0;
+
+protected:
+  ~Blocking() = default;
+
+private:
+  friend class Scheduler;
+  std::coroutine_handle<> waiting;
+};
+
+class Scheduler {
+public:
+  /** Start "threads" threads to make the calls that may wait. */
+  explicit Scheduler(unsigned int threads = 4) {
+    for (unsigned int i = 0; i < threads; i++) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~Scheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    pending.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+    /* The Tasks not completed, wherever they wait. A Blocking lives in the
+     * frame of its Task, so it is read before the frame goes. */
+    for (Blocking *blocking : calls) {
+      blocking->waiting.destroy();
+    }
+    for (std::coroutine_handle<> task : completed) {
+      task.destroy();
+    }
+    for (std::coroutine_handle<> task : ready) {
+      task.destroy();
+    }
+  }
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  /** Run "task" from the next call of run() on. */
+  void spawn(Task task) {
+    ready.push_back(std::exchange(task.handle, {}));
+    live++;
+  }
+
+  /** Run the Tasks spawned until all of them have completed. */
+  void run() {
+    while (live > 0) {
+      if (ready.empty()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return !completed.empty(); });
+        ready.insert(ready.end(), completed.begin(), completed.end());
+        completed.clear();
+      }
+
+      std::coroutine_handle<> task = ready.front();
+      ready.pop_front();
+      task.resume();
+      if (task.done()) {
+        task.destroy();
+        live--;
+      }
+    }
+  }
+
+  /** Suspend "task" until a thread has made "blocking.call()". */
+  void block(std::coroutine_handle<> task, Blocking &blocking) {
+    blocking.waiting = task;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      calls.push_back(&blocking);
+    }
+    pending.notify_one();
+  }
+
+private:
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+      pending.wait(lock, [this] { return stopping || !calls.empty(); });
+      if (calls.empty()) {
+        return;
+      }
+      Blocking *blocking = calls.front();
+      calls.pop_front();
+
+      lock.unlock();
+      blocking->call();
+      lock.lock();
+
+      completed.push_back(blocking->waiting);
+      finished.notify_one();
+    }
+  }
+
+  /* Of the thread of run() only. */
+  std::deque<std::coroutine_handle<>> ready;
+  unsigned long live = 0;
+
+  std::mutex mutex;
+  std::condition_variable pending;  /* Calls for the threads, or stopping. */
+  std::condition_variable finished; /* Tasks to resume. */
+  std::deque<Blocking *> calls;
+  std::deque<std::coroutine_handle<>> completed;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
+
+template <Storable Record> class Table {
+public:
+  /** A table of the cache, already open: 0 or an id of MYC_openTable(). */
+  explicit Table(int id = 0) : id(id) {}
+
+  int read(int fileIndex, Record &record) const {
+    MYRECORD_RECORD_t entry;
+    int status = MYC_readTableEntry(id, fileIndex, &entry);
+    if (status == 0) {
+      std::memcpy(&record, &entry, sizeof(Record));
+    }
+    return status;
+  }
+
+  int write(int fileIndex, const Record &record) const {
+    MYRECORD_RECORD_t entry = toEntry(record);
+    return MYC_writeTableEntry(id, fileIndex, &entry);
+  }
+
+  int remove(int fileIndex) const {
+    return MYC_deleteTableEntry(id, fileIndex);
+  }
+
+  int flush(int fileIndex) const { return MYC_flushTableEntry(id, fileIndex); }
+
+  /* co_await table.read(scheduler, index, record) in a Task: the status of
+   * MYC_readTableEntry(), with the record filled when it is 0. */
+  class ReadAwaiter : Blocking {
+  public:
+    ReadAwaiter(Scheduler &scheduler, int id, int fileIndex, Record &record)
+        : scheduler(scheduler), id(id), fileIndex(fileIndex), record(record) {}
+
+    bool await_ready() {
+      status = MYC_tryReadTableEntry(id, fileIndex, &entry);
+      return status != MYC_WOULDBLOCK;
+    }
+    void await_suspend(std::coroutine_handle<> task) {
+      scheduler.block(task, *this);
+    }
+    int await_resume() {
+      if (status == 0) {
+        std::memcpy(&record, &entry, sizeof(Record));
+      }
+      return status;
+    }
+
+  private:
+    void call() override {
+      status = MYC_readTableEntry(id, fileIndex, &entry);
+    }
+
+    Scheduler &scheduler;
+    int id;
+    int fileIndex;
+    Record &record;
+    MYRECORD_RECORD_t entry;
+    int status = 0;
+  };
+
+  /* co_await table.write(scheduler, index, record) in a Task: the status of
+   * MYC_writeTableEntry(). */
+  class WriteAwaiter : Blocking {
+  public:
+    WriteAwaiter(Scheduler &scheduler, int id, int fileIndex,
+                 const Record &record)
+        : scheduler(scheduler), id(id), fileIndex(fileIndex),
+          entry(toEntry(record)) {}
+
+    bool await_ready() {
+      status = MYC_tryWriteTableEntry(id, fileIndex, &entry);
+      return status != MYC_WOULDBLOCK;
+    }
+    void await_suspend(std::coroutine_handle<> task) {
+      scheduler.block(task, *this);
+    }
+    int await_resume() { return status; }
+
+  private:
+    void call() override {
+      status = MYC_writeTableEntry(id, fileIndex, &entry);
+    }
+
+    Scheduler &scheduler;
+    int id;
+    int fileIndex;
+    MYRECORD_RECORD_t entry;
+    int status = 0;
+  };
+
+  ReadAwaiter read(Scheduler &scheduler, int fileIndex, Record &record) const {
+    return ReadAwaiter(scheduler, id, fileIndex, record);
+  }
+
+  WriteAwaiter write(Scheduler &scheduler, int fileIndex,
+                     const Record &record) const {
+    return WriteAwaiter(scheduler, id, fileIndex, record);
+  }
+
+private:
+  static MYRECORD_RECORD_t toEntry(const Record &record) {
+    MYRECORD_RECORD_t entry;
+    if constexpr (sizeof(Record) < sizeof(MYRECORD_RECORD_t)) {
+      std::memset(&entry, 0, sizeof(MYRECORD_RECORD_t));
+    }
+    std::memcpy(&entry, &record, sizeof(Record));
+    return entry;
+  }
+
+  int id;
+};
+
+} // namespace mycache
+
+#endif /* MYCACHE_HPP */
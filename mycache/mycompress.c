@@ -0,0 +1,164 @@
+#include "mycompress.h"
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t hash(uint32_t value) {
+  return (value * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/** Write the extra bytes of a length that does not fit in its nibble. */
+static unsigned char *putLength(unsigned char *out, size_t length) {
+  for (; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = (unsigned char)length;
+  return out;
+}
+
+/**
+ * Compress "length" bytes of "source" into "dest".
+ * @param capacity Size of "dest", at least MYCOMP_BOUND(length).
+ * @return The compressed length. 0 if "dest" is too small.
+ */
+size_t MYCOMP_compress(const void *source, size_t length, void *dest,
+                       size_t capacity) {
+  const unsigned char *in = source;
+  const unsigned char *end = in + length;
+  const unsigned char *anchor = in;
+  const unsigned char *p = in;
+  unsigned char *out = dest;
+  uint16_t table[1 << HASH_BITS];
+
+  if (capacity < MYCOMP_BOUND(length) || length > MAX_OFFSET) {
+    return 0;
+  }
+  memset(table, 0, sizeof(table));
+
+  while (p + MIN_MATCH <= end) {
+    uint32_t h = hash(read32(p));
+    const unsigned char *candidate = in + table[h];
+    table[h] = (uint16_t)(p - in);
+
+    if (candidate >= p || read32(candidate) != read32(p)) {
+      p++;
+      continue;
+    }
+
+    const unsigned char *match = p + MIN_MATCH;
+    while (match < end && *match == *(candidate + (match - p))) {
+      match++;
+    }
+
+    size_t literals = p - anchor;
+    size_t matchLength = match - p - MIN_MATCH;
+    unsigned char *token = out++;
+
+    *token = (unsigned char)((literals < 15 ? literals : 15) << 4 |
+                             (matchLength < 15 ? matchLength : 15));
+    if (literals >= 15) {
+      out = putLength(out, literals - 15);
+    }
+    memcpy(out, anchor, literals);
+    out += literals;
+
+    uint16_t offset = (uint16_t)(p - candidate);
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+    if (matchLength >= 15) {
+      out = putLength(out, matchLength - 15);
+    }
+
+    p = anchor = match;
+  }
+
+  /* The last sequence has only literals and no offset. */
+  size_t literals = end - anchor;
+  *out++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+  if (literals >= 15) {
+    out = putLength(out, literals - 15);
+  }
+  memcpy(out, anchor, literals);
+  out += literals;
+
+  return out - (unsigned char *)dest;
+}
+
+/**
+ * Decompress a block made by MYCOMP_compress().
+ * @param capacity Size of "dest".
+ * @return The decompressed length. -1 if the block is corrupted or does not
+ * fit in "dest".
+ */
+int MYCOMP_decompress(const void *source, size_t length, void *dest,
+                      size_t capacity) {
+  const unsigned char *in = source;
+  const unsigned char *inEnd = in + length;
+  unsigned char *out = dest;
+  unsigned char *outEnd = out + capacity;
+
+  while (in < inEnd) {
+    unsigned char token = *in++;
+    size_t literals = token >> 4;
+
+    if (literals == 15) {
+      unsigned char extra;
+      do {
+        if (in >= inEnd) {
+          return -1;
+        }
+        extra = *in++;
+        literals += extra;
+      } while (extra == 255);
+    }
+    if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out)) {
+      return -1;
+    }
+    memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+
+    if (in == inEnd) {
+      break;
+    }
+    if (inEnd - in < 2) {
+      return -1;
+    }
+
+    size_t offset = in[0] | (in[1] << 8);
+    size_t matchLength = (token & 15);
+    in += 2;
+    if (matchLength == 15) {
+      unsigned char extra;
+      do {
+        if (in >= inEnd) {
+          return -1;
+        }
+        extra = *in++;
+        matchLength += extra;
+      } while (extra == 255);
+    }
+    matchLength += MIN_MATCH;
+
+    if (offset == 0 || offset > (size_t)(out - (unsigned char *)dest) ||
+        matchLength > (size_t)(outEnd - out)) {
+      return -1;
+    }
+    /* Byte by byte: the match may overlap what it is copying. */
+    for (const unsigned char *from = out - offset; matchLength > 0;
+         matchLength--) {
+      *out++ = *from++;
+    }
+  }
+
+  return (int)(out - (unsigned char *)dest);
+}
@@ -0,0 +1,27 @@
+#ifndef MYCOMPRESS_H
+#define MYCOMPRESS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lightweight LZ77 codec using the LZ4 block layout: each sequence is a token
+ * (literal length << 4 | match length - 4), the literals and a two byte
+ * offset. There are no dependencies and no state between blocks.
+ */
+
+#define MYCOMP_BOUND(n) ((n) + (n) / 255 + 16)
+
+size_t MYCOMP_compress(const void *source, size_t length, void *dest,
+                       size_t capacity);
+int MYCOMP_decompress(const void *source, size_t length, void *dest,
+                      size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#include "mycrc.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC_ARM
+#endif
+
+#define POLYNOMIAL 0x82f63b78 /* Castagnoli, reflected. */
+
+static uint32_t table[256];
+static uint32_t (*update)(uint32_t crc, const unsigned char *p, size_t length);
+
+static uint32_t updateTable(uint32_t crc, const unsigned char *p,
+                            size_t length) {
+  while (length-- > 0) {
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef CRC_X86
+__attribute__((target("sse4.2"))) static uint32_t
+updateSse42(uint32_t crc, const unsigned char *p, size_t length) {
+#ifdef __x86_64__
+  uint64_t wide = crc;
+  for (; length >= 8; length -= 8, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = (uint32_t)wide;
+#endif
+  for (; length >= 4; length -= 4, p += 4) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+  while (length-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+#ifdef CRC_ARM
+static uint32_t updateArm(uint32_t crc, const unsigned char *p,
+                          size_t length) {
+  for (; length >= 8; length -= 8, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  while (length-- > 0) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+/** Pick the implementation once. Threads racing here pick the same one. */
+static void choose(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (crc & 1 ? POLYNOMIAL : 0);
+    }
+    table[i] = crc;
+  }
+#if defined(CRC_X86)
+  __builtin_cpu_init();
+  __atomic_store_n(&update,
+                   __builtin_cpu_supports("sse4.2") ? updateSse42
+                                                    : updateTable,
+                   __ATOMIC_RELEASE);
+#elif defined(CRC_ARM)
+  __atomic_store_n(&update, updateArm, __ATOMIC_RELEASE);
+#else
+  __atomic_store_n(&update, updateTable, __ATOMIC_RELEASE);
+#endif
+}
+
+/** CRC32C of "length" bytes of "data". */
+uint32_t MYCRC_crc32c(const void *data, size_t length) {
+  uint32_t (*fn)(uint32_t, const unsigned char *, size_t) =
+      __atomic_load_n(&update, __ATOMIC_ACQUIRE);
+
+  if (fn == NULL) {
+    choose();
+    fn = update;
+  }
+  return ~fn(~0U, data, length);
+}
+
+/** 1 if MYCRC_crc32c() uses an instruction of the processor. */
+int MYCRC_hardware(void) {
+  if (__atomic_load_n(&update, __ATOMIC_ACQUIRE) == NULL) {
+    choose();
+  }
+  return update != updateTable;
+}
@@ -0,0 +1,24 @@
+#ifndef MYCRC_H
+#define MYCRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CRC32C (Castagnoli), the checksum of the iSCSI and ext4 metadata. It uses
+ * the crc32 instruction of SSE4.2 or ARMv8 when the processor has it and a
+ * lookup table otherwise; all of them give the same result.
+ */
+
+uint32_t MYCRC_crc32c(const void *data, size_t length);
+int MYCRC_hardware(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef MYHISTO_H
+#define MYHISTO_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-linear latency histogram in the style of HdrHistogram: every power of
+ * two is split in 2^MYHISTO_SUBBITS linear buckets, so any value is kept with
+ * a relative error below 12.5%. Values are nanoseconds, up to ~68 seconds.
+ * Recording is a couple of shifts and one relaxed atomic add.
+ */
+#define MYHISTO_SUBBITS 3
+#define MYHISTO_SUBBUCKETS (1 << MYHISTO_SUBBITS)
+#define MYHISTO_MAXEXP 35
+#define MYHISTO_BUCKETS ((MYHISTO_MAXEXP - MYHISTO_SUBBITS + 2) * MYHISTO_SUBBUCKETS)
+
+typedef struct {
+  uint32_t counts[MYHISTO_BUCKETS];
+  uint64_t total;
+  uint64_t max;
+} MYHISTO_t;
+
+static inline int myh_bucket(uint64_t value) {
+  if (value < MYHISTO_SUBBUCKETS) {
+    return (int)value;
+  }
+
+  int exponent = 63 - __builtin_clzll(value);
+  if (exponent > MYHISTO_MAXEXP) {
+    return MYHISTO_BUCKETS - 1;
+  }
+
+  int sub = (int)(value >> (exponent - MYHISTO_SUBBITS)) & (MYHISTO_SUBBUCKETS - 1);
+  return (exponent - MYHISTO_SUBBITS + 1) * MYHISTO_SUBBUCKETS + sub;
+}
+
+/** Highest value that falls into the given bucket. */
+static inline uint64_t myh_value(int bucket) {
+  if (bucket < MYHISTO_SUBBUCKETS) {
+    return (uint64_t)bucket;
+  }
+
+  int exponent = bucket / MYHISTO_SUBBUCKETS + MYHISTO_SUBBITS - 1;
+  uint64_t sub = (uint64_t)(bucket % MYHISTO_SUBBUCKETS);
+  return ((MYHISTO_SUBBUCKETS + sub + 1) << (exponent - MYHISTO_SUBBITS)) - 1;
+}
+
+static inline void myh_record(MYHISTO_t *h, uint64_t value) {
+  __atomic_fetch_add(&h->counts[myh_bucket(value)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value, 1,
+                                                     __ATOMIC_RELAXED,
+                                                     __ATOMIC_RELAXED)) {
+  }
+}
+
+static inline void myh_merge(MYHISTO_t *to, const MYHISTO_t *from) {
+  for (int i = 0; i < MYHISTO_BUCKETS; i++) {
+    to->counts[i] += from->counts[i];
+  }
+  to->total += from->total;
+  if (from->max > to->max) {
+    to->max = from->max;
+  }
+}
+
+/**
+ * Value below which "percentile" percent of the recorded values fall.
+ * @return 0 for an empty histogram.
+ */
+static inline uint64_t myh_percentile(const MYHISTO_t *h, double percentile) {
+  uint64_t rank = (uint64_t)(h->total * percentile / 100.0 + 0.5);
+  uint64_t seen = 0;
+
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (int i = 0; i < MYHISTO_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t value = myh_value(i);
+      return value < h->max ? value : h->max;
+    }
+  }
+  return h->max;
+}
+
+/** Monotonic clock in nanoseconds, comparable between processes. */
+static inline uint64_t myh_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+#include "mymrc.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOTS (2 * MYMRC_SAMPLES) /* Of the hash table of the keys. */
+#define CLOCK (4 * MYMRC_SAMPLES) /* Times before they are renumbered. */
+#define DECAY (4 * MYMRC_SAMPLES) /* Sampled accesses between two halvings. */
+
+/** Finalizer of MurmurHash3, every bit of the key moves every bit. */
+static uint64_t hashKey(uint32_t key) {
+  uint64_t h = key;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/** Slot of "key" in the hash table, or the free slot where it would go. */
+static unsigned int findSlot(const MYMRC_t *mrc, uint32_t key) {
+  unsigned int slot = (hashKey(key) >> 32) & (SLOTS - 1);
+
+  while (mrc->keys[slot] != 0 && mrc->keys[slot] != key + 1) {
+    slot = (slot + 1) & (SLOTS - 1);
+  }
+  return slot;
+}
+
+static void treeAdd(MYMRC_t *mrc, uint32_t time, int delta) {
+  for (; time < CLOCK; time += time & -time) {
+    mrc->tree[time] += delta;
+  }
+}
+
+/** Keys whose last access was at "time" or before. */
+static uint32_t treeCount(const MYMRC_t *mrc, uint32_t time) {
+  uint32_t count = 0;
+
+  for (; time > 0; time -= time & -time) {
+    count += mrc->tree[time];
+  }
+  return count;
+}
+
+static int compareTime(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Give the keys the times 1 to "count", in the order of their last access,
+ * and build the tree again. Called when the clock runs out.
+ */
+static void renumber(MYMRC_t *mrc) {
+  unsigned int n = 0;
+
+  for (unsigned int slot = 0; slot < SLOTS; slot++) {
+    if (mrc->keys[slot] != 0) {
+      mrc->scratch[n++] = (uint64_t)mrc->times[slot] << 32 | slot;
+    }
+  }
+  qsort(mrc->scratch, n, sizeof(uint64_t), compareTime);
+  for (unsigned int i = 0; i < n; i++) {
+    mrc->times[(uint32_t)mrc->scratch[i]] = i + 1;
+  }
+
+  /* A 1 at every time up to n, then each node adds up its children. */
+  memset(mrc->tree, 0, CLOCK * sizeof(uint32_t));
+  for (uint32_t time = 1; time < CLOCK; time++) {
+    mrc->tree[time] += (time <= n);
+    uint32_t parent = time + (time & -time);
+    if (parent < CLOCK) {
+      mrc->tree[parent] += mrc->tree[time];
+    }
+  }
+  mrc->clock = n;
+}
+
+/**
+ * Halve the sampling rate: forget the keys that are not sampled anymore and
+ * put the others back in the hash table.
+ */
+static void halveRate(MYMRC_t *mrc) {
+  uint64_t mask = (1ULL << ++mrc->shift) - 1;
+  unsigned int n = 0;
+
+  for (unsigned int slot = 0; slot < SLOTS; slot++) {
+    if (mrc->keys[slot] != 0 && 0 == (hashKey(mrc->keys[slot] - 1) & mask)) {
+      mrc->scratch[n++] = (uint64_t)mrc->times[slot] << 32 | mrc->keys[slot];
+    }
+  }
+  memset(mrc->keys, 0, SLOTS * sizeof(uint32_t));
+  for (unsigned int i = 0; i < n; i++) {
+    uint32_t key = (uint32_t)mrc->scratch[i] - 1;
+    unsigned int slot = findSlot(mrc, key);
+
+    mrc->keys[slot] = key + 1;
+    mrc->times[slot] = mrc->scratch[i] >> 32;
+  }
+  mrc->count = n;
+  renumber(mrc);
+}
+
+/**
+ * Count an access that would miss in the caches smaller than "distance"
+ * entries, with the weight of a sample.
+ */
+static void recordAccess(MYMRC_t *mrc, uint64_t distance) {
+  uint64_t weight = 1ULL << mrc->shift;
+
+  for (int i = 0; i < MYMRC_POINTS && distance >= MYMRC_SIZE(i); i++) {
+    mrc->curve.misses[i] += weight;
+  }
+  if (++mrc->sinceDecay >= DECAY) {
+    mrc->curve.accesses /= 2;
+    for (int i = 0; i < MYMRC_POINTS; i++) {
+      mrc->curve.misses[i] /= 2;
+    }
+    mrc->sinceDecay = 0;
+  }
+}
+
+/**
+ * Allocate the structures of an empty curve, tracking every key at first.
+ * @return -1 with errno ENOMEM. 0 means OK.
+ */
+int MYMRC_init(MYMRC_t *mrc) {
+  memset(mrc, 0, sizeof(MYMRC_t));
+  mrc->keys = calloc(SLOTS, sizeof(uint32_t));
+  mrc->times = calloc(SLOTS, sizeof(uint32_t));
+  mrc->tree = calloc(CLOCK, sizeof(uint32_t));
+  mrc->scratch = calloc(MYMRC_SAMPLES, sizeof(uint64_t));
+  if (mrc->keys == NULL || mrc->times == NULL || mrc->tree == NULL ||
+      mrc->scratch == NULL) {
+    MYMRC_free(mrc);
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+
+void MYMRC_free(MYMRC_t *mrc) {
+  free(mrc->keys);
+  free(mrc->times);
+  free(mrc->tree);
+  free(mrc->scratch);
+  memset(mrc, 0, sizeof(MYMRC_t));
+}
+
+/**
+ * Account an access to "key". Most keys are not sampled and cost one hash;
+ * a sampled one costs two walks of the tree, O(log MYMRC_SAMPLES).
+ */
+void MYMRC_access(MYMRC_t *mrc, uint32_t key) {
+  mrc->curve.accesses++;
+  if (0 != (hashKey(key) & ((1ULL << mrc->shift) - 1))) {
+    return;
+  }
+  if (mrc->clock == CLOCK - 1) {
+    renumber(mrc);
+  }
+
+  unsigned int slot = findSlot(mrc, key);
+  if (mrc->keys[slot] != 0) {
+    /* Keys accessed since the last access of this one. */
+    uint64_t distance = mrc->count - treeCount(mrc, mrc->times[slot]);
+
+    recordAccess(mrc, distance << mrc->shift);
+    treeAdd(mrc, mrc->times[slot], -1);
+  } else {
+    if (mrc->count == MYMRC_SAMPLES) {
+      halveRate(mrc);
+      if (0 != (hashKey(key) & ((1ULL << mrc->shift) - 1))) {
+        return;
+      }
+      slot = findSlot(mrc, key);
+    }
+    recordAccess(mrc, UINT64_MAX);
+    mrc->keys[slot] = key + 1;
+    mrc->count++;
+  }
+  mrc->times[slot] = ++mrc->clock;
+  treeAdd(mrc, mrc->clock, 1);
+}
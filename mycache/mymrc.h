@@ -0,0 +1,85 @@
+#ifndef MYMRC_H
+#define MYMRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Miss ratio curve of an LRU cache, estimated online with SHARDS (spatially
+ * hashed sampling, Waldspurger et al., FAST 2015). Only the keys whose hash
+ * has its low "shift" bits at zero are tracked; the reuse distance of each of
+ * their accesses, times 2^shift, is the number of entries an LRU cache would
+ * need to hit. At most MYMRC_SAMPLES keys are tracked: when they are that
+ * many the sampling rate is halved and half of them are forgotten.
+ */
+#define MYMRC_SAMPLES 8192
+#define MYMRC_POINTS 20
+/* Entries of the cache at the point "i" of the curve, 16 to 8M. */
+#define MYMRC_SIZE(i) ((uint64_t)16 << (i))
+
+/* The curve: of "accesses", misses[i] would miss in a cache of
+ * MYMRC_SIZE(i) entries. The misses come from the samples while every access
+ * is counted, so, as in SHARDS-adj, the accesses a hot key adds to the
+ * samples or takes from them do not skew the ratio. Sizes below 2^shift
+ * entries are not resolved. Both are halved every 4 * MYMRC_SAMPLES samples,
+ * so the curve follows the workload. */
+typedef struct {
+  uint64_t accesses;
+  uint64_t misses[MYMRC_POINTS];
+} MYMRC_CURVE_t;
+
+typedef struct {
+  MYMRC_CURVE_t curve;
+  unsigned int shift;      /* One key in 2^shift is tracked. */
+  unsigned int count;      /* Keys tracked. */
+  uint32_t clock;          /* Time of the last sampled access. */
+  uint32_t sinceDecay;     /* Sampled accesses since the curve was halved. */
+  uint32_t *keys;          /* Open addressing, key + 1 or 0 if free. */
+  uint32_t *times;         /* Time of the last access of each key. */
+  uint32_t *tree;          /* Fenwick tree, a 1 at the time of each key. */
+  uint64_t *scratch;       /* To renumber the times. */
+} MYMRC_t;
+
+int MYMRC_init(MYMRC_t *mrc);
+void MYMRC_free(MYMRC_t *mrc);
+void MYMRC_access(MYMRC_t *mrc, uint32_t key);
+
+static inline void mymrc_merge(MYMRC_CURVE_t *to, const MYMRC_CURVE_t *from) {
+  to->accesses += from->accesses;
+  for (int i = 0; i < MYMRC_POINTS; i++) {
+    to->misses[i] += from->misses[i];
+  }
+}
+
+/**
+ * Hit ratio, from 0 to 1, of an LRU cache of "entries" entries, interpolated
+ * between the points of the curve.
+ * @return 0 for an empty curve.
+ */
+static inline double mymrc_hitRatio(const MYMRC_CURVE_t *curve,
+                                    uint64_t entries) {
+  double misses = curve->accesses;
+
+  if (curve->accesses == 0) {
+    return 0.0;
+  }
+  for (int i = 0; i < MYMRC_POINTS; i++) {
+    if (entries < MYMRC_SIZE(i)) {
+      double from = i > 0 ? MYMRC_SIZE(i - 1) : 0;
+      double to = MYMRC_SIZE(i);
+      misses += (curve->misses[i] - misses) * (entries - from) / (to - from);
+      break;
+    }
+    misses = curve->misses[i];
+  }
+  return misses < curve->accesses ? 1.0 - misses / curve->accesses : 0.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
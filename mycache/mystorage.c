@@ -0,0 +1,1663 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* fallocate(), sync_file_range(), copy_file_range() */
+#endif
+#include "mystorage.h"
+#include "mycrc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The file system reclaims space in blocks of this size. */
+#define HOLE_SIZE 4096
+
+#define CRC_MAGIC 0x324b594d /* "MYK2" */
+/* Records of a region of "<file>.crc", read at once to compute their
+ * checksums. */
+#define CRC_BATCH 4096
+/* Records of MYS_writeMany() submitted at once by the file format. */
+#define WRITE_BATCH 64
+
+/* "<file>.crc" holds this header and then a region for every CRC_BATCH
+ * records: a word, not 0 while the region is stale, that is, may have been
+ * written since its checksums were last durable, and the checksum of each
+ * record. */
+typedef struct {
+  uint32_t magic;
+  uint32_t regionRecords; /* CRC_BATCH of the library that wrote it. */
+} CRC_HEADER_t;
+#define CRC_REGION_BYTES ((1 + CRC_BATCH) * sizeof(uint32_t))
+
+static int openMap(MYSTORAGE_t *storage, const char *filename);
+static int openChecksums(MYSTORAGE_t *storage, const char *filename);
+static int saveChecksums(MYSTORAGE_t *storage);
+static void abandonCompaction(MYSTORAGE_t *storage);
+static void abandonBackup(MYSTORAGE_t *storage);
+static void backupBefore(MYSTORAGE_t *storage, off_t offset, off_t length);
+
+/**
+ * Path of the copy of a file of the table during a compaction: the name of
+ * the table file followed by "suffix" and ".compact".
+ * @return -1 with errno ENAMETOOLONG if it does not fit in PATH_MAX.
+ */
+int MYS_compactPath(const MYSTORAGE_t *storage, char *path,
+                    const char *suffix) {
+  if ((size_t)snprintf(path, PATH_MAX, "%s%s.compact", storage->filename,
+                       suffix) >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Open the table file and let the backend load whatever it needs.
+ * @param diskIO Histogram for the latency of each I/O, or NULL.
+ * @return -1 in case of error opening. 0 means OK.
+ */
+int MYS_open(MYSTORAGE_t *storage, const MYSTORAGE_OPS_t *ops,
+             const char *filename, MYHISTO_t *diskIO) {
+  char path[PATH_MAX];
+
+  memset(storage, 0, sizeof(MYSTORAGE_t));
+  storage->ops = ops;
+  storage->diskIO = diskIO;
+  storage->mapFd = -1;
+  storage->compactFd = -1;
+  storage->crcFd = -1;
+  storage->filename = strdup(filename);
+  if (storage->filename == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  /* The copy of a compaction interrupted by a crash. */
+  if (ops->compact == NULL && 0 == MYS_compactPath(storage, path, "")) {
+    unlink(path);
+  }
+
+  storage->fd = open(filename, O_SYNC | O_RDWR | O_CREAT,
+                     S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+  if (storage->fd < 0) {
+    free(storage->filename);
+    storage->filename = NULL;
+    return -1;
+  }
+
+  if (ops->open != NULL && -1 == ops->open(storage, filename)) {
+    int error = errno;
+    close(storage->fd);
+    storage->fd = -1;
+    free(storage->filename);
+    storage->filename = NULL;
+    errno = error;
+    return -1;
+  }
+
+  if (-1 == openMap(storage, filename) ||
+      -1 == openChecksums(storage, filename)) {
+    int error = errno;
+    /* Regions computed halfway must be left stale. */
+    if (storage->crcFd >= 0) {
+      close(storage->crcFd);
+      storage->crcFd = -1;
+    }
+    MYS_close(storage);
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Close the backend and the map of present records, then save the checksums.
+ * @return -1 in case of error, after closing everything anyway. 0 means OK.
+ */
+int MYS_close(MYSTORAGE_t *storage) {
+  int status = 0;
+
+  if (storage->compactFd >= 0) {
+    abandonCompaction(storage);
+  }
+  if (storage->backup != NULL) {
+    abandonBackup(storage);
+  }
+  MYURING_close(storage->uring);
+  storage->uring = NULL;
+  MYBLOCK_close(storage->blocks);
+  storage->blocks = NULL;
+  if (storage->ops->close != NULL) {
+    status = storage->ops->close(storage);
+  } else if (-1 == close(storage->fd)) {
+    status = -1;
+  }
+  if (storage->mapFd >= 0 && -1 == close(storage->mapFd)) {
+    status = -1;
+  }
+  /* The regions of a table not closed without errors are left stale. */
+  if (0 == status) {
+    status = saveChecksums(storage);
+  }
+  if (storage->crcFd >= 0) {
+    close(storage->crcFd);
+  }
+  free(storage->crc);
+  free(storage->crcStale);
+  storage->crc = NULL;
+  storage->crcStale = NULL;
+  storage->crcCount = 0;
+  storage->crcFd = -1;
+  free(storage->map);
+  free(storage->filename);
+  storage->map = NULL;
+  storage->filename = NULL;
+  storage->mapBytes = 0;
+  storage->mapFd = -1;
+  return status;
+}
+
+/**
+ * Make the map cover the record "index", the new part absent.
+ * @return -1 with errno ENOMEM. 0 means OK.
+ */
+static int growMap(MYSTORAGE_t *storage, unsigned int index) {
+  size_t needed = (size_t)index / 8 + 1;
+  size_t size = storage->mapBytes > 0 ? storage->mapBytes : HOLE_SIZE;
+
+  if (needed <= storage->mapBytes) {
+    return 0;
+  }
+  while (size < needed) {
+    size *= 2;
+  }
+  unsigned char *map = realloc(storage->map, size);
+  if (map == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  memset(map + storage->mapBytes, 0, size - storage->mapBytes);
+  storage->map = map;
+  storage->mapBytes = size;
+  return 0;
+}
+
+/**
+ * Set or clear the bits of "count" records from "index" and write the bytes
+ * that changed to the map file, which is opened with O_SYNC.
+ * @return -1 in case of error writing. 0 means OK.
+ */
+static int markRecords(MYSTORAGE_t *storage, unsigned int index,
+                       unsigned int count, int present) {
+  size_t first = (size_t)-1;
+  size_t last = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+  if (-1 == growMap(storage, index + count - 1)) {
+    return -1;
+  }
+  for (unsigned int i = index; i < index + count; i++) {
+    unsigned char bit = 1 << (i % 8);
+    unsigned char *byte = &storage->map[i / 8];
+
+    if (!(*byte & bit) == !present) {
+      continue;
+    }
+    *byte ^= bit;
+    first = first < i / 8 ? first : i / 8;
+    last = i / 8;
+  }
+  if (first == (size_t)-1) {
+    return 0;
+  }
+  return MYS_pwriteFd(storage, storage->mapFd, storage->map + first,
+                      last - first + 1, first);
+}
+
+/**
+ * Open "<file>.map" and read it. When it is new but the table is not, the
+ * table predates the map and every record it spans is taken as present.
+ * @return -1 in case of error. 0 means OK.
+ */
+static int openMap(MYSTORAGE_t *storage, const char *filename) {
+  char path[PATH_MAX];
+  uint64_t diskBytes;
+  uint64_t tableBytes;
+  struct stat st;
+
+  if ((size_t)snprintf(path, sizeof(path), "%s.map", filename) >=
+      sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  storage->mapFd = open(path, O_SYNC | O_RDWR | O_CREAT,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (storage->mapFd < 0 || -1 == fstat(storage->mapFd, &st)) {
+    return -1;
+  }
+
+  if (st.st_size > 0) {
+    if (-1 == growMap(storage, (unsigned int)(st.st_size * 8 - 1))) {
+      return -1;
+    }
+    return MYS_preadFd(storage, storage->mapFd, storage->map, st.st_size, 0);
+  }
+
+  if (-1 == MYS_space(storage, &diskBytes, &tableBytes)) {
+    return -1;
+  }
+  if (tableBytes > 0) {
+    return markRecords(storage, 0,
+                       (tableBytes + MYBUCKET_RECORDSIZE - 1) /
+                           MYBUCKET_RECORDSIZE,
+                       1);
+  }
+  return 0;
+}
+
+/** 1 if the record at "index" is present, 0 if never written or deleted. */
+int MYS_isPresent(const MYSTORAGE_t *storage, unsigned int index) {
+  return (size_t)index / 8 < storage->mapBytes &&
+         (storage->map[index / 8] & (1 << (index % 8))) != 0;
+}
+
+/** Records up to the last present one, 0 if none is. */
+unsigned int MYS_records(const MYSTORAGE_t *storage) {
+  size_t byte = storage->mapBytes;
+
+  while (byte > 0 && storage->map[byte - 1] == 0) {
+    byte--;
+  }
+  if (byte == 0) {
+    return 0;
+  }
+  unsigned int records = (byte - 1) * 8;
+  for (unsigned char bits = storage->map[byte - 1]; bits != 0; bits >>= 1) {
+    records++;
+  }
+  return records;
+}
+
+/**
+ * Mark "count" records from "index" present, before their data is written so
+ * a crash in between cannot hide it.
+ * @return -1 in case of error writing the map. 0 means OK.
+ */
+int MYS_setPresent(MYSTORAGE_t *storage, unsigned int index,
+                   unsigned int count) {
+  return markRecords(storage, index, count, 1);
+}
+
+/**
+ * Make the checksums cover the record "index", the new ones unknown and
+ * their regions not stale.
+ * @return -1 with errno ENOMEM. 0 means OK.
+ */
+static int growChecksums(MYSTORAGE_t *storage, unsigned int index) {
+  size_t count = storage->crcCount > 0 ? storage->crcCount : CRC_BATCH;
+
+  if (index < storage->crcCount) {
+    return 0;
+  }
+  while (count <= index) {
+    count *= 2;
+  }
+  uint32_t *crc = realloc(storage->crc, count * sizeof(uint32_t));
+  if (crc == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  storage->crc = crc;
+  unsigned char *stale = realloc(storage->crcStale, count / CRC_BATCH);
+  if (stale == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  storage->crcStale = stale;
+  memset(crc + storage->crcCount, 0,
+         (count - storage->crcCount) * sizeof(uint32_t));
+  memset(stale + storage->crcCount / CRC_BATCH, 0,
+         (count - storage->crcCount) / CRC_BATCH);
+  storage->crcCount = count;
+  return 0;
+}
+
+/** Offset in "<file>.crc" of the stale word of the region "region". */
+static off_t regionOffset(size_t region) {
+  return sizeof(CRC_HEADER_t) + (off_t)region * CRC_REGION_BYTES;
+}
+
+/**
+ * Write to "<file>.crc" the checksums of "count" records from "index", not
+ * durable until the next saveChecksums().
+ * @return -1 in case of error writing. 0 means OK.
+ */
+static int writeChecksums(MYSTORAGE_t *storage, unsigned int index,
+                          unsigned int count) {
+  while (count > 0) {
+    unsigned int within = index % CRC_BATCH;
+    unsigned int part =
+        CRC_BATCH - within < count ? CRC_BATCH - within : count;
+
+    if (-1 == MYS_pwriteFd(storage, storage->crcFd, storage->crc + index,
+                           part * sizeof(uint32_t),
+                           regionOffset(index / CRC_BATCH) +
+                               (1 + within) * sizeof(uint32_t))) {
+      return -1;
+    }
+    index += part;
+    count -= part;
+  }
+  return 0;
+}
+
+/**
+ * Mark the region of "index" stale in "<file>.crc", durably, before any
+ * record of it is written: after a crash its checksums are computed again
+ * from the table file, those of the other regions are kept.
+ * @return -1 in case of error writing. 0 means OK.
+ */
+static int markStale(MYSTORAGE_t *storage, unsigned int index) {
+  uint32_t stale = 1;
+  size_t region = index / CRC_BATCH;
+
+  if (-1 == growChecksums(storage, index)) {
+    return -1;
+  }
+  if (storage->crcStale[region]) {
+    return 0;
+  }
+  if (-1 == MYS_pwriteFd(storage, storage->crcFd, &stale, sizeof(stale),
+                         regionOffset(region)) ||
+      -1 == fdatasync(storage->crcFd)) {
+    return -1;
+  }
+  storage->crcStale[region] = 1;
+  return 0;
+}
+
+/**
+ * Keep the checksum of the record about to be written at "index", or forget
+ * it if "record" is NULL, and write it to "<file>.crc" with the record.
+ * @return -1 in case of error. 0 means OK.
+ */
+static int setChecksum(MYSTORAGE_t *storage, unsigned int index,
+                       const void *record) {
+  if (-1 == markStale(storage, index)) {
+    return -1;
+  }
+  storage->crc[index] =
+      record != NULL ? MYCRC_crc32c(record, MYBUCKET_RECORDSIZE) : 0;
+  return writeChecksums(storage, index, 1);
+}
+
+/**
+ * Compute from the table file the checksums of the present records of the
+ * region "region", and forget those of the rest.
+ * @return -1 in case of error reading. 0 means OK.
+ */
+static int computeChecksums(MYSTORAGE_t *storage, size_t region,
+                            unsigned char *batch) {
+  unsigned int first = region * CRC_BATCH;
+  unsigned int present = 0;
+
+  if (-1 == growChecksums(storage, first + CRC_BATCH - 1)) {
+    return -1;
+  }
+  memset(storage->crc + first, 0, CRC_BATCH * sizeof(uint32_t));
+  for (unsigned int i = first; i < first + CRC_BATCH && !present; i++) {
+    present = MYS_isPresent(storage, i);
+  }
+  if (!present) {
+    return 0;
+  }
+  if (-1 == storage->ops->read(storage, first, CRC_BATCH, batch)) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < CRC_BATCH; i++) {
+    if (MYS_isPresent(storage, first + i)) {
+      storage->crc[first + i] =
+          MYCRC_crc32c(batch + (size_t)i * MYBUCKET_RECORDSIZE,
+                       MYBUCKET_RECORDSIZE);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Open "<file>.crc" and load the checksums. The regions left stale by a
+ * crash may be older than their records, so theirs are computed again; all
+ * of them are for a table that predates the file. Writes keep it up to
+ * date, see setChecksum() and MYS_sync().
+ * @return -1 in case of error. 0 means OK.
+ */
+static int openChecksums(MYSTORAGE_t *storage, const char *filename) {
+  char path[PATH_MAX];
+  CRC_HEADER_t header = {0, 0};
+  struct stat st;
+
+  if ((size_t)snprintf(path, sizeof(path), "%s.crc", filename) >=
+      sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  storage->crcFd = open(path, O_RDWR | O_CREAT,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (storage->crcFd < 0 || -1 == fstat(storage->crcFd, &st)) {
+    return -1;
+  }
+  if ((size_t)st.st_size >= sizeof(header) &&
+      -1 == MYS_preadFd(storage, storage->crcFd, &header, sizeof(header), 0)) {
+    return -1;
+  }
+
+  unsigned char *batch = malloc((size_t)CRC_BATCH * MYBUCKET_RECORDSIZE);
+  uint32_t *words = malloc(CRC_REGION_BYTES);
+  int status = 0;
+  if (batch == NULL || words == NULL) {
+    free(batch);
+    free(words);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if (header.magic == CRC_MAGIC && header.regionRecords == CRC_BATCH) {
+    size_t regions =
+        (st.st_size - sizeof(header) + CRC_REGION_BYTES - 1) / CRC_REGION_BYTES;
+
+    for (size_t r = 0; r < regions && 0 == status; r++) {
+      if (-1 == growChecksums(storage, (r + 1) * CRC_BATCH - 1) ||
+          -1 == MYS_preadFd(storage, storage->crcFd, words, CRC_REGION_BYTES,
+                            regionOffset(r))) {
+        status = -1;
+      } else if (words[0] != 0) {
+        storage->crcStale[r] = 1;
+        status = computeChecksums(storage, r, batch);
+        status = status == 0 ? writeChecksums(storage, r * CRC_BATCH,
+                                              CRC_BATCH)
+                             : -1;
+      } else {
+        memcpy(storage->crc + r * CRC_BATCH, words + 1,
+               CRC_BATCH * sizeof(uint32_t));
+      }
+    }
+    free(batch);
+    free(words);
+    return status == 0 ? saveChecksums(storage) : -1;
+  }
+
+  /* Computed from the table file, and valid once the header is written. */
+  size_t regions = (storage->mapBytes * 8 + CRC_BATCH - 1) / CRC_BATCH;
+  if (-1 == ftruncate(storage->crcFd, 0)) {
+    status = -1;
+  }
+  for (size_t r = 0; r < regions && 0 == status; r++) {
+    if (-1 == computeChecksums(storage, r, batch) ||
+        -1 == writeChecksums(storage, r * CRC_BATCH, CRC_BATCH)) {
+      status = -1;
+    }
+  }
+  free(batch);
+  free(words);
+  header.magic = CRC_MAGIC;
+  header.regionRecords = CRC_BATCH;
+  if (-1 == status || -1 == fdatasync(storage->crcFd) ||
+      -1 == MYS_pwriteFd(storage, storage->crcFd, &header, sizeof(header),
+                         0)) {
+    return -1;
+  }
+  return fdatasync(storage->crcFd);
+}
+
+/**
+ * Make the checksums written to "<file>.crc" durable, then mark their
+ * regions no longer stale. Called once the backend made the records
+ * durable, with the cache lock held.
+ * @return -1 in case of error writing. 0 means OK.
+ */
+static int saveChecksums(MYSTORAGE_t *storage) {
+  uint32_t fresh = 0;
+  int written = 0;
+
+  if (storage->crcFd < 0) {
+    return 0;
+  }
+  for (size_t r = 0; r < storage->crcCount / CRC_BATCH; r++) {
+    if (!storage->crcStale[r]) {
+      continue;
+    }
+    if (!written && -1 == fdatasync(storage->crcFd)) {
+      return -1;
+    }
+    written = 1;
+    if (-1 == MYS_pwriteFd(storage, storage->crcFd, &fresh, sizeof(fresh),
+                           regionOffset(r))) {
+      return -1;
+    }
+    storage->crcStale[r] = 0;
+  }
+  return written ? fdatasync(storage->crcFd) : 0;
+}
+
+/**
+ * Make every write done so far durable, with the checksums of the records.
+ * Called with the cache lock held.
+ * @return -1 in case of error writing. 0 means OK.
+ */
+int MYS_sync(MYSTORAGE_t *storage) {
+  if (-1 == storage->ops->sync(storage)) {
+    return -1;
+  }
+  return saveChecksums(storage);
+}
+
+/**
+ * Check a record read from "index" against its checksum. Absent records and
+ * those without a checksum, like payloads, are not checked.
+ * @return -1 with errno EBADMSG if the record does not match. 0 means OK.
+ */
+int MYS_verify(const MYSTORAGE_t *storage, unsigned int index,
+               const void *record) {
+  if (index < storage->crcCount && storage->crc[index] != 0 &&
+      MYS_isPresent(storage, index) &&
+      storage->crc[index] != MYCRC_crc32c(record, MYBUCKET_RECORDSIZE)) {
+    errno = EBADMSG;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Read "count" consecutive records starting at "index" and check them
+ * against their checksums. Called with the cache lock held.
+ * @return -1 in case of error, with errno EBADMSG if a record is corrupted.
+ * 0 success.
+ */
+int MYS_read(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+             void *records) {
+  if (-1 == storage->ops->read(storage, index, count, records)) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (-1 == MYS_verify(storage, index + i,
+                         (const char *)records +
+                             (size_t)i * MYBUCKET_RECORDSIZE)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Write the record at "index", marking it present.
+ * @return -1 in case of error writing. 0 success.
+ */
+int MYS_write(MYSTORAGE_t *storage, unsigned int index, const void *record) {
+  if (-1 == MYS_setPresent(storage, index, 1) ||
+      -1 == setChecksum(storage, index, record)) {
+    return -1;
+  }
+  return storage->ops->write(storage, index, record);
+}
+
+/**
+ * Write the records of "writes", marking them present. No two of them may
+ * have the same index. The formats that can send them to the file at the
+ * same time do, like the file format with a ring, see MYS_useUring().
+ * @return -1 in case of error writing, some of them may be written. 0
+ * success.
+ */
+int MYS_writeMany(MYSTORAGE_t *storage, const MYSTORAGE_WRITE_t *writes,
+                  unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    if (-1 == MYS_setPresent(storage, writes[i].index, 1) ||
+        -1 == setChecksum(storage, writes[i].index, writes[i].record)) {
+      return -1;
+    }
+  }
+  if (storage->ops->writeMany != NULL) {
+    return storage->ops->writeMany(storage, writes, count);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (-1 == storage->ops->write(storage, writes[i].index, writes[i].record)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Write the payload of "length" bytes at "index", marking it present, or
+ * erase the record if "length" is 0. A payload has no record checksum.
+ * @return -1 in case of error writing. 0 success.
+ */
+int MYS_writeBlob(MYSTORAGE_t *storage, unsigned int index, const void *buffer,
+                  size_t length) {
+  if (length == 0) {
+    return MYS_erase(storage, index);
+  }
+  if (-1 == MYS_setPresent(storage, index, 1) ||
+      -1 == setChecksum(storage, index, NULL)) {
+    return -1;
+  }
+  return storage->ops->writeBlob(storage, index, buffer, length);
+}
+
+/**
+ * Delete the record at "index": clear it in the map, then let the backend
+ * give back its space or overwrite it with zeros. Nothing is done for a
+ * record already absent.
+ * @return -1 in case of error writing. 0 success.
+ */
+int MYS_erase(MYSTORAGE_t *storage, unsigned int index) {
+  static const unsigned char zeros[MYBUCKET_RECORDSIZE];
+
+  if (!MYS_isPresent(storage, index)) {
+    return 0;
+  }
+  if (-1 == markRecords(storage, index, 1, 0)) {
+    return -1;
+  }
+  if (storage->ops->erase != NULL) {
+    return storage->ops->erase(storage, index);
+  }
+  return storage->ops->write(storage, index, zeros);
+}
+
+/**
+ * Make the reads and writes of "ios" on "fd", the table file, through the
+ * ring of the storage, timed as a single operation.
+ * @return -1 indicates an error. 0 success.
+ */
+static int runRing(MYSTORAGE_t *storage, int fd, MYURING_IO_t *ios,
+                   unsigned int count) {
+  uint64_t start = myh_now();
+
+  if (-1 == MYURING_run(storage->uring, fd, ios, count)) {
+    return -1;
+  }
+  if (storage->diskIO != NULL) {
+    myh_record(storage->diskIO, myh_now() - start);
+  }
+  return 0;
+}
+
+/**
+ * Read "size" bytes at "offset" of the table file, retrying when interrupted.
+ * The part beyond the end of the file is returned as zeros, like a hole.
+ * @return -1 indicates an error reading. 0 success.
+ */
+int MYS_pread(MYSTORAGE_t *storage, void *buffer, size_t size, off_t offset) {
+  if (storage->blocks != NULL) {
+    uint64_t start = myh_now();
+    int reads = MYBLOCK_read(storage->blocks, buffer, size, offset);
+
+    if (reads > 0 && storage->diskIO != NULL) {
+      myh_record(storage->diskIO, myh_now() - start);
+    }
+    return reads < 0 ? -1 : 0;
+  }
+  if (storage->uring != NULL) {
+    MYURING_IO_t io = {buffer, size, offset, 0};
+    return runRing(storage, storage->fd, &io, 1);
+  }
+  return MYS_preadFd(storage, storage->fd, buffer, size, offset);
+}
+
+/**
+ * Write "size" bytes at "offset" of the table file, retrying when interrupted.
+ * During a compaction of a format written in place the copy is written too.
+ * During a backup the old content goes to the backup first.
+ * @return -1 indicates an error writing. 0 success.
+ */
+int MYS_pwrite(MYSTORAGE_t *storage, const void *buffer, size_t size,
+               off_t offset) {
+  backupBefore(storage, offset, size);
+  if (storage->blocks != NULL) {
+    uint64_t start = myh_now();
+
+    if (-1 == MYBLOCK_write(storage->blocks, buffer, size, offset)) {
+      return -1;
+    }
+    if (storage->diskIO != NULL) {
+      myh_record(storage->diskIO, myh_now() - start);
+    }
+  } else if (storage->uring != NULL) {
+    MYURING_IO_t io = {(void *)buffer, size, offset, 1};
+    if (-1 == runRing(storage, storage->fd, &io, 1)) {
+      return -1;
+    }
+  } else if (-1 == MYS_pwriteFd(storage, storage->fd, buffer, size, offset)) {
+    return -1;
+  }
+  if (storage->compactFd >= 0) {
+    return MYS_pwriteFd(storage, storage->compactFd, buffer, size, offset);
+  }
+  return 0;
+}
+
+/**
+ * Give back to the file system the space of "length" bytes at "offset" of
+ * the table file, which read as zeros afterwards.
+ * @return -1 indicates an error, with errno EOPNOTSUPP if the file system
+ * has no holes. 0 success.
+ */
+int MYS_punch(MYSTORAGE_t *storage, off_t offset, off_t length) {
+  int fds[2] = {storage->fd, storage->compactFd};
+
+  backupBefore(storage, offset, length);
+  for (int i = 0; i < 2 && fds[i] >= 0; i++) {
+    if (-1 == fallocate(fds[i], FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                        offset, length)) {
+      return -1;
+    }
+  }
+  if (storage->blocks != NULL) {
+    MYBLOCK_drop(storage->blocks, offset, length);
+  }
+  return 0;
+}
+
+/** MYS_pread() on another file of the backend, like an index. */
+int MYS_preadFd(MYSTORAGE_t *storage, int fd, void *buffer, size_t size,
+                off_t offset) {
+  uint64_t start = myh_now();
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = pread(fd, (char *)buffer + done, size - done, offset + done);
+
+    if (n == 0) {
+      memset((char *)buffer + done, 0, size - done);
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+
+  if (storage->diskIO != NULL) {
+    myh_record(storage->diskIO, myh_now() - start);
+  }
+  return 0;
+}
+
+/** MYS_pwrite() on another file of the backend, like an index. */
+int MYS_pwriteFd(MYSTORAGE_t *storage, int fd, const void *buffer, size_t size,
+                 off_t offset) {
+  uint64_t start = myh_now();
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n =
+        pwrite(fd, (const char *)buffer + done, size - done, offset + done);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+
+  if (storage->diskIO != NULL) {
+    myh_record(storage->diskIO, myh_now() - start);
+  }
+  return 0;
+}
+
+/* The records of a bulk load are written through a second descriptor
+ * without O_SYNC, and made durable by a single fdatasync in the next sync.
+ * It is only open from a load to the next sync, so it never refers to a
+ * table file replaced by a compaction. */
+typedef struct {
+  int loadFd; /* -1 when no load is waiting for a sync. */
+} PLAINFILE_t;
+
+static int fileOpen(MYSTORAGE_t *storage, const char *filename) {
+  PLAINFILE_t *file = calloc(1, sizeof(PLAINFILE_t));
+
+  if (file == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  file->loadFd = -1;
+  storage->state = file;
+  return 0;
+}
+
+/* The file is opened with O_SYNC, every write is already durable but those
+ * of a bulk load. */
+static int fileSync(MYSTORAGE_t *storage) {
+  PLAINFILE_t *file = storage->state;
+
+  if (file->loadFd >= 0) {
+    if (-1 == fdatasync(file->loadFd)) {
+      return -1;
+    }
+    /* With O_DIRECT the records are not kept in the page cache either. */
+    if (storage->blocks != NULL) {
+      posix_fadvise(file->loadFd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(file->loadFd);
+    file->loadFd = -1;
+  }
+  return 0;
+}
+
+static int fileClose(MYSTORAGE_t *storage) {
+  PLAINFILE_t *file = storage->state;
+  int status = fileSync(storage);
+
+  if (file->loadFd >= 0) {
+    close(file->loadFd);
+  }
+  if (-1 == close(storage->fd)) {
+    status = -1;
+  }
+  free(file);
+  storage->state = NULL;
+  return status;
+}
+
+static int fileRead(MYSTORAGE_t *storage, unsigned int index,
+                    unsigned int count, void *records) {
+  return MYS_pread(storage, records, (size_t)count * MYBUCKET_RECORDSIZE,
+                   (off_t)index * MYBUCKET_RECORDSIZE);
+}
+
+static int fileWrite(MYSTORAGE_t *storage, unsigned int index,
+                     const void *record) {
+  return MYS_pwrite(storage, record, MYBUCKET_RECORDSIZE,
+                    (off_t)index * MYBUCKET_RECORDSIZE);
+}
+
+static int fileLoad(MYSTORAGE_t *storage, unsigned int index,
+                    unsigned int count, const void *records) {
+  PLAINFILE_t *file = storage->state;
+  size_t size = (size_t)count * MYBUCKET_RECORDSIZE;
+  off_t offset = (off_t)index * MYBUCKET_RECORDSIZE;
+
+  if (file->loadFd < 0) {
+    file->loadFd = open(storage->filename, O_WRONLY);
+    if (file->loadFd < 0) {
+      return -1;
+    }
+  }
+  backupBefore(storage, offset, size);
+  if (-1 == MYS_pwriteFd(storage, file->loadFd, records, size, offset)) {
+    return -1;
+  }
+  if (storage->blocks != NULL) {
+    MYBLOCK_drop(storage->blocks, offset, size);
+  }
+  if (storage->compactFd >= 0) {
+    return MYS_pwriteFd(storage, storage->compactFd, records, size, offset);
+  }
+  return 0;
+}
+
+/* The records go out like a load, without O_SYNC, and are made durable with
+ * a single sync at the end instead of one each. With a ring they are sent
+ * WRITE_BATCH at a time, each straight from where the cache holds it. */
+static int fileWriteMany(MYSTORAGE_t *storage, const MYSTORAGE_WRITE_t *writes,
+                         unsigned int count) {
+  PLAINFILE_t *file = storage->state;
+  MYURING_IO_t ios[WRITE_BATCH];
+
+  if (file->loadFd < 0) {
+    file->loadFd = open(storage->filename, O_WRONLY);
+    if (file->loadFd < 0) {
+      return -1;
+    }
+  }
+  for (unsigned int done = 0; done < count; done += WRITE_BATCH) {
+    unsigned int batch =
+        count - done < WRITE_BATCH ? count - done : WRITE_BATCH;
+
+    for (unsigned int i = 0; i < batch; i++) {
+      ios[i].buffer = (void *)writes[done + i].record;
+      ios[i].size = MYBUCKET_RECORDSIZE;
+      ios[i].offset = (off_t)writes[done + i].index * MYBUCKET_RECORDSIZE;
+      ios[i].write = 1;
+      backupBefore(storage, ios[i].offset, ios[i].size);
+    }
+    if (storage->uring != NULL) {
+      if (-1 == runRing(storage, file->loadFd, ios, batch)) {
+        return -1;
+      }
+    } else {
+      for (unsigned int i = 0; i < batch; i++) {
+        if (-1 == MYS_pwriteFd(storage, file->loadFd, ios[i].buffer,
+                               ios[i].size, ios[i].offset)) {
+          return -1;
+        }
+      }
+    }
+    for (unsigned int i = 0; i < batch && storage->blocks != NULL; i++) {
+      MYBLOCK_drop(storage->blocks, ios[i].offset, ios[i].size);
+    }
+    for (unsigned int i = 0; i < batch && storage->compactFd >= 0; i++) {
+      if (-1 == MYS_pwriteFd(storage, storage->compactFd, ios[i].buffer,
+                             ios[i].size, ios[i].offset)) {
+        return -1;
+      }
+    }
+  }
+  return fileSync(storage);
+}
+
+/** 1 if no present record has a byte in the block "block" of the file. */
+static int blockAbsent(const MYSTORAGE_t *storage, off_t block) {
+  unsigned int first = block * HOLE_SIZE / MYBUCKET_RECORDSIZE;
+  unsigned int last = ((block + 1) * HOLE_SIZE - 1) / MYBUCKET_RECORDSIZE;
+
+  for (unsigned int i = first; i <= last; i++) {
+    if (MYS_isPresent(storage, i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Zero the record, then punch a hole in the blocks it spans that hold no
+ * other present record. File systems without holes keep the zeros. */
+static int fileErase(MYSTORAGE_t *storage, unsigned int index) {
+  static const unsigned char zeros[MYBUCKET_RECORDSIZE];
+  off_t start = (off_t)index * MYBUCKET_RECORDSIZE;
+  off_t end = start + MYBUCKET_RECORDSIZE;
+
+  if (-1 == MYS_pwrite(storage, zeros, MYBUCKET_RECORDSIZE, start)) {
+    return -1;
+  }
+  for (off_t block = start / HOLE_SIZE; block * HOLE_SIZE < end; block++) {
+    if (blockAbsent(storage, block) &&
+        -1 == MYS_punch(storage, block * HOLE_SIZE, HOLE_SIZE) &&
+        errno != EOPNOTSUPP) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+const MYSTORAGE_OPS_t MYS_FILE = {
+    "file",    fileOpen, fileClose, fileRead,     fileWrite,
+    fileSync,  NULL,     NULL,      NULL,         fileLoad,
+    fileErase, NULL,     fileWriteMany};
+
+/**
+ * Write "count" consecutive records starting at "index", in large writes if
+ * the backend can. They are only durable after the next sync.
+ * @return -1 in case of error writing. 0 success.
+ */
+int MYS_load(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+             const void *records) {
+  if (-1 == MYS_setPresent(storage, index, count)) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (-1 == markStale(storage, index + i)) {
+      return -1;
+    }
+    storage->crc[index + i] =
+        MYCRC_crc32c((const char *)records + (size_t)i * MYBUCKET_RECORDSIZE,
+                     MYBUCKET_RECORDSIZE);
+  }
+  if (count > 0 && -1 == writeChecksums(storage, index, count)) {
+    return -1;
+  }
+  if (storage->ops->load != NULL) {
+    return storage->ops->load(storage, index, count, records);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (-1 == storage->ops->write(storage, index + i,
+                                  (const char *)records +
+                                      (size_t)i * MYBUCKET_RECORDSIZE)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Size of the table on disk, from the backend or from the table file.
+ * @param diskBytes Bytes allocated on disk.
+ * @param tableBytes Bytes of table they hold, uncompressed and with holes.
+ * @return -1 in case of error. 0 means OK.
+ */
+int MYS_space(MYSTORAGE_t *storage, uint64_t *diskBytes, uint64_t *tableBytes) {
+  struct stat st;
+
+  if (storage->ops->space != NULL) {
+    return storage->ops->space(storage, diskBytes, tableBytes);
+  }
+  if (-1 == fstat(storage->fd, &st)) {
+    return -1;
+  }
+  *diskBytes = (uint64_t)st.st_blocks * 512;
+  *tableBytes = (uint64_t)st.st_size;
+  return 0;
+}
+
+/** Stop a compaction of a format written in place and remove the copy. */
+static void abandonCompaction(MYSTORAGE_t *storage) {
+  char path[PATH_MAX];
+
+  close(storage->compactFd);
+  storage->compactFd = -1;
+  if (0 == MYS_compactPath(storage, path, "")) {
+    unlink(path);
+  }
+}
+
+/** 1 if the "size" bytes of "buffer" are all zero. */
+static int isZero(const unsigned char *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (buffer[i] != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Copy up to "blocks" blocks of the table file to the copy of a compaction,
+ * leaving out the holes and the blocks of zeros.
+ * @return 1 while there are blocks left, 0 when all are copied. -1 in case of
+ * error.
+ */
+static int copyBlocks(MYSTORAGE_t *storage, unsigned int blocks) {
+  unsigned char block[HOLE_SIZE];
+  struct stat st;
+
+  off_t from = storage->compactCursor;
+
+  if (-1 == fstat(storage->fd, &st)) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < blocks && storage->compactCursor < st.st_size;
+       i++) {
+    off_t data = lseek(storage->fd, storage->compactCursor, SEEK_DATA);
+
+    if (data < 0) {
+      if (errno != ENXIO) {
+        return -1;
+      }
+      storage->compactCursor = st.st_size; /* Only a hole is left. */
+      break;
+    }
+    data -= data % HOLE_SIZE;
+    size_t size = data + HOLE_SIZE <= st.st_size ? HOLE_SIZE
+                                                 : (size_t)(st.st_size - data);
+    if (-1 == MYS_pread(storage, block, size, data) ||
+        (!isZero(block, size) &&
+         -1 == MYS_pwriteFd(storage, storage->compactFd, block, size, data))) {
+      return -1;
+    }
+    storage->compactCursor = data + HOLE_SIZE;
+  }
+  /* Start writing the copy now, the last step only waits for the rest. */
+  if (storage->compactCursor > from) {
+    sync_file_range(storage->compactFd, from, storage->compactCursor - from,
+                    SYNC_FILE_RANGE_WRITE);
+  }
+  return storage->compactCursor < st.st_size ? 1 : 0;
+}
+
+/**
+ * Make the copy of a compaction durable and rename it over the table file.
+ * The descriptor is opened before the rename, so once the copy is in place
+ * nothing can fail before the table uses it.
+ * @return -1 in case of error, the table file is still the old one. 0 OK.
+ */
+static int replaceTableFile(MYSTORAGE_t *storage, const char *path) {
+  struct stat st;
+
+  if (-1 == storage->ops->sync(storage) || -1 == fstat(storage->fd, &st) ||
+      -1 == ftruncate(storage->compactFd, st.st_size) ||
+      -1 == fdatasync(storage->compactFd)) {
+    return -1;
+  }
+  int fd = open(path, O_SYNC | O_RDWR);
+  if (fd < 0) {
+    return -1;
+  }
+  int directFd = -1;
+  if (storage->blocks != NULL &&
+      (directFd = open(path, O_DIRECT | O_SYNC | O_RDWR)) < 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  if (-1 == rename(path, storage->filename)) {
+    int error = errno;
+    close(fd);
+    if (directFd >= 0) {
+      close(directFd);
+    }
+    errno = error;
+    return -1;
+  }
+  dup2(fd, storage->fd);
+  close(fd);
+  close(storage->compactFd);
+  storage->compactFd = -1;
+  /* The copy was written through the page cache. */
+  if (storage->blocks != NULL) {
+    MYBLOCK_setFile(storage->blocks, directFd);
+    posix_fadvise(storage->fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  /* The ring still has the old file, fall back to the descriptor if it
+   * cannot take the new one. */
+  if (storage->uring != NULL) {
+    MYURING_registerFile(storage->uring, storage->fd);
+  }
+  return 0;
+}
+
+/**
+ * Compaction of the formats that write in place, where the offset of a
+ * record follows from its index. The table file is copied block by block to
+ * "<file>.compact", which gets no space for the empty regions and is laid
+ * out in order. The writes done meanwhile go to both files, see MYS_pwrite()
+ * and MYS_punch(). The last step renames the copy over the table file.
+ */
+static int compactInPlace(MYSTORAGE_t *storage, unsigned int blocks) {
+  char path[PATH_MAX];
+  int status;
+
+  if (-1 == MYS_compactPath(storage, path, "")) {
+    return -1;
+  }
+  if (storage->compactFd < 0) {
+    storage->compactFd = open(path, O_RDWR | O_CREAT | O_TRUNC,
+                              S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (storage->compactFd < 0) {
+      return -1;
+    }
+    storage->compactCursor = 0;
+  }
+
+  status = copyBlocks(storage, blocks);
+  if (0 == status) {
+    status = replaceTableFile(storage, path);
+  }
+  if (-1 == status) {
+    int error = errno;
+    abandonCompaction(storage);
+    errno = error;
+  }
+  return status;
+}
+
+/**
+ * One step of the compaction of the table into a new file that takes its
+ * place at the end, copying up to "blocks" blocks. Reads and writes go on
+ * between steps. Called with the cache lock held.
+ * @return 1 while there are steps left, 0 once the new file is in place.
+ * -1 in case of error, the compaction is abandoned.
+ */
+int MYS_compact(MYSTORAGE_t *storage, unsigned int blocks) {
+  if (storage->ops->compact != NULL) {
+    return storage->ops->compact(storage, blocks);
+  }
+  return compactInPlace(storage, blocks);
+}
+
+/**
+ * Make the reads and writes of the table file through an io_uring of
+ * "entries" entries with the file registered, instead of pread() and
+ * pwrite(). Called right after MYS_open(), the ring is closed by MYS_close().
+ * @return -1 if the kernel cannot, with errno set: the storage goes on with
+ * pread() and pwrite(). 0 success.
+ */
+int MYS_useUring(MYSTORAGE_t *storage, unsigned int entries) {
+  MYURING_t *ring = MYURING_open(entries);
+
+  if (ring == NULL) {
+    return -1;
+  }
+  if (-1 == MYURING_registerFile(ring, storage->fd)) {
+    int error = errno;
+    MYURING_close(ring);
+    errno = error;
+    return -1;
+  }
+  storage->uring = ring;
+  return 0;
+}
+
+/**
+ * Make the reads and writes of the table file with O_DIRECT, in aligned
+ * blocks of MYBLOCK_SIZE through a pool of "blocks" of them, so that the
+ * page cache does not keep a second copy of the records the cache holds.
+ * Only for the formats that write in place. Called right after MYS_open(),
+ * the pool is freed by MYS_close(). It takes precedence over MYS_useUring().
+ * @return -1 if it cannot, with errno set, EINVAL for the other formats or
+ * a file system without O_DIRECT: the storage goes on through the page
+ * cache. 0 success.
+ */
+int MYS_useDirect(MYSTORAGE_t *storage, unsigned int blocks) {
+  if (storage->ops->compact != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = open(storage->filename, O_DIRECT | O_SYNC | O_RDWR);
+  if (fd < 0) {
+    return -1;
+  }
+  storage->blocks = MYBLOCK_open(fd, blocks);
+  if (storage->blocks == NULL) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  /* What opening the table read through the page cache. */
+  posix_fadvise(storage->fd, 0, 0, POSIX_FADV_DONTNEED);
+  return 0;
+}
+
+/**
+ * Register "buffer", where the records are read into and written from, with
+ * the ring of the storage, replacing the one registered before. NULL to
+ * register none, before freeing or moving it.
+ * @return -1 if it cannot be registered, the I/O works without. 0 success,
+ * or no ring.
+ */
+int MYS_setBuffer(MYSTORAGE_t *storage, void *buffer, size_t size) {
+  if (storage->uring == NULL) {
+    return 0;
+  }
+  return MYURING_registerBuffer(storage->uring, buffer, size);
+}
+
+/*
+ * Online backup. MYS_backupBegin() takes the point of the backup: the files
+ * kept next to the table file are small and copied right away, the table
+ * file is cloned when the file system shares extents (reflink) and copied
+ * chunk by chunk by MYS_backup() otherwise. Until then a chunk about to be
+ * written or punched is copied first, so the backup holds the table file as
+ * it was at the point of the backup whatever is written meanwhile.
+ */
+
+#define BACKUP_CHUNK (64 * 1024)
+
+/* Files kept next to the table file: the map of present records and the
+ * block index of MYS_COMPRESSED. */
+static const char *const sideFiles[] = {".map", ".idx"};
+#define SIDE_FILES (sizeof(sideFiles) / sizeof(sideFiles[0]))
+
+struct MYSTORAGE_BACKUP {
+  int fd;                 /* Open on "partial". */
+  char path[PATH_MAX];    /* The backup of the table file, once complete. */
+  char partial[PATH_MAX]; /* Its name until then. */
+  off_t size;          /* Of the table file at the point of the backup. */
+  off_t chunks;
+  off_t cursor;          /* Next chunk copied by MYS_backup(). */
+  unsigned char *copied; /* One bit per chunk already in the backup. */
+  int error; /* errno of a copy done before a write that failed, or 0. */
+};
+
+/**
+ * Path of a file of the table, "filename" followed by "suffix", in another
+ * directory.
+ * @return -1 with errno ENAMETOOLONG if it does not fit in PATH_MAX.
+ */
+static int pathIn(char *path, const char *directory, const char *filename,
+                  const char *suffix) {
+  const char *base = strrchr(filename, '/');
+
+  base = base != NULL ? base + 1 : filename;
+  if ((size_t)snprintf(path, PATH_MAX, "%s/%s%s", directory, base, suffix) >=
+      PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Copy "length" bytes at "offset" of "from" to the same offset of "to", in
+ * the kernel with copy_file_range() where the file systems allow it, with
+ * reads and writes otherwise. Stops early at the end of "from".
+ * @return -1 in case of error. 0 success.
+ */
+static int copyRange(int from, int to, off_t offset, off_t length) {
+  unsigned char buffer[BACKUP_CHUNK];
+  off_t done = 0;
+
+  while (done < length) {
+    loff_t in = offset + done;
+    loff_t out = offset + done;
+    ssize_t n = copy_file_range(from, &in, to, &out, length - done, 0);
+
+    if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+                  errno == EINVAL)) {
+      size_t size = length - done < BACKUP_CHUNK ? (size_t)(length - done)
+                                                 : BACKUP_CHUNK;
+      n = pread(from, buffer, size, offset + done);
+      if (n > 0 && n != pwrite(to, buffer, n, offset + done)) {
+        return -1;
+      }
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return n;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+/**
+ * Copy a file whole to "to", through "<to>.partial" made durable and renamed.
+ * @return -1 in case of error, with errno ENOENT if "from" does not exist.
+ * 0 success.
+ */
+static int copyFile(const char *from, const char *to) {
+  char partial[PATH_MAX];
+  struct stat st;
+  int status = -1;
+
+  if ((size_t)snprintf(partial, sizeof(partial), "%s.partial", to) >=
+      sizeof(partial)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  int in = open(from, O_RDONLY);
+  if (in < 0) {
+    return -1;
+  }
+  int out = open(partial, O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (out >= 0 && 0 == fstat(in, &st) &&
+      0 == copyRange(in, out, 0, st.st_size) &&
+      0 == ftruncate(out, st.st_size) && 0 == fdatasync(out) &&
+      0 == rename(partial, to)) {
+    status = 0;
+  }
+  int error = errno;
+  if (out >= 0) {
+    close(out);
+  }
+  close(in);
+  if (status != 0) {
+    unlink(partial);
+  }
+  errno = error;
+  return status;
+}
+
+/** Make the names of the files of a directory durable. */
+static int syncDirectory(const char *directory) {
+  int fd = open(directory, O_RDONLY | O_DIRECTORY);
+
+  if (fd < 0) {
+    return -1;
+  }
+  int status = fsync(fd);
+  close(fd);
+  return status;
+}
+
+/**
+ * Copy a chunk of the table file to the backup, unless it is a hole.
+ * @return -1 in case of error. 0 success.
+ */
+static int backupChunk(MYSTORAGE_t *storage, off_t chunk) {
+  MYSTORAGE_BACKUP_t *backup = storage->backup;
+  off_t offset = chunk * BACKUP_CHUNK;
+  off_t length = offset + BACKUP_CHUNK <= backup->size
+                     ? BACKUP_CHUNK
+                     : backup->size - offset;
+  off_t data = lseek(storage->fd, offset, SEEK_DATA);
+
+  if (data < 0 && errno != ENXIO) {
+    return -1;
+  }
+  if (data >= 0 && data < offset + length &&
+      -1 == copyRange(storage->fd, backup->fd, offset, length)) {
+    return -1;
+  }
+  backup->copied[chunk / 8] |= 1 << (chunk % 8);
+  return 0;
+}
+
+/**
+ * Copy to the backup in progress the chunks of "length" bytes at "offset" of
+ * the table file not copied yet, before they change. If that fails the write
+ * still goes on and the next step of the backup abandons it.
+ */
+static void backupBefore(MYSTORAGE_t *storage, off_t offset, off_t length) {
+  MYSTORAGE_BACKUP_t *backup = storage->backup;
+
+  if (backup == NULL || backup->error != 0) {
+    return;
+  }
+  for (off_t chunk = offset / BACKUP_CHUNK;
+       chunk < backup->chunks && chunk * BACKUP_CHUNK < offset + length;
+       chunk++) {
+    if (!(backup->copied[chunk / 8] & (1 << (chunk % 8))) &&
+        -1 == backupChunk(storage, chunk)) {
+      backup->error = errno;
+      return;
+    }
+  }
+}
+
+/** Stop a backup and remove the files it wrote. */
+static void abandonBackup(MYSTORAGE_t *storage) {
+  MYSTORAGE_BACKUP_t *backup = storage->backup;
+  char path[PATH_MAX];
+
+  close(backup->fd);
+  unlink(backup->partial);
+  for (size_t i = 0; i < SIDE_FILES; i++) {
+    if ((size_t)snprintf(path, sizeof(path), "%s%s", backup->path,
+                         sideFiles[i]) < sizeof(path)) {
+      unlink(path);
+    }
+  }
+  free(backup->copied);
+  free(backup);
+  storage->backup = NULL;
+}
+
+/**
+ * Start a backup of the table into "directory", which must exist, as the
+ * files of the table with the same names. Everything written so far is made
+ * durable and is in the backup, nothing written later is; the table file is
+ * copied by the following calls to MYS_backup(). A previous backup of the
+ * table in "directory" is replaced. Not allowed during a compaction. Called
+ * with the cache lock held.
+ * @return -1 in case of error, with errno EBUSY if a backup is in progress.
+ * 0 success.
+ */
+int MYS_backupBegin(MYSTORAGE_t *storage, const char *directory) {
+  char path[PATH_MAX];
+  char copy[PATH_MAX];
+  struct stat st;
+
+  if (storage->backup != NULL) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (-1 == storage->ops->sync(storage) || -1 == fstat(storage->fd, &st)) {
+    return -1;
+  }
+  MYSTORAGE_BACKUP_t *backup = calloc(1, sizeof(MYSTORAGE_BACKUP_t));
+  if (backup == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  backup->size = st.st_size;
+  backup->chunks = (st.st_size + BACKUP_CHUNK - 1) / BACKUP_CHUNK;
+  backup->copied = calloc(backup->chunks / 8 + 1, 1);
+  if (backup->copied == NULL) {
+    free(backup);
+    errno = ENOMEM;
+    return -1;
+  }
+  if (-1 == pathIn(backup->path, directory, storage->filename, "") ||
+      -1 == pathIn(backup->partial, directory, storage->filename,
+                   ".partial")) {
+    free(backup->copied);
+    free(backup);
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  /* The old backup goes first, its files do not match the new ones. */
+  unlink(backup->path);
+  backup->fd = open(backup->partial, O_WRONLY | O_CREAT | O_TRUNC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (backup->fd < 0) {
+    int error = errno;
+    free(backup->copied);
+    free(backup);
+    errno = error;
+    return -1;
+  }
+  storage->backup = backup;
+
+  for (size_t i = 0; i < SIDE_FILES; i++) {
+    if ((size_t)snprintf(path, sizeof(path), "%s%s", storage->filename,
+                         sideFiles[i]) >= sizeof(path) ||
+        (size_t)snprintf(copy, sizeof(copy), "%s%s", backup->path,
+                         sideFiles[i]) >= sizeof(copy)) {
+      abandonBackup(storage);
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    if (-1 == copyFile(path, copy) && errno != ENOENT) {
+      int error = errno;
+      abandonBackup(storage);
+      errno = error;
+      return -1;
+    }
+  }
+
+  /* A clone shares the extents of the table file and is complete at once. */
+  if (0 == ioctl(backup->fd, FICLONE, storage->fd)) {
+    memset(backup->copied, 0xff, backup->chunks / 8 + 1);
+    backup->cursor = backup->chunks;
+  }
+  return 0;
+}
+
+/**
+ * One step of a backup started by MYS_backupBegin(), copying up to "chunks"
+ * chunks of the table file. Reads and writes go on between steps. The last
+ * step makes the backup durable and gives the copy of the table file its
+ * name, the backup is only complete then. Called with the cache lock held.
+ * @return 1 while there are steps left, 0 once the backup is complete.
+ * -1 in case of error, the backup is abandoned.
+ */
+int MYS_backup(MYSTORAGE_t *storage, unsigned int chunks) {
+  MYSTORAGE_BACKUP_t *backup = storage->backup;
+  char directory[PATH_MAX];
+  off_t from = backup->cursor;
+  int status = 0;
+
+  /* The writes started by the last step had the pause to complete: waiting
+   * for them keeps the sync of the last step short. */
+  sync_file_range(backup->fd, 0, from * BACKUP_CHUNK,
+                  SYNC_FILE_RANGE_WAIT_BEFORE);
+  for (unsigned int i = 0; i < chunks && backup->cursor < backup->chunks &&
+                           0 == backup->error;
+       i++, backup->cursor++) {
+    if (!(backup->copied[backup->cursor / 8] & (1 << (backup->cursor % 8))) &&
+        -1 == backupChunk(storage, backup->cursor)) {
+      backup->error = errno;
+    }
+  }
+  if (backup->error != 0) {
+    status = backup->error;
+    abandonBackup(storage);
+    errno = status;
+    return -1;
+  }
+  if (backup->cursor < backup->chunks) {
+    sync_file_range(backup->fd, from * BACKUP_CHUNK,
+                    (backup->cursor - from) * BACKUP_CHUNK,
+                    SYNC_FILE_RANGE_WRITE);
+    return 1;
+  }
+
+  if (-1 == ftruncate(backup->fd, backup->size) ||
+      -1 == fdatasync(backup->fd) ||
+      -1 == rename(backup->partial, backup->path)) {
+    status = errno;
+    abandonBackup(storage);
+    errno = status;
+    return -1;
+  }
+  /* The side files were renamed in place before, the same sync covers them. */
+  strcpy(directory, backup->path);
+  *strrchr(directory, '/') = '\0';
+  status = syncDirectory(directory);
+  close(backup->fd);
+  free(backup->copied);
+  free(backup);
+  storage->backup = NULL;
+  return status;
+}
+
+/**
+ * Put back the table file "filename" and the files kept next to it from a
+ * backup made by MYS_backupBegin() into "directory". The table must not be
+ * open. Every file is copied aside and renamed over the current one, the
+ * table file last; a restore interrupted by a crash is simply run again.
+ * @return -1 in case of error, with errno ENOENT if "directory" holds no
+ * complete backup of the table. 0 success.
+ */
+int MYS_restore(const char *filename, const char *directory) {
+  char path[PATH_MAX];
+  char target[PATH_MAX];
+
+  if (-1 == pathIn(path, directory, filename, "") ||
+      -1 == access(path, R_OK)) {
+    return -1;
+  }
+  /* A compaction interrupted by a crash must not be finished over it, and
+   * the checksums of the current records are computed again. */
+  const char *stale[] = {"%s.compact", "%s.idx.compact", "%s.crc"};
+  for (int i = 0; i < 3; i++) {
+    if ((size_t)snprintf(target, sizeof(target), stale[i], filename) <
+        sizeof(target)) {
+      unlink(target);
+    }
+  }
+  for (size_t i = 0; i < SIDE_FILES; i++) {
+    if (-1 == pathIn(path, directory, filename, sideFiles[i]) ||
+        (size_t)snprintf(target, sizeof(target), "%s%s", filename,
+                         sideFiles[i]) >= sizeof(target)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    if (-1 == copyFile(path, target)) {
+      if (errno != ENOENT) {
+        return -1;
+      }
+      unlink(target);
+    }
+  }
+  pathIn(path, directory, filename, "");
+  return copyFile(path, filename);
+}
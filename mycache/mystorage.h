@@ -0,0 +1,153 @@
+#ifndef MYSTORAGE_H
+#define MYSTORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "mybucket.h"
+#include "myblock.h"
+#include "myhisto.h"
+#include "myuring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Storage backends of libmycache. A backend maps record indices to the table
+ * file; the cache above only sees records of MYBUCKET_RECORDSIZE bytes.
+ * Every function returns -1 with errno set on error and does not log, so the
+ * cache can report the error in its own context.
+ */
+
+typedef struct MYSTORAGE_OPS MYSTORAGE_OPS_t;
+typedef struct MYSTORAGE_BACKUP MYSTORAGE_BACKUP_t;
+
+typedef struct {
+  const MYSTORAGE_OPS_t *ops;
+  char *filename;
+  int fd;
+  unsigned long generation; /* Incremented by the cache on every write. */
+  MYHISTO_t *diskIO;        /* Latency of every read or write, or NULL. */
+  void *state;              /* Private to the backend. */
+  /* One bit per record, set while it is present: written and not deleted.
+   * Kept in "<file>.map" and grown on demand. */
+  int mapFd;
+  unsigned char *map;
+  size_t mapBytes;
+  /* Copy of a compaction of a format written in place, -1 if none. */
+  int compactFd;
+  off_t compactCursor; /* Bytes of the table file copied so far. */
+  MYSTORAGE_BACKUP_t *backup; /* Backup in progress, or NULL. */
+  /* CRC32C of every record written, 0 if unknown. Written to "<file>.crc"
+   * with the records and durable after MYS_sync(), see openChecksums().
+   * One byte for every region of them stale on disk. */
+  int crcFd;
+  uint32_t *crc;
+  unsigned char *crcStale;
+  size_t crcCount;
+  /* Ring the I/O of the table file goes through, NULL for pread() and
+   * pwrite(), see MYS_useUring(). */
+  MYURING_t *uring;
+  /* Blocks the I/O of the table file goes through with O_DIRECT, NULL for
+   * the page cache, see MYS_useDirect(). */
+  MYBLOCK_POOL_t *blocks;
+} MYSTORAGE_t;
+
+/* A record of MYS_writeMany(). */
+typedef struct {
+  unsigned int index;
+  const void *record;
+} MYSTORAGE_WRITE_t;
+
+struct MYSTORAGE_OPS {
+  const char *name;
+  int (*open)(MYSTORAGE_t *storage, const char *filename);
+  int (*close)(MYSTORAGE_t *storage);
+  /* Read "count" consecutive records starting at "index". Absent records
+   * are returned as zeros. May be called without the cache lock. */
+  int (*read)(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+              void *records);
+  int (*write)(MYSTORAGE_t *storage, unsigned int index, const void *record);
+  /* Make every write done so far durable. */
+  int (*sync)(MYSTORAGE_t *storage);
+  /* Variable length payloads, NULL when the format cannot store them.
+   * readBlob returns the length of the payload, which may exceed "size". */
+  int (*readBlob)(MYSTORAGE_t *storage, unsigned int index, void *buffer,
+                  size_t size);
+  int (*writeBlob)(MYSTORAGE_t *storage, unsigned int index,
+                   const void *buffer, size_t length);
+  /* Bytes allocated on disk and bytes of table they represent, NULL to
+   * take them from the table file. */
+  int (*space)(MYSTORAGE_t *storage, uint64_t *diskBytes,
+               uint64_t *tableBytes);
+  /* Write "count" consecutive records starting at "index" with large writes
+   * that are durable after the next sync, NULL to write them one by one. */
+  int (*load)(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+              const void *records);
+  /* Remove the record at "index", already clear in the map, giving back to
+   * the file system the space left holding only absent records. NULL to
+   * overwrite it with zeros. */
+  int (*erase)(MYSTORAGE_t *storage, unsigned int index);
+  /* One step of a compaction moving up to "blocks" blocks, see
+   * MYS_compact(). NULL for a format written in place, copied as is. */
+  int (*compact)(MYSTORAGE_t *storage, unsigned int blocks);
+  /* Write the records of "writes", at different indices, at the same time.
+   * NULL to write them one by one. */
+  int (*writeMany)(MYSTORAGE_t *storage, const MYSTORAGE_WRITE_t *writes,
+                   unsigned int count);
+};
+
+/* Fixed size records at index * MYBUCKET_RECORDSIZE. */
+extern const MYSTORAGE_OPS_t MYS_FILE;
+/* Slotted pages of MYPAGE_SIZE bytes, see mystorage_paged.c. */
+extern const MYSTORAGE_OPS_t MYS_PAGED;
+/* Compressed blocks of records, see mystorage_compressed.c. */
+extern const MYSTORAGE_OPS_t MYS_COMPRESSED;
+
+int MYS_open(MYSTORAGE_t *storage, const MYSTORAGE_OPS_t *ops,
+             const char *filename, MYHISTO_t *diskIO);
+int MYS_close(MYSTORAGE_t *storage);
+int MYS_space(MYSTORAGE_t *storage, uint64_t *diskBytes, uint64_t *tableBytes);
+int MYS_read(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+             void *records);
+int MYS_verify(const MYSTORAGE_t *storage, unsigned int index,
+               const void *record);
+int MYS_write(MYSTORAGE_t *storage, unsigned int index, const void *record);
+int MYS_writeMany(MYSTORAGE_t *storage, const MYSTORAGE_WRITE_t *writes,
+                  unsigned int count);
+int MYS_writeBlob(MYSTORAGE_t *storage, unsigned int index, const void *buffer,
+                  size_t length);
+int MYS_erase(MYSTORAGE_t *storage, unsigned int index);
+int MYS_isPresent(const MYSTORAGE_t *storage, unsigned int index);
+unsigned int MYS_records(const MYSTORAGE_t *storage);
+int MYS_setPresent(MYSTORAGE_t *storage, unsigned int index,
+                   unsigned int count);
+int MYS_sync(MYSTORAGE_t *storage);
+int MYS_load(MYSTORAGE_t *storage, unsigned int index, unsigned int count,
+             const void *records);
+int MYS_compact(MYSTORAGE_t *storage, unsigned int blocks);
+int MYS_useUring(MYSTORAGE_t *storage, unsigned int entries);
+int MYS_useDirect(MYSTORAGE_t *storage, unsigned int blocks);
+int MYS_setBuffer(MYSTORAGE_t *storage, void *buffer, size_t size);
+int MYS_compactPath(const MYSTORAGE_t *storage, char *path,
+                    const char *suffix);
+int MYS_backupBegin(MYSTORAGE_t *storage, const char *directory);
+int MYS_backup(MYSTORAGE_t *storage, unsigned int chunks);
+int MYS_restore(const char *filename, const char *directory);
+
+int MYS_pread(MYSTORAGE_t *storage, void *buffer, size_t size, off_t offset);
+int MYS_pwrite(MYSTORAGE_t *storage, const void *buffer, size_t size,
+               off_t offset);
+int MYS_punch(MYSTORAGE_t *storage, off_t offset, off_t length);
+int MYS_preadFd(MYSTORAGE_t *storage, int fd, void *buffer, size_t size,
+                off_t offset);
+int MYS_pwriteFd(MYSTORAGE_t *storage, int fd, const void *buffer, size_t size,
+                 off_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,589 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sync_file_range() */
+#endif
+#include "mycompress.h"
+#include "mystorage.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Block compressed format. Records are grouped in blocks of
+ * MYCOMP_BLOCKRECORDS consecutive indices and every block is compressed on
+ * its own with the codec of mycompress.c. The table file only holds the
+ * compressed blocks; "<table file>.idx" is the block index, one BLOCKINDEX_t
+ * per block number with the offset and length of its current version.
+ *
+ * Every version of a block is appended at the end of the table file, and
+ * its index entry switched to it once it is durable: a crash or a torn write
+ * leaves the old version or the new one, never a block that does not
+ * decode. A block never written has a length of 0 and reads as zeros.
+ * Recently used blocks stay uncompressed in a cache of MYCOMP_CACHEDBLOCKS
+ * frames: reads decompress on miss and dirty blocks are compressed again
+ * when evicted or synced.
+ *
+ * The old versions are reclaimed by compaction, which copies the current
+ * blocks one after the other to "<file>.compact" with their index in
+ * "<file>.idx.compact". Renaming the new index over the
+ * old one commits it; a table opened with only "<file>.compact" left was
+ * committed and is renamed over the table file then.
+ */
+
+#define MYCOMP_BLOCKRECORDS 128
+#define MYCOMP_BLOCKSIZE (MYCOMP_BLOCKRECORDS * MYBUCKET_RECORDSIZE)
+#define MYCOMP_CACHEDBLOCKS 32
+#define MYCOMP_UNUSED ((unsigned int)-1)
+
+#define BLOCK_RAW 0x1 /* Stored uncompressed, the codec did not help. */
+
+typedef struct {
+  uint64_t offset;
+  uint32_t length; /* On disk, 0 if the block was never written. */
+  uint32_t flags;
+} BLOCKINDEX_t;
+
+typedef struct {
+  unsigned int blockNo;
+  int dirty;
+  unsigned long lastUse;
+  unsigned char data[MYCOMP_BLOCKSIZE];
+} FRAME_t;
+
+typedef struct {
+  pthread_mutex_t lock; /* The warm start thread reads without cache lock. */
+  int indexFd;
+  BLOCKINDEX_t *index;
+  unsigned int blocks; /* Entries allocated in "index". */
+  uint64_t end;        /* Where the next appended block goes. */
+  unsigned long clock;
+  /* Compaction in progress when newFd is not -1. */
+  int newFd;
+  int newIndexFd;
+  BLOCKINDEX_t *moved;     /* Index of the new file. */
+  BLOCKINDEX_t *movedFrom; /* Entry of each block when it was copied. */
+  unsigned int movedBlocks;
+  unsigned int cursor; /* Next block to copy. */
+  uint64_t newEnd;
+  unsigned char scratch[MYCOMP_BOUND(MYCOMP_BLOCKSIZE)];
+  FRAME_t frames[MYCOMP_CACHEDBLOCKS];
+} COMPRESSED_t;
+
+/**
+ * Make room in the in-memory block index for "blockNo".
+ * @return -1 if there is no memory. 0 success.
+ */
+static int growIndex(COMPRESSED_t *comp, unsigned int blockNo) {
+  if (blockNo < comp->blocks) {
+    return 0;
+  }
+
+  unsigned int blocks = comp->blocks ? comp->blocks : 1024;
+  while (blocks <= blockNo) {
+    blocks *= 2;
+  }
+
+  BLOCKINDEX_t *index = realloc(comp->index, blocks * sizeof(BLOCKINDEX_t));
+  if (index == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  memset(index + comp->blocks, 0,
+         (blocks - comp->blocks) * sizeof(BLOCKINDEX_t));
+  comp->index = index;
+  comp->blocks = blocks;
+  return 0;
+}
+
+/**
+ * Compress a dirty frame and append it, then switch its index entry to it.
+ * The table file is opened with O_SYNC, so the block is durable before the
+ * index points to it.
+ * @return -1 indicates an error writing, the old version still current.
+ * 0 success.
+ */
+static int writeBlock(MYSTORAGE_t *storage, FRAME_t *frame) {
+  COMPRESSED_t *comp = storage->state;
+  BLOCKINDEX_t entry;
+  const void *data = comp->scratch;
+
+  if (-1 == growIndex(comp, frame->blockNo)) {
+    return -1;
+  }
+
+  entry = comp->index[frame->blockNo];
+  size_t length = MYCOMP_compress(frame->data, MYCOMP_BLOCKSIZE, comp->scratch,
+                                  sizeof(comp->scratch));
+  uint32_t flags = 0;
+
+  if (length == 0 || length >= MYCOMP_BLOCKSIZE) {
+    data = frame->data;
+    length = MYCOMP_BLOCKSIZE;
+    flags = BLOCK_RAW;
+  }
+
+  entry.offset = comp->end;
+  entry.length = length;
+  entry.flags = flags;
+
+  if (-1 == MYS_pwrite(storage, data, length, entry.offset)) {
+    return -1;
+  }
+  comp->end += length;
+  if (-1 == MYS_pwriteFd(storage, comp->indexFd, &entry, sizeof(entry),
+                         (off_t)frame->blockNo * sizeof(BLOCKINDEX_t))) {
+    return -1;
+  }
+
+  comp->index[frame->blockNo] = entry;
+  frame->dirty = 0;
+  return 0;
+}
+
+/**
+ * Return the frame holding block "blockNo", decompressing it if needed and
+ * evicting the least recently used frame.
+ * @return NULL in case of I/O error or a corrupted block.
+ */
+static FRAME_t *getBlock(MYSTORAGE_t *storage, unsigned int blockNo) {
+  COMPRESSED_t *comp = storage->state;
+  FRAME_t *victim = &comp->frames[0];
+
+  for (int i = 0; i < MYCOMP_CACHEDBLOCKS; i++) {
+    FRAME_t *frame = &comp->frames[i];
+    if (frame->blockNo == blockNo) {
+      frame->lastUse = ++comp->clock;
+      return frame;
+    }
+    if (frame->blockNo == MYCOMP_UNUSED ||
+        (victim->blockNo != MYCOMP_UNUSED && frame->lastUse < victim->lastUse)) {
+      victim = frame;
+    }
+  }
+
+  if (victim->dirty && -1 == writeBlock(storage, victim)) {
+    return NULL;
+  }
+  victim->blockNo = MYCOMP_UNUSED;
+
+  BLOCKINDEX_t entry = {0, 0, 0};
+  if (blockNo < comp->blocks) {
+    entry = comp->index[blockNo];
+  }
+
+  if (entry.length == 0) {
+    memset(victim->data, 0, MYCOMP_BLOCKSIZE);
+  } else if (entry.flags & BLOCK_RAW) {
+    if (-1 == MYS_pread(storage, victim->data, MYCOMP_BLOCKSIZE,
+                        entry.offset)) {
+      return NULL;
+    }
+  } else {
+    if (entry.length > sizeof(comp->scratch) ||
+        -1 == MYS_pread(storage, comp->scratch, entry.length, entry.offset)) {
+      return NULL;
+    }
+    if (MYCOMP_BLOCKSIZE != MYCOMP_decompress(comp->scratch, entry.length,
+                                              victim->data,
+                                              MYCOMP_BLOCKSIZE)) {
+      errno = EIO;
+      return NULL;
+    }
+  }
+
+  victim->blockNo = blockNo;
+  victim->lastUse = ++comp->clock;
+  return victim;
+}
+
+/**
+ * Finish or undo a compaction interrupted by a crash, before the table is
+ * read: the new files are only whole once the index has been renamed.
+ * @return -1 in case of error putting the committed file in place. 0 OK.
+ */
+static int recoverCompaction(MYSTORAGE_t *storage) {
+  char newName[PATH_MAX];
+  char newIndexName[PATH_MAX];
+
+  if (-1 == MYS_compactPath(storage, newName, "") ||
+      -1 == MYS_compactPath(storage, newIndexName, ".idx")) {
+    return -1;
+  }
+  if (0 == access(newIndexName, F_OK)) {
+    unlink(newName);
+    unlink(newIndexName);
+  } else if (0 == access(newName, F_OK)) {
+    int fd = open(newName, O_SYNC | O_RDWR);
+    if (fd < 0 || -1 == rename(newName, storage->filename)) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      return -1;
+    }
+    dup2(fd, storage->fd);
+    close(fd);
+  }
+  return 0;
+}
+
+static int compressedOpen(MYSTORAGE_t *storage, const char *filename) {
+  COMPRESSED_t *comp = calloc(1, sizeof(COMPRESSED_t));
+  char indexName[256];
+  struct stat st;
+
+  if (comp == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (-1 == recoverCompaction(storage)) {
+    free(comp);
+    return -1;
+  }
+  comp->newFd = comp->newIndexFd = -1;
+  snprintf(indexName, sizeof(indexName), "%s.idx", filename);
+  comp->indexFd = open(indexName, O_SYNC | O_RDWR | O_CREAT,
+                       S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+  if (comp->indexFd < 0 || -1 == fstat(comp->indexFd, &st) ||
+      -1 == growIndex(comp, st.st_size / sizeof(BLOCKINDEX_t)) ||
+      -1 == MYS_preadFd(storage, comp->indexFd, comp->index, st.st_size, 0) ||
+      -1 == fstat(storage->fd, &st)) {
+    int error = errno;
+    if (comp->indexFd >= 0) {
+      close(comp->indexFd);
+    }
+    free(comp->index);
+    free(comp);
+    errno = error;
+    return -1;
+  }
+
+  comp->end = st.st_size;
+
+  pthread_mutex_init(&comp->lock, NULL);
+  for (int i = 0; i < MYCOMP_CACHEDBLOCKS; i++) {
+    comp->frames[i].blockNo = MYCOMP_UNUSED;
+  }
+  storage->state = comp;
+  return 0;
+}
+
+static int compressedSync(MYSTORAGE_t *storage) {
+  COMPRESSED_t *comp = storage->state;
+  int status = 0;
+
+  pthread_mutex_lock(&comp->lock);
+  for (int i = 0; i < MYCOMP_CACHEDBLOCKS && 0 == status; i++) {
+    if (comp->frames[i].dirty) {
+      status = writeBlock(storage, &comp->frames[i]);
+    }
+  }
+  pthread_mutex_unlock(&comp->lock);
+  return status;
+}
+
+static void abandonCompaction(COMPRESSED_t *comp, MYSTORAGE_t *storage);
+
+static int compressedClose(MYSTORAGE_t *storage) {
+  int status = compressedSync(storage);
+  COMPRESSED_t *comp = storage->state;
+
+  if (comp->newFd >= 0) {
+    abandonCompaction(comp, storage);
+  }
+  if (-1 == close(comp->indexFd) || -1 == close(storage->fd)) {
+    status = -1;
+  }
+  pthread_mutex_destroy(&comp->lock);
+  free(comp->index);
+  free(comp);
+  storage->state = NULL;
+  return status;
+}
+
+static int compressedRead(MYSTORAGE_t *storage, unsigned int index,
+                          unsigned int count, void *records) {
+  COMPRESSED_t *comp = storage->state;
+  int status = 0;
+
+  pthread_mutex_lock(&comp->lock);
+  for (unsigned int i = 0; i < count && 0 == status; i++) {
+    FRAME_t *frame = getBlock(storage, (index + i) / MYCOMP_BLOCKRECORDS);
+    if (frame == NULL) {
+      status = -1;
+    } else {
+      memcpy((unsigned char *)records + i * MYBUCKET_RECORDSIZE,
+             frame->data +
+                 ((index + i) % MYCOMP_BLOCKRECORDS) * MYBUCKET_RECORDSIZE,
+             MYBUCKET_RECORDSIZE);
+    }
+  }
+  pthread_mutex_unlock(&comp->lock);
+  return status;
+}
+
+static int compressedWrite(MYSTORAGE_t *storage, unsigned int index,
+                           const void *record) {
+  COMPRESSED_t *comp = storage->state;
+  int status = -1;
+
+  pthread_mutex_lock(&comp->lock);
+  FRAME_t *frame = getBlock(storage, index / MYCOMP_BLOCKRECORDS);
+  if (frame != NULL) {
+    memcpy(frame->data + (index % MYCOMP_BLOCKRECORDS) * MYBUCKET_RECORDSIZE,
+           record, MYBUCKET_RECORDSIZE);
+    frame->dirty = 1;
+    status = 0;
+  }
+  pthread_mutex_unlock(&comp->lock);
+  return status;
+}
+
+static int compressedSpace(MYSTORAGE_t *storage, uint64_t *diskBytes,
+                           uint64_t *tableBytes) {
+  COMPRESSED_t *comp = storage->state;
+  struct stat st;
+
+  pthread_mutex_lock(&comp->lock);
+  *tableBytes = 0;
+  for (unsigned int i = 0; i < comp->blocks; i++) {
+    if (comp->index[i].length > 0) {
+      *tableBytes = (uint64_t)(i + 1) * MYCOMP_BLOCKSIZE;
+    }
+  }
+  pthread_mutex_unlock(&comp->lock);
+
+  if (-1 == fstat(storage->fd, &st)) {
+    return -1;
+  }
+  *diskBytes = (uint64_t)st.st_blocks * 512;
+  if (0 == fstat(comp->indexFd, &st)) {
+    *diskBytes += (uint64_t)st.st_blocks * 512;
+  }
+  return 0;
+}
+
+/**
+ * Remove the new files of a compaction, the data first: the index alone is
+ * what marks an uncommitted compaction after a crash.
+ */
+static void abandonCompaction(COMPRESSED_t *comp, MYSTORAGE_t *storage) {
+  char name[PATH_MAX];
+
+  close(comp->newFd);
+  close(comp->newIndexFd);
+  if (0 == MYS_compactPath(storage, name, "")) {
+    unlink(name);
+  }
+  if (0 == MYS_compactPath(storage, name, ".idx")) {
+    unlink(name);
+  }
+  free(comp->moved);
+  free(comp->movedFrom);
+  comp->moved = comp->movedFrom = NULL;
+  comp->newFd = comp->newIndexFd = -1;
+}
+
+/**
+ * Create the new files of a compaction, the index first, and the new index
+ * for the blocks there are now.
+ * @return -1 in case of error. 0 success.
+ */
+static int beginCompaction(COMPRESSED_t *comp, MYSTORAGE_t *storage) {
+  char name[PATH_MAX];
+
+  comp->movedBlocks = comp->blocks;
+  comp->moved = calloc(comp->movedBlocks + 1, sizeof(BLOCKINDEX_t));
+  comp->movedFrom = calloc(comp->movedBlocks + 1, sizeof(BLOCKINDEX_t));
+  comp->cursor = 0;
+  comp->newEnd = 0;
+  if (comp->moved == NULL || comp->movedFrom == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if (-1 == MYS_compactPath(storage, name, ".idx")) {
+    return -1;
+  }
+  comp->newIndexFd = open(name, O_RDWR | O_CREAT | O_TRUNC,
+                          S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (comp->newIndexFd < 0 || -1 == MYS_compactPath(storage, name, "")) {
+    return -1;
+  }
+  comp->newFd = open(name, O_RDWR | O_CREAT | O_TRUNC,
+                     S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  return comp->newFd < 0 ? -1 : 0;
+}
+
+/**
+ * Copy the current version of block "blockNo" to the end of the new file as
+ * it is, without decompressing it. Blocks without present records are left
+ * out, they read as zeros.
+ * @return -1 in case of I/O error. 0 success.
+ */
+static int moveBlock(COMPRESSED_t *comp, MYSTORAGE_t *storage,
+                     unsigned int blockNo) {
+  BLOCKINDEX_t entry = comp->index[blockNo];
+  int present = 0;
+
+  comp->movedFrom[blockNo] = entry;
+  memset(&comp->moved[blockNo], 0, sizeof(BLOCKINDEX_t));
+  for (unsigned int i = 0; i < MYCOMP_BLOCKRECORDS && !present; i++) {
+    present = MYS_isPresent(storage, blockNo * MYCOMP_BLOCKRECORDS + i);
+  }
+  if (entry.length == 0 || !present) {
+    return 0;
+  }
+
+  if (entry.length > sizeof(comp->scratch) ||
+      -1 == MYS_pread(storage, comp->scratch, entry.length, entry.offset) ||
+      -1 == MYS_pwriteFd(storage, comp->newFd, comp->scratch, entry.length,
+                         comp->newEnd)) {
+    return -1;
+  }
+  comp->moved[blockNo].offset = comp->newEnd;
+  comp->moved[blockNo].length = entry.length;
+  comp->moved[blockNo].flags = entry.flags;
+  comp->newEnd += entry.length;
+  return 0;
+}
+
+/**
+ * Grow an index of a compaction from "blocks" to "newBlocks" entries, the new
+ * ones empty.
+ * @return -1 if there is no memory. 0 success.
+ */
+static int growMoved(BLOCKINDEX_t **index, unsigned int blocks,
+                     unsigned int newBlocks) {
+  BLOCKINDEX_t *grown = realloc(*index, newBlocks * sizeof(BLOCKINDEX_t));
+
+  if (grown == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  memset(grown + blocks, 0, (newBlocks - blocks) * sizeof(BLOCKINDEX_t));
+  *index = grown;
+  return 0;
+}
+
+/**
+ * Copy again the blocks written since they were copied, write the new index
+ * and rename both files over the old ones. The descriptors are opened before
+ * the renames, so after the commit the table uses the new files even if the
+ * second rename fails: the next open finishes it.
+ * @return -1 in case of error before the commit. 0 success.
+ */
+static int finishCompaction(COMPRESSED_t *comp, MYSTORAGE_t *storage) {
+  char name[PATH_MAX];
+  char indexName[PATH_MAX];
+  char newName[PATH_MAX];
+  char newIndexName[PATH_MAX];
+  unsigned int used = 0;
+
+  for (int i = 0; i < MYCOMP_CACHEDBLOCKS; i++) {
+    if (comp->frames[i].dirty && -1 == writeBlock(storage, &comp->frames[i])) {
+      return -1;
+    }
+  }
+
+  /* Blocks written for the first time since the compaction began. */
+  if (comp->blocks > comp->movedBlocks) {
+    if (-1 == growMoved(&comp->moved, comp->movedBlocks, comp->blocks) ||
+        -1 == growMoved(&comp->movedFrom, comp->movedBlocks, comp->blocks)) {
+      return -1;
+    }
+    comp->movedBlocks = comp->blocks;
+  }
+  for (unsigned int i = 0; i < comp->movedBlocks; i++) {
+    if (0 != memcmp(&comp->index[i], &comp->movedFrom[i],
+                    sizeof(BLOCKINDEX_t)) &&
+        -1 == moveBlock(comp, storage, i)) {
+      return -1;
+    }
+    if (comp->moved[i].length > 0) {
+      used = i + 1;
+    }
+  }
+
+  if (-1 == MYS_pwriteFd(storage, comp->newIndexFd, comp->moved,
+                         used * sizeof(BLOCKINDEX_t), 0) ||
+      -1 == fdatasync(comp->newFd) || -1 == fdatasync(comp->newIndexFd) ||
+      -1 == MYS_compactPath(storage, newName, "") ||
+      -1 == MYS_compactPath(storage, newIndexName, ".idx")) {
+    return -1;
+  }
+  snprintf(name, sizeof(name), "%s", storage->filename);
+  snprintf(indexName, sizeof(indexName), "%s.idx", storage->filename);
+
+  int fd = open(newName, O_SYNC | O_RDWR);
+  int indexFd = fd < 0 ? -1 : open(newIndexName, O_SYNC | O_RDWR);
+  if (indexFd < 0 || -1 == rename(newIndexName, indexName)) {
+    int error = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (indexFd >= 0) {
+      close(indexFd);
+    }
+    errno = error;
+    return -1;
+  }
+  rename(newName, name);
+
+  dup2(fd, storage->fd);
+  dup2(indexFd, comp->indexFd);
+  close(fd);
+  close(indexFd);
+  close(comp->newFd);
+  close(comp->newIndexFd);
+  free(comp->index);
+  free(comp->movedFrom);
+  comp->index = comp->moved;
+  comp->blocks = comp->movedBlocks;
+  comp->end = comp->newEnd;
+  comp->moved = comp->movedFrom = NULL;
+  comp->newFd = comp->newIndexFd = -1;
+  return 0;
+}
+
+static int compressedCompact(MYSTORAGE_t *storage, unsigned int blocks) {
+  COMPRESSED_t *comp = storage->state;
+  int status = 1;
+
+  pthread_mutex_lock(&comp->lock);
+  if (comp->newFd < 0 && -1 == beginCompaction(comp, storage)) {
+    status = -1;
+  }
+  uint64_t from = comp->newEnd;
+  for (unsigned int i = 0;
+       1 == status && i < blocks && comp->cursor < comp->movedBlocks; i++) {
+    if (-1 == moveBlock(comp, storage, comp->cursor++)) {
+      status = -1;
+    }
+  }
+  /* Start writing the copy now, the last step only waits for the rest. */
+  if (1 == status && comp->newEnd > from) {
+    sync_file_range(comp->newFd, from, comp->newEnd - from,
+                    SYNC_FILE_RANGE_WRITE);
+  }
+  if (1 == status && comp->cursor >= comp->movedBlocks) {
+    status = finishCompaction(comp, storage);
+  }
+  if (-1 == status) {
+    int error = errno;
+    abandonCompaction(comp, storage);
+    errno = error;
+  }
+  pthread_mutex_unlock(&comp->lock);
+  return status;
+}
+
+const MYSTORAGE_OPS_t MYS_COMPRESSED = {
+    "compressed",     compressedOpen,   compressedClose, compressedRead,
+    compressedWrite,  compressedSync,   NULL,            NULL,
+    compressedSpace,  NULL,             NULL,            compressedCompact,
+    NULL};
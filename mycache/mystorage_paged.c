@@ -0,0 +1,311 @@
+#include "mycache.h"
+#include "myrecord.h"
+#include "mystorage.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Slotted page format. The file is a sequence of MYPAGE_SIZE pages and the
+ * record "index" lives in slot index % MYPAGE_SLOTS of page
+ * index / MYPAGE_SLOTS. Each page starts with a header and the directory of
+ * its slots; the payloads grow from the end of the page towards it:
+ *
+ *   | header | slot 0 | ... | slot 63 | free space | payloads |
+ *
+ * A slot holds the offset and length of a payload of any size up to
+ * MYPAGE_MAXPAYLOAD, so records are not limited to a fixed size. A length of
+ * 0 means the record is absent. Pages are read and written whole, through a
+ * small LRU cache of MYPAGE_CACHEDPAGES frames. A page left without records
+ * is punched out of the file and reads back empty.
+ */
+
+#define MYPAGE_SIZE 4096
+#define MYPAGE_SLOTS 64
+#define MYPAGE_MAXPAYLOAD MYC_BLOBMAX
+#define MYPAGE_CACHEDPAGES 16
+#define MYPAGE_MAGIC 0x4750594d /* "MYPG" */
+#define MYPAGE_UNUSED ((unsigned int)-1)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t pageNo;
+  uint16_t dataStart; /* Offset of the lowest payload. */
+  uint16_t liveBytes; /* Bytes used by the payloads of the slots. */
+  uint32_t reserved;
+} MYPAGE_HEADER_t;
+
+typedef struct {
+  uint16_t offset;
+  uint16_t length;
+} MYPAGE_SLOT_t;
+
+#define MYPAGE_DATABEGIN                                                       \
+  (sizeof(MYPAGE_HEADER_t) + MYPAGE_SLOTS * sizeof(MYPAGE_SLOT_t))
+#define MYPAGE_CAPACITY (MYPAGE_SIZE - MYPAGE_DATABEGIN)
+
+/* Records are stored without their trailing zero bytes, as the unused tail
+ * of a name, and read back with them: every byte of the record round-trips,
+ * whatever its layout, and the checksums see what was written. */
+
+typedef struct {
+  unsigned int pageNo;
+  int dirty;
+  unsigned long lastUse;
+  unsigned char data[MYPAGE_SIZE];
+} FRAME_t;
+
+typedef struct {
+  pthread_mutex_t lock; /* The warm start thread reads without cache lock. */
+  unsigned long clock;
+  FRAME_t frames[MYPAGE_CACHEDPAGES];
+} PAGED_t;
+
+#define pageHeader(f) ((MYPAGE_HEADER_t *)(f)->data)
+#define pageSlot(f, s)                                                         \
+  ((MYPAGE_SLOT_t *)((f)->data + sizeof(MYPAGE_HEADER_t)) + (s))
+
+static void initPage(FRAME_t *frame, unsigned int pageNo) {
+  memset(frame->data, 0, MYPAGE_SIZE);
+  pageHeader(frame)->magic = MYPAGE_MAGIC;
+  pageHeader(frame)->pageNo = pageNo;
+  pageHeader(frame)->dataStart = MYPAGE_SIZE;
+}
+
+static int writePage(MYSTORAGE_t *storage, FRAME_t *frame) {
+  if (-1 == MYS_pwrite(storage, frame->data, MYPAGE_SIZE,
+                       (off_t)frame->pageNo * MYPAGE_SIZE)) {
+    return -1;
+  }
+  frame->dirty = 0;
+  return 0;
+}
+
+/**
+ * Return the frame holding page "pageNo", reading it if it is not cached.
+ * A page never written (a hole or beyond the end of file) is initialized
+ * empty. The least recently used frame is evicted, written if dirty.
+ * @return NULL in case of I/O error or a corrupted page.
+ */
+static FRAME_t *getPage(MYSTORAGE_t *storage, unsigned int pageNo) {
+  PAGED_t *paged = storage->state;
+  FRAME_t *victim = &paged->frames[0];
+
+  for (int i = 0; i < MYPAGE_CACHEDPAGES; i++) {
+    FRAME_t *frame = &paged->frames[i];
+    if (frame->pageNo == pageNo) {
+      frame->lastUse = ++paged->clock;
+      return frame;
+    }
+    if (frame->pageNo == MYPAGE_UNUSED ||
+        (victim->pageNo != MYPAGE_UNUSED && frame->lastUse < victim->lastUse)) {
+      victim = frame;
+    }
+  }
+
+  if (victim->dirty && -1 == writePage(storage, victim)) {
+    return NULL;
+  }
+
+  victim->pageNo = MYPAGE_UNUSED;
+  if (-1 == MYS_pread(storage, victim->data, MYPAGE_SIZE,
+                      (off_t)pageNo * MYPAGE_SIZE)) {
+    return NULL;
+  }
+
+  if (pageHeader(victim)->magic == 0) {
+    initPage(victim, pageNo);
+  } else if (pageHeader(victim)->magic != MYPAGE_MAGIC ||
+             pageHeader(victim)->pageNo != pageNo) {
+    errno = EIO;
+    return NULL;
+  }
+
+  victim->pageNo = pageNo;
+  victim->lastUse = ++paged->clock;
+  return victim;
+}
+
+/**
+ * Move the payloads of a page together at its end, so all the free space is
+ * contiguous.
+ */
+static void compactPage(FRAME_t *frame) {
+  unsigned char copy[MYPAGE_SIZE];
+  uint16_t dataStart = MYPAGE_SIZE;
+
+  memcpy(copy, frame->data, MYPAGE_SIZE);
+  for (int i = 0; i < MYPAGE_SLOTS; i++) {
+    MYPAGE_SLOT_t *slot = pageSlot(frame, i);
+    if (slot->length > 0) {
+      dataStart -= slot->length;
+      memcpy(frame->data + dataStart, copy + slot->offset, slot->length);
+      slot->offset = dataStart;
+    }
+  }
+  pageHeader(frame)->dataStart = dataStart;
+}
+
+/**
+ * Store a payload in a slot of a page, in place if it is not longer than the
+ * current one, or in the free space, compacting the page if needed.
+ * @return -1 with errno ENOSPC if the page cannot hold it. 0 success.
+ */
+static int putPayload(FRAME_t *frame, int s, const void *payload,
+                      size_t length) {
+  MYPAGE_HEADER_t *header = pageHeader(frame);
+  MYPAGE_SLOT_t *slot = pageSlot(frame, s);
+
+  if (length > MYPAGE_MAXPAYLOAD ||
+      header->liveBytes - slot->length + length > MYPAGE_CAPACITY) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  header->liveBytes -= slot->length;
+  if (length == 0 || length > slot->length) {
+    slot->length = 0;
+    if ((size_t)header->dataStart < MYPAGE_DATABEGIN + length) {
+      compactPage(frame);
+    }
+    header->dataStart -= length;
+    slot->offset = header->dataStart;
+  }
+  memcpy(frame->data + slot->offset, payload, length);
+  slot->length = length;
+  header->liveBytes += length;
+  frame->dirty = 1;
+  return 0;
+}
+
+static int pagedOpen(MYSTORAGE_t *storage, const char *filename) {
+  PAGED_t *paged = calloc(1, sizeof(PAGED_t));
+
+  if (paged == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  pthread_mutex_init(&paged->lock, NULL);
+  for (int i = 0; i < MYPAGE_CACHEDPAGES; i++) {
+    paged->frames[i].pageNo = MYPAGE_UNUSED;
+  }
+  storage->state = paged;
+  return 0;
+}
+
+static int pagedSync(MYSTORAGE_t *storage) {
+  PAGED_t *paged = storage->state;
+  int status = 0;
+
+  pthread_mutex_lock(&paged->lock);
+  for (int i = 0; i < MYPAGE_CACHEDPAGES && 0 == status; i++) {
+    if (paged->frames[i].dirty) {
+      status = writePage(storage, &paged->frames[i]);
+    }
+  }
+  pthread_mutex_unlock(&paged->lock);
+  return status;
+}
+
+static int pagedClose(MYSTORAGE_t *storage) {
+  int status = pagedSync(storage);
+  PAGED_t *paged = storage->state;
+
+  pthread_mutex_destroy(&paged->lock);
+  free(paged);
+  storage->state = NULL;
+
+  if (-1 == close(storage->fd)) {
+    status = -1;
+  }
+  return status;
+}
+
+static int pagedReadBlob(MYSTORAGE_t *storage, unsigned int index,
+                         void *buffer, size_t size) {
+  PAGED_t *paged = storage->state;
+  int length = -1;
+
+  pthread_mutex_lock(&paged->lock);
+  FRAME_t *frame = getPage(storage, index / MYPAGE_SLOTS);
+  if (frame != NULL) {
+    MYPAGE_SLOT_t *slot = pageSlot(frame, index % MYPAGE_SLOTS);
+    length = slot->length;
+    memcpy(buffer, frame->data + slot->offset,
+           (size_t)length < size ? (size_t)length : size);
+  }
+  pthread_mutex_unlock(&paged->lock);
+  return length;
+}
+
+static int pagedWriteBlob(MYSTORAGE_t *storage, unsigned int index,
+                          const void *buffer, size_t length) {
+  PAGED_t *paged = storage->state;
+  int status = -1;
+
+  pthread_mutex_lock(&paged->lock);
+  FRAME_t *frame = getPage(storage, index / MYPAGE_SLOTS);
+  if (frame != NULL) {
+    status = putPayload(frame, index % MYPAGE_SLOTS, buffer, length);
+  }
+  pthread_mutex_unlock(&paged->lock);
+  return status;
+}
+
+static int pagedRead(MYSTORAGE_t *storage, unsigned int index,
+                     unsigned int count, void *records) {
+  for (unsigned int i = 0; i < count; i++) {
+    MYRECORD_RECORD_t *record = (MYRECORD_RECORD_t *)records + i;
+    memset(record, 0, sizeof(MYRECORD_RECORD_t));
+
+    if (-1 == pagedReadBlob(storage, index + i, record,
+                            sizeof(MYRECORD_RECORD_t))) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int pagedWrite(MYSTORAGE_t *storage, unsigned int index,
+                      const void *record) {
+  const unsigned char *bytes = record;
+  size_t length = sizeof(MYRECORD_RECORD_t);
+
+  /* At least a byte, a length of 0 is an absent record. */
+  while (length > 1 && bytes[length - 1] == 0) {
+    length--;
+  }
+
+  return pagedWriteBlob(storage, index, record, length);
+}
+
+static int pagedErase(MYSTORAGE_t *storage, unsigned int index) {
+  PAGED_t *paged = storage->state;
+  int status = -1;
+
+  pthread_mutex_lock(&paged->lock);
+  FRAME_t *frame = getPage(storage, index / MYPAGE_SLOTS);
+  if (frame != NULL) {
+    status = putPayload(frame, index % MYPAGE_SLOTS, "", 0);
+  }
+  if (0 == status && pageHeader(frame)->liveBytes == 0) {
+    if (0 == MYS_punch(storage, (off_t)frame->pageNo * MYPAGE_SIZE,
+                       MYPAGE_SIZE)) {
+      frame->dirty = 0;
+      frame->pageNo = MYPAGE_UNUSED;
+    } else if (errno != EOPNOTSUPP) {
+      status = -1;
+    }
+  }
+  pthread_mutex_unlock(&paged->lock);
+  return status;
+}
+
+const MYSTORAGE_OPS_t MYS_PAGED = {
+    "paged",   pagedOpen,     pagedClose,     pagedRead, pagedWrite,
+    pagedSync, pagedReadBlob, pagedWriteBlob, NULL,      NULL,
+    pagedErase, NULL,          NULL};
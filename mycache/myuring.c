@@ -0,0 +1,351 @@
+#include "myuring.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define URING_AVAILABLE
+#endif
+
+#ifdef URING_AVAILABLE
+
+struct MYURING {
+  int fd;
+  pthread_mutex_t lock;
+  unsigned int entries;
+  void *sqRing;
+  size_t sqRingSize;
+  unsigned int *sqHead;
+  unsigned int *sqTail;
+  unsigned int *sqMask;
+  unsigned int *sqArray;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+  void *cqRing; /* The same mapping as sqRing with IORING_FEAT_SINGLE_MMAP. */
+  size_t cqRingSize;
+  unsigned int *cqHead;
+  unsigned int *cqTail;
+  unsigned int *cqMask;
+  struct io_uring_cqe *cqes;
+  int file;      /* Registered at index 0, -1 if none. */
+  char *buffer;  /* Registered at index 0, NULL if none. */
+  size_t bufferSize;
+};
+
+static int enter(int fd, unsigned int submit, unsigned int complete) {
+  return syscall(__NR_io_uring_enter, fd, submit, complete,
+                 IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int registerRing(int fd, unsigned int opcode, void *arg,
+                        unsigned int count) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+/**
+ * Open a ring of "entries" submissions at most, rounded up by the kernel to
+ * a power of 2.
+ * @return NULL with errno set, ENOSYS if the kernel has no io_uring.
+ */
+MYURING_t *MYURING_open(unsigned int entries) {
+  struct io_uring_params params;
+  MYURING_t *ring = calloc(1, sizeof(MYURING_t));
+
+  if (ring == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  memset(&params, 0, sizeof(params));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) {
+    free(ring);
+    return NULL;
+  }
+  ring->file = -1;
+  ring->entries = params.sq_entries;
+  pthread_mutex_init(&ring->lock, NULL);
+
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cqRingSize > ring->sqRingSize) {
+      ring->sqRingSize = ring->cqRingSize;
+    }
+    ring->cqRingSize = ring->sqRingSize;
+  }
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cqRing = ring->sqRing;
+  if (ring->sqRing != MAP_FAILED &&
+      !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    ring->cqRing =
+        mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED ||
+      ring->sqes == MAP_FAILED) {
+    int error = errno;
+    MYURING_close(ring);
+    errno = error;
+    return NULL;
+  }
+
+  char *sq = ring->sqRing, *cq = ring->cqRing;
+  ring->sqHead = (unsigned int *)(sq + params.sq_off.head);
+  ring->sqTail = (unsigned int *)(sq + params.sq_off.tail);
+  ring->sqMask = (unsigned int *)(sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned int *)(sq + params.sq_off.array);
+  ring->cqHead = (unsigned int *)(cq + params.cq_off.head);
+  ring->cqTail = (unsigned int *)(cq + params.cq_off.tail);
+  ring->cqMask = (unsigned int *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  return ring;
+}
+
+/** Close a ring, which drops what was registered, and free it. */
+void MYURING_close(MYURING_t *ring) {
+  if (ring == NULL) {
+    return;
+  }
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqesSize);
+  }
+  if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED &&
+      ring->cqRing != ring->sqRing) {
+    munmap(ring->cqRing, ring->cqRingSize);
+  }
+  if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED) {
+    munmap(ring->sqRing, ring->sqRingSize);
+  }
+  close(ring->fd);
+  pthread_mutex_destroy(&ring->lock);
+  free(ring);
+}
+
+/**
+ * Register "fd", or nothing if -1, in place of the file registered before.
+ * Needed again when another file takes the number of "fd": the ring keeps
+ * the file it was given.
+ * @return -1 with errno set, nothing registered then. 0 means OK.
+ */
+int MYURING_registerFile(MYURING_t *ring, int fd) {
+  int status = 0;
+
+  pthread_mutex_lock(&ring->lock);
+  if (ring->file >= 0) {
+    registerRing(ring->fd, IORING_UNREGISTER_FILES, NULL, 0);
+    ring->file = -1;
+  }
+  if (fd >= 0) {
+    status = registerRing(ring->fd, IORING_REGISTER_FILES, &fd, 1);
+    ring->file = status < 0 ? -1 : fd;
+  }
+  pthread_mutex_unlock(&ring->lock);
+  return status < 0 ? -1 : 0;
+}
+
+/**
+ * Register "size" bytes at "buffer", or nothing if NULL, in place of the
+ * buffer registered before. Their pages stay pinned while registered: change
+ * it before the memory is freed.
+ * @return -1 with errno set, like ENOMEM beyond RLIMIT_MEMLOCK, nothing
+ * registered then. 0 means OK.
+ */
+int MYURING_registerBuffer(MYURING_t *ring, void *buffer, size_t size) {
+  int status = 0;
+
+  pthread_mutex_lock(&ring->lock);
+  if (ring->buffer != NULL) {
+    registerRing(ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    ring->buffer = NULL;
+    ring->bufferSize = 0;
+  }
+  if (buffer != NULL && size > 0) {
+    struct iovec iov = {buffer, size};
+    status = registerRing(ring->fd, IORING_REGISTER_BUFFERS, &iov, 1);
+    if (status >= 0) {
+      ring->buffer = buffer;
+      ring->bufferSize = size;
+    }
+  }
+  pthread_mutex_unlock(&ring->lock);
+  return status < 0 ? -1 : 0;
+}
+
+/** Queue "io" as the submission "index" of the batch. */
+static void prepare(MYURING_t *ring, int fd, const MYURING_IO_t *io,
+                    unsigned int index) {
+  unsigned int tail = *ring->sqTail;
+  unsigned int slot = tail & *ring->sqMask;
+  struct io_uring_sqe *sqe = &ring->sqes[slot];
+  char *buffer = io->buffer;
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  if (ring->buffer != NULL && buffer >= ring->buffer &&
+      buffer + io->size <= ring->buffer + ring->bufferSize) {
+    sqe->opcode = io->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = 0;
+  } else {
+    sqe->opcode = io->write ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+  if (fd == ring->file) {
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = fd;
+  }
+  sqe->addr = (unsigned long)buffer;
+  sqe->len = io->size;
+  sqe->off = io->offset;
+  sqe->user_data = index;
+
+  ring->sqArray[slot] = slot;
+  __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Complete "io" after its first "done" bytes with pread() or pwrite(). Like
+ * MYS_pread(), the part of a read beyond the end of the file is zeros.
+ * @return -1 with errno set. 0 means OK.
+ */
+static int finish(int fd, const MYURING_IO_t *io, size_t done) {
+  char *buffer = io->buffer;
+
+  while (done < io->size) {
+    ssize_t n = io->write ? pwrite(fd, buffer + done, io->size - done,
+                                   io->offset + done)
+                          : pread(fd, buffer + done, io->size - done,
+                                  io->offset + done);
+    if (n == 0 && !io->write) {
+      memset(buffer + done, 0, io->size - done);
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+/**
+ * Submit up to one ring of "ios" and wait for all of them.
+ * @return The errno of the first that failed, 0 if none.
+ */
+static int runBatch(MYURING_t *ring, int fd, MYURING_IO_t *ios,
+                    unsigned int count) {
+  unsigned int submitted = 0;
+  unsigned int completed = 0;
+  int error = 0;
+
+  for (unsigned int i = 0; i < count; i++) {
+    prepare(ring, fd, &ios[i], i);
+  }
+
+  while (completed < count) {
+    int n = enter(ring->fd, count - submitted, count - completed);
+    if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      if (error == 0) {
+        error = errno;
+      }
+      if (submitted == count) {
+        return error; /* Cannot wait: would fail again. */
+      }
+      /* Take back what the kernel did not take, then wait for the rest. */
+      __atomic_store_n(ring->sqTail,
+                       __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE),
+                       __ATOMIC_RELEASE);
+      count = submitted;
+      continue;
+    }
+    submitted += n > 0 ? n : 0;
+
+    unsigned int head = *ring->cqHead;
+    while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+      MYURING_IO_t *io = &ios[cqe->user_data];
+
+      if (cqe->res < 0) {
+        if (error == 0) {
+          error = -cqe->res;
+        }
+      } else if ((size_t)cqe->res < io->size &&
+                 -1 == finish(fd, io, cqe->res) && error == 0) {
+        error = errno;
+      }
+      head++;
+      completed++;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+  return error;
+}
+
+/**
+ * Make the reads and writes of "ios" on "fd", in any order and at the same
+ * time: none of them may overlap another write. They go to the kernel a ring
+ * at a time.
+ * @return -1 with the errno of the first that failed, after all of them
+ * ended. 0 means OK.
+ */
+int MYURING_run(MYURING_t *ring, int fd, MYURING_IO_t *ios,
+                unsigned int count) {
+  int error = 0;
+
+  pthread_mutex_lock(&ring->lock);
+  for (unsigned int done = 0; done < count; done += ring->entries) {
+    unsigned int batch =
+        count - done < ring->entries ? count - done : ring->entries;
+    int status = runBatch(ring, fd, ios + done, batch);
+    if (error == 0) {
+      error = status;
+    }
+  }
+  pthread_mutex_unlock(&ring->lock);
+
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+#else
+
+MYURING_t *MYURING_open(unsigned int entries) {
+  errno = ENOSYS;
+  return NULL;
+}
+
+void MYURING_close(MYURING_t *ring) {}
+
+int MYURING_registerFile(MYURING_t *ring, int fd) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int MYURING_registerBuffer(MYURING_t *ring, void *buffer, size_t size) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int MYURING_run(MYURING_t *ring, int fd, MYURING_IO_t *ios,
+                unsigned int count) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MYURING_H
+#define MYURING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batches of reads and writes through an io_uring, with the raw system
+ * calls. A batch goes to the kernel with a single io_uring_enter() that also
+ * waits for all of it. One file and one buffer may be registered: the I/O on
+ * that file, and into or from that buffer, skips looking the file up and
+ * pinning the pages on every operation. A ring is shared by the threads of a
+ * table, one batch at a time.
+ */
+
+typedef struct MYURING MYURING_t;
+
+typedef struct {
+  void *buffer;
+  size_t size;
+  off_t offset;
+  int write; /* 1 to write "buffer" to the file, 0 to read into it. */
+} MYURING_IO_t;
+
+MYURING_t *MYURING_open(unsigned int entries);
+void MYURING_close(MYURING_t *ring);
+int MYURING_registerFile(MYURING_t *ring, int fd);
+int MYURING_registerBuffer(MYURING_t *ring, void *buffer, size_t size);
+int MYURING_run(MYURING_t *ring, int fd, MYURING_IO_t *ios, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
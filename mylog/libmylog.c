@@ -0,0 +1,262 @@
+#include "mylog.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Every thread that logs gets its own single producer ring, so logging on the
+ * request path is a vsnprintf into a slot and one release store: no lock, no
+ * stdio and no syscall. The message text is formatted right away because the
+ * arguments may not outlive the call. The drainer thread formats the rest of
+ * the line (file, function, level) and writes it to stderr. The ring of a
+ * thread that exits is left to the next new thread, which goes on writing
+ * after the lines still queued there: the rings are as many as the threads
+ * that log at the same time, not as all those that ever logged.
+ * Before MYLOG_init() and after MYLOG_close() lines go straight to stderr.
+ */
+
+typedef struct {
+  int level;
+  int error;
+  const char *file;
+  const char *func;
+  char message[MYLOG_MSGLENGTH];
+} MYLOG_SLOT_t;
+
+typedef struct MYLOG_RING {
+  unsigned int head; /* Written by the owner thread only. */
+  unsigned int tail; /* Written by the drainer only. */
+  int owned;         /* A live thread writes in it, see threadRing(). */
+  unsigned long dropped;
+  struct MYLOG_RING *next;
+  MYLOG_SLOT_t slots[MYLOG_SLOTS];
+} MYLOG_RING_t;
+
+static const char *levelNames[] = {
+    "\033[0;31mERROR\033[0m", "\033[0;36mINFO\033[0m",
+    "\033[0;32mDEBUG\033[0m", "\033[0;33mVERBOSE\033[0m\033[0m"};
+
+static MYLOG_RING_t *rings = NULL;
+static __thread MYLOG_RING_t *myRing = NULL;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ringKey;
+
+static pthread_t drainer;
+static int registered = 0;
+static int running = 0;
+static volatile int stopping = 0;
+
+static const char *levelName(int level) {
+  if (level < 0 || level > 3) {
+    level = 0;
+  }
+  return levelNames[level];
+}
+
+/**
+ * Write a complete line to stderr, the way the debug_* macros used to do.
+ */
+static void printLine(int level, int error, const char *file, const char *func,
+                      const char *message) {
+  fprintf(stderr, "%s:%s()::%s %s%s\n", file, func, levelName(level), message,
+          error ? strerror(error) : "");
+}
+
+/**
+ * Destructor of ringKey: give the ring of an exiting thread up. A line it
+ * logs afterwards, from another destructor, takes a ring again.
+ */
+static void releaseRing(void *ring) {
+  myRing = NULL;
+  __atomic_store_n(&((MYLOG_RING_t *)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void createRingKey() { pthread_key_create(&ringKey, releaseRing); }
+
+/**
+ * Return the ring of the calling thread, taking the first time one given up
+ * by a thread that exited, or else creating and publishing one. The list of
+ * rings only grows, so it is pushed with a CAS.
+ * @return NULL if there is no memory for the ring.
+ */
+static MYLOG_RING_t *threadRing() {
+  if (myRing != NULL) {
+    return myRing;
+  }
+  pthread_once(&ringKeyOnce, createRingKey);
+
+  MYLOG_RING_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+  int unowned = 0;
+  for (; ring != NULL; ring = ring->next) {
+    if (__atomic_compare_exchange_n(&ring->owned, &unowned, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+    unowned = 0;
+  }
+
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(MYLOG_RING_t));
+    if (ring == NULL) {
+      return NULL;
+    }
+    ring->owned = 1;
+    ring->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    }
+  }
+  if (0 != pthread_setspecific(ringKey, ring)) {
+    __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+    return NULL;
+  }
+  myRing = ring;
+  return ring;
+}
+
+/**
+ * Move every pending message of one ring to stderr.
+ * @return The number of messages written.
+ */
+static int drainRing(MYLOG_RING_t *ring) {
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  unsigned int tail = ring->tail;
+  int count = 0;
+
+  for (; tail != head; tail++, count++) {
+    MYLOG_SLOT_t *slot = &ring->slots[tail & (MYLOG_SLOTS - 1)];
+    printLine(slot->level, slot->error, slot->file, slot->func, slot->message);
+  }
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0,
+                                              __ATOMIC_RELAXED);
+  if (dropped > 0) {
+    fprintf(stderr, "mylog::%s %lu messages dropped, ring full.\n",
+            levelName(0), dropped);
+  }
+  return count;
+}
+
+static int drainAll() {
+  int count = 0;
+
+  for (MYLOG_RING_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+       ring != NULL; ring = ring->next) {
+    count += drainRing(ring);
+  }
+  if (count > 0) {
+    fflush(stderr);
+  }
+  return count;
+}
+
+/**
+ * Body of the drainer thread. It sleeps MYLOG_IDLE_USECONDS when there was
+ * nothing to write.
+ */
+static void *drain(void *arg) {
+  while (!stopping) {
+    if (0 == drainAll()) {
+      usleep(MYLOG_IDLE_USECONDS);
+    }
+  }
+  drainAll();
+  return NULL;
+}
+
+/** Do not lose the queued lines when the process calls exit(). */
+static void closeAtExit() { MYLOG_close(); }
+
+/**
+ * Start the drainer thread. From now on log lines are queued in the rings.
+ * Call it after any fork() and any redirection of stderr.
+ * @return -1 in case of error starting the thread. 0 means OK.
+ */
+int MYLOG_init() {
+  if (running) {
+    return 0;
+  }
+
+  stopping = 0;
+  if (0 != pthread_create(&drainer, NULL, drain, NULL)) {
+    return -1;
+  }
+  __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+
+  if (!registered) {
+    atexit(closeAtExit);
+    registered = 1;
+  }
+  return 0;
+}
+
+/**
+ * Write the pending lines and stop the drainer thread.
+ * @return 0 means OK.
+ */
+int MYLOG_close() {
+  if (!running) {
+    return 0;
+  }
+
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+  stopping = 1;
+  pthread_join(drainer, NULL);
+  drainAll();
+  return 0;
+}
+
+/**
+ * Log one line. Called by the debug_* macros once the level has been checked.
+ * @param level DEBUG_* level of the line.
+ * @param withErrno Append the description of errno, like perror.
+ * @param file Source file, must be a string literal.
+ * @param func Function name, must be a string literal.
+ */
+void MYLOG_write(int level, int withErrno, const char *file, const char *func,
+                 const char *format, ...) {
+  int savedErrno = errno;
+  int error = withErrno ? errno : 0;
+  MYLOG_RING_t *ring = NULL;
+  va_list args;
+
+  if (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+    ring = threadRing();
+  }
+
+  if (ring == NULL) {
+    char message[MYLOG_MSGLENGTH];
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    printLine(level, error, file, func, message);
+    errno = savedErrno;
+    return;
+  }
+
+  unsigned int head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= MYLOG_SLOTS) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    errno = savedErrno;
+    return;
+  }
+
+  MYLOG_SLOT_t *slot = &ring->slots[head & (MYLOG_SLOTS - 1)];
+  slot->level = level;
+  slot->error = error;
+  slot->file = file;
+  slot->func = func;
+
+  va_start(args, format);
+  vsnprintf(slot->message, sizeof(slot->message), format, args);
+  va_end(args);
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  errno = savedErrno;
+}
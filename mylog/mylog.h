@@ -0,0 +1,23 @@
+#ifndef MYLOG_H
+#define MYLOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MYLOG_SLOTS 1024       /* Messages per thread ring, a power of two. */
+#define MYLOG_MSGLENGTH 240    /* Longest message kept, including the '\0'. */
+#define MYLOG_IDLE_USECONDS 1000
+
+int MYLOG_init();
+int MYLOG_close();
+
+void MYLOG_write(int level, int withErrno, const char *file, const char *func,
+                 const char *format, ...)
+    __attribute__((format(printf, 5, 6)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
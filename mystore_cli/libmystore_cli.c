@@ -12,38 +12,426 @@
 
 #define SEND_TO_SERVER 1
 
-static int message_queue = -1;
+/* Exponential backoff of a client when the server is busy: the delay doubles
+ * from the hint of the server, or from BACKOFF_US, up to BACKOFF_MAX_US, and
+ * a request is retried MAX_RETRIES times at most. */
+#define BACKOFF_US 100
+#define BACKOFF_MAX_US 10000
+#define MAX_RETRIES 40
+
+/* A point of the consistent hashing ring, owned by a partition. */
+typedef struct {
+  uint32_t hash;
+  int partition;
+} VNODE_t;
+
+typedef struct {
+  int size;
+  VNODE_t nodes[MYSTORE_MAXPARTITIONS * MYSTORE_VNODES];
+} RING_t;
+
+/* A record of the near cache, read with a lease that ends at "expires". The
+ * records are chained in buckets by index and kept in LRU order. */
+typedef struct {
+  int table;
+  int index;
+  uint64_t expires;
+  int newer; /* LRU list, -1 at both ends. */
+  int older;
+  int next; /* Chain of the bucket, or of the free slots. */
+  MYRECORD_RECORD_t record;
+} NEAR_t;
+
+/* A connection to the servers. */
+struct STORC_CLIENT {
+  unsigned int id; /* Tells its answers from those of the others, see
+                    * clientId(). 0 for the default client. */
+
+  /* Queue of every partition, a single one when the server is not
+   * partitioned. */
+  int message_queue[MYSTORE_MAXPARTITIONS];
+  int partitions;
+  RING_t ring;
+
+  /* Ids in every partition of the snapshots opened in partitioned mode. */
+  int snapshots[MYC_MAXSNAPSHOTS][MYSTORE_MAXPARTITIONS];
+  int snapshotOpen[MYC_MAXSNAPSHOTS];
+
+  NEAR_t *nearSlots;
+  int *nearBuckets;
+  unsigned int nearEntries;
+  unsigned int nearMask;
+  int nearNewest;
+  int nearOldest;
+  int nearFree;
+  STORC_NEARSTATS_t nearStats;
+
+  unsigned int backoffSeed;
+  int priority;
+  uint64_t timeout; /* Of the requests, 0 for no deadline. */
+};
+
+#define CLIENT_INITIALIZER                                                     \
+  {                                                                            \
+    .message_queue = {-1}, .nearNewest = -1, .nearOldest = -1, .nearFree = -1, \
+    .priority = MYSPRIO_INTERACTIVE                                            \
+  }
+
+/* The client of STORC_init() and the rest of the calls of a thread, the
+ * default one unless the thread selects another with STORC_select(). */
+static STORC_CLIENT_t defaultClient = CLIENT_INITIALIZER;
+static __thread STORC_CLIENT_t *client = &defaultClient;
+static unsigned int lastId = 0;
 
 static int debug_level = DEBUG_INIT;
 
 /**
- * Initialize the client API: open message queue, etc.
- * @return -1 in case of error during initialization. 0 means OK.
+ * Id of the current client in the requests, the type of the messages of its
+ * answers and invalidations. The pid for the default client, so that it is
+ * the same as before there were more; the others add theirs above the bits of
+ * a pid, and below those of MYSTORE_INVALIDATE().
  */
-int STORC_init() {
+static long clientId() {
+  return (long)getpid() | ((long)client->id << 40);
+}
+
+/**
+ * Sleep before the retry number "attempt", a random time between half and
+ * all of the backoff so that clients refused together do not come back
+ * together.
+ */
+static void backoff(unsigned int hint, int attempt) {
+  uint64_t delay = hint > BACKOFF_US ? hint : BACKOFF_US;
+
+  if (client->backoffSeed == 0) {
+    client->backoffSeed = (unsigned int)getpid() ^ (unsigned int)myh_now();
+  }
+  while (attempt-- > 0 && delay < BACKOFF_MAX_US) {
+    delay *= 2;
+  }
+  if (delay > BACKOFF_MAX_US) {
+    delay = BACKOFF_MAX_US;
+  }
+  usleep(delay / 2 + rand_r(&client->backoffSeed) % (delay / 2 + 1));
+}
+
+/** Scatter the bits of "value", so near indices land far in the ring. */
+static uint32_t mix(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x85ebca6b;
+  value ^= value >> 13;
+  value *= 0xc2b2ae35;
+  value ^= value >> 16;
+  return value;
+}
+
+static int compareVnodes(const void *a, const void *b) {
+  uint32_t x = ((const VNODE_t *)a)->hash, y = ((const VNODE_t *)b)->hash;
+  return (x > y) - (x < y);
+}
+
+/** Place MYSTORE_VNODES points of each of "count" partitions in the ring. */
+static void buildRing(RING_t *r, int count) {
+  r->size = 0;
+  for (int p = 0; p < count; p++) {
+    for (int v = 0; v < MYSTORE_VNODES; v++) {
+      r->nodes[r->size].hash = mix(0x9e3779b9u * (p * MYSTORE_VNODES + v + 1));
+      r->nodes[r->size++].partition = p;
+    }
+  }
+  qsort(r->nodes, r->size, sizeof(VNODE_t), compareVnodes);
+}
+
+/** Partition owning "fileIndex": the first point of the ring after it. */
+static int route(const RING_t *r, int fileIndex) {
+  uint32_t hash = mix((uint32_t)fileIndex);
+  int low = 0, high = r->size;
+
+  if (r->size == 0) {
+    return 0;
+  }
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (r->nodes[middle].hash < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return r->nodes[low == r->size ? 0 : low].partition;
+}
+
+static int *nearBucket(int table, int fileIndex) {
+  return &client->nearBuckets[mix((uint32_t)fileIndex ^ 0x9e3779b9u * table) &
+                              client->nearMask];
+}
+
+static int nearFind(int table, int fileIndex) {
+  int slot = *nearBucket(table, fileIndex);
+
+  while (slot != -1 &&
+         (client->nearSlots[slot].table != table ||
+          client->nearSlots[slot].index != fileIndex)) {
+    slot = client->nearSlots[slot].next;
+  }
+  return slot;
+}
+
+static void nearUnlinkLRU(int slot) {
+  NEAR_t *entry = &client->nearSlots[slot];
+
+  if (entry->newer != -1) {
+    client->nearSlots[entry->newer].older = entry->older;
+  } else {
+    client->nearNewest = entry->older;
+  }
+  if (entry->older != -1) {
+    client->nearSlots[entry->older].newer = entry->newer;
+  } else {
+    client->nearOldest = entry->newer;
+  }
+}
+
+static void nearPushLRU(int slot) {
+  client->nearSlots[slot].newer = -1;
+  client->nearSlots[slot].older = client->nearNewest;
+  if (client->nearNewest != -1) {
+    client->nearSlots[client->nearNewest].newer = slot;
+  } else {
+    client->nearOldest = slot;
+  }
+  client->nearNewest = slot;
+}
+
+/** Drop a record from the near cache and give its slot back. */
+static void nearRemove(int slot) {
+  NEAR_t *entry = &client->nearSlots[slot];
+  int *link = nearBucket(entry->table, entry->index);
+
+  while (*link != slot) {
+    link = &client->nearSlots[*link].next;
+  }
+  *link = entry->next;
+  nearUnlinkLRU(slot);
+
+  entry->next = client->nearFree;
+  client->nearFree = slot;
+}
+
+/** Drop the record at "fileIndex" if it is in the near cache. */
+static void nearForget(int table, int fileIndex) {
+  if (client->nearSlots != NULL) {
+    int slot = nearFind(table, fileIndex);
+    if (slot != -1) {
+      nearRemove(slot);
+    }
+  }
+}
+
+/** Keep a record read with a lease, evicting the least recently used. */
+static void nearInsert(int table, int fileIndex,
+                       const MYRECORD_RECORD_t *record, uint64_t expires) {
+  int slot = nearFind(table, fileIndex);
 
-  key_t key = IPC_PRIVATE;
-  key = (key_t)getuid();
+  if (slot != -1) {
+    nearUnlinkLRU(slot);
+  } else {
+    if (client->nearFree == -1) {
+      nearRemove(client->nearOldest);
+    }
+    slot = client->nearFree;
+    client->nearFree = client->nearSlots[slot].next;
+
+    int *bucket = nearBucket(table, fileIndex);
+    client->nearSlots[slot].table = table;
+    client->nearSlots[slot].index = fileIndex;
+    client->nearSlots[slot].next = *bucket;
+    *bucket = slot;
+  }
 
+  client->nearSlots[slot].expires = expires;
+  memcpy(&client->nearSlots[slot].record, record, sizeof(MYRECORD_RECORD_t));
+  nearPushLRU(slot);
+}
+
+/** Drop the records of "table" from "fileIndex" on, "count" of them. */
+static void nearForgetRange(int table, int fileIndex, int count) {
+  int slot = client->nearNewest;
+
+  while (client->nearSlots != NULL && slot != -1) {
+    int older = client->nearSlots[slot].older;
+    if (client->nearSlots[slot].table == table &&
+        client->nearSlots[slot].index >= fileIndex &&
+        client->nearSlots[slot].index - fileIndex < count) {
+      nearRemove(slot);
+    }
+    slot = older;
+  }
+}
+
+/** Apply the invalidations the servers have sent to this client. */
+static void nearDrain() {
+  invalidate_message_t message;
+
+  for (int p = 0; p < client->partitions; p++) {
+    while (-1 != msgrcv(client->message_queue[p], &message,
+                        sizeof(invalidate_message_t) - sizeof(long),
+                        MYSTORE_INVALIDATE(clientId()), IPC_NOWAIT)) {
+      int slot = nearFind(message.table, message.index);
+      if (slot != -1) {
+        nearRemove(slot);
+        client->nearStats.invalidations++;
+      }
+    }
+  }
+}
+
+/**
+ * Open the queue of a server.
+ * @return -1 in case of error. The id of the queue otherwise.
+ */
+static int openQueue(key_t key) {
   debug_verbose("Opening message queue in client API. (key=0x%08x)", key);
-  message_queue = msgget(key, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  int queue = msgget(key, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 
-  if (-1 == message_queue) {
+  if (-1 == queue) {
     switch (errno) {
     case EACCES:
       debug_error("Client has no permission to access the IPC queue");
       break;
     case ENOENT:
-      debug_error("Server is not running");
+      debug_error("Server is not running (key=0x%08x)", key);
       break;
     }
     return -1;
   }
 
   debug_info("Message queue opened in client API. (key=0x%08x)", key);
+  return queue;
+}
+
+/**
+ * Initialize the client API: open message queue, etc. With MYSTORE_PARTITIONS
+ * in the environment it connects to a cluster of that many partitions.
+ * @return -1 in case of error during initialization. 0 means OK.
+ */
+int STORC_init() {
+  const char *count = getenv(MYSTORE_PARTITIONS_ENV);
+  const char *entries = getenv(STORC_NEARCACHE_ENV);
+
+  if (-1 == STORC_initPartitions(count != NULL ? atoi(count) : 0)) {
+    return -1;
+  }
+  return STORC_nearCache(entries != NULL ? strtoul(entries, NULL, 10) : 0);
+}
+
+/**
+ * Keep up to "entries" records read in a cache of the client, 0 disables it.
+ * Reads of them are answered without asking the server while their lease
+ * lasts, unless the server sends an invalidation because they were written.
+ * @return -1 if there is no memory. 0 means OK.
+ */
+int STORC_nearCache(unsigned int entries) {
+  free(client->nearSlots);
+  free(client->nearBuckets);
+  client->nearSlots = NULL;
+  client->nearBuckets = NULL;
+  client->nearNewest = client->nearOldest = client->nearFree = -1;
+  client->nearEntries = entries;
+  memset(&client->nearStats, 0, sizeof(STORC_NEARSTATS_t));
+
+  if (entries == 0) {
+    return 0;
+  }
+
+  client->nearMask = 1;
+  while (client->nearMask < 2 * entries) {
+    client->nearMask *= 2;
+  }
+  client->nearSlots = malloc(entries * sizeof(NEAR_t));
+  client->nearBuckets = malloc(client->nearMask * sizeof(int));
+  if (client->nearSlots == NULL || client->nearBuckets == NULL) {
+    debug_error("No memory for a near cache of %u entries.", entries);
+    free(client->nearSlots);
+    free(client->nearBuckets);
+    client->nearSlots = NULL;
+    client->nearBuckets = NULL;
+    return -1;
+  }
+  memset(client->nearBuckets, -1, client->nearMask * sizeof(int));
+  client->nearMask--;
+  for (unsigned int i = 0; i < entries; i++) {
+    client->nearSlots[i].next = i + 1 < entries ? (int)i + 1 : -1;
+  }
+  client->nearFree = 0;
+
+  /* Invalidations left by a previous cache are about records not cached. */
+  nearDrain();
+  memset(&client->nearStats, 0, sizeof(STORC_NEARSTATS_t));
+  return 0;
+}
+
+/**
+ * Set the priority class of the reads and writes sent from now on, like
+ * MYSPRIO_BULK for a loader that must not delay interactive clients.
+ * @return -1 if it is not a MYSTORE_PRIORITY. 0 means OK.
+ */
+int STORC_setPriority(int newPriority) {
+  if (newPriority != MYSPRIO_INTERACTIVE && newPriority != MYSPRIO_BULK) {
+    return -1;
+  }
+  client->priority = newPriority;
   return 0;
 }
 
+/**
+ * Give the reads and writes sent from now on a deadline "nanoseconds" after
+ * they are first sent, 0 for none. Those still waiting in the server, or
+ * still refused as busy, by then are answered MYSTORE_EXPIRED.
+ */
+void STORC_setDeadline(uint64_t nanoseconds) { client->timeout = nanoseconds; }
+
+/** Copy the counters of the near cache of this client. */
+void STORC_nearStats(STORC_NEARSTATS_t *stats) {
+  memcpy(stats, &client->nearStats, sizeof(STORC_NEARSTATS_t));
+}
+
+/**
+ * Initialize the client API for a cluster of "count" partitions, each server
+ * owning the indices that hash to it. 0 is a single server, not partitioned.
+ * @return -1 in case of error during initialization. 0 means OK.
+ */
+int STORC_initPartitions(int count) {
+  if (count < 0 || count > MYSTORE_MAXPARTITIONS) {
+    debug_error("Invalid number of partitions %d.", count);
+    return -1;
+  }
+
+  if (count == 0) {
+    client->message_queue[0] = openQueue(MYSTORE_API_KEY);
+    client->partitions = 1;
+    client->ring.size = 0;
+    return client->message_queue[0] == -1 ? -1 : 0;
+  }
+
+  for (int p = 0; p < count; p++) {
+    client->message_queue[p] = openQueue(MYSTORE_PARTITION_KEY(p));
+    if (-1 == client->message_queue[p]) {
+      return -1;
+    }
+  }
+  client->partitions = count;
+  buildRing(&client->ring, count);
+  memset(client->snapshotOpen, 0, sizeof(client->snapshotOpen));
+  return 0;
+}
+
+/**
+ * Partition of the cluster owning "fileIndex", so that the writes of a
+ * transaction can be grouped by partition. Always 0 without partitions.
+ */
+int STORC_partition(int fileIndex) { return route(&client->ring, fileIndex); }
+
 /**
  * This function finishes the client API. You should not remove the queue in
  * the client as thre may be more clients.
@@ -57,32 +445,80 @@ int STORC_close() {
    * SYSTEM V MESSAGE QUEUE IF YOU "CLOSE" IT, IT WOULD BE REMOVED FROM THE
    * SYSTEM.
    */
-  message_queue = -1;
+  STORC_nearCache(0);
+  for (int p = 0; p < client->partitions; p++) {
+    client->message_queue[p] = -1;
+  }
+  client->partitions = 0;
   return 0;
 }
 
 /**
- * This function reads a record from the store server.
- * @param fileIndex This is the index of the record to read.
- * @param record This is a pointer to a record allocated by the user.
- * @return Return the status from the server. 0 is OK.
+ * Create a client of its own, not initialized: select it with STORC_select()
+ * to STORC_init() it and send requests through it. It has its own queues,
+ * near cache, priority and deadline, and its answers do not mix with those of
+ * the other clients of the process, so that several threads may use one each
+ * at the same time. A client is used by one thread at a time.
+ * @return NULL if there is no memory.
  */
-int STORC_read(int fileIndex, MYRECORD_RECORD_t *record) {
+STORC_CLIENT_t *STORC_newClient() {
+  STORC_CLIENT_t *created = malloc(sizeof(STORC_CLIENT_t));
 
-  answer_message_t answer;
-  request_message_t request;
+  if (created == NULL) {
+    debug_error("No memory for a client.");
+    return NULL;
+  }
+  *created = (STORC_CLIENT_t)CLIENT_INITIALIZER;
+  created->id = __atomic_add_fetch(&lastId, 1, __ATOMIC_RELAXED);
+  return created;
+}
 
-  request.mtype = SEND_TO_SERVER;
-  request.requested_op = MYSCOP_READ;
-  request.return_to = getpid();
-  memcpy(&(request.data), record, sizeof(MYRECORD_RECORD_t));
-  request.index = fileIndex;
+/**
+ * Close and free a client of STORC_newClient(). The thread that has it
+ * selected goes back to the default client.
+ */
+void STORC_freeClient(STORC_CLIENT_t *freed) {
+  if (freed == NULL || freed == &defaultClient) {
+    return;
+  }
+
+  STORC_CLIENT_t *previous = STORC_select(freed);
+  STORC_close();
+  STORC_select(previous == freed ? NULL : previous);
+  free(freed);
+}
+
+/**
+ * Send the calls of this thread from now on through "selected", or through
+ * the default client if it is NULL.
+ * @return The client selected until now.
+ */
+STORC_CLIENT_t *STORC_select(STORC_CLIENT_t *selected) {
+  STORC_CLIENT_t *previous = client;
+
+  client = selected != NULL ? selected : &defaultClient;
+  return previous;
+}
+
+/**
+ * Send a request to the server of a partition once and wait for its answer.
+ * @return -1 in case of error with the queue. 0 means OK.
+ */
+static int sendOnce(int partition, request_message_t *request,
+                    size_t requestSize, void *answer, size_t answerSize) {
 
   int status;
+  int queue = client->message_queue[partition];
+
+  request->mtype = SEND_TO_SERVER;
+  request->return_to = clientId();
+  request->sent = myh_now();
 
-  debug_verbose("Sending request to server (idx=%d).", fileIndex);
+  /* A full queue blocks the client: the server reads requests whenever the
+   * queue is full, to answer MYSTORE_BUSY beyond its budget. */
+  debug_verbose("Sending request to server (idx=%d).", request->index);
   do {
-    status = msgsnd(message_queue, &request, sizeof(request_message_t), 0);
+    status = msgsnd(queue, request, requestSize - sizeof(long), 0);
 
     if (-1 != status) {
       break;
@@ -92,16 +528,17 @@ int STORC_read(int fileIndex, MYRECORD_RECORD_t *record) {
       perror("Message queue is removed");
       return -1;
     }
-
-    perror("Error sending message, retrying");
+    if (errno != EINTR) {
+      perror("Error sending message, retrying");
+    }
 
   } while (1);
 
   debug_verbose("Receiving answer from server (client id=%ld).",
-                request.return_to);
+                request->return_to);
   do {
-    status =
-        msgrcv(message_queue, &answer, sizeof(answer_message_t), getpid(), 0);
+    status = msgrcv(queue, answer, answerSize - sizeof(long),
+                    request->return_to, 0);
 
     if (-1 != status) {
       break;
@@ -115,77 +552,826 @@ int STORC_read(int fileIndex, MYRECORD_RECORD_t *record) {
 
   } while (1);
 
+  return 0;
+}
+
+/**
+ * Send a request of "requestSize" bytes to the server of a partition and wait
+ * for its answer, which is received in a buffer of "answerSize" bytes. Both
+ * sizes include the mtype, which msgsnd() and msgrcv() do not count. While
+ * the queue is full or the server refuses it as MYSTORE_BUSY the client backs
+ * off and tries again, until the deadline of the request if it has one. Only
+ * the requests on records have one, and their status is never a count or an
+ * id, so a request refused as MYSTORE_EXPIRED gets it as its status.
+ * @return -1 in case of error with the queue or if the server stays busy.
+ * 0 means OK.
+ */
+static int sendRequest(int partition, request_message_t *request,
+                       size_t requestSize, void *answer, size_t answerSize) {
+
+  /* Only the requests on records wait behind others or expire: the answers
+   * to the rest carry ids and counters, not a status. */
+  switch (request->requested_op) {
+  case MYSCOP_READ:
+  case MYSCOP_WRITE:
+  case MYSCOP_DELETE:
+  case MYSCOP_COMMIT:
+  case MYSCOP_SNAPREAD:
+    request->priority = client->priority;
+    request->deadline = client->timeout ? myh_now() + client->timeout : 0;
+    break;
+  default:
+    request->priority = MYSPRIO_INTERACTIVE;
+    request->deadline = 0;
+    break;
+  }
+
+  for (int attempt = 0;; attempt++) {
+    int status = sendOnce(partition, request, requestSize, answer, answerSize);
+    answer_message_t *busy = answer;
+
+    if (0 == status && MYSTORE_EXPIRED == busy->refused) {
+      busy->status = MYSTORE_EXPIRED;
+    }
+    if (0 != status || MYSTORE_BUSY != busy->refused) {
+      return status;
+    }
+    if (request->deadline != 0 && myh_now() >= request->deadline) {
+      busy->status = MYSTORE_EXPIRED;
+      return 0;
+    }
+    if (attempt == MAX_RETRIES) {
+      debug_error("Server busy, request abandoned after %d retries.",
+                  MAX_RETRIES);
+      return -1;
+    }
+    backoff(busy->retryAfter, attempt);
+  }
+}
+
+/**
+ * This function reads a record from a table of the store server.
+ * @param table This is the id of the table in the server.
+ * @param fileIndex This is the index of the record to read.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_readTable(int table, int fileIndex, MYRECORD_RECORD_t *record) {
+
+  answer_message_t answer;
+  request_message_t request;
+
+  request.flags = 0;
+  if (client->nearSlots != NULL) {
+    nearDrain();
+    int slot = nearFind(table, fileIndex);
+    if (slot != -1 && myh_now() < client->nearSlots[slot].expires) {
+      nearUnlinkLRU(slot);
+      nearPushLRU(slot);
+      memcpy(record, &client->nearSlots[slot].record,
+             sizeof(MYRECORD_RECORD_t));
+      client->nearStats.hits++;
+      return 0;
+    }
+    if (slot != -1) {
+      nearRemove(slot);
+      client->nearStats.expirations++;
+    }
+    client->nearStats.misses++;
+    request.flags = MYSTORE_REQ_LEASE;
+  }
+
+  request.requested_op = MYSCOP_READ;
+  memcpy(&(request.data), record, sizeof(MYRECORD_RECORD_t));
+  request.table = table;
+  request.index = fileIndex;
+
+  if (-1 == sendRequest(route(&client->ring, fileIndex), &request,
+                        sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
+
   debug_debug("Answer received from server (status=%d).", answer.status);
 
-  if (-1 != answer.status) {
+  if (-1 != answer.status && MYSTORE_EXPIRED != answer.status) {
     memcpy(record, &(answer.data), sizeof(MYRECORD_RECORD_t));
   }
 
+  /* The lease started after the request was sent, ending it sooner here is
+   * on the safe side. */
+  if (client->nearSlots != NULL && 0 == answer.status && answer.lease) {
+    nearInsert(table, fileIndex, &(answer.data),
+               request.sent + MYSTORE_LEASE_NS);
+  }
+
   return answer.status;
 }
 
 /**
- * This function writes a record to the store server.
+ * This function writes a record to a table of the store server.
+ * @param table This is the id of the table in the server.
  * @param fileIndex This is the index of the record to write.
  * @param record This is a pointer to a record allocated by the user.
  * @return Return the status from the server. 0 is OK.
  */
-int STORC_write(int fileIndex, MYRECORD_RECORD_t *record) {
+int STORC_writeTable(int table, int fileIndex, MYRECORD_RECORD_t *record) {
 
   answer_message_t answer;
   request_message_t request;
 
-  request.mtype = SEND_TO_SERVER;
+  nearForget(table, fileIndex);
+
+  request.flags = 0;
   request.requested_op = MYSCOP_WRITE;
-  request.return_to = getpid();
   memcpy(&(request.data), record, sizeof(MYRECORD_RECORD_t));
+  request.table = table;
   request.index = fileIndex;
 
-  debug_verbose("Sending request to server (idx=%d).", fileIndex);
+  if (-1 == sendRequest(route(&client->ring, fileIndex), &request,
+                        sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
 
-  int status;
+  debug_debug("Answer received from server (status=%d).", answer.status);
 
-  do {
-    status = msgsnd(message_queue, &request, sizeof(request_message_t), 0);
+  if (-1 != answer.status && MYSTORE_EXPIRED != answer.status) {
+    memcpy(record, &(answer.data), sizeof(MYRECORD_RECORD_t));
+  }
 
-    if (-1 != status) {
-      break;
+  return answer.status;
+}
+
+/**
+ * This function deletes a record of a table of the store server. The server
+ * reads it as zeros afterwards without going to disk, and gives back the
+ * space of file blocks left without records.
+ * @param table This is the id of the table in the server.
+ * @param fileIndex This is the index of the record to delete.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_deleteTable(int table, int fileIndex) {
+
+  answer_message_t answer;
+  request_message_t request;
+
+  nearForget(table, fileIndex);
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_DELETE;
+  request.table = table;
+  request.index = fileIndex;
+
+  if (-1 == sendRequest(route(&client->ring, fileIndex), &request,
+                        sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Answer received from server (status=%d).", answer.status);
+
+  return answer.status;
+}
+
+/**
+ * Read the variable length payload of a record of a table of the store
+ * server, see MYC_readBlob(). Only tables in the paged format have them.
+ * @param buffer Buffer allocated by the user for the payload.
+ * @param size Size of the buffer. Longer payloads are truncated.
+ * @return The length of the payload, 0 if absent. -1 in case of error.
+ */
+int STORC_readTableBlob(int table, int fileIndex, void *buffer, size_t size) {
+
+  payload_message_t answer;
+  request_message_t request;
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_BLOBREAD;
+  request.table = table;
+  request.index = fileIndex;
+
+  if (-1 == sendRequest(route(&client->ring, fileIndex), &request,
+                        sizeof(request_message_t), &answer,
+                        sizeof(payload_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Payload received from server (status=%d).", answer.status);
+
+  if (answer.status > 0) {
+    memcpy(buffer, answer.payload,
+           (size_t)answer.status < size ? (size_t)answer.status : size);
+  }
+  return answer.status;
+}
+
+/**
+ * Store a variable length payload of up to MYC_BLOBMAX bytes in place of a
+ * record of a table of the store server, see MYC_writeBlob(). Not available
+ * with a standby.
+ * @param length Length of the payload, 0 deletes the record.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_writeTableBlob(int table, int fileIndex, const void *buffer,
+                         size_t length) {
+
+  answer_message_t answer;
+  blob_message_t request;
+
+  if (length > MYC_BLOBMAX) {
+    debug_error("Payload of %zu bytes larger than %d.", length, MYC_BLOBMAX);
+    return -1;
+  }
+  nearForget(table, fileIndex);
+
+  memset(&request, 0, sizeof(blob_message_t));
+  request.request.requested_op = MYSCOP_BLOBWRITE;
+  request.request.table = table;
+  request.request.index = fileIndex;
+  request.length = length;
+  memcpy(request.payload, buffer, length);
+
+  if (-1 == sendRequest(route(&client->ring, fileIndex), &request.request,
+                        sizeof(blob_message_t), &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Answer received from server (status=%d).", answer.status);
+
+  return answer.status;
+}
+
+/**
+ * Import into a table of the store server the records of a file, stored one
+ * after the other as MYRECORD_RECORD_t, the first one at "fileIndex" and the
+ * rest at the indices that follow. The server reads the file itself, with
+ * large writes that bypass its cache, and only from the directory given to
+ * its -I option. Not available in partitioned mode.
+ * @param name Name of the file in the import directory of the server.
+ * @return The number of records loaded. -1 in case of error, the server may
+ * have loaded some of them.
+ */
+int STORC_loadTable(int table, int fileIndex, const char *name) {
+
+  answer_message_t answer;
+  load_message_t request;
+
+  if (client->partitions > 1) {
+    debug_error("Bulk loads are not routed to partitions.");
+    return -1;
+  }
+  if (strchr(name, '/') != NULL || strlen(name) >= MYSTORE_PATHMAX) {
+    debug_error("Invalid file to load %s, not a name in the import "
+                "directory.", name);
+    return -1;
+  }
+
+  memset(&request, 0, sizeof(load_message_t));
+  request.request.requested_op = MYSCOP_LOAD;
+  request.request.table = table;
+  request.request.index = fileIndex;
+  strcpy(request.path, name);
+
+  if (-1 == sendRequest(0, &request.request, sizeof(load_message_t), &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Load answered by server (status=%d).", answer.status);
+
+  if (answer.status > 0) {
+    nearForgetRange(table, fileIndex, answer.status);
+  }
+  return answer.status;
+}
+
+/**
+ * This function deletes a record of the default table of the store server.
+ * @param fileIndex This is the index of the record to delete.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_delete(int fileIndex) { return STORC_deleteTable(0, fileIndex); }
+
+/**
+ * This function reads a record from the default table of the store server.
+ * @param fileIndex This is the index of the record to read.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_read(int fileIndex, MYRECORD_RECORD_t *record) {
+  return STORC_readTable(0, fileIndex, record);
+}
+
+/**
+ * This function writes a record to the default table of the store server.
+ * @param fileIndex This is the index of the record to write.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_write(int fileIndex, MYRECORD_RECORD_t *record) {
+  return STORC_writeTable(0, fileIndex, record);
+}
+
+/** Add the counters and histograms of a partition to "total". */
+static void addStats(MYSTORE_STATS_t *total, const MYSTORE_STATS_t *one) {
+  total->totalRequests += one->totalRequests;
+  total->totalReadRequests += one->totalReadRequests;
+  total->totalWriteRequests += one->totalWriteRequests;
+  total->leases += one->leases;
+  total->invalidations += one->invalidations;
+  total->busy += one->busy;
+  total->expired += one->expired;
+  myh_merge(&total->queueWait, &one->queueWait);
+  myh_merge(&total->service, &one->service);
+  for (int c = 0; c < MYSTORE_PRIORITIES; c++) {
+    myh_merge(&total->latency[c], &one->latency[c]);
+  }
+  total->cache.hits += one->cache.hits;
+  total->cache.misses += one->cache.misses;
+  total->cache.evictions += one->cache.evictions;
+  total->cache.writebacks += one->cache.writebacks;
+  total->cache.stalls += one->cache.stalls;
+  total->cache.dirty += one->cache.dirty;
+  total->cache.commits += one->cache.commits;
+  total->cache.conflicts += one->cache.conflicts;
+  total->cache.versions += one->cache.versions;
+  total->cache.deletes += one->cache.deletes;
+  total->cache.absent += one->cache.absent;
+  total->cache.compacted += one->cache.compacted;
+  total->cache.backups += one->cache.backups;
+  total->cache.corrupt += one->cache.corrupt;
+  total->cache.scrubbed += one->cache.scrubbed;
+  total->cache.scrubCorrupt += one->cache.scrubCorrupt;
+  total->cache.entries += one->cache.entries;
+  mymrc_merge(&total->cache.mrc, &one->cache.mrc);
+  total->cache.diskBytes += one->cache.diskBytes;
+  total->cache.tableBytes += one->cache.tableBytes;
+  myh_merge(&total->cache.diskIO, &one->cache.diskIO);
+}
+
+/**
+ * This function asks the store server for the counters and histograms of one
+ * of its tables, or of all of them added up. In partitioned mode they are
+ * added up over all the partitions.
+ * The server keeps serving other clients while answering.
+ * @param table This is the id of the table, -1 for all of them.
+ * @param stats This is a pointer to a structure allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_tableStats(int table, MYSTORE_STATS_t *stats) {
+
+  stats_message_t answer;
+  request_message_t request;
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_STATS;
+  request.table = table;
+
+  memset(stats, 0, sizeof(MYSTORE_STATS_t));
+  for (int p = 0; p < client->partitions; p++) {
+    if (-1 == sendRequest(p, &request, sizeof(request_message_t), &answer,
+                          sizeof(stats_message_t))) {
+      return -1;
     }
 
-    if (errno == EIDRM) {
-      perror("Message queue is removed");
+    debug_debug("Stats received from server (partition=%d, status=%d).", p,
+                answer.status);
+
+    if (-1 == answer.status) {
       return -1;
     }
+    addStats(stats, &(answer.stats));
+  }
 
-    perror("Error sending message, retrying");
+  return 0;
+}
 
-  } while (1);
+/**
+ * Start compacting a table of the store server in the background, in every
+ * partition: the server goes on answering while it rewrites the table file
+ * without the space of deleted records, see MYC_compactTable().
+ * @param budget Microseconds a step may hold the table, 0 for the default.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_compactTable(int table, unsigned int budget) {
 
-  debug_verbose("Receiving answer from server (client id=%ld).",
-                request.return_to);
+  answer_message_t answer;
+  request_message_t request;
 
-  do {
-    status =
-        msgrcv(message_queue, &answer, sizeof(answer_message_t), getpid(), 0);
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_COMPACT;
+  request.table = table;
+  request.index = budget;
 
-    if (-1 != status) {
-      break;
+  for (int p = 0; p < client->partitions; p++) {
+    if (-1 == sendRequest(p, &request, sizeof(request_message_t), &answer,
+                          sizeof(answer_message_t))) {
+      return -1;
     }
 
-    if (errno == EIDRM) {
-      perror("Message queue is removed");
+    debug_debug("Compaction started (partition=%d, status=%d).", p,
+                answer.status);
+
+    if (0 != answer.status) {
+      return answer.status;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Start an online backup of a table of the store server into a directory of
+ * the server, see MYC_backupTable(). The server goes on answering while it
+ * copies. In partitioned mode every partition backs up its slice into the
+ * subdirectory "partition.N" of "name", which the servers create.
+ * @param name Name of the directory in the backup root of the servers, the
+ * directory given to their -O option, created if needed.
+ * @param budget Microseconds a step may hold the table, 0 for the default.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_backupTable(int table, const char *name, unsigned int budget) {
+
+  answer_message_t answer;
+  load_message_t request;
+
+  if (strchr(name, '/') != NULL || strlen(name) >= MYSTORE_PATHMAX) {
+    debug_error("Invalid backup %s, not a name in the backup root.", name);
+    return -1;
+  }
+
+  memset(&request, 0, sizeof(load_message_t));
+  request.request.requested_op = MYSCOP_BACKUP;
+  request.request.table = table;
+  request.request.index = budget;
+  strcpy(request.path, name);
+
+  for (int p = 0; p < client->partitions; p++) {
+    if (-1 == sendRequest(p, &request.request, sizeof(load_message_t),
+                          &answer, sizeof(answer_message_t))) {
       return -1;
     }
 
-    perror("Error receiving message, retrying");
+    debug_debug("Backup started (partition=%d, status=%d).", p,
+                answer.status);
 
-  } while (1);
+    if (0 != answer.status) {
+      return answer.status;
+    }
+  }
 
-  debug_debug("Answer received from server (status=%d).", answer.status);
+  return 0;
+}
+
+/**
+ * This function asks the store server for its counters and histograms.
+ * @param stats This is a pointer to a structure allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_stats(MYSTORE_STATS_t *stats) { return STORC_tableStats(-1, stats); }
+
+/**
+ * Open a snapshot of a table in the server of a partition.
+ * @return The id of the snapshot in that server, -1 in case of error.
+ */
+static int openSnapshot(int partition, int table) {
+
+  answer_message_t answer;
+  request_message_t request;
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_SNAPOPEN;
+  request.table = table;
 
-  if (-1 != answer.status) {
+  if (-1 == sendRequest(partition, &request, sizeof(request_message_t),
+                        &answer, sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Snapshot opened by server (status=%d).", answer.status);
+  return answer.status;
+}
+
+/**
+ * Close a snapshot in the server of a partition.
+ * @return Return the status from the server. 0 is OK.
+ */
+static int closeSnapshot(int partition, int snapshot) {
+
+  answer_message_t answer;
+  request_message_t request;
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_SNAPCLOSE;
+  request.snapshot = snapshot;
+
+  if (-1 == sendRequest(partition, &request, sizeof(request_message_t),
+                        &answer, sizeof(answer_message_t))) {
+    return -1;
+  }
+  return answer.status;
+}
+
+/**
+ * Open a snapshot of a table in the server. Reads through it see the table
+ * as it is now while other clients keep writing. In partitioned mode there is
+ * a snapshot in every partition, each one consistent on its own.
+ * @return The id of the snapshot, -1 in case of error.
+ */
+int STORC_openSnapshot(int table) {
+  int slot = 0;
+
+  if (client->ring.size == 0) {
+    return openSnapshot(0, table);
+  }
+
+  while (slot < MYC_MAXSNAPSHOTS && client->snapshotOpen[slot]) {
+    slot++;
+  }
+  if (slot == MYC_MAXSNAPSHOTS) {
+    debug_error("Too many snapshots open.");
+    return -1;
+  }
+
+  for (int p = 0; p < client->partitions; p++) {
+    client->snapshots[slot][p] = openSnapshot(p, table);
+    if (client->snapshots[slot][p] < 0) {
+      while (--p >= 0) {
+        closeSnapshot(p, client->snapshots[slot][p]);
+      }
+      return -1;
+    }
+  }
+  client->snapshotOpen[slot] = 1;
+  return slot;
+}
+
+/**
+ * This function reads a record as it was when the snapshot was opened.
+ * @param record This is a pointer to a record allocated by the user.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_readSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record) {
+
+  answer_message_t answer;
+  request_message_t request;
+  int partition = route(&client->ring, fileIndex);
+
+  if (client->ring.size != 0) {
+    if (snapshot < 0 || snapshot >= MYC_MAXSNAPSHOTS ||
+        !client->snapshotOpen[snapshot]) {
+      return -1;
+    }
+    snapshot = client->snapshots[snapshot][partition];
+  }
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_SNAPREAD;
+  request.snapshot = snapshot;
+  request.index = fileIndex;
+
+  if (-1 == sendRequest(partition, &request, sizeof(request_message_t),
+                        &answer, sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  if (-1 != answer.status && MYSTORE_EXPIRED != answer.status) {
     memcpy(record, &(answer.data), sizeof(MYRECORD_RECORD_t));
   }
+  return answer.status;
+}
+
+/**
+ * Close a snapshot, so the server stops keeping versions for it.
+ * @return Return the status from the server. 0 is OK.
+ */
+int STORC_closeSnapshot(int snapshot) {
+  int status = 0;
+
+  if (client->ring.size == 0) {
+    return closeSnapshot(0, snapshot);
+  }
+
+  if (snapshot < 0 || snapshot >= MYC_MAXSNAPSHOTS ||
+      !client->snapshotOpen[snapshot]) {
+    return -1;
+  }
+  for (int p = 0; p < client->partitions; p++) {
+    if (0 != closeSnapshot(p, client->snapshots[snapshot][p])) {
+      status = -1;
+    }
+  }
+  client->snapshotOpen[snapshot] = 0;
+  return status;
+}
+
+/**
+ * Start a transaction on a table. Nothing is sent until STORC_commit().
+ * @param tx This is a pointer to a transaction allocated by the user.
+ * @param table This is the id of the table in the server.
+ */
+void STORC_begin(STORC_TX_t *tx, int table) {
+  memset(&(tx->message.request), 0, sizeof(request_message_t));
+  tx->message.request.requested_op = MYSCOP_COMMIT;
+  tx->message.request.table = table;
+  tx->message.count = 0;
+}
+
+/**
+ * Add an entry to a transaction.
+ * @return -1 if the transaction already has MYSTORE_TXMAX entries. 0 is OK.
+ */
+static int addEntry(STORC_TX_t *tx, int op, int fileIndex,
+                    const MYRECORD_RECORD_t *record) {
+  if (tx->message.count == MYSTORE_TXMAX) {
+    debug_error("Transaction full (%d entries).", MYSTORE_TXMAX);
+    return -1;
+  }
+
+  MYC_TXENTRY_t *entry = &(tx->message.entries[tx->message.count++]);
+  entry->op = op;
+  entry->index = fileIndex;
+  memcpy(&(entry->record), record, sizeof(MYRECORD_RECORD_t));
+  return 0;
+}
+
+/**
+ * Buffer the write of a record in a transaction.
+ * @return -1 if the transaction is full. 0 is OK.
+ */
+int STORC_txWrite(STORC_TX_t *tx, int fileIndex,
+                  const MYRECORD_RECORD_t *record) {
+  return addEntry(tx, MYC_TXWRITE, fileIndex, record);
+}
+
+/**
+ * Make the commit of a transaction fail unless the record at "fileIndex" is
+ * still "expected".
+ * @return -1 if the transaction is full. 0 is OK.
+ */
+int STORC_txCheck(STORC_TX_t *tx, int fileIndex,
+                  const MYRECORD_RECORD_t *expected) {
+  return addEntry(tx, MYC_TXCHECK, fileIndex, expected);
+}
+
+/**
+ * Send a transaction to the server in one message. It is applied completely
+ * or not at all, and it is durable when this function returns 0. In
+ * partitioned mode all its entries must belong to the same partition.
+ * @param current Receives the record that failed a check, or NULL.
+ * @return Return the status from the server: 0 is OK, MYC_CONFLICT if a check
+ * failed.
+ */
+int STORC_commit(STORC_TX_t *tx, MYRECORD_RECORD_t *current) {
+
+  answer_message_t answer;
+  size_t size = sizeof(commit_message_t) -
+                (MYSTORE_TXMAX - tx->message.count) * sizeof(MYC_TXENTRY_t);
+  int partition =
+      tx->message.count > 0
+          ? route(&client->ring, tx->message.entries[0].index)
+          : 0;
+
+  for (int i = 0; i < tx->message.count; i++) {
+    if (tx->message.entries[i].op == MYC_TXWRITE) {
+      nearForget(tx->message.request.table, tx->message.entries[i].index);
+    }
+    if (route(&client->ring, tx->message.entries[i].index) != partition) {
+      debug_error("Transaction spans partitions %d and %d.", partition,
+                  route(&client->ring, tx->message.entries[i].index));
+      return -1;
+    }
+  }
+
+  if (-1 == sendRequest(partition, &(tx->message.request), size, &answer,
+                        sizeof(answer_message_t))) {
+    return -1;
+  }
+
+  debug_debug("Commit answered by server (status=%d).", answer.status);
+
+  if (MYC_CONFLICT == answer.status && current != NULL) {
+    memcpy(current, &(answer.data), sizeof(MYRECORD_RECORD_t));
+  }
 
   return answer.status;
 }
+
+/**
+ * Replace the record at "fileIndex" with "record" only if it still holds
+ * "expected", in a single round trip.
+ * @param expected On a conflict it receives the record found instead.
+ * @return Return the status from the server: 0 is OK, MYC_CONFLICT if the
+ * record was not "expected".
+ */
+int STORC_cas(int table, int fileIndex, MYRECORD_RECORD_t *expected,
+              const MYRECORD_RECORD_t *record) {
+  STORC_TX_t tx;
+
+  STORC_begin(&tx, table);
+  STORC_txCheck(&tx, fileIndex, expected);
+  STORC_txWrite(&tx, fileIndex, record);
+  return STORC_commit(&tx, expected);
+}
+
+/**
+ * Move record "index" of a table from partition "from" to partition "to":
+ * written there and deleted here. An absent record is deleted there instead,
+ * so that a copy left by an earlier rebalance does not come back.
+ * @return 1 if a record was moved, 0 if it was absent, -1 in case of error.
+ */
+static int moveRecord(int table, int index, int from, int to) {
+  static const MYRECORD_RECORD_t empty;
+  answer_message_t answer;
+  request_message_t request;
+
+  memset(&request, 0, sizeof(request_message_t));
+  request.requested_op = MYSCOP_READ;
+  request.table = table;
+  request.index = index;
+  if (-1 == sendRequest(from, &request, sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t)) ||
+      0 != answer.status) {
+    debug_error("Error reading record %d from partition %d.", index, from);
+    return -1;
+  }
+  int present = 0 != memcmp(&(answer.data), &empty, sizeof(MYRECORD_RECORD_t));
+
+  request.requested_op = present ? MYSCOP_WRITE : MYSCOP_DELETE;
+  memcpy(&(request.data), &(answer.data), sizeof(MYRECORD_RECORD_t));
+  if (-1 == sendRequest(to, &request, sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t)) ||
+      0 != answer.status) {
+    debug_error("Error writing record %d to partition %d.", index, to);
+    return -1;
+  }
+  if (!present) {
+    return 0;
+  }
+
+  request.requested_op = MYSCOP_DELETE;
+  if (-1 == sendRequest(from, &request, sizeof(request_message_t), &answer,
+                        sizeof(answer_message_t)) ||
+      0 != answer.status) {
+    debug_error("Error deleting record %d from partition %d.", index, from);
+    return -1;
+  }
+  return 1;
+}
+
+/**
+ * Move the records of a table to the partitions that own them in a cluster
+ * of "count" partitions, and route to them from now on. With consistent
+ * hashing only the indices whose owner changes are moved, about 1/count of
+ * them when a partition is added; the old owner keeps no copy. The servers of
+ * every partition must be running, and no other client may write until it
+ * ends; they must be started again with the new MYSTORE_PARTITIONS.
+ * @param keys Indices of the table, from 0 on, that are checked.
+ * @return Records moved, -1 in case of error.
+ */
+int STORC_rebalance(int table, int keys, int count) {
+  int moved = 0;
+
+  if (client->ring.size == 0 || count <= 0 || count > MYSTORE_MAXPARTITIONS) {
+    debug_error("Only a partitioned store can be rebalanced to %d.", count);
+    return -1;
+  }
+
+  for (int p = client->partitions; p < count; p++) {
+    client->message_queue[p] = openQueue(MYSTORE_PARTITION_KEY(p));
+    if (-1 == client->message_queue[p]) {
+      return -1;
+    }
+  }
+  RING_t *target = malloc(sizeof(RING_t));
+  if (target == NULL) {
+    debug_error("Not enough memory to rebalance to %d partitions.", count);
+    return -1;
+  }
+  buildRing(target, count);
+
+  for (int i = 0; i < keys; i++) {
+    int from = route(&client->ring, i), to = route(target, i);
+
+    if (from == to) {
+      continue;
+    }
+    int status = moveRecord(table, i, from, to);
+    if (-1 == status) {
+      free(target);
+      return -1;
+    }
+    moved += status;
+  }
+
+  if (count > client->partitions) {
+    client->partitions = count;
+  }
+  memcpy(&client->ring, target, sizeof(RING_t));
+  free(target);
+  STORC_nearCache(client->nearEntries);
+  debug_info("%d records moved to rebalance to %d partitions.", moved, count);
+  return moved;
+}
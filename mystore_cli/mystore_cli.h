@@ -4,19 +4,73 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <messages.h>
 #include <myrecord.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Entries of the near cache when set in the environment. */
+#define STORC_NEARCACHE_ENV "MYSTORE_NEARCACHE"
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t invalidations; /* Records dropped because the server wrote them. */
+  uint64_t expirations;   /* Found in the cache after their lease ended. */
+} STORC_NEARSTATS_t;
+
+/* A connection to the servers, see STORC_newClient(). */
+typedef struct STORC_CLIENT STORC_CLIENT_t;
+
+/* A transaction buffered by the client until STORC_commit(). */
+typedef struct {
+  commit_message_t message;
+} STORC_TX_t;
+
 int STORC_init();
+int STORC_initPartitions(int count);
 int STORC_close();
+STORC_CLIENT_t *STORC_newClient();
+void STORC_freeClient(STORC_CLIENT_t *client);
+STORC_CLIENT_t *STORC_select(STORC_CLIENT_t *client);
+int STORC_partition(int fileIndex);
+int STORC_nearCache(unsigned int entries);
+void STORC_nearStats(STORC_NEARSTATS_t *stats);
+int STORC_rebalance(int table, int keys, int count);
+int STORC_setPriority(int priority);
+void STORC_setDeadline(uint64_t nanoseconds);
 
 int STORC_read(int fileIndex, MYRECORD_RECORD_t *record);
 int STORC_write(int fileIndex, MYRECORD_RECORD_t *record);
+int STORC_delete(int fileIndex);
+int STORC_readTable(int table, int fileIndex, MYRECORD_RECORD_t *record);
+int STORC_writeTable(int table, int fileIndex, MYRECORD_RECORD_t *record);
+int STORC_deleteTable(int table, int fileIndex);
+int STORC_readTableBlob(int table, int fileIndex, void *buffer, size_t size);
+int STORC_writeTableBlob(int table, int fileIndex, const void *buffer,
+                         size_t length);
+int STORC_loadTable(int table, int fileIndex, const char *name);
+int STORC_compactTable(int table, unsigned int budget);
+int STORC_backupTable(int table, const char *name, unsigned int budget);
 int STORC_flush(int fileIndex);
 int STORC_flushAll();
+int STORC_stats(MYSTORE_STATS_t *stats);
+int STORC_tableStats(int table, MYSTORE_STATS_t *stats);
+
+int STORC_openSnapshot(int table);
+int STORC_readSnapshot(int snapshot, int fileIndex, MYRECORD_RECORD_t *record);
+int STORC_closeSnapshot(int snapshot);
+
+void STORC_begin(STORC_TX_t *tx, int table);
+int STORC_txWrite(STORC_TX_t *tx, int fileIndex,
+                  const MYRECORD_RECORD_t *record);
+int STORC_txCheck(STORC_TX_t *tx, int fileIndex,
+                  const MYRECORD_RECORD_t *expected);
+int STORC_commit(STORC_TX_t *tx, MYRECORD_RECORD_t *current);
+int STORC_cas(int table, int fileIndex, MYRECORD_RECORD_t *expected,
+              const MYRECORD_RECORD_t *record);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,253 @@
+#ifndef MYSTORE_CLI_HPP
+#define MYSTORE_CLI_HPP
+
+/*
+ * C++17 interface of the client API, header only over libmystore_cli. A
+ * StoreClient is a connection of its own, see STORC_newClient(): a process
+ * may open several, and each one serializes the calls made through it, so
+ * threads sharing one wait for each other while threads with one each do
+ * not. Calls return the status of the C API; the constructor throws
+ * std::runtime_error when the client cannot be initialized.
+ */
+
+#include <cstddef>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#include <mystore_cli.h>
+
+namespace mystore {
+
+using Record = MYRECORD_RECORD_t;
+
+#if __cplusplus >= 202002L
+template <typename T> using Span = std::span<T>;
+#else
+/* What the client needs of the std::span of C++20. */
+template <typename T> class Span {
+public:
+  constexpr Span() noexcept : first(nullptr), count(0) {}
+  constexpr Span(T *data, std::size_t size) noexcept
+      : first(data), count(size) {}
+  template <std::size_t N>
+  constexpr Span(T (&array)[N]) noexcept : first(array), count(N) {}
+  template <typename Container>
+  constexpr Span(Container &container) noexcept
+      : first(container.data()), count(container.size()) {}
+
+  constexpr T *data() const noexcept { return first; }
+  constexpr std::size_t size() const noexcept { return count; }
+  constexpr T &operator[](std::size_t i) const { return first[i]; }
+  constexpr T *begin() const noexcept { return first; }
+  constexpr T *end() const noexcept { return first + count; }
+
+private:
+  T *first;
+  std::size_t count;
+};
+#endif
+
+/* Answer of an asynchronous read. */
+struct ReadResult {
+  int status;
+  Record record;
+};
+
+class StoreClient {
+public:
+  /**
+   * Connect to a cluster of "partitions" servers, 0 for a single server,
+   * keeping up to "nearEntries" records in a near cache of this client.
+   */
+  explicit StoreClient(int partitions = 0, unsigned int nearEntries = 0)
+      : client(STORC_newClient()) {
+    if (client == nullptr) {
+      throw std::runtime_error("No memory for a store client.");
+    }
+    Selected selected(client);
+    if (STORC_initPartitions(partitions) != 0 ||
+        STORC_nearCache(nearEntries) != 0) {
+      STORC_freeClient(client);
+      throw std::runtime_error("Error initializing the store client.");
+    }
+  }
+
+  ~StoreClient() { STORC_freeClient(client); }
+
+  StoreClient(const StoreClient &) = delete;
+  StoreClient &operator=(const StoreClient &) = delete;
+
+  /* A moved-from client is empty: it may only be destroyed or assigned. */
+  StoreClient(StoreClient &&other) noexcept
+      : client(std::exchange(other.client, nullptr)) {}
+  StoreClient &operator=(StoreClient &&other) noexcept {
+    if (this != &other) {
+      STORC_freeClient(client);
+      client = std::exchange(other.client, nullptr);
+    }
+    return *this;
+  }
+
+  int read(int table, int fileIndex, Record &record) {
+    Locked locked(*this);
+    return STORC_readTable(table, fileIndex, &record);
+  }
+
+  int write(int table, int fileIndex, Record &record) {
+    Locked locked(*this);
+    return STORC_writeTable(table, fileIndex, &record);
+  }
+
+  int remove(int table, int fileIndex) {
+    Locked locked(*this);
+    return STORC_deleteTable(table, fileIndex);
+  }
+
+  /**
+   * Read the records at "indices" straight into "records", of the same size.
+   * @return -1 if a request failed, the first status that is not 0, or 0.
+   */
+  int readMany(int table, Span<const int> indices, Span<Record> records) {
+    if (indices.size() != records.size()) {
+      return -1;
+    }
+    Locked locked(*this);
+    return forEach(indices, [&](std::size_t i) {
+      return STORC_readTable(table, indices[i], &records[i]);
+    });
+  }
+
+  /** Read "records.size()" consecutive records from "fileIndex" on. */
+  int readMany(int table, int fileIndex, Span<Record> records) {
+    Locked locked(*this);
+    return forEach(records, [&](std::size_t i) {
+      return STORC_readTable(table, fileIndex + (int)i, &records[i]);
+    });
+  }
+
+  /**
+   * Write "records" at "indices", of the same size. Each record gets the
+   * answer of the server, as with STORC_writeTable().
+   * @return -1 if a request failed, the first status that is not 0, or 0.
+   */
+  int writeMany(int table, Span<const int> indices, Span<Record> records) {
+    if (indices.size() != records.size()) {
+      return -1;
+    }
+    Locked locked(*this);
+    return forEach(indices, [&](std::size_t i) {
+      return STORC_writeTable(table, indices[i], &records[i]);
+    });
+  }
+
+  /** Write "records" to consecutive indices from "fileIndex" on. */
+  int writeMany(int table, int fileIndex, Span<Record> records) {
+    Locked locked(*this);
+    return forEach(records, [&](std::size_t i) {
+      return STORC_writeTable(table, fileIndex + (int)i, &records[i]);
+    });
+  }
+
+  /**
+   * Read in another thread. The calls of this client made meanwhile wait for
+   * it: asynchronous calls overlap only across clients.
+   */
+  std::future<ReadResult> readAsync(int table, int fileIndex) {
+    return std::async(std::launch::async, [this, table, fileIndex] {
+      ReadResult result{};
+      result.status = read(table, fileIndex, result.record);
+      return result;
+    });
+  }
+
+  /** Write a copy of "record" in another thread, see readAsync(). */
+  std::future<int> writeAsync(int table, int fileIndex, const Record &record) {
+    return std::async(std::launch::async, [this, table, fileIndex, record] {
+      Record written = record;
+      return write(table, fileIndex, written);
+    });
+  }
+
+  /** Read into "records", which must outlive the future, see readAsync(). */
+  std::future<int> readManyAsync(int table, int fileIndex,
+                                 Span<Record> records) {
+    return std::async(std::launch::async, [this, table, fileIndex, records] {
+      return readMany(table, fileIndex, records);
+    });
+  }
+
+  int setPriority(int priority) {
+    Locked locked(*this);
+    return STORC_setPriority(priority);
+  }
+
+  void setDeadline(uint64_t nanoseconds) {
+    Locked locked(*this);
+    STORC_setDeadline(nanoseconds);
+  }
+
+  STORC_NEARSTATS_t nearStats() {
+    Locked locked(*this);
+    STORC_NEARSTATS_t stats;
+    STORC_nearStats(&stats);
+    return stats;
+  }
+
+  int stats(int table, MYSTORE_STATS_t &stats) {
+    Locked locked(*this);
+    return STORC_tableStats(table, &stats);
+  }
+
+private:
+  /* Selects a client in the calling thread for the life of the object. */
+  class Selected {
+  public:
+    explicit Selected(STORC_CLIENT_t *client)
+        : previous(STORC_select(client)) {}
+    ~Selected() { STORC_select(previous); }
+    Selected(const Selected &) = delete;
+    Selected &operator=(const Selected &) = delete;
+
+  private:
+    STORC_CLIENT_t *previous;
+  };
+
+  /* Holds the client for one call, or one batch. */
+  class Locked {
+  public:
+    explicit Locked(StoreClient &owner)
+        : lock(owner.mutex), selected(owner.client) {}
+
+  private:
+    std::lock_guard<std::mutex> lock;
+    Selected selected;
+  };
+
+  template <typename Range, typename Call>
+  static int forEach(const Range &range, Call call) {
+    int status = 0;
+
+    for (std::size_t i = 0; i < range.size(); i++) {
+      int answer = call(i);
+      if (answer == -1) {
+        return -1;
+      }
+      if (status == 0) {
+        status = answer;
+      }
+    }
+    return status;
+  }
+
+  STORC_CLIENT_t *client;
+  std::mutex mutex;
+};
+
+} // namespace mystore
+
+#endif /* MYSTORE_CLI_HPP */
@@ -0,0 +1,621 @@
+#include "debug.h"
+#include "messages.h"
+#include "myreplica.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Log shipping to a hot standby. The primary appends every write it applies
+ * to a buffer and a sender thread streams it to the standby connected to a
+ * Unix socket. A standby that connects is first sent every record of every
+ * table, the absent ones as deletes, read from snapshots opened when it
+ * connected, and then the writes applied after that moment. It applies them
+ * to its own cache: single writes one by one and the writes of a transaction
+ * with MYC_commit(), so they stay atomic there too. Deletes travel in frames
+ * of their own.
+ */
+
+#define REPL_MAGIC 0x5243594d /* "MYCR" */
+#define REPL_ATOMIC 0x1       /* Writes of a transaction, applied together. */
+#define REPL_DELETE 0x2       /* Indices to delete, the records are unused. */
+#define REPL_MAXENTRIES MYSTORE_TXMAX
+
+typedef struct {
+  uint32_t magic;
+  uint32_t flags;
+  int32_t table;
+  int32_t count; /* MYC_TXENTRY_t that follow, all of them MYC_TXWRITE. */
+} REPL_FRAME_t;
+
+typedef struct {
+  REPL_FRAME_t frame;
+  MYC_TXENTRY_t entries[REPL_MAXENTRIES];
+} REPL_BATCH_t;
+
+static int debug_level = DEBUG_INIT;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Primary side, all of it but the buffer being sent protected by "lock". */
+static pthread_cond_t shipped = PTHREAD_COND_INITIALIZER;
+static pthread_t sender;
+static char listenPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int listenFd = -1;
+static int standbyFd = -1;
+static int numTables;
+static int streaming; /* Writes are buffered only while a standby is synced. */
+static int overflow;  /* The standby fell behind, it must start again. */
+static int stopSender;
+static unsigned char *pending;
+static size_t pendingLength;
+static unsigned char *sending;
+
+/* Standby side. */
+static pthread_t follower;
+static char followPath[sizeof(listenPath)];
+static int primaryFd = -1;
+static int following;
+static int stopFollower;
+
+/**
+ * Write all of "size" bytes to a socket, retrying when interrupted.
+ * @return -1 if the peer is gone or in case of error. 0 success.
+ */
+static int sendAll(int fd, const void *buffer, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = send(fd, (const char *)buffer + done, size - done,
+                     MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+/**
+ * Read exactly "size" bytes from a socket, retrying when interrupted.
+ * @return -1 if the peer is gone or in case of error. 0 success.
+ */
+static int recvAll(int fd, void *buffer, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = recv(fd, (char *)buffer + done, size - done, 0);
+    if (n == 0) {
+      return -1;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+/**
+ * Fill the address of the socket at "path".
+ * @return -1 if the path does not fit. 0 success.
+ */
+static int socketAddress(struct sockaddr_un *address, const char *path) {
+  memset(address, 0, sizeof(struct sockaddr_un));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address->sun_path, path);
+  return 0;
+}
+
+/**
+ * Append a frame with the writes among "entries" to the buffer of the
+ * standby. Called with "lock" held.
+ * @return -1 if the standby was dropped because it fell behind. 0 success.
+ */
+static int ship(int table, const MYC_TXENTRY_t *entries, int count,
+                uint32_t flags) {
+  REPL_FRAME_t frame = {REPL_MAGIC, flags, table, 0};
+
+  if (!streaming) {
+    return 0;
+  }
+
+  for (int i = 0; i < count; i++) {
+    frame.count += (entries[i].op == MYC_TXWRITE);
+  }
+  if (frame.count == 0) {
+    return 0;
+  }
+
+  size_t size = sizeof(REPL_FRAME_t) + frame.count * sizeof(MYC_TXENTRY_t);
+  if (frame.count > REPL_MAXENTRIES ||
+      pendingLength + size > STORR_BUFFERSIZE) {
+    debug_error("Standby cannot keep up (%zu bytes behind), it will be "
+                "synchronized again.",
+                pendingLength);
+    streaming = 0;
+    overflow = 1;
+    pthread_cond_signal(&shipped);
+    return -1;
+  }
+
+  memcpy(pending + pendingLength, &frame, sizeof(REPL_FRAME_t));
+  pendingLength += sizeof(REPL_FRAME_t);
+  for (int i = 0; i < count; i++) {
+    if (entries[i].op == MYC_TXWRITE) {
+      memcpy(pending + pendingLength, &entries[i], sizeof(MYC_TXENTRY_t));
+      pendingLength += sizeof(MYC_TXENTRY_t);
+    }
+  }
+
+  pthread_cond_signal(&shipped);
+  return 0;
+}
+
+/**
+ * Send the frame of "batch" to the standby and start an empty one of the
+ * same table with "flags".
+ * @return -1 if the standby is gone. 0 success.
+ */
+static int sendBatch(int fd, REPL_BATCH_t *batch, uint32_t flags) {
+  int status = 0;
+
+  if (batch->frame.count > 0) {
+    status = sendAll(fd, batch,
+                     sizeof(REPL_FRAME_t) +
+                         batch->frame.count * sizeof(MYC_TXENTRY_t));
+  }
+  batch->frame.flags = flags;
+  batch->frame.count = 0;
+  return status;
+}
+
+/**
+ * Send every record of every table to a standby that just connected. The
+ * snapshots are opened at the same moment the buffer starts keeping writes:
+ * the primary cannot apply a write while this holds "lock", it waits to ship
+ * the one it applied last. A write may then reach the standby twice, never
+ * out of order. The present records are sent as writes and the absent ones
+ * up to the last present record as deletes, so that the standby has the
+ * same records present and the same holes.
+ * @return -1 if the standby is gone or in case of error. 0 success.
+ */
+static int synchronize(int fd) {
+  int snapshots[MYC_MAXTABLES];
+  REPL_BATCH_t batch;
+  int status = 0;
+  int opened = 0;
+
+  pthread_mutex_lock(&lock);
+  for (; opened < numTables; opened++) {
+    snapshots[opened] = MYC_openSnapshot(opened);
+    if (snapshots[opened] < 0) {
+      status = -1;
+      break;
+    }
+  }
+  if (0 == status) {
+    pendingLength = 0;
+    overflow = 0;
+    streaming = 1;
+    standbyFd = fd;
+  }
+  pthread_mutex_unlock(&lock);
+
+  for (int table = 0; table < numTables && 0 == status; table++) {
+    unsigned int present = 0;
+    unsigned int absent = 0;
+    MYRECORD_RECORD_t record;
+    int found = 0;
+
+    batch.frame.magic = REPL_MAGIC;
+    batch.frame.flags = 0;
+    batch.frame.table = table;
+    batch.frame.count = 0;
+    for (int i = 0; 0 == status; i++) {
+      found = MYC_scanSnapshot(snapshots[table], i, &record);
+      if (found == -1 || found == MYC_END) {
+        break;
+      }
+      uint32_t flags = (found == MYC_ABSENT) ? REPL_DELETE : 0;
+      if ((batch.frame.count == REPL_MAXENTRIES ||
+           batch.frame.flags != flags) &&
+          -1 == sendBatch(fd, &batch, flags)) {
+        status = -1;
+        break;
+      }
+      MYC_TXENTRY_t *entry = &batch.entries[batch.frame.count++];
+      entry->op = MYC_TXWRITE;
+      entry->index = i;
+      memcpy(&entry->record, &record, sizeof(MYRECORD_RECORD_t));
+      if (found == MYC_ABSENT) {
+        absent++;
+      } else {
+        present++;
+      }
+    }
+    if (found == -1 || (0 == status && -1 == sendBatch(fd, &batch, 0))) {
+      status = -1;
+    }
+    debug_info("Sent %u records and %u holes of table %d to the standby.",
+               present, absent, table);
+  }
+
+  for (int table = 0; table < opened; table++) {
+    MYC_closeSnapshot(snapshots[table]);
+  }
+  return status;
+}
+
+/**
+ * Send the writes buffered by the primary until the standby goes away, falls
+ * behind or the primary stops.
+ */
+static void stream(int fd) {
+  while (1) {
+    pthread_mutex_lock(&lock);
+    while (pendingLength == 0 && !overflow && !stopSender) {
+      pthread_cond_wait(&shipped, &lock);
+    }
+    if (overflow || stopSender) {
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+    unsigned char *buffer = pending;
+    size_t length = pendingLength;
+    pending = sending;
+    pendingLength = 0;
+    sending = buffer;
+    pthread_mutex_unlock(&lock);
+
+    if (-1 == sendAll(fd, sending, length)) {
+      return;
+    }
+  }
+}
+
+/** Sender thread of the primary, serving one standby at a time. */
+static void *sendToStandby(void *arg) {
+  while (1) {
+    int fd = accept(listenFd, NULL, NULL);
+
+    pthread_mutex_lock(&lock);
+    int stop = stopSender;
+    pthread_mutex_unlock(&lock);
+    if (stop) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      break;
+    }
+    if (fd < 0) {
+      if (errno != EINTR) {
+        debug_perror("Error accepting a standby");
+        sleep(1);
+      }
+      continue;
+    }
+
+    debug_info("Standby connected, synchronizing it.");
+    if (0 == synchronize(fd)) {
+      debug_info("Standby synchronized, streaming writes.");
+      stream(fd);
+    }
+
+    pthread_mutex_lock(&lock);
+    streaming = 0;
+    overflow = 0;
+    pendingLength = 0;
+    standbyFd = -1;
+    pthread_mutex_unlock(&lock);
+    close(fd);
+    debug_info("Standby disconnected.");
+  }
+  return NULL;
+}
+
+/**
+ * Start serving the writes applied by this server to a standby connecting to
+ * the Unix socket at "path".
+ * @param tables Tables served, from table 0 on. The standby must serve the
+ * same tables with the same ids.
+ * @return -1 in case of error creating the socket. 0 means OK.
+ */
+int STORR_listen(const char *path, int tables) {
+  struct sockaddr_un address;
+
+  if (listenFd >= 0 || -1 == socketAddress(&address, path)) {
+    debug_error("Cannot listen for a standby at %s.", path);
+    return -1;
+  }
+
+  pending = malloc(STORR_BUFFERSIZE);
+  sending = malloc(STORR_BUFFERSIZE);
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (pending == NULL || sending == NULL || listenFd < 0 ||
+      -1 == bind(listenFd, (struct sockaddr *)&address, sizeof(address)) ||
+      -1 == listen(listenFd, 1)) {
+    debug_perror("Error creating the replication socket");
+    if (listenFd >= 0) {
+      close(listenFd);
+      listenFd = -1;
+    }
+    free(pending);
+    free(sending);
+    pending = sending = NULL;
+    return -1;
+  }
+
+  strcpy(listenPath, path);
+  numTables = tables;
+  stopSender = 0;
+  if (0 != pthread_create(&sender, NULL, sendToStandby, NULL)) {
+    debug_error("Error starting the replication sender.");
+    close(listenFd);
+    listenFd = -1;
+    unlink(listenPath);
+    return -1;
+  }
+
+  debug_info("Waiting for a standby at %s.", path);
+  return 0;
+}
+
+/**
+ * Ship a write applied to the cache to the standby, if there is one.
+ * @return -1 if the standby had to be dropped. 0 means OK.
+ */
+int STORR_shipWrite(int table, int fileIndex, const MYRECORD_RECORD_t *record) {
+  MYC_TXENTRY_t entry;
+  int status;
+
+  if (listenFd < 0) {
+    return 0;
+  }
+
+  entry.op = MYC_TXWRITE;
+  entry.index = fileIndex;
+  memcpy(&entry.record, record, sizeof(MYRECORD_RECORD_t));
+
+  pthread_mutex_lock(&lock);
+  status = ship(table, &entry, 1, 0);
+  pthread_mutex_unlock(&lock);
+  return status;
+}
+
+/**
+ * Ship a delete applied to the cache to the standby, if there is one.
+ * @return -1 if the standby had to be dropped. 0 means OK.
+ */
+int STORR_shipDelete(int table, int fileIndex) {
+  MYC_TXENTRY_t entry;
+  int status;
+
+  if (listenFd < 0) {
+    return 0;
+  }
+
+  memset(&entry, 0, sizeof(MYC_TXENTRY_t));
+  entry.op = MYC_TXWRITE;
+  entry.index = fileIndex;
+
+  pthread_mutex_lock(&lock);
+  status = ship(table, &entry, 1, REPL_DELETE);
+  pthread_mutex_unlock(&lock);
+  return status;
+}
+
+/**
+ * Ship the writes of a committed transaction to the standby, if there is one.
+ * The checks are left out, they already succeeded here.
+ * @return -1 if the standby had to be dropped. 0 means OK.
+ */
+int STORR_shipCommit(int table, const MYC_TXENTRY_t *entries, int count) {
+  int status;
+
+  if (listenFd < 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&lock);
+  status = ship(table, entries, count, REPL_ATOMIC);
+  pthread_mutex_unlock(&lock);
+  return status;
+}
+
+/**
+ * Disconnect the standby and stop listening. The writes not sent yet are lost
+ * for the standby, which synchronizes again when it connects to a primary.
+ * @return -1 in case of error. 0 means OK.
+ */
+int STORR_closeListen() {
+  if (listenFd < 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&lock);
+  stopSender = 1;
+  if (standbyFd >= 0) {
+    shutdown(standbyFd, SHUT_RDWR);
+  }
+  pthread_cond_signal(&shipped);
+  pthread_mutex_unlock(&lock);
+
+  /* Wakes up accept(). */
+  shutdown(listenFd, SHUT_RDWR);
+  pthread_join(sender, NULL);
+
+  close(listenFd);
+  listenFd = -1;
+  unlink(listenPath);
+  free(pending);
+  free(sending);
+  pending = sending = NULL;
+
+  debug_info("Replication to standby stopped.");
+  return 0;
+}
+
+/**
+ * Apply a frame received from the primary to the cache.
+ * @return -1 in case of error applying it. 0 success.
+ */
+static int apply(const REPL_BATCH_t *batch) {
+  if (batch->frame.flags & REPL_ATOMIC) {
+    return MYC_commit(batch->frame.table, batch->entries, batch->frame.count,
+                      NULL);
+  }
+
+  for (int i = 0; i < batch->frame.count; i++) {
+    if (batch->frame.flags & REPL_DELETE) {
+      if (-1 == MYC_deleteTableEntry(batch->frame.table,
+                                     batch->entries[i].index)) {
+        return -1;
+      }
+    } else if (-1 == MYC_writeTableEntry(
+                         batch->frame.table, batch->entries[i].index,
+                         (MYRECORD_RECORD_t *)&batch->entries[i].record)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** Wait up to a second for a retry, or less if the standby is promoted. */
+static int waitRetry() {
+  for (int i = 0; i < 10; i++) {
+    pthread_mutex_lock(&lock);
+    int stop = stopFollower;
+    pthread_mutex_unlock(&lock);
+    if (stop) {
+      return -1;
+    }
+    usleep(100000);
+  }
+  return 0;
+}
+
+/** Follower thread of the standby, connecting again when the primary goes. */
+static void *followPrimary(void *arg) {
+  static REPL_BATCH_t batch;
+  struct sockaddr_un address;
+  unsigned long applied = 0;
+
+  socketAddress(&address, followPath);
+
+  do {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        -1 == connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      continue;
+    }
+
+    pthread_mutex_lock(&lock);
+    int stop = stopFollower;
+    if (!stop) {
+      primaryFd = fd;
+    }
+    pthread_mutex_unlock(&lock);
+    if (stop) {
+      close(fd);
+      break;
+    }
+    debug_info("Following the primary at %s.", followPath);
+
+    while (0 == recvAll(fd, &batch.frame, sizeof(REPL_FRAME_t))) {
+      if (batch.frame.magic != REPL_MAGIC || batch.frame.count <= 0 ||
+          batch.frame.count > REPL_MAXENTRIES) {
+        debug_error("Invalid frame received from the primary.");
+        break;
+      }
+      if (-1 == recvAll(fd, batch.entries,
+                        batch.frame.count * sizeof(MYC_TXENTRY_t))) {
+        break;
+      }
+      if (-1 == apply(&batch)) {
+        debug_error("Error applying %d writes to table %d.", batch.frame.count,
+                    batch.frame.table);
+      }
+      applied += batch.frame.count;
+      debug_verbose("%lu writes applied from the primary.", applied);
+    }
+
+    pthread_mutex_lock(&lock);
+    primaryFd = -1;
+    pthread_mutex_unlock(&lock);
+    close(fd);
+    debug_info("Connection to the primary lost after %lu writes.", applied);
+  } while (0 == waitRetry());
+
+  return NULL;
+}
+
+/**
+ * Start following the primary listening at "path": its writes are applied to
+ * the cache of this server, connecting again whenever the connection is lost.
+ * The tables must be open already, with the same ids as in the primary.
+ * @return -1 in case of error. 0 means OK.
+ */
+int STORR_follow(const char *path) {
+  struct sockaddr_un address;
+
+  if (following || -1 == socketAddress(&address, path)) {
+    debug_error("Cannot follow a primary at %s.", path);
+    return -1;
+  }
+
+  strcpy(followPath, path);
+  stopFollower = 0;
+  if (0 != pthread_create(&follower, NULL, followPrimary, NULL)) {
+    debug_error("Error starting the replication follower.");
+    return -1;
+  }
+  following = 1;
+  return 0;
+}
+
+/**
+ * Stop following the primary, the writes received are kept. The server may
+ * take writes of its own from now on.
+ * @return -1 if this server was not following a primary. 0 means OK.
+ */
+int STORR_promote() {
+  if (!following) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&lock);
+  stopFollower = 1;
+  if (primaryFd >= 0) {
+    shutdown(primaryFd, SHUT_RDWR);
+  }
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(follower, NULL);
+  following = 0;
+
+  debug_info("Standby promoted, it no longer follows %s.", followPath);
+  return 0;
+}
+
+/** Increases current debug level or reset to 0 if maximum is reached. */
+void STORR_debuglevel_rotate() { debuglevel_rotate(); }
@@ -3,27 +3,111 @@
 #include "mystore_srv.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #define DEBUG_LEVEL 0
 #define SEND_TO_SERVER 1
 
+/* Leases live in a set associative table, the ways of a bucket hold the
+ * records hashing to it, one way per client holding each. */
+#define LEASE_WAYS 8
+#define LEASE_BUCKETS (MYSTORE_LEASES / LEASE_WAYS)
+
+/* Clients with invalidations pending to be read, at most. */
+#define NOTIFIED_CLIENTS 256
+
+typedef struct {
+  long client; /* 0 if the way is free. */
+  int table;
+  int index;
+  uint64_t expires;
+} LEASE_t;
+
+/* A client sent invalidations. They are removed from the queue if it has not
+ * read them once the last lease they are about has ended: the client will not
+ * use those records any more, and the queue must not fill up with the
+ * invalidations of clients that are gone. */
+typedef struct {
+  long client;
+  uint64_t expires;
+} NOTIFIED_t;
+
+/* An answer to a write held back until the leases on the record that could
+ * not be invalidated have ended, see invalidateLease(). The clients send one
+ * request at a time, so there are never more than the requests in flight. */
+#define HELD_ANSWERS MYSTORE_INFLIGHT
+#define HELD_POLL_US 1000
+
+typedef struct {
+  uint64_t until;
+  answer_message_t answer;
+} HELD_t;
+
 static int message_queue = -1;
+static key_t message_key = IPC_PRIVATE;
+
+/* Requests read from the queue and not served yet. Each client has its own
+ * FIFO of them in every priority class, and the clients with requests of a
+ * class are served in turns. */
+typedef struct {
+  int next; /* Next request of the same client, or next free slot. */
+  commit_message_t message;
+} SLOT_t;
+
+typedef struct {
+  long client;
+  int head;
+  int tail;
+} FLOW_t;
+
+/* Answers that cannot be sent because the queue is full are retried for this
+ * long, reading requests meanwhile, before giving up on the client. */
+#define SEND_TIMEOUT_NS 1000000000ULL
+
+static unsigned int inflight = MYSTORE_INFLIGHT;
+static SLOT_t *slots = NULL;
+static int freeSlots = -1;
+static unsigned int pending = 0;
+static unsigned int pendingClass[MYSTORE_PRIORITIES];
+static FLOW_t *flows[MYSTORE_PRIORITIES];
+static int numFlows[MYSTORE_PRIORITIES];
+static int nextFlow[MYSTORE_PRIORITIES];
+static int bulkSkipped = 0; /* Interactive turns since the last bulk one. */
+static uint64_t serviceStart = 0;
+static uint64_t serviceAverage = 0; /* Nanoseconds, moving average. */
+static uint64_t busy = 0;
+static uint64_t expired = 0;
+
+static LEASE_t leases[LEASE_BUCKETS][LEASE_WAYS];
+static NOTIFIED_t notified[NOTIFIED_CLIENTS];
+static uint64_t nextPurge;
+static HELD_t held[HELD_ANSWERS];
+static int numHeld = 0;
+static uint64_t holdUntil = 0; /* For the answer of the current request. */
 
 static int debug_level = DEBUG_INIT;
 
+static int sendMessage(const void *message, size_t size);
+
 /**
  * Initialize the server library: open message queue, etc.
  * @return -1 in case of error during initialization. 0 means OK.
  */
-int STORS_init() {
+int STORS_init() { return STORS_initKey(MYSTORE_API_KEY); }
 
-  key_t key = IPC_PRIVATE;
-  key = (key_t)getuid();
+/**
+ * Initialize the server library on the queue with the given key, like the one
+ * of a partition.
+ * @return -1 in case of error during initialization. 0 means OK.
+ */
+int STORS_initKey(key_t key) {
 
   debug_verbose("Opening message queue in server API... (key=0x%08x)", key);
   message_queue =
@@ -45,7 +129,44 @@ int STORS_init() {
     return -1;
   }
 
+  /* Room for twice the budget: busy answers may not fit in a full queue. */
+  slots = malloc(2 * inflight * sizeof(SLOT_t));
+  int allocated = slots != NULL;
+  for (int c = 0; c < MYSTORE_PRIORITIES; c++) {
+    flows[c] = malloc(2 * inflight * sizeof(FLOW_t));
+    allocated &= flows[c] != NULL;
+    pendingClass[c] = 0;
+    numFlows[c] = 0;
+    nextFlow[c] = 0;
+  }
+  if (!allocated) {
+    debug_error("No memory for %u requests in flight.", inflight);
+    freeSlots = -1;
+    STORS_close();
+    return -1;
+  }
+  for (unsigned int i = 0; i < 2 * inflight; i++) {
+    slots[i].next = i + 1 < 2 * inflight ? (int)i + 1 : -1;
+  }
+  freeSlots = 0;
+  pending = 0;
+  bulkSkipped = 0;
+
   debug_info("Message queue opened in server API. (key=0x%08x)", key);
+  message_key = key;
+  return 0;
+}
+
+/**
+ * Set how many requests may wait inside the server before new ones are
+ * answered MYSTORE_BUSY. Must be called before STORS_init().
+ * @return -1 if it is 0. 0 means OK.
+ */
+int STORS_setInflight(unsigned int requests) {
+  if (requests == 0 || slots != NULL) {
+    return -1;
+  }
+  inflight = requests;
   return 0;
 }
 
@@ -60,31 +181,33 @@ int STORS_close() {
     return -1;
   }
   debug_info("Message queue removed in server API. (key=0x%08x)",
-             MYSTORE_API_KEY);
+             message_key);
 
   message_queue = -1;
+  free(slots);
+  slots = NULL;
+  for (int c = 0; c < MYSTORE_PRIORITIES; c++) {
+    free(flows[c]);
+    flows[c] = NULL;
+  }
 
   return 0;
 }
 
 /**
- * This function reads a request from the message queue.
- * This function will wait blocked until it receives a request.
- * When returning, the request passed by reference as pameter will contain the
- * data of the request received from the message queue.
- * The request will be processes outside this library.
- * @param request Is a pointer to a request structure to return a request
- * received from the client.
+ * This function reads a request from the message queue into a buffer of
+ * "size" bytes, large enough for a commit_message_t when it may be one.
+ * Sizes of messages include the mtype, which msgrcv() does not count.
  * @return Return 0 if OK. -1 in case of some error receiving.
  */
-int STORS_readrequest(request_message_t *request) {
+int STORS_readmessage(void *message, size_t size) {
 
   debug_verbose("Receiving request from client (type=%d).", MYSAPMT_REQUEST);
 
   int status;
 
   do {
-    status = msgrcv(message_queue, request, sizeof(request_message_t),
+    status = msgrcv(message_queue, message, size - sizeof(long),
                     SEND_TO_SERVER, 0);
     if (-1 != status) {
       break;
@@ -103,24 +226,256 @@ int STORS_readrequest(request_message_t *request) {
   } while (1);
 
   debug_debug("Request received from client (cliend id=%ld, op=%d, idx=%d).",
-              request->return_to, request->requested_op, request->index);
+              ((request_message_t *)message)->return_to,
+              ((request_message_t *)message)->requested_op,
+              ((request_message_t *)message)->index);
 
   return 0;
 }
 
 /**
- * This function send an answer structure to a client through a message queue.
- * @param answer This structure is already initialized and ready to be sent.
+ * Answer a request that does not fit in the budget, without waiting for room
+ * in the queue. The hint is the time to serve the requests already waiting.
+ * @return -1 if the queue is full. 0 success.
+ */
+static int sendBusy(const request_message_t *request) {
+  answer_message_t answer;
+  uint64_t wait = pending * serviceAverage / 1000;
+
+  memset(&answer, 0, sizeof(answer_message_t));
+  answer.mtype = request->return_to;
+  answer.status = -1;
+  answer.refused = MYSTORE_BUSY;
+  answer.retryAfter = wait < 100 ? 100 : (wait > 100000 ? 100000 : wait);
+
+  if (-1 == msgsnd(message_queue, &answer,
+                   sizeof(answer_message_t) - sizeof(long), IPC_NOWAIT)) {
+    return -1;
+  }
+  busy++;
+  return 0;
+}
+
+/** Priority class of a request, bulk if the client sent something else. */
+static int requestClass(const request_message_t *request) {
+  return request->priority == MYSPRIO_INTERACTIVE ? MYSPRIO_INTERACTIVE
+                                                  : MYSPRIO_BULK;
+}
+
+/**
+ * Queue a request read in "slot" behind the others of its client in its
+ * class.
+ */
+static void enqueue(int slot) {
+  long client = slots[slot].message.request.return_to;
+  int c = requestClass(&slots[slot].message.request);
+  FLOW_t *classFlows = flows[c];
+  int flow = 0;
+
+  freeSlots = slots[slot].next;
+  slots[slot].next = -1;
+  pending++;
+  pendingClass[c]++;
+
+  while (flow < numFlows[c] && classFlows[flow].client != client) {
+    flow++;
+  }
+  if (flow == numFlows[c]) {
+    classFlows[flow].client = client;
+    classFlows[flow].head = slot;
+    classFlows[flow].tail = slot;
+    numFlows[c]++;
+  } else {
+    slots[classFlows[flow].tail].next = slot;
+    classFlows[flow].tail = slot;
+  }
+}
+
+/**
+ * Take the oldest request of the next client in turn of class "c" out of the
+ * queues into "message".
+ */
+static void dequeue(int c, commit_message_t *message) {
+  if (nextFlow[c] >= numFlows[c]) {
+    nextFlow[c] = 0;
+  }
+  FLOW_t *flow = &flows[c][nextFlow[c]];
+  int slot = flow->head;
+
+  memcpy(message, &slots[slot].message, sizeof(commit_message_t));
+  flow->head = slots[slot].next;
+  slots[slot].next = freeSlots;
+  freeSlots = slot;
+  pending--;
+  pendingClass[c]--;
+
+  if (flow->head == -1) {
+    memmove(flow, flow + 1,
+            (numFlows[c] - nextFlow[c] - 1) * sizeof(FLOW_t));
+    numFlows[c]--;
+  } else {
+    nextFlow[c]++;
+  }
+}
+
+/**
+ * Answer MYSTORE_EXPIRED to a request whose deadline passed while it waited.
  * @return Return 0 if OK. -1 in case of some error sending.
  */
-int STORS_sendanswer(answer_message_t *answer) {
+static int sendExpired(const request_message_t *request) {
+  answer_message_t answer;
+
+  memset(&answer, 0, sizeof(answer_message_t));
+  answer.mtype = request->return_to;
+  answer.status = -1;
+  answer.refused = MYSTORE_EXPIRED;
+  expired++;
+
+  debug_debug("Request of client %ld expired %lu ns ago.", request->return_to,
+              myh_now() - request->deadline);
+  return sendMessage(&answer, sizeof(answer_message_t));
+}
+
+/**
+ * Send the held answers whose leases have ended.
+ * @return -1 if the queue is gone. 0 success.
+ */
+static int releaseHeld() {
+  uint64_t now = myh_now();
+
+  for (int i = 0; i < numHeld;) {
+    if (held[i].until > now) {
+      i++;
+      continue;
+    }
+    if (-1 == sendMessage(&held[i].answer, sizeof(answer_message_t))) {
+      return -1;
+    }
+    held[i] = held[--numHeld];
+  }
+  return 0;
+}
+
+/**
+ * Read every request waiting in the queue without blocking. Beyond the
+ * budget they are answered MYSTORE_BUSY, or kept while there are slots if not
+ * even that answer fits.
+ * @return The number of requests read.
+ */
+static int admit() {
+  int read = 0;
+
+  while (freeSlots != -1) {
+    int slot = freeSlots;
+
+    if (-1 == msgrcv(message_queue, &slots[slot].message,
+                     sizeof(commit_message_t) - sizeof(long), SEND_TO_SERVER,
+                     IPC_NOWAIT)) {
+      break;
+    }
+    read++;
+    if (pending < inflight || -1 == sendBusy(&slots[slot].message.request)) {
+      enqueue(slot);
+    }
+  }
+  return read;
+}
+
+/**
+ * Wait for the next request to serve: the oldest one of the next client in
+ * turn among those with interactive requests waiting, or with bulk ones if
+ * there are none or the bulk class is due its share. The requests arrived
+ * meanwhile are read first, so that clients are served fairly and those
+ * beyond the budget are told to come back later. Requests whose deadline
+ * has passed are answered MYSTORE_EXPIRED instead of returned, and the held
+ * answers sent once they are due.
+ * @param message Receives the request, large enough for a commit_message_t.
+ * @return Return 0 if OK. -1 if interrupted or in case of error receiving.
+ */
+int STORS_nextrequest(commit_message_t *message) {
+  holdUntil = 0;
+  do {
+    admit();
+    if (-1 == releaseHeld()) {
+      return -1;
+    }
+
+    /* The held answers are due even if no request comes. */
+    while (pending == 0 && numHeld > 0) {
+      usleep(HELD_POLL_US);
+      admit();
+      if (-1 == releaseHeld()) {
+        return -1;
+      }
+    }
+    if (pending == 0) {
+      int slot = freeSlots;
+      if (-1 ==
+          STORS_readmessage(&slots[slot].message, sizeof(commit_message_t))) {
+        return -1;
+      }
+      enqueue(slot);
+    }
+
+    int c = MYSPRIO_INTERACTIVE;
+    if (pendingClass[MYSPRIO_BULK] > 0) {
+      if (pendingClass[MYSPRIO_INTERACTIVE] == 0 ||
+          bulkSkipped >= MYSTORE_BULK_SHARE - 1) {
+        c = MYSPRIO_BULK;
+        bulkSkipped = 0;
+      } else {
+        bulkSkipped++;
+      }
+    }
+    dequeue(c, message);
+
+    if (message->request.deadline == 0 ||
+        myh_now() <= message->request.deadline) {
+      break;
+    }
+    if (-1 == sendExpired(&message->request)) {
+      return -1;
+    }
+  } while (1);
+
+  serviceStart = myh_now();
+  return 0;
+}
+
+/** Requests answered MYSTORE_BUSY since the server started. */
+uint64_t STORS_busy() { return busy; }
+
+/** Requests answered MYSTORE_EXPIRED since the server started. */
+uint64_t STORS_expired() { return expired; }
+
+/**
+ * This function reads a request from the message queue.
+ * This function will wait blocked until it receives a request.
+ * When returning, the request passed by reference as pameter will contain the
+ * data of the request received from the message queue.
+ * The request will be processes outside this library.
+ * @param request Is a pointer to a request structure to return a request
+ * received from the client.
+ * @return Return 0 if OK. -1 in case of some error receiving.
+ */
+int STORS_readrequest(request_message_t *request) {
+  return STORS_readmessage(request, sizeof(request_message_t));
+}
+
+/**
+ * Send a message of "size" bytes to a client. While the queue is full the
+ * requests in it are read to make room, so the server never blocks on a
+ * queue full of requests waiting for it. A client that does not read its
+ * answers for SEND_TIMEOUT_NS loses them.
+ * @return Return 0 if OK or the answer was dropped. -1 if the queue is gone.
+ */
+static int sendMessage(const void *message, size_t size) {
 
-  debug_verbose("Sending answer to client (client id=%ld, status=%d).",
-                answer->mtype, answer->status);
   int status;
+  uint64_t start = 0;
 
   do {
-    status = msgsnd(message_queue, answer, sizeof(answer_message_t), 0);
+    status = msgsnd(message_queue, message, size - sizeof(long), IPC_NOWAIT);
 
     if (-1 != status) {
       break;
@@ -130,16 +485,287 @@ int STORS_sendanswer(answer_message_t *answer) {
       debug_perror("Message queue is removed");
       return -1;
     }
+    if (errno != EAGAIN && errno != EINTR) {
+      debug_perror("Error sending message, retrying");
+    }
 
-    debug_perror("Error sending message, retrying");
+    if (start == 0) {
+      start = myh_now();
+    } else if (myh_now() - start > SEND_TIMEOUT_NS) {
+      debug_error("Queue full for too long, answer to client %ld dropped.",
+                  *(const long *)message);
+      return 0;
+    }
+    if (0 == admit()) {
+      usleep(1000);
+    }
 
   } while (1);
 
+  if (serviceStart != 0) {
+    uint64_t service = myh_now() - serviceStart;
+    serviceAverage = serviceAverage ? (7 * serviceAverage + service) / 8
+                                    : service;
+    serviceStart = 0;
+  }
+  return 0;
+}
+
+/**
+ * This function send an answer structure to a client through a message queue.
+ * @param answer This structure is already initialized and ready to be sent.
+ * @return Return 0 if OK. -1 in case of some error sending.
+ */
+int STORS_sendanswer(answer_message_t *answer) {
+
+  debug_verbose("Sending answer to client (client id=%ld, status=%d).",
+                answer->mtype, answer->status);
+
+  if (holdUntil > myh_now()) {
+    if (numHeld < HELD_ANSWERS) {
+      held[numHeld].until = holdUntil;
+      memcpy(&held[numHeld].answer, answer, sizeof(answer_message_t));
+      numHeld++;
+      holdUntil = 0;
+      debug_debug("Answer to client %ld held until the leases end.",
+                  answer->mtype);
+      return 0;
+    }
+    /* Not reached while the clients send one request at a time. */
+    uint64_t left = holdUntil - myh_now();
+    struct timespec wait = {left / 1000000000ULL, left % 1000000000ULL};
+    while (-1 == nanosleep(&wait, &wait) && errno == EINTR) {
+    }
+  }
+  holdUntil = 0;
+
+  if (-1 == sendMessage(answer, sizeof(answer_message_t))) {
+    return -1;
+  }
+
   debug_debug("Answer sent to client (client id=%ld, status=%d).",
               answer->mtype, answer->status);
 
   return 0;
 }
 
+/**
+ * This function send the answer to a MYSCOP_STATS request to a client.
+ * @param answer This structure is already initialized and ready to be sent.
+ * @return Return 0 if OK. -1 in case of some error sending.
+ */
+int STORS_sendstats(stats_message_t *answer) {
+
+  debug_verbose("Sending stats to client (client id=%ld).", answer->mtype);
+
+  return sendMessage(answer, sizeof(stats_message_t));
+}
+
+/**
+ * This function send the answer to a MYSCOP_BLOBREAD request to a client.
+ * @param answer This structure is already initialized and ready to be sent.
+ * @return Return 0 if OK. -1 in case of some error sending.
+ */
+int STORS_sendpayload(payload_message_t *answer) {
+
+  debug_verbose("Sending payload to client (client id=%ld, status=%d).",
+                answer->mtype, answer->status);
+
+  return sendMessage(answer, sizeof(payload_message_t));
+}
+
+static LEASE_t *leaseBucket(int table, int index) {
+  return leases[((unsigned int)index * 2654435761u ^ (unsigned int)table) %
+                LEASE_BUCKETS];
+}
+
+/**
+ * Grant a client a lease on a record it has just read, or renew it. None is
+ * granted while half the requests in flight are waiting: a write of a leased
+ * record may then have to wait for it, see invalidateLease().
+ * @return -1 if there is no room for another lease. 0 means OK.
+ */
+int STORS_grantLease(int table, int index, long client) {
+  LEASE_t *bucket = leaseBucket(table, index);
+  LEASE_t *way = NULL;
+  uint64_t now = myh_now();
+
+  if (pending >= inflight / 2) {
+    return -1;
+  }
+
+  for (int i = 0; i < LEASE_WAYS; i++) {
+    if (bucket[i].client == client && bucket[i].table == table &&
+        bucket[i].index == index) {
+      way = &bucket[i];
+      break;
+    }
+    if (way == NULL && (bucket[i].client == 0 || bucket[i].expires <= now)) {
+      way = &bucket[i];
+    }
+  }
+  if (way == NULL) {
+    return -1;
+  }
+
+  way->client = client;
+  way->table = table;
+  way->index = index;
+  way->expires = now + MYSTORE_LEASE_NS;
+  return 0;
+}
+
+/** Remove the invalidations a client did not read from the queue. */
+static void purgeInvalidations(NOTIFIED_t *entry) {
+  invalidate_message_t message;
+
+  while (-1 != msgrcv(message_queue, &message,
+                      sizeof(invalidate_message_t) - sizeof(long),
+                      MYSTORE_INVALIDATE(entry->client), IPC_NOWAIT)) {
+  }
+  debug_verbose("Invalidations of client %ld purged.", entry->client);
+  entry->client = 0;
+}
+
+/**
+ * The entry where to remember that a client has invalidations: its own, or
+ * a free one, or the one of a client whose leases have all ended, purged.
+ * @return NULL if every entry is in use by a client with a live lease.
+ */
+static NOTIFIED_t *findNotified(long client, uint64_t now) {
+  NOTIFIED_t *entry = NULL;
+
+  for (int i = 0; i < NOTIFIED_CLIENTS; i++) {
+    if (notified[i].client == client) {
+      return &notified[i];
+    }
+    if (entry == NULL &&
+        (notified[i].client == 0 || notified[i].expires <= now)) {
+      entry = &notified[i];
+    }
+  }
+  if (entry != NULL && entry->client != 0) {
+    purgeInvalidations(entry);
+  }
+  return entry;
+}
+
+/**
+ * Send an invalidation unless the queue is half full: the other half is kept
+ * for requests, or clients blocked sending them could never read theirs.
+ * @return -1 if it was not sent. 0 success.
+ */
+static int sendInvalidation(invalidate_message_t *message) {
+  struct msqid_ds queue;
+
+  if (-1 == msgctl(message_queue, IPC_STAT, &queue) ||
+      queue.msg_cbytes + sizeof(invalidate_message_t) > queue.msg_qbytes / 2) {
+    errno = EAGAIN;
+    return -1;
+  }
+  return msgsnd(message_queue, message,
+                sizeof(invalidate_message_t) - sizeof(long), IPC_NOWAIT);
+}
+
+/**
+ * End a lease on a record that has been written, sending an invalidation to
+ * its client if it is live and not the writer. When the queue is too full,
+ * or too many clients have invalidations pending, the answer to the writer
+ * is held until the lease ends instead, so that the client cannot serve the
+ * old record once the write is acknowledged. The other requests go on.
+ * @return 1 if an invalidation was sent. 0 otherwise.
+ */
+static int invalidateLease(LEASE_t *way, long writer, uint64_t now) {
+  invalidate_message_t message;
+  int sent = 0;
+
+  if (way->expires > now && way->client != writer &&
+      !(-1 == kill((pid_t)way->client, 0) && errno == ESRCH)) {
+    NOTIFIED_t *entry = findNotified(way->client, now);
+
+    message.mtype = MYSTORE_INVALIDATE(way->client);
+    message.table = way->table;
+    message.index = way->index;
+
+    if (entry != NULL && 0 == sendInvalidation(&message)) {
+      if (entry->client != way->client || entry->expires < way->expires) {
+        entry->expires = way->expires;
+      }
+      entry->client = way->client;
+      sent = 1;
+    } else {
+      debug_debug("Cannot invalidate the lease of client %ld, the answer "
+                  "waits for it to end.",
+                  way->client);
+      if (way->expires > holdUntil) {
+        holdUntil = way->expires;
+      }
+    }
+  }
+  way->client = 0;
+  return sent;
+}
+
+/**
+ * A record has been written: send an invalidation to every other client
+ * holding a live lease on it, and end the leases.
+ * @param writer The client that wrote it, it drops the record itself.
+ * @return The number of invalidations sent.
+ */
+int STORS_invalidate(int table, int index, long writer) {
+  LEASE_t *bucket = leaseBucket(table, index);
+  uint64_t now = myh_now();
+  int sent = 0;
+
+  for (int i = 0; i < LEASE_WAYS; i++) {
+    if (bucket[i].client != 0 && bucket[i].table == table &&
+        bucket[i].index == index) {
+      sent += invalidateLease(&bucket[i], writer, now);
+    }
+  }
+
+  return sent;
+}
+
+/**
+ * STORS_invalidate() for the "count" records from "index" on, like those of
+ * a bulk load. Looks at every lease once instead of at every record.
+ * @return The number of invalidations sent.
+ */
+int STORS_invalidateRange(int table, int index, int count, long writer) {
+  uint64_t now = myh_now();
+  int sent = 0;
+
+  for (int b = 0; b < LEASE_BUCKETS; b++) {
+    for (int i = 0; i < LEASE_WAYS; i++) {
+      LEASE_t *way = &leases[b][i];
+      if (way->client != 0 && way->table == table && way->index >= index &&
+          way->index - index < count) {
+        sent += invalidateLease(way, writer, now);
+      }
+    }
+  }
+
+  return sent;
+}
+
+/**
+ * Purge the invalidations no client is going to read. Cheap enough to be
+ * called after every request: it only looks every half a lease.
+ */
+void STORS_expireLeases() {
+  uint64_t now = myh_now();
+
+  if (now < nextPurge) {
+    return;
+  }
+  for (int i = 0; i < NOTIFIED_CLIENTS; i++) {
+    if (notified[i].client != 0 && notified[i].expires < now) {
+      purgeInvalidations(&notified[i]);
+    }
+  }
+  nextPurge = now + MYSTORE_LEASE_NS / 2;
+}
+
 /** Increases current debug level or reset to 0 if maximum is reached. */
 void STORS_debuglevel_rotate() { debuglevel_rotate(); }
\ No newline at end of file
@@ -5,12 +5,35 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define MYSTORE_API_KEY ((key_t)getuid())
+#include <mycache.h>
+#include <myrecord.h>
+
+/* The queue of the server is keyed by the uid, unless MYSTORE_KEY is set in
+ * the environment: several servers of one user need a key each. */
+#define MYSTORE_KEY_ENV "MYSTORE_KEY"
+
+static inline key_t mystore_apiKey(void) {
+  const char *key = getenv(MYSTORE_KEY_ENV);
+  return key != NULL ? (key_t)strtol(key, NULL, 0) : (key_t)getuid();
+}
+
+#define MYSTORE_API_KEY (mystore_apiKey())
+
+/* Partitioned mode: server "p" of a cluster owns a slice of the indices and
+ * listens on its own queue. Clients find the number of partitions in
+ * MYSTORE_PARTITIONS and route every index by consistent hashing, with
+ * MYSTORE_VNODES points of the hash ring per partition. */
+#define MYSTORE_PARTITIONS_ENV "MYSTORE_PARTITIONS"
+#define MYSTORE_MAXPARTITIONS 64
+#define MYSTORE_VNODES 64
+#define MYSTORE_PARTITION_KEY(p) ((key_t)((MYSTORE_API_KEY << 8) | (p)))
 #define MYSTORE_API_CLIENT ((long)getpid())
 
 typedef enum {
@@ -19,21 +42,150 @@ typedef enum {
   MYSAPMT_ANYCLIENT = 3
 } MYSTORE_API_MTYPES;
 
-typedef enum { MYSCOP_READ = 0, MYSCOP_WRITE = 1 } MYSTORE_CLI_OP;
+typedef enum {
+  MYSCOP_READ = 0,
+  MYSCOP_WRITE = 1,
+  MYSCOP_STATS = 2,
+  MYSCOP_COMMIT = 3,
+  MYSCOP_SNAPOPEN = 4,
+  MYSCOP_SNAPREAD = 5,
+  MYSCOP_SNAPCLOSE = 6,
+  MYSCOP_LOAD = 7,
+  MYSCOP_DELETE = 8,
+  MYSCOP_COMPACT = 9,
+  MYSCOP_BACKUP = 10,
+  MYSCOP_BLOBREAD = 11,
+  MYSCOP_BLOBWRITE = 12
+} MYSTORE_CLI_OP;
+
+/* Entries of a transaction sent in one commit_message_t. */
+#define MYSTORE_TXMAX 64
+
+/* Refusal of a request when the server has MYSTORE_INFLIGHT requests waiting
+ * already: the request was not served, retry it after "retryAfter". The
+ * refusals are in the "refused" field of the answer, since the status of
+ * some operations is a snapshot id or a count. */
+#define MYSTORE_BUSY 2
+#define MYSTORE_INFLIGHT 128
+
+/* Priority classes. The server serves the interactive requests waiting
+ * before the bulk ones, but gives a bulk request one turn every
+ * MYSTORE_BULK_SHARE requests while both wait, so that a loader is slowed
+ * down and never stopped. A request with a deadline that is still waiting
+ * when it passes is not served, it is refused with MYSTORE_EXPIRED. */
+typedef enum { MYSPRIO_INTERACTIVE = 0, MYSPRIO_BULK = 1 } MYSTORE_PRIORITY;
+
+#define MYSTORE_PRIORITIES 2
+#define MYSTORE_BULK_SHARE 8
+#define MYSTORE_EXPIRED 3
+
+/* Near cache of the clients. A read with MYSTORE_REQ_LEASE asks for a lease
+ * of MYSTORE_LEASE_NS on the record: until it ends the client may serve it
+ * from its own cache, and a write of the record before that sends the client
+ * an invalidate_message_t of type MYSTORE_INVALIDATE(client). The server
+ * keeps MYSTORE_LEASES leases at most, a read beyond that gets none. */
+#define MYSTORE_REQ_LEASE 0x1
+#define MYSTORE_LEASE_NS 1000000000ULL
+#define MYSTORE_LEASES 4096
+#define MYSTORE_INVALIDATE(client) ((1L << 32) + (client))
 
 typedef struct {
   long mtype;
   MYSTORE_CLI_OP requested_op;
   long return_to;
+  int table; /* Id of the table in the server, 0 is the default one. */
+  int snapshot; /* For MYSCOP_SNAPREAD and MYSCOP_SNAPCLOSE. */
+  int flags;    /* MYSTORE_REQ_* */
+  int priority; /* MYSTORE_PRIORITY */
+  int index; /* Of the record, or the budget of MYSCOP_COMPACT and
+              * MYSCOP_BACKUP in us. */
+  uint64_t sent;     /* myh_now() when the client sent it. */
+  uint64_t deadline; /* myh_now() after which it is not served, 0 never. */
   MYRECORD_RECORD_t data;
 } request_message_t;
 
+/* A MYSCOP_COMMIT request: the usual header followed by the entries. The
+ * answer is an answer_message_t with MYC_CONFLICT and the current record of
+ * the failed check when a check fails. */
+typedef struct {
+  request_message_t request;
+  int count;
+  MYC_TXENTRY_t entries[MYSTORE_TXMAX];
+} commit_message_t;
+
+/* Bytes of the path of a MYSCOP_LOAD, which keep a load_message_t smaller
+ * than a commit_message_t, the largest request the server reads. */
+#define MYSTORE_PATHMAX 1024
+
+/* A MYSCOP_LOAD request: the server imports the records of the file named
+ * "path" in its import directory, a name without '/', into "table" from
+ * "index" on, see MYC_loadTable(). The status of the answer is the number
+ * of records loaded, or -1. Also a MYSCOP_BACKUP: the server starts a
+ * backup of "table" into the directory named "path" in its backup root,
+ * created if needed, see MYC_backupTable(). */
+typedef struct {
+  request_message_t request;
+  char path[MYSTORE_PATHMAX];
+} load_message_t;
+
+/* A MYSCOP_BLOBWRITE request: the server stores the "length" bytes of
+ * "payload" at "index" of "table", see MYC_writeBlob(), 0 deletes the
+ * record. MYC_BLOBMAX keeps it smaller than a commit_message_t. A
+ * MYSCOP_BLOBREAD is a request_message_t. */
+typedef struct {
+  request_message_t request;
+  int length;
+  char payload[MYC_BLOBMAX];
+} blob_message_t;
+
 typedef struct {
   long mtype;
   int status;
+  int refused; /* MYSTORE_BUSY or MYSTORE_EXPIRED if not served, else 0. */
+  int lease;   /* A lease was granted on the record read. */
+  unsigned int retryAfter; /* Microseconds, with MYSTORE_BUSY. */
   MYRECORD_RECORD_t data;
 } answer_message_t;
 
+/* Sent to a client holding a lease on a record that has been written. */
+typedef struct {
+  long mtype;
+  int table;
+  int index;
+} invalidate_message_t;
+
+typedef struct {
+  uint64_t totalRequests;
+  uint64_t totalReadRequests;
+  uint64_t totalWriteRequests;
+  uint64_t leases;        /* Granted to the near caches of the clients. */
+  uint64_t invalidations; /* Sent to them on writes. */
+  uint64_t busy;          /* Requests answered MYSTORE_BUSY. */
+  uint64_t expired;       /* Requests answered MYSTORE_EXPIRED. */
+  MYHISTO_t queueWait; /* From the client sending to the server reading. */
+  MYHISTO_t service;   /* Time spent in the cache by each request. */
+  MYHISTO_t latency[MYSTORE_PRIORITIES]; /* From sending to answering. */
+  MYC_STATS_t cache;
+} MYSTORE_STATS_t;
+
+/* Answer to MYSCOP_STATS, larger than answer_message_t. A refusal is an
+ * answer_message_t, "refused" is where it has it. */
+typedef struct {
+  long mtype;
+  int status;
+  int refused;
+  MYSTORE_STATS_t stats;
+} stats_message_t;
+
+/* Answer to MYSCOP_BLOBREAD, larger than answer_message_t: the status is the
+ * length of the payload, 0 if absent, or -1. */
+typedef struct {
+  long mtype;
+  int status;
+  int refused;
+  char payload[MYC_BLOBMAX];
+} payload_message_t;
+
 #ifdef __cplusplus
 }
 #endif
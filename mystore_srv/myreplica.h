@@ -0,0 +1,32 @@
+#ifndef MYREPLICA_H
+#define MYREPLICA_H
+
+#include <mycache.h>
+#include <myrecord.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writes waiting to be sent to the standby. When the standby falls behind by
+ * more than this it is disconnected and synchronized again from scratch. */
+#define STORR_BUFFERSIZE (4 * 1024 * 1024)
+
+/* Primary: serve the stream of applied writes on a Unix socket. */
+int STORR_listen(const char *path, int tables);
+int STORR_shipWrite(int table, int fileIndex, const MYRECORD_RECORD_t *record);
+int STORR_shipDelete(int table, int fileIndex);
+int STORR_shipCommit(int table, const MYC_TXENTRY_t *entries, int count);
+int STORR_closeListen();
+
+/* Standby: apply the stream of a primary to the local cache. */
+int STORR_follow(const char *path);
+int STORR_promote();
+
+void STORR_debuglevel_rotate();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MYREPLICA_H */
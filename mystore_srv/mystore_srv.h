@@ -12,10 +12,23 @@ extern "C" {
 #endif
 
 int STORS_init();
+int STORS_initKey(key_t key);
+int STORS_setInflight(unsigned int requests);
 int STORS_close();
 
 int STORS_readrequest(request_message_t *request);
+int STORS_readmessage(void *message, size_t size);
+int STORS_nextrequest(commit_message_t *message);
+uint64_t STORS_busy();
+uint64_t STORS_expired();
 int STORS_sendanswer(answer_message_t *answer);
+int STORS_sendstats(stats_message_t *answer);
+int STORS_sendpayload(payload_message_t *answer);
+
+int STORS_grantLease(int table, int index, long client);
+int STORS_invalidate(int table, int index, long writer);
+int STORS_invalidateRange(int table, int index, int count, long writer);
+void STORS_expireLeases();
 
 void STORS_debuglevel_rotate();
 
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mycache.h>
+
+#define OPTIONS_SET "k:m:p:s:r:"
+#define ADDITIONAL_ARGS 0
+
+#define TABLE "autosize"
+
+static int debug_level = DEBUG_INIT;
+
+static int keys = 40000;
+static unsigned int entries = 20000;
+static int phases = 6;
+static int seconds = 5;
+static int readPercent = 30;
+
+/* Age last written to each key, 0 if none: what a read must find. */
+static int *expected;
+
+/** Start from an empty table. */
+static void removeTable() {
+  unlink(TABLE ".dat");
+  unlink(TABLE ".dat.map");
+  unlink(TABLE ".dat.crc");
+  unlink(TABLE ".snap");
+  unlink(TABLE ".log");
+}
+
+/**
+ * Read and write the table for "seconds", over every key or, if "skewed",
+ * mostly over a hundredth of them, so that the cache is grown and shrunk
+ * while the cleaner writes back what the writes leave dirty.
+ * @return The reads that did not find what was last written.
+ */
+static long runPhase(int table, int skewed, unsigned int *seed) {
+  MYRECORD_RECORD_t record;
+  uint64_t end = myh_now() + (uint64_t)seconds * 1000000000;
+  int hot = keys / 100 > 0 ? keys / 100 : 1;
+  long operations = 0;
+  long errors = 0;
+
+  while (myh_now() < end) {
+    int key = skewed && rand_r(seed) % 100 != 0 ? rand_r(seed) % hot
+                                                : rand_r(seed) % keys;
+
+    if (rand_r(seed) % 100 < readPercent) {
+      if (expected[key] != 0 &&
+          (MYC_readTableEntry(table, key, &record) != 0 ||
+           record.registerid != (unsigned int)key ||
+           record.age != expected[key])) {
+        errors++;
+      }
+    } else {
+      memset(&record, 0, sizeof(MYRECORD_RECORD_t));
+      record.registerid = key;
+      record.age = expected[key] + 1;
+      snprintf(record.name, sizeof(record.name), "#%d", key);
+      if (MYC_writeTableEntry(table, key, &record) != 0) {
+        errors++;
+      } else {
+        expected[key] = record.age;
+      }
+    }
+    operations++;
+  }
+
+  MYC_STATS_t stats;
+  MYC_getTableStats(table, &stats);
+  printf("%-7s ops=%-9ld entries=%-7lu dirty=%-7lu writebacks=%-9lu "
+         "errors=%ld\n",
+         skewed ? "skewed" : "uniform", operations, stats.entries,
+         stats.dirty, stats.writebacks, errors);
+  return errors;
+}
+
+/**
+ * Reopen the table and read every key written.
+ * @return The keys that did not read back as last written, -1 if the table
+ * does not open.
+ */
+static long checkTable() {
+  MYRECORD_RECORD_t record;
+  long errors = 0;
+  int table = MYC_openTable(TABLE, 0, entries);
+
+  if (table < 0) {
+    return -1;
+  }
+  for (int key = 0; key < keys; key++) {
+    if (expected[key] != 0 &&
+        (MYC_readTableEntry(table, key, &record) != 0 ||
+         record.registerid != (unsigned int)key ||
+         record.age != expected[key])) {
+      errors++;
+    }
+  }
+  if (MYC_closeTable(table) != 0) {
+    errors++;
+  }
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'm':
+      entries = strtoul(optarg, NULL, 10);
+      errorWithOptions |= (entries == 0);
+      break;
+    case 'p':
+      phases = atoi(optarg);
+      errorWithOptions |= (phases <= 0);
+      break;
+    case 's':
+      seconds = atoi(optarg);
+      errorWithOptions |= (seconds <= 0);
+      break;
+    case 'r':
+      readPercent = atoi(optarg);
+      errorWithOptions |= (readPercent < 0 || readPercent >= 100);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-k "
+                "[keys]: Of the table " TABLE " (default 40000)\n>\t-m "
+                "[entries]: Budget of the cache (default 20000)\n>\t-p "
+                "[phases]: Uniform and skewed in turn (default 6)\n>\t-s "
+                "[seconds]: Of each phase (default 5)\n>\t-r [percent]: "
+                "Reads among the operations (default 30)");
+    exit(1);
+  }
+
+  expected = calloc(keys, sizeof(int));
+  if (expected == NULL || MYC_setBudget(entries) != 0) {
+    debug_error("Error preparing table %s.", TABLE);
+    exit(1);
+  }
+  removeTable();
+
+  /* The phases last longer than MYC_RESIZEPERIOD, so that each one moves
+   * the size of the cache. */
+  int table = MYC_openTable(TABLE, MYC_OPT_AUTOSIZE, entries / 4);
+  if (table < 0) {
+    debug_error("Error opening table %s.", TABLE);
+    exit(1);
+  }
+  unsigned int seed = 1;
+  long errors = 0;
+  for (int i = 0; i < phases; i++) {
+    errors += runPhase(table, i % 2, &seed);
+  }
+  if (MYC_closeTable(table) != 0) {
+    debug_error("Error closing table %s.", TABLE);
+    exit(1);
+  }
+
+  long wrong = checkTable();
+  printf("all     errors=%ld wrong after reopening=%ld\n", errors, wrong);
+  free(expected);
+  removeTable();
+  return errors == 0 && wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
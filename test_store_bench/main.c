@@ -0,0 +1,681 @@
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <myhisto.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "d:k:n:r:c:w:z:s:R:T:Vt:x:SN:L:D:B:"
+#define ADDITIONAL_ARGS 0
+
+#define HOTSPOT_KEYS 0.1 /* Fraction of the keys that are hot. */
+#define HOTSPOT_OPS 0.9  /* Fraction of the operations going to them. */
+
+typedef enum { DIST_UNIFORM, DIST_ZIPF, DIST_SEQUENTIAL, DIST_HOTSPOT } DIST_t;
+
+typedef struct {
+  char op; /* 'r' or 'w'. */
+  int index;
+} OPERATION_t;
+
+/* What every client process sends back to the parent through a pipe. */
+typedef struct {
+  unsigned long operations;
+  unsigned long errors;
+  unsigned long mismatches;
+  unsigned long expired;
+  STORC_NEARSTATS_t near;
+  MYHISTO_t reads;
+  MYHISTO_t writes;
+} RESULT_t;
+
+static int debug_level = DEBUG_INIT;
+
+static DIST_t distribution = DIST_UNIFORM;
+static int keys = 1000;
+static long operations = 10000;
+static int readPercent = 50;
+static int processes = 1;
+static long warmup = 0;
+static double theta = 0.99;
+static unsigned int seed = 1;
+static int verify = 0;
+static int table = 0;
+static int txSize = 0;
+static int scanning = 0;
+static unsigned int nearEntries = 0;
+static int loaders = 0;
+static uint64_t deadline = 0; /* Nanoseconds, 0 for none. */
+static volatile sig_atomic_t backgroundStop = 0;
+static char *recordFile = NULL;
+static char *replayFile = NULL;
+static char *backupDir = NULL;
+
+/* State of the Zipf generator (Gray et al., "Quickly generating
+ * billion-record synthetic databases"). */
+static double zipfZetan, zipfAlpha, zipfEta;
+
+static double zeta(long n, double theta) {
+  double sum = 0;
+  for (long i = 1; i <= n; i++) {
+    sum += 1.0 / pow((double)i, theta);
+  }
+  return sum;
+}
+
+static void zipfInit() {
+  zipfZetan = zeta(keys, theta);
+  zipfAlpha = 1.0 / (1.0 - theta);
+  zipfEta = (1 - pow(2.0 / keys, 1 - theta)) / (1 - zeta(2, theta) / zipfZetan);
+}
+
+static int zipfNext(unsigned int *state) {
+  double u = (double)rand_r(state) / RAND_MAX;
+  double uz = u * zipfZetan;
+
+  if (uz < 1.0) {
+    return 0;
+  }
+  if (uz < 1.0 + pow(0.5, theta)) {
+    return 1;
+  }
+  int index = (int)(keys * pow(zipfEta * u - zipfEta + 1, zipfAlpha));
+  return index < keys ? index : keys - 1;
+}
+
+/**
+ * Generate the next operation of a client from the configured distribution.
+ * @param counter Number of operations already generated by this client.
+ */
+static OPERATION_t nextOperation(unsigned int *state, long counter,
+                                 int client) {
+  OPERATION_t op;
+
+  op.op = (rand_r(state) % 100 < readPercent) ? 'r' : 'w';
+
+  switch (distribution) {
+  case DIST_ZIPF:
+    /* Scatter the popular keys instead of packing them at the beginning. */
+    op.index = (int)(((unsigned long)zipfNext(state) * 2654435761UL) % keys);
+    break;
+  case DIST_SEQUENTIAL:
+    op.index = (int)((counter * processes + client) % keys);
+    break;
+  case DIST_HOTSPOT: {
+    int hot = (int)(keys * HOTSPOT_KEYS);
+    if (hot < 1) {
+      hot = 1;
+    }
+    if ((double)rand_r(state) / RAND_MAX < HOTSPOT_OPS || hot == keys) {
+      op.index = rand_r(state) % hot;
+    } else {
+      op.index = hot + rand_r(state) % (keys - hot);
+    }
+    break;
+  }
+  default:
+    op.index = rand_r(state) % keys;
+    break;
+  }
+  return op;
+}
+
+/**
+ * Load the operations of one client from a trace file. The file has one
+ * operation per line, "r <index>" or "w <index>". Client "c" takes the lines
+ * c, c + processes, c + 2 * processes...
+ * @return The number of operations loaded. -1 in case of error.
+ */
+static long loadTrace(OPERATION_t **trace, int client) {
+  FILE *file = fopen(replayFile, "r");
+  long count = 0, size = 1024, line = 0;
+  OPERATION_t op;
+
+  if (file == NULL) {
+    debug_perror("Error opening trace file %s. ", replayFile);
+    return -1;
+  }
+
+  *trace = malloc(size * sizeof(OPERATION_t));
+  while (*trace != NULL && 2 == fscanf(file, " %c %d", &op.op, &op.index)) {
+    if (line++ % processes != client) {
+      continue;
+    }
+    if (count == size) {
+      size *= 2;
+      *trace = realloc(*trace, size * sizeof(OPERATION_t));
+      if (*trace == NULL) {
+        break;
+      }
+    }
+    (*trace)[count++] = op;
+  }
+  fclose(file);
+
+  if (*trace == NULL) {
+    debug_error("Not enough memory for the trace.");
+    return -1;
+  }
+  return count;
+}
+
+/** Content written to an index, so any reader can check what it gets. */
+static void makeRecord(int index, MYRECORD_RECORD_t *record) {
+  memset(record, 0, sizeof(MYRECORD_RECORD_t));
+  record->registerid = index;
+  record->age = index % 100;
+  record->gender = index % 2;
+  snprintf(record->name, sizeof(record->name), "bench #%u",
+           (unsigned int)index % 10000000);
+}
+
+/**
+ * An index that was never written reads as zeros; anything else must be
+ * exactly what makeRecord() writes.
+ * @return 1 if the record is valid for the index.
+ */
+static int checkRecord(int index, const MYRECORD_RECORD_t *record) {
+  MYRECORD_RECORD_t expected;
+  MYRECORD_RECORD_t empty;
+
+  makeRecord(index, &expected);
+  memset(&empty, 0, sizeof(MYRECORD_RECORD_t));
+  return 0 == memcmp(record, &expected, sizeof(MYRECORD_RECORD_t)) ||
+         0 == memcmp(record, &empty, sizeof(MYRECORD_RECORD_t));
+}
+
+/**
+ * Body of every client process: run the warmup and the measured operations
+ * and write the result to "out".
+ */
+static int runClient(int client, int out) {
+  RESULT_t result;
+  OPERATION_t *trace = NULL;
+  long total = warmup + operations;
+  unsigned int state = seed + client * 7919;
+  FILE *record = NULL;
+
+  memset(&result, 0, sizeof(RESULT_t));
+
+  if (replayFile != NULL) {
+    total = loadTrace(&trace, client);
+    if (total < 0) {
+      return -1;
+    }
+  }
+  if (recordFile != NULL) {
+    if ((record = fopen(recordFile, "a")) == NULL) {
+      debug_perror("Error opening trace file %s. ", recordFile);
+      return -1;
+    }
+    /* One append per line, so the lines of the processes do not mix. */
+    setvbuf(record, NULL, _IOLBF, 0);
+  }
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    return -1;
+  }
+  if (nearEntries > 0 && STORC_nearCache(nearEntries) != 0) {
+    STORC_close();
+    return -1;
+  }
+  STORC_setDeadline(deadline);
+
+  /* With -x, writes are buffered and the last one of every group of txSize
+   * pays for the commit. A transaction cannot span partitions, so there is a
+   * group per partition. */
+  static STORC_TX_t tx[MYSTORE_MAXPARTITIONS];
+  for (int p = 0; p < MYSTORE_MAXPARTITIONS; p++) {
+    STORC_begin(&tx[p], table);
+  }
+
+  for (long i = 0; i < total; i++) {
+    OPERATION_t op =
+        trace ? trace[i] : nextOperation(&state, i, client);
+    MYRECORD_RECORD_t data;
+    int status;
+
+    if (record != NULL) {
+      fprintf(record, "%c %d\n", op.op, op.index);
+    }
+
+    uint64_t start = myh_now();
+    if (op.op == 'r') {
+      status = STORC_readTable(table, op.index, &data);
+    } else if (txSize > 0) {
+      STORC_TX_t *group = &tx[STORC_partition(op.index)];
+      makeRecord(op.index, &data);
+      status = STORC_txWrite(group, op.index, &data);
+      if (0 == status && group->message.count == txSize) {
+        status = STORC_commit(group, NULL);
+        STORC_begin(group, table);
+      }
+    } else {
+      makeRecord(op.index, &data);
+      status = STORC_writeTable(table, op.index, &data);
+    }
+    uint64_t elapsed = myh_now() - start;
+
+    if (i < (trace ? 0 : warmup)) {
+      continue;
+    }
+    result.operations++;
+    if (status == MYSTORE_EXPIRED) {
+      result.expired++;
+    } else if (status != 0) {
+      result.errors++;
+    } else if (verify && op.op == 'r' && !checkRecord(op.index, &data)) {
+      debug_error("Record %d contains id %u.", op.index, data.registerid);
+      result.mismatches++;
+    }
+    myh_record(op.op == 'r' ? &result.reads : &result.writes, elapsed);
+  }
+
+  for (int p = 0; p < MYSTORE_MAXPARTITIONS; p++) {
+    if (tx[p].message.count > 0 && 0 != STORC_commit(&tx[p], NULL)) {
+      result.errors++;
+    }
+  }
+
+  STORC_nearStats(&result.near);
+  STORC_close();
+  if (record != NULL) {
+    fclose(record);
+  }
+  free(trace);
+
+  return write(out, &result, sizeof(RESULT_t)) == sizeof(RESULT_t) ? 0 : -1;
+}
+
+static void stopBackground(int sig_num) { backgroundStop = 1; }
+
+/**
+ * Body of the scanner process of -S: read every key through a snapshot,
+ * again and again, until the clients are done.
+ */
+static int runScanner() {
+  unsigned long scans = 0, records = 0, errors = 0, mismatches = 0;
+  uint64_t start = myh_now();
+
+  signal(SIGTERM, stopBackground);
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    return -1;
+  }
+
+  while (!backgroundStop) {
+    int snapshot = STORC_openSnapshot(table);
+    if (snapshot < 0) {
+      errors++;
+      break;
+    }
+    for (int i = 0; i < keys && !backgroundStop; i++) {
+      MYRECORD_RECORD_t data;
+      if (STORC_readSnapshot(snapshot, i, &data) != 0) {
+        errors++;
+      } else if (verify && !checkRecord(i, &data)) {
+        mismatches++;
+      }
+      records++;
+    }
+    STORC_closeSnapshot(snapshot);
+    scans += !backgroundStop;
+  }
+  STORC_close();
+
+  double seconds = (myh_now() - start) / 1e9;
+  printf("scanner full scans=%lu records=%lu (%.0f/s) errors=%lu "
+         "mismatches=%lu\n",
+         scans, records, records / seconds, errors, mismatches);
+  fflush(stdout);
+  return (errors || mismatches) ? -1 : 0;
+}
+
+static void printHistogram(const char *name, const MYHISTO_t *h) {
+  printf("%-6s ops=%-9lu p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n", name,
+         h->total, myh_percentile(h, 50.0) / 1000.0,
+         myh_percentile(h, 99.0) / 1000.0, myh_percentile(h, 99.9) / 1000.0,
+         h->max / 1000.0);
+}
+
+/**
+ * Body of the loader processes of -L: write every key in order as bulk
+ * requests, again and again, until the clients are done.
+ */
+static int runLoader(int loader) {
+  unsigned long errors = 0;
+  MYHISTO_t writes;
+
+  memset(&writes, 0, sizeof(MYHISTO_t));
+  signal(SIGTERM, stopBackground);
+  if (STORC_init() != 0 || STORC_setPriority(MYSPRIO_BULK) != 0) {
+    debug_error("Error initializing client API.");
+    return -1;
+  }
+
+  for (long i = loader; !backgroundStop; i += loaders) {
+    MYRECORD_RECORD_t data;
+    int index = (int)(i % keys);
+
+    makeRecord(index, &data);
+    uint64_t start = myh_now();
+    if (STORC_writeTable(table, index, &data) != 0) {
+      errors++;
+    }
+    myh_record(&writes, myh_now() - start);
+  }
+  STORC_close();
+
+  printf("loader %d errors=%lu ", loader, errors);
+  printHistogram("bulk", &writes);
+  fflush(stdout);
+  return errors ? -1 : 0;
+}
+
+/**
+ * Body of the backup process of -B: back up the table into backupDir, again
+ * and again, until the clients are done. A backup is timed from its start
+ * until every partition has completed it.
+ */
+static int runBackups() {
+  const char *partitions = getenv(MYSTORE_PARTITIONS_ENV);
+  uint64_t expected = partitions != NULL ? strtoul(partitions, NULL, 10) : 1;
+  unsigned long errors = 0;
+  MYHISTO_t backups;
+
+  memset(&backups, 0, sizeof(MYHISTO_t));
+  signal(SIGTERM, stopBackground);
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    return -1;
+  }
+
+  while (!backgroundStop) {
+    MYSTORE_STATS_t stats;
+    uint64_t start = myh_now();
+
+    if (STORC_tableStats(table, &stats) != 0 ||
+        STORC_backupTable(table, backupDir, 0) != 0) {
+      errors++;
+      break;
+    }
+    uint64_t before = stats.cache.backups;
+    while (!backgroundStop && stats.cache.backups - before < expected) {
+      usleep(10000);
+      if (STORC_tableStats(table, &stats) != 0) {
+        errors++;
+        break;
+      }
+    }
+    if (stats.cache.backups - before >= expected) {
+      myh_record(&backups, myh_now() - start);
+    }
+  }
+  STORC_close();
+
+  printf("backups errors=%lu ", errors);
+  printHistogram("backup", &backups);
+  fflush(stdout);
+  return errors ? -1 : 0;
+}
+
+static int parseDistribution(const char *name) {
+  const char *names[] = {"uniform", "zipf", "seq", "hotspot"};
+
+  for (int i = 0; i < 4; i++) {
+    if (0 == strcmp(name, names[i])) {
+      distribution = (DIST_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void usage() {
+  debug_error(
+      "Incorrect parameters please provide any or none of these:\n"
+      ">\t-d [uniform|zipf|seq|hotspot]: Key distribution (default uniform)\n"
+      ">\t-k [keys]: Number of distinct indices (default 1000)\n"
+      ">\t-n [ops]: Measured operations per process (default 10000)\n"
+      ">\t-r [percent]: Percentage of reads (default 50)\n"
+      ">\t-c [processes]: Concurrent client processes (default 1)\n"
+      ">\t-w [ops]: Warmup operations per process, not measured\n"
+      ">\t-z [theta]: Skew of the zipf distribution (default 0.99)\n"
+      ">\t-s [seed]: Seed of the generators (default 1)\n"
+      ">\t-V: Verify the content of every record read\n"
+      ">\t-t [table]: Id of the table in the server (default 0)\n"
+      ">\t-x [size]: Commit the writes in transactions of \"size\" records\n"
+      ">\t-S: Scan all the keys through snapshots while the clients run\n"
+      ">\t-N [entries]: Near cache of that many records in every client\n"
+      ">\t-L [processes]: Bulk loaders writing all the keys while the "
+      "clients run\n"
+      ">\t-D [us]: Deadline of every request of the clients, expired ones "
+      "are counted apart\n"
+      ">\t-B [name]: Back up the table into that directory of the backup "
+      "root of the server, again and again, while the clients run\n"
+      ">\t-R [file]: Append the generated operations to a trace file\n"
+      ">\t-T [file]: Replay a trace file instead of generating operations");
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'd':
+      errorWithOptions |= parseDistribution(optarg);
+      break;
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'n':
+      operations = atol(optarg);
+      errorWithOptions |= (operations <= 0);
+      break;
+    case 'r':
+      readPercent = atoi(optarg);
+      errorWithOptions |= (readPercent < 0 || readPercent > 100);
+      break;
+    case 'c':
+      processes = atoi(optarg);
+      errorWithOptions |= (processes <= 0);
+      break;
+    case 'w':
+      warmup = atol(optarg);
+      errorWithOptions |= (warmup < 0);
+      break;
+    case 'z':
+      theta = atof(optarg);
+      errorWithOptions |= (theta <= 0 || theta >= 1);
+      break;
+    case 's':
+      seed = (unsigned int)atoi(optarg);
+      break;
+    case 'V':
+      verify = 1;
+      break;
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    case 'S':
+      scanning = 1;
+      break;
+    case 'x':
+      txSize = atoi(optarg);
+      errorWithOptions |= (txSize <= 0 || txSize > MYSTORE_TXMAX);
+      break;
+    case 'N':
+      nearEntries = strtoul(optarg, NULL, 10);
+      errorWithOptions |= (nearEntries == 0);
+      break;
+    case 'L':
+      loaders = atoi(optarg);
+      errorWithOptions |= (loaders <= 0);
+      break;
+    case 'D':
+      deadline = strtoull(optarg, NULL, 10) * 1000;
+      errorWithOptions |= (deadline == 0);
+      break;
+    case 'B':
+      backupDir = optarg;
+      break;
+    case 'R':
+      recordFile = optarg;
+      break;
+    case 'T':
+      replayFile = optarg;
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    usage();
+    exit(1);
+  }
+
+  if (distribution == DIST_ZIPF) {
+    zipfInit();
+  }
+
+  int results[2];
+  if (pipe(results) != 0) {
+    debug_perror("Error creating pipe. ");
+    exit(1);
+  }
+
+  pid_t scanner = -1;
+  if (scanning) {
+    scanner = fork();
+    if (scanner == 0) {
+      close(results[0]);
+      close(results[1]);
+      exit(runScanner() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (scanner < 0) {
+      debug_perror("Error creating scanner process. ");
+      exit(1);
+    }
+  }
+
+  pid_t loader[loaders > 0 ? loaders : 1];
+  for (int i = 0; i < loaders; i++) {
+    loader[i] = fork();
+    if (loader[i] == 0) {
+      close(results[0]);
+      close(results[1]);
+      exit(runLoader(i) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (loader[i] < 0) {
+      debug_perror("Error creating loader process. ");
+      exit(1);
+    }
+  }
+
+  pid_t backups = -1;
+  if (backupDir != NULL) {
+    backups = fork();
+    if (backups == 0) {
+      close(results[0]);
+      close(results[1]);
+      exit(runBackups() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (backups < 0) {
+      debug_perror("Error creating backup process. ");
+      exit(1);
+    }
+  }
+
+  uint64_t start = myh_now();
+  for (int i = 0; i < processes; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(results[0]);
+      exit(runClient(i, results[1]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (pid < 0) {
+      debug_perror("Error creating client process. ");
+      exit(1);
+    }
+  }
+  close(results[1]);
+
+  RESULT_t total, one;
+  int failed = 0;
+  memset(&total, 0, sizeof(RESULT_t));
+
+  /* Read before waiting: the pipe cannot hold the results of many clients. */
+  while (read(results[0], &one, sizeof(RESULT_t)) == sizeof(RESULT_t)) {
+    total.operations += one.operations;
+    total.errors += one.errors;
+    total.mismatches += one.mismatches;
+    total.expired += one.expired;
+    total.near.hits += one.near.hits;
+    total.near.misses += one.near.misses;
+    total.near.invalidations += one.near.invalidations;
+    total.near.expirations += one.near.expirations;
+    myh_merge(&total.reads, &one.reads);
+    myh_merge(&total.writes, &one.writes);
+  }
+  double seconds = (myh_now() - start) / 1e9;
+
+  if (scanner > 0) {
+    int status;
+    kill(scanner, SIGTERM);
+    waitpid(scanner, &status, 0);
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  if (backups > 0) {
+    int status;
+    kill(backups, SIGTERM);
+    waitpid(backups, &status, 0);
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  for (int i = 0; i < loaders; i++) {
+    int status;
+    kill(loader[i], SIGTERM);
+    waitpid(loader[i], &status, 0);
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  for (int i = 0; i < processes; i++) {
+    int status;
+    wait(&status);
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  MYHISTO_t all = total.reads;
+  myh_merge(&all, &total.writes);
+
+  printf("processes=%d ops=%lu time=%.2fs throughput=%.0f ops/s errors=%lu "
+         "mismatches=%lu expired=%lu\n",
+         processes, total.operations, seconds, total.operations / seconds,
+         total.errors, total.mismatches, total.expired);
+  printHistogram("read", &total.reads);
+  printHistogram("write", &total.writes);
+  printHistogram("all", &all);
+  if (nearEntries > 0) {
+    uint64_t lookups = total.near.hits + total.near.misses;
+    printf("near   hits=%lu misses=%lu (hit ratio %.2f%%) invalidations=%lu "
+           "expirations=%lu\n",
+           total.near.hits, total.near.misses,
+           lookups ? 100.0 * total.near.hits / lookups : 0.0,
+           total.near.invalidations, total.near.expirations);
+  }
+
+  if (failed) {
+    debug_error("%d client processes failed.", failed);
+  }
+  return (failed || total.errors || total.mismatches) ? EXIT_FAILURE
+                                                      : EXIT_SUCCESS;
+}
@@ -6,72 +6,69 @@ extern "C" {
 #endif
 
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <mylog.h>
+
 #define DEBUG_ERROR 0
 #define DEBUG_INFO 1
 #define DEBUG_DEBUG 2
 #define DEBUG_VERBOSE 3
 #define DEBUG_INIT DEBUG_INFO
 
-#define debuglevel_increase() {
-if (debug_level < DEBUG_VERBOSE)
-  debug_level++;
-}
-#define debuglevel_decrease() {
-if (debug_level > DEBUG_ERROR)
-  debug_level--;
-}
-#define debuglevel_rotate() {
-if (debug_level < DEBUG_VERBOSE)
-  debug_level++;
-else
-  debug_level = DEBUG_ERROR;
-}
+/* Highest level compiled in. The calls above it generate no code at all. */
+#ifndef DEBUG_MAXLEVEL
+#ifdef DEBUG_LIB
+#define DEBUG_MAXLEVEL DEBUG_VERBOSE
+#else
+#define DEBUG_MAXLEVEL DEBUG_INFO
+#endif
+#endif
 
-#define debug_error(...) {
-if (debug_level >= DEBUG_ERROR) {
-  fprintf(stderr, "%s:%s()::\033[0;31mERROR\033[0m ", __FILE__, __func__);
-  fprintf(stderr, __VA_ARGS__);
-  fputc('\n', stderr);
-}
-}
-#define debug_perror(...) {
-if (debug_level >= DEBUG_ERROR) {
-  fprintf(stderr, "%s:%s()::\033[0;31mERROR\033[0m ", __FILE__, __func__);
-  fprintf(stderr, __VA_ARGS__);
-  fputs(strerror(errno), stderr);
-  fputc('\n', stderr);
-}
+#define debuglevel_increase() {                                                \
+if (debug_level < DEBUG_VERBOSE)                                               \
+  debug_level++;                                                               \
 }
-#define debug_info(...) {
-if (debug_level >= DEBUG_INFO) {
-  fprintf(stderr, "%s:%s()::\033[0;36mINFO\033[0m ", __FILE__, __func__);
-  fprintf(stderr, __VA_ARGS__);
-  fputc('\n', stderr);
+#define debuglevel_decrease() {                                                \
+if (debug_level > DEBUG_ERROR)                                                 \
+  debug_level--;                                                               \
 }
+#define debuglevel_rotate() {                                                  \
+if (debug_level < DEBUG_VERBOSE)                                               \
+  debug_level++;                                                               \
+else                                                                           \
+  debug_level = DEBUG_ERROR;                                                   \
 }
 
-#ifdef DEBUG_LIB
-#define debug_debug(...) {
-if (debug_level >= DEBUG_DEBUG) {
-  fprintf(stderr, "%s:%s()::\033[0;32mDEBUG\033[0m ", __FILE__, __func__);
-  fprintf(stderr, __VA_ARGS__);
-  fputc('\n', stderr);
-}
-}
-#define debug_verbose(...) {
-if (debug_level >= DEBUG_VERBOSE) {
-  fprintf(stderr, "%s:%s()::\033[0;33mVERBOSE\033[0m\033[0m ", __FILE__,
-          __func__);
-  fprintf(stderr, __VA_ARGS__);
-  fputc('\n', stderr);
+/* Lines are queued in a per thread ring and written by the mylog drainer. */
+#define debug_log(level, withErrno, ...) {                                     \
+if (__builtin_expect(debug_level >= (level), 0)) {                             \
+  MYLOG_write((level), (withErrno), __FILE__, __func__, __VA_ARGS__);          \
+}                                                                              \
 }
+
+#define debug_error(...) debug_log(DEBUG_ERROR, 0, __VA_ARGS__)
+#define debug_perror(...) debug_log(DEBUG_ERROR, 1, __VA_ARGS__)
+
+#if DEBUG_MAXLEVEL >= DEBUG_INFO
+#define debug_info(...) debug_log(DEBUG_INFO, 0, __VA_ARGS__)
+#else
+#define debug_info(...) {                                                      \
 }
+#endif
+
+#if DEBUG_MAXLEVEL >= DEBUG_DEBUG
+#define debug_debug(...) debug_log(DEBUG_DEBUG, 0, __VA_ARGS__)
 #else
-#define debug_debug(...) {
+#define debug_debug(...) {                                                     \
 }
-#define debug_verbose(...) {
+#endif
+
+#if DEBUG_MAXLEVEL >= DEBUG_VERBOSE
+#define debug_verbose(...) debug_log(DEBUG_VERBOSE, 0, __VA_ARGS__)
+#else
+#define debug_verbose(...) {                                                   \
 }
 #endif
 
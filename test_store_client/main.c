@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "debug.h"
 #include <mycache.h>
@@ -74,6 +76,121 @@ int main(int argc, char **argv) {
 
   debug_info("Read test ended OK.");
 
+  debug_info("Transaction test started...");
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  STORC_TX_t tx;
+  STORC_begin(&tx, 0);
+  for (int i = 1; i <= MYSTORE_TXMAX; i++) {
+    record.registerid = i;
+    record.age = 0;
+    record.gender = -1;
+    snprintf(record.name, sizeof(record.name), "tx #%d", i);
+    STORC_txWrite(&tx, i, &record);
+  }
+  if (STORC_commit(&tx, NULL) != 0) {
+    debug_error("Error committing transaction.");
+    exit(1);
+  }
+
+  MYRECORD_RECORD_t expected;
+  if (STORC_read(1, &expected) != 0 || expected.age != 0) {
+    debug_error("Transaction not applied to register 1.");
+    exit(1);
+  }
+  memcpy(&record, &expected, sizeof(MYRECORD_RECORD_t));
+  record.age = 1;
+  if (STORC_cas(0, 1, &expected, &record) != 0) {
+    debug_error("Compare-and-swap failed on an unchanged register.");
+    exit(1);
+  }
+  /* "expected" still holds age 0, so the second swap must conflict. */
+  if (STORC_cas(0, 1, &expected, &record) != MYC_CONFLICT ||
+      expected.age != 1) {
+    debug_error("Compare-and-swap did not detect a changed register.");
+    exit(1);
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  debug_info("Transaction test ended OK.");
+
+  debug_info("Near cache test started...");
+  if (STORC_init() != 0 || STORC_nearCache(NUMBER_CACHE_ENTRIES) != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  STORC_NEARSTATS_t near;
+  if (STORC_read(2, &record) != 0 || STORC_read(2, &record) != 0) {
+    debug_error("Error reading from server.");
+    exit(1);
+  }
+  STORC_nearStats(&near);
+  if (near.hits != 1) {
+    debug_error("Second read of register 2 not served by the near cache.");
+    exit(1);
+  }
+
+  /* Another client, with a pid of its own, writes the cached register. */
+  pid_t writer = fork();
+  if (writer == 0) {
+    record.age = 2;
+    exit(STORC_init() == 0 && STORC_write(2, &record) == 0 ? EXIT_SUCCESS
+                                                           : EXIT_FAILURE);
+  }
+  int status;
+  if (writer < 0 || waitpid(writer, &status, 0) != writer ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    debug_error("Error writing from another client.");
+    exit(1);
+  }
+  if (STORC_read(2, &record) != 0 || record.age != 2) {
+    debug_error("Near cache served register 2 after another client wrote it.");
+    exit(1);
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  debug_info("Near cache test ended OK.");
+
+  debug_info("Delete test started...");
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  if (STORC_delete(3) != 0 || STORC_read(3, &record) != 0) {
+    debug_error("Error deleting register 3.");
+    exit(1);
+  }
+  memset(&expected, 0, sizeof(MYRECORD_RECORD_t));
+  if (memcmp(&record, &expected, sizeof(MYRECORD_RECORD_t)) != 0) {
+    debug_error("Register 3 not empty after deleting it.");
+    exit(1);
+  }
+  /* Deleting an absent register is not an error. */
+  if (STORC_delete(3) != 0) {
+    debug_error("Error deleting register 3 again.");
+    exit(1);
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  debug_info("Delete test ended OK.");
+
   debug_info("Test store client ended OK.");
   return (EXIT_SUCCESS);
 }
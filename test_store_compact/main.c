@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "t:b:w"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  int table = 0;
+  int budget = 0;
+  int wait = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    case 'b':
+      budget = atoi(optarg);
+      errorWithOptions |= (budget <= 0);
+      break;
+    case 'w':
+      wait = 1;
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-t "
+                "[table]: Id of the table in the server (default 0)\n>\t-b "
+                "[us]: Microseconds a step of the compaction may hold the "
+                "table\n>\t-w: Wait for the compaction to end");
+    exit(1);
+  }
+
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  MYSTORE_STATS_t before;
+  MYSTORE_STATS_t after;
+  uint64_t start = myh_now();
+  if (STORC_tableStats(table, &before) != 0 ||
+      STORC_compactTable(table, budget) != 0) {
+    debug_error("Error starting the compaction of table %d.", table);
+    exit(1);
+  }
+
+  memcpy(&after, &before, sizeof(MYSTORE_STATS_t));
+  while (wait && after.cache.compacted == before.cache.compacted) {
+    usleep(100000);
+    if (STORC_tableStats(table, &after) != 0) {
+      debug_error("Error reading the stats of table %d.", table);
+      exit(1);
+    }
+  }
+  if (wait) {
+    printf("compacted in %.2fs, disk:%lu bytes before, %lu bytes after\n",
+           (myh_now() - start) / 1e9, before.cache.diskBytes,
+           after.cache.diskBytes);
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}
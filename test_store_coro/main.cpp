@@ -0,0 +1,230 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mycache.hpp>
+
+#define OPTIONS_SET "k:n:c:t:r:"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+/* A schema of its own, smaller than MYRECORD_RECORD_t. */
+struct Reading {
+  uint32_t sensor;
+  uint32_t time;
+  double value;
+};
+
+/* Records of the tables checked in each storage format, many more than
+ * their caches hold. */
+#define FORMAT_KEYS 4096
+
+static int keys = 100000;
+static long operations = 200000;
+static int coroutines = 64;
+static int threads = 4;
+static int readPercent = 90;
+
+/** Pick the key of the next operation, and whether it is a read. */
+static int pickKey(unsigned int *seed, bool *reading) {
+  *reading = rand_r(seed) % 100 < readPercent;
+  return rand_r(seed) % keys;
+}
+
+static void report(const char *name, long errors, uint64_t start,
+                   const MYC_STATS_t &before) {
+  MYC_STATS_t after;
+  double seconds = (myh_now() - start) / 1e9;
+
+  MYC_getStats(&after);
+  uint64_t hits = after.hits - before.hits;
+  uint64_t misses = after.misses - before.misses;
+  printf("%-10s ops=%-9ld time=%.2fs throughput=%.0f ops/s hits=%.1f%% "
+         "errors=%ld\n",
+         name, operations, seconds, operations / seconds,
+         100.0 * hits / (hits + misses ? hits + misses : 1), errors);
+}
+
+/** The reading stored at "key": values like 1.0 end in zero bytes. */
+static Reading makeReading(int key) {
+  return {(uint32_t)key, (uint32_t)key % 7, key % 3 == 0 ? 1.0 : key / 10.0};
+}
+
+/** Read back every reading of a table, counting those that differ. */
+static long checkReadings(const mycache::Table<Reading> &table) {
+  long errors = 0;
+
+  for (int key = 0; key < FORMAT_KEYS; key++) {
+    Reading expected = makeReading(key);
+    Reading reading;
+    errors += table.read(key, reading) != 0 ||
+              0 != std::memcmp(&reading, &expected, sizeof(Reading));
+  }
+  return errors;
+}
+
+/**
+ * Write readings to a table in the storage format of "options" and read them
+ * back, from the file as the cache is small, and again after reopening it.
+ * @return The readings that did not read back, -1 if the table does not open.
+ */
+static long checkFormat(const char *name, int options) {
+  long errors = 0;
+  int id = MYC_openTable(name, options, 0);
+
+  if (id < 0) {
+    return -1;
+  }
+  mycache::Table<Reading> table(id);
+  for (int key = 0; key < FORMAT_KEYS; key++) {
+    errors += table.write(key, makeReading(key)) != 0;
+  }
+  errors += checkReadings(table);
+  errors += MYC_closeTable(id) != 0;
+
+  id = MYC_openTable(name, options, 0);
+  if (id < 0) {
+    return -1;
+  }
+  errors += checkReadings(mycache::Table<Reading>(id));
+  errors += MYC_closeTable(id) != 0;
+  printf("%-10s readings=%d errors=%ld\n", name, FORMAT_KEYS, errors);
+  return errors;
+}
+
+static mycache::Task worker(mycache::Scheduler &scheduler,
+                            const mycache::Table<Reading> &table, long count,
+                            unsigned int seed, long &errors) {
+  Reading reading;
+  bool isRead;
+
+  for (long i = 0; i < count; i++) {
+    int key = pickKey(&seed, &isRead);
+    if (isRead) {
+      errors += co_await table.read(scheduler, key, reading) != 0 ||
+                reading.sensor != (uint32_t)key;
+    } else {
+      reading = {(uint32_t)key, (uint32_t)i, key / 10.0};
+      errors += co_await table.write(scheduler, key, reading) != 0;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'n':
+      operations = atol(optarg);
+      errorWithOptions |= (operations <= 0);
+      break;
+    case 'c':
+      coroutines = atoi(optarg);
+      errorWithOptions |= (coroutines <= 0);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      errorWithOptions |= (threads <= 0);
+      break;
+    case 'r':
+      readPercent = atoi(optarg);
+      errorWithOptions |= (readPercent < 0 || readPercent > 100);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-k "
+                "[keys]: Records of the table (default 100000)\n>\t-n "
+                "[operations]: Of each run (default 200000)\n>\t-c "
+                "[coroutines]: Tasks of the scheduler (default 64)\n>\t-t "
+                "[threads]: For the calls that wait (default 4)\n>\t-r "
+                "[percent]: Reads among the operations (default 90)");
+    exit(1);
+  }
+
+  if (MYC_initCache() != 0) {
+    debug_error("Error initializing the cache.");
+    exit(1);
+  }
+
+  const struct {
+    const char *name;
+    int options;
+  } formats[] = {{"coro_file", 0},
+                 {"coro_paged", MYC_OPT_PAGED},
+                 {"coro_compressed", MYC_OPT_COMPRESSED}};
+  for (const auto &format : formats) {
+    if (checkFormat(format.name, format.options) != 0) {
+      debug_error("Table %s did not keep its readings.", format.name);
+      exit(1);
+    }
+  }
+
+  mycache::Table<Reading> table;
+  for (int key = 0; key < keys; key++) {
+    Reading reading = {(uint32_t)key, 0, key / 10.0};
+    if (table.write(key, reading) != 0) {
+      debug_error("Error writing record %d.", key);
+      exit(1);
+    }
+  }
+
+  MYC_STATS_t before;
+  MYC_getStats(&before);
+  uint64_t start = myh_now();
+  unsigned int seed = 1;
+  long errors = 0;
+  for (long i = 0; i < operations; i++) {
+    Reading reading;
+    bool isRead;
+    int key = pickKey(&seed, &isRead);
+    if (isRead) {
+      errors += table.read(key, reading) != 0 ||
+                reading.sensor != (uint32_t)key;
+    } else {
+      reading = {(uint32_t)key, (uint32_t)i, key / 10.0};
+      errors += table.write(key, reading) != 0;
+    }
+  }
+  report("blocking", errors, start, before);
+
+  MYC_getStats(&before);
+  start = myh_now();
+  {
+    mycache::Scheduler scheduler(threads);
+    std::vector<long> taskErrors(coroutines);
+    for (int t = 0; t < coroutines; t++) {
+      long count = operations / coroutines + (t < operations % coroutines);
+      scheduler.spawn(worker(scheduler, table, count, t + 1, taskErrors[t]));
+    }
+    scheduler.run();
+    errors = 0;
+    for (long e : taskErrors) {
+      errors += e;
+    }
+  }
+  report("coroutine", errors, start, before);
+
+  if (MYC_closeCache() != 0) {
+    debug_error("Error closing the cache.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}
@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mystore_cli.hpp>
+
+#define OPTIONS_SET "k:n:c:b:t:"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+static int keys = 1000;
+static long operations = 100000;
+static int clients = 4;
+static int batch = 16;
+static int table = 0;
+
+static void makeRecord(mystore::Record &record, int index) {
+  memset(&record, 0, sizeof(record));
+  record.registerid = index;
+  record.age = index % 100;
+  snprintf(record.name, sizeof(record.name), "cpp %d", index);
+}
+
+static void report(const char *name, long done, long errors, uint64_t start) {
+  double seconds = (myh_now() - start) / 1e9;
+  printf("%-10s ops=%-9ld time=%.2fs throughput=%.0f ops/s errors=%ld\n", name,
+         done, seconds, done / seconds, errors);
+}
+
+/** Reads and writes one by one through the C API, the baseline. */
+static void benchC() {
+  mystore::Record record;
+  long errors = 0;
+  uint64_t start = myh_now();
+
+  for (long i = 0; i < operations; i++) {
+    int index = (int)(i % keys);
+    if (i % 2 == 0) {
+      makeRecord(record, index);
+      errors += STORC_writeTable(table, index, &record) != 0;
+    } else {
+      errors += STORC_readTable(table, index, &record) != 0;
+    }
+  }
+  report("c", operations, errors, start);
+}
+
+/** The same operations through a StoreClient. */
+static void benchClient(mystore::StoreClient &client) {
+  mystore::Record record;
+  long errors = 0;
+  uint64_t start = myh_now();
+
+  for (long i = 0; i < operations; i++) {
+    int index = (int)(i % keys);
+    if (i % 2 == 0) {
+      makeRecord(record, index);
+      errors += client.write(table, index, record) != 0;
+    } else {
+      errors += client.read(table, index, record) != 0;
+    }
+  }
+  report("cpp", operations, errors, start);
+}
+
+/** Batches of "batch" consecutive records written and read back. */
+static void benchBatches(mystore::StoreClient &client) {
+  std::vector<mystore::Record> records(batch);
+  long errors = 0;
+  long done = 0;
+  uint64_t start = myh_now();
+
+  while (done < operations) {
+    int first = (int)(done % keys);
+    for (int i = 0; i < batch; i++) {
+      makeRecord(records[i], first + i);
+    }
+    errors += client.writeMany(table, first, records) != 0;
+    errors += client.readMany(table, first, records) != 0;
+    for (int i = 0; i < batch; i++) {
+      errors += records[i].registerid != (unsigned int)(first + i);
+    }
+    done += 2 * batch;
+  }
+  report("cpp-many", done, errors, start);
+}
+
+/** A client per thread, each reading its share of the keys asynchronously. */
+static void benchThreads() {
+  std::vector<std::thread> threads;
+  std::vector<long> errors(clients);
+  uint64_t start = myh_now();
+
+  for (int t = 0; t < clients; t++) {
+    threads.emplace_back([t, &errors] {
+      mystore::StoreClient client;
+      for (long i = t; i < operations; i += clients) {
+        mystore::ReadResult result =
+            client.readAsync(table, (int)(i % keys)).get();
+        errors[t] += result.status != 0;
+      }
+    });
+  }
+  long total = 0;
+  for (int t = 0; t < clients; t++) {
+    threads[t].join();
+    total += errors[t];
+  }
+  report("cpp-async", operations, total, start);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'n':
+      operations = atol(optarg);
+      errorWithOptions |= (operations <= 0);
+      break;
+    case 'c':
+      clients = atoi(optarg);
+      errorWithOptions |= (clients <= 0);
+      break;
+    case 'b':
+      batch = atoi(optarg);
+      errorWithOptions |= (batch <= 0);
+      break;
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-k "
+                "[keys]: Indices used (default 1000)\n>\t-n [operations]: Of "
+                "each run (default 100000)\n>\t-c [clients]: Threads of the "
+                "asynchronous run, a client each (default 4)\n>\t-b [records]: "
+                "Of each batch (default 16)\n>\t-t [table]: Id of the table in "
+                "the server (default 0)");
+    exit(1);
+  }
+
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+  benchC();
+
+  try {
+    mystore::StoreClient client;
+    benchClient(client);
+    benchBatches(client);
+    benchThreads();
+  } catch (const std::exception &e) {
+    debug_error("%s", e.what());
+    exit(1);
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}
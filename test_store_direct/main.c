@@ -0,0 +1,246 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mycache.h>
+
+#define OPTIONS_SET "k:n:m:r:"
+#define ADDITIONAL_ARGS 0
+
+#define TABLE "direct"
+#define TABLE_FILE TABLE ".dat"
+#define LOAD_FILE TABLE ".load"
+
+static int debug_level = DEBUG_INIT;
+
+static int keys = 4000000;
+static long operations = 200000;
+static unsigned int entries = 4096;
+static int readPercent = 90;
+
+/**
+ * Fill the table with "keys" records, record "i" at index "i", unless it
+ * already has them from a previous run.
+ * @return -1 in case of error. 0 means OK.
+ */
+static int prepareTable() {
+  struct stat st;
+
+  if (0 == stat(TABLE_FILE, &st) &&
+      st.st_size == (off_t)keys * (off_t)sizeof(MYRECORD_RECORD_t)) {
+    return 0;
+  }
+  FILE *file = fopen(LOAD_FILE, "w");
+  if (file == NULL) {
+    debug_perror("Error creating %s. ", LOAD_FILE);
+    return -1;
+  }
+  for (int i = 0; i < keys; i++) {
+    MYRECORD_RECORD_t record;
+
+    memset(&record, 0, sizeof(MYRECORD_RECORD_t));
+    record.registerid = i;
+    record.age = i % 100;
+    snprintf(record.name, sizeof(record.name), "#%d", i);
+    if (fwrite(&record, sizeof(MYRECORD_RECORD_t), 1, file) != 1) {
+      debug_perror("Error writing %s. ", LOAD_FILE);
+      fclose(file);
+      return -1;
+    }
+  }
+  if (fclose(file) != 0) {
+    return -1;
+  }
+
+  int fd = open(LOAD_FILE, O_RDONLY);
+  int table = MYC_openTable(TABLE, 0, entries);
+  int loaded = -1;
+  if (fd >= 0 && table >= 0) {
+    loaded = MYC_loadTable(table, 0, fd);
+  }
+  if (table >= 0) {
+    MYC_closeTable(table);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  unlink(LOAD_FILE);
+  return loaded == keys ? 0 : -1;
+}
+
+/** Bytes of "path" in the page cache. */
+static long long cachedBytes(const char *path) {
+  long page = sysconf(_SC_PAGESIZE);
+  long long cached = 0;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || -1 == fstat(fd, &st) || st.st_size == 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 0;
+  }
+  size_t pages = (st.st_size + page - 1) / page;
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  unsigned char *vector = malloc(pages);
+  if (map != MAP_FAILED && vector != NULL &&
+      0 == mincore(map, st.st_size, vector)) {
+    for (size_t i = 0; i < pages; i++) {
+      cached += (vector[i] & 1) * page;
+    }
+  }
+  free(vector);
+  if (map != MAP_FAILED) {
+    munmap(map, st.st_size);
+  }
+  close(fd);
+  return cached;
+}
+
+/** Resident memory of the process, in bytes. */
+static long long residentBytes() {
+  long long size = 0;
+  long long resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+
+  if (statm != NULL) {
+    if (fscanf(statm, "%lld %lld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/** Take the table file out of the page cache: every run starts cold. */
+static void dropCache(const char *path) {
+  int fd = open(path, O_RDONLY);
+
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+/**
+ * The same random reads and writes on the table opened with "options", and
+ * the memory the records take in the process and in the page cache after.
+ * Each run is a process of its own, so that its memory is its alone.
+ */
+static void run(const char *name, int options) {
+  MYRECORD_RECORD_t record;
+  MYC_STATS_t stats;
+  unsigned int seed = 1;
+  long errors = 0;
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child != 0) {
+    if (child < 0 || waitpid(child, NULL, 0) < 0) {
+      debug_perror("Error running %s. ", name);
+      exit(1);
+    }
+    return;
+  }
+
+  dropCache(TABLE_FILE);
+  int table = MYC_openTable(TABLE, options, entries);
+  if (table < 0) {
+    debug_error("Error opening table %s.", TABLE);
+    exit(1);
+  }
+
+  uint64_t start = myh_now();
+  for (long i = 0; i < operations; i++) {
+    int key = rand_r(&seed) % keys;
+    if (rand_r(&seed) % 100 < readPercent) {
+      errors += MYC_readTableEntry(table, key, &record) != 0 ||
+                record.registerid != (unsigned int)key;
+    } else {
+      memset(&record, 0, sizeof(MYRECORD_RECORD_t));
+      record.registerid = key;
+      record.age = i % 100;
+      snprintf(record.name, sizeof(record.name), "#%d", key);
+      errors += MYC_writeTableEntry(table, key, &record) != 0;
+    }
+  }
+  double seconds = (myh_now() - start) / 1e9;
+
+  MYC_getTableStats(table, &stats);
+  printf("%-9s ops=%-8ld time=%.2fs throughput=%.0f ops/s hits=%.1f%% "
+         "errors=%ld\n",
+         name, operations, seconds, operations / seconds,
+         100.0 * stats.hits /
+             (stats.hits + stats.misses ? stats.hits + stats.misses : 1),
+         errors);
+  printf("%-9s table=%.1fMB page cache=%.1fMB resident=%.1fMB disk I/O "
+         "p50=%.1fus p99=%.1fus\n",
+         "", (double)stats.tableBytes / (1 << 20),
+         (double)cachedBytes(TABLE_FILE) / (1 << 20),
+         (double)residentBytes() / (1 << 20),
+         myh_percentile(&stats.diskIO, 50) / 1e3,
+         myh_percentile(&stats.diskIO, 99) / 1e3);
+
+  if (MYC_closeTable(table) != 0) {
+    debug_error("Error closing table %s.", TABLE);
+    exit(1);
+  }
+  exit(0);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'n':
+      operations = atol(optarg);
+      errorWithOptions |= (operations <= 0);
+      break;
+    case 'm':
+      entries = strtoul(optarg, NULL, 10);
+      errorWithOptions |= (entries == 0);
+      break;
+    case 'r':
+      readPercent = atoi(optarg);
+      errorWithOptions |= (readPercent < 0 || readPercent > 100);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-k "
+                "[keys]: Records of the table " TABLE_FILE " (default "
+                "4000000)\n>\t-n [operations]: Of each run (default 200000)"
+                "\n>\t-m [entries]: Of the cache (default 4096)\n>\t-r "
+                "[percent]: Reads among the operations (default 90)");
+    exit(1);
+  }
+
+  if (MYC_setBudget(entries) != 0 || prepareTable() != 0) {
+    debug_error("Error preparing table %s.", TABLE);
+    exit(1);
+  }
+
+  run("buffered", 0);
+  run("direct", MYC_OPT_DIRECT);
+
+  return (EXIT_SUCCESS);
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mycache.h>
+
+#define OPTIONS_SET "k:m:"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+static int keys = 20000;
+static unsigned int entries = 256;
+
+typedef struct {
+  const char *name; /* Also of the table. */
+  int options;
+  const char *extension;
+  int blobs; /* Stores variable length payloads. */
+} FORMAT_t;
+
+static const FORMAT_t formats[] = {
+    {"file", 0, ".dat", 0},
+    {"paged", MYC_OPT_PAGED, ".pag", 1},
+    {"compressed", MYC_OPT_COMPRESSED, ".lz", 0}};
+
+/** Start from an empty table. */
+static void removeTable(const FORMAT_t *format) {
+  const char *suffixes[] = {"", ".map", ".crc", ".idx"};
+  char path[64];
+
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+    snprintf(path, sizeof(path), "%s%s%s", format->name, format->extension,
+             suffixes[i]);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s.snap", format->name);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s.log", format->name);
+  unlink(path);
+}
+
+/**
+ * The record "key" holds: every byte is used, past the NUL of the name too,
+ * and some end in zeros, so that nothing but the whole record reads back.
+ */
+static void makeRecord(int key, MYRECORD_RECORD_t *record) {
+  memset(record, 0, sizeof(MYRECORD_RECORD_t));
+  record->registerid = key;
+  record->age = key % 3 == 0 ? 0 : key;
+  record->gender = key % 2;
+  snprintf(record->name, sizeof(record->name), "#%d", key % 1000);
+  for (size_t i = strlen(record->name) + 1;
+       i < sizeof(record->name) - (key % 4); i++) {
+    record->name[i] = (char)(key + i);
+  }
+}
+
+/**
+ * Read back every key of a table and count those that differ from what was
+ * written, or that fail.
+ */
+static long checkRecords(int table) {
+  MYRECORD_RECORD_t expected;
+  MYRECORD_RECORD_t record;
+  long errors = 0;
+
+  for (int key = 0; key < keys; key++) {
+    makeRecord(key, &expected);
+    errors += MYC_readTableEntry(table, key, &record) != 0 ||
+              0 != memcmp(&record, &expected, sizeof(MYRECORD_RECORD_t));
+  }
+  return errors;
+}
+
+/* Records between two payloads: a page of the paged format holds 64
+ * records in 4 KiB, so a payload of MYC_BLOBMAX bytes needs a page. */
+#define BLOB_STRIDE 64
+
+/** The payload "key" holds after "round" writes: "length" bytes. */
+static void makePayload(int key, int round, char *payload, int *length) {
+  *length = 1 + (key * 37 + round * 311) % MYC_BLOBMAX;
+  for (int i = 0; i < *length; i++) {
+    payload[i] = (char)(key + round + i * 7);
+  }
+}
+
+/**
+ * Write payloads to keys beyond the records, overwrite them with longer and
+ * shorter ones, read them back, then delete half of them, which must read
+ * as absent and give back their pages, and check the records were not
+ * touched. A format without payloads must refuse them.
+ * @return The errors found.
+ */
+static long checkBlobs(int table, const FORMAT_t *format) {
+  MYRECORD_RECORD_t zeros;
+  MYRECORD_RECORD_t record;
+  MYC_STATS_t before;
+  MYC_STATS_t after;
+  char expected[MYC_BLOBMAX];
+  char payload[MYC_BLOBMAX];
+  int blobs = keys / BLOB_STRIDE > 0 ? keys / BLOB_STRIDE : 1;
+  long errors = 0;
+  int length;
+
+  if (!format->blobs) {
+    makePayload(keys, 0, payload, &length);
+    return (MYC_writeTableBlob(table, keys, payload, length) != -1) +
+           (MYC_readTableBlob(table, keys, payload, MYC_BLOBMAX) != -1);
+  }
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < blobs; i++) {
+      int key = keys + i * BLOB_STRIDE;
+      makePayload(key, round, payload, &length);
+      errors += MYC_writeTableBlob(table, key, payload, length) != 0;
+    }
+  }
+  errors += MYC_writeTableBlob(table, keys, payload, MYC_BLOBMAX + 1) != -1;
+
+  MYC_flushAll();
+  MYC_getTableStats(table, &before);
+  for (int i = 0; i < blobs; i += 2) {
+    errors += MYC_writeTableBlob(table, keys + i * BLOB_STRIDE, NULL, 0) != 0;
+  }
+  MYC_flushAll();
+  MYC_getTableStats(table, &after);
+  errors += blobs > 2 && after.diskBytes >= before.diskBytes;
+  memset(&zeros, 0, sizeof(MYRECORD_RECORD_t));
+  for (int i = 0; i < blobs; i++) {
+    int key = keys + i * BLOB_STRIDE;
+
+    makePayload(key, 2, expected, &length);
+    if (i % 2 == 0) {
+      errors += MYC_readTableBlob(table, key, payload, MYC_BLOBMAX) != 0 ||
+                MYC_readTableEntry(table, key, &record) != 0 ||
+                0 != memcmp(&record, &zeros, sizeof(MYRECORD_RECORD_t));
+    } else {
+      errors += MYC_readTableBlob(table, key, payload, MYC_BLOBMAX) !=
+                    length ||
+                0 != memcmp(payload, expected, length);
+    }
+  }
+  return errors + checkRecords(table);
+}
+
+/**
+ * Write the records to a table of the format with a cache much smaller than
+ * them, so that they are read back from the file, then check them there and
+ * once more after reopening the table, with the scrubber.
+ * @return The errors found, -1 if the table does not open.
+ */
+static long runFormat(const FORMAT_t *format) {
+  MYRECORD_RECORD_t record;
+  MYC_STATS_t stats;
+  long errors = 0;
+
+  removeTable(format);
+  int table = MYC_openTable(format->name, format->options, entries);
+  if (table < 0) {
+    return -1;
+  }
+  for (int key = 0; key < keys; key++) {
+    makeRecord(key, &record);
+    errors += MYC_writeTableEntry(table, key, &record) != 0;
+  }
+  errors += checkRecords(table);
+  errors += checkBlobs(table, format);
+  MYC_getTableStats(table, &stats);
+  errors += MYC_closeTable(table) != 0;
+  uint64_t corrupt = stats.corrupt;
+
+  table = MYC_openTable(format->name, format->options | MYC_OPT_SCRUB,
+                        entries);
+  if (table < 0) {
+    return -1;
+  }
+  errors += checkRecords(table);
+  for (int waited = 0; waited < 100; waited++) {
+    usleep(100000);
+    MYC_getTableStats(table, &stats);
+    if (stats.scrubbed >= (uint64_t)keys) {
+      break;
+    }
+  }
+  errors += stats.scrubbed < (uint64_t)keys;
+  errors += MYC_closeTable(table) != 0;
+  corrupt += stats.corrupt + stats.scrubCorrupt;
+
+  printf("%-10s records=%d errors=%ld corrupt=%lu\n", format->name, keys,
+         errors, corrupt);
+  removeTable(format);
+  return errors + corrupt;
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'm':
+      entries = strtoul(optarg, NULL, 10);
+      errorWithOptions |= (entries == 0);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide any or none of these:\n>\t-k "
+                "[keys]: Records of each table (default 20000)\n>\t-m "
+                "[entries]: Of the cache of each table (default 256)");
+    exit(1);
+  }
+
+  if (MYC_setBudget(entries) != 0) {
+    debug_error("Error setting the budget of the cache.");
+    exit(1);
+  }
+
+  long errors = 0;
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    long found = runFormat(&formats[i]);
+    if (found < 0) {
+      debug_error("Error opening table %s.", formats[i].name);
+      exit(1);
+    }
+    errors += found;
+  }
+
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "i:t:g:"
+#define ADDITIONAL_ARGS 1
+
+static int debug_level = DEBUG_INIT;
+
+/**
+ * Write "count" records to a file to load, record "i" with the content that
+ * test_store_bench writes and verifies at index "first + i".
+ * @return -1 in case of error writing. 0 means OK.
+ */
+static int generate(const char *path, int first, int count) {
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    debug_perror("Error creating %s. ", path);
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    MYRECORD_RECORD_t record;
+    int index = first + i;
+
+    memset(&record, 0, sizeof(MYRECORD_RECORD_t));
+    record.registerid = index;
+    record.age = index % 100;
+    record.gender = index % 2;
+    snprintf(record.name, sizeof(record.name), "bench #%u",
+             (unsigned int)index % 10000000);
+    if (fwrite(&record, sizeof(MYRECORD_RECORD_t), 1, file) != 1) {
+      debug_perror("Error writing %s. ", path);
+      fclose(file);
+      return -1;
+    }
+  }
+  return fclose(file) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  int first = 0;
+  int table = 0;
+  int count = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'i':
+      first = atoi(optarg);
+      errorWithOptions |= (first < 0);
+      break;
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    case 'g':
+      count = atoi(optarg);
+      errorWithOptions |= (count <= 0);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters, provide the file of records to load, "
+                "in the import directory of the server (its -I option), "
+                "and any or none of these:\n>\t-i [index]: Index of the first "
+                "record (default 0)\n>\t-t [table]: Id of the table in the "
+                "server (default 0)\n>\t-g [count]: Generate the file first, "
+                "with the records test_store_bench verifies");
+    exit(1);
+  }
+
+  if (count > 0 && generate(argv[optind], first, count) != 0) {
+    exit(1);
+  }
+
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  /* The server finds it by name in its import directory. */
+  const char *name = strrchr(argv[optind], '/');
+  name = name != NULL ? name + 1 : argv[optind];
+
+  uint64_t start = myh_now();
+  int loaded = STORC_loadTable(table, first, name);
+  double seconds = (myh_now() - start) / 1e9;
+  if (loaded < 0) {
+    debug_error("Error loading %s.", argv[optind]);
+    exit(1);
+  }
+  printf("loaded %d records in %.2fs (%.0f records/s)\n", loaded, seconds,
+         seconds > 0 ? loaded / seconds : 0.0);
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "k:n:t:"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  int keys = 0;
+  int count = 0;
+  int table = 0;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys <= 0);
+      break;
+    case 'n':
+      count = atoi(optarg);
+      errorWithOptions |= (count <= 0 || count > MYSTORE_MAXPARTITIONS);
+      break;
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions || keys == 0 ||
+      count == 0 || getenv(MYSTORE_PARTITIONS_ENV) == NULL) {
+    debug_error("Incorrect parameters, with " MYSTORE_PARTITIONS_ENV " set to "
+                "the current number of partitions provide:\n>\t-n [count]: "
+                "New number of partitions, all of them running\n>\t-k [keys]: "
+                "Indices checked, from 0 on\n>\t-t [table]: Id of the table in "
+                "the servers (default 0)");
+    exit(1);
+  }
+
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  int moved = STORC_rebalance(table, keys, count);
+  if (moved < 0) {
+    debug_error("Error rebalancing, run it again: the records moved so far "
+                "are only in their new partitions.");
+    exit(1);
+  }
+  printf("moved %d of %d records to rebalance to %d partitions\n", moved, keys,
+         count);
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}
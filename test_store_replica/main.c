@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/msg.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mycache.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "s:k:PZ"
+#define ADDITIONAL_ARGS 0
+
+#define PRIMARY_DIR "primary"
+#define STANDBY_DIR "standby"
+#define SOCKET_NAME "replica.sock"
+#define WAIT_STEPS 100   /* Polls of a server before giving up on it. */
+#define WAIT_STEP 100000   /* Microseconds between two of them. */
+
+/*
+ * Check of the replication to a standby with two servers of its own: a
+ * primary in PRIMARY_DIR gets records written and deleted before the standby
+ * connects, which it must be synchronized with, and while it follows, which
+ * are streamed to it. Once both are stopped, their tables must hold the same
+ * records present and the same holes, up to the same last record.
+ */
+
+static int debug_level = DEBUG_INIT;
+
+static int keys;
+static int records; /* keys, a quarter more beyond them and the sentinel. */
+static int cacheOptions;
+static MYRECORD_RECORD_t *expected;
+static char *present;
+
+/** The record written at "index" in round "round" of the check. */
+static void makeRecord(MYRECORD_RECORD_t *record, int index, int round) {
+  memset(record, 0, sizeof(MYRECORD_RECORD_t));
+  record->registerid = index;
+  record->age = round;
+  snprintf(record->name, sizeof(record->name), "r%d.%d", round, index);
+}
+
+/**
+ * Write the record of "round" at "index" to the selected server and keep it
+ * as expected.
+ * @return -1 in case of error. 0 success.
+ */
+static int writeRecord(int index, int round) {
+  MYRECORD_RECORD_t record;
+
+  makeRecord(&record, index, round);
+  memcpy(&expected[index], &record, sizeof(MYRECORD_RECORD_t));
+  present[index] = 1;
+  return STORC_write(index, &record);
+}
+
+/**
+ * Delete the record at "index" of the selected server.
+ * @return -1 in case of error. 0 success.
+ */
+static int deleteRecord(int index) {
+  memset(&expected[index], 0, sizeof(MYRECORD_RECORD_t));
+  present[index] = 0;
+  return STORC_delete(index);
+}
+
+/**
+ * Start a server in "dir", with the queue "key" and the replication option
+ * "mode" on the socket "path". Its messages go to "dir"/server.log.
+ * @return The pid of the server. -1 in case of error.
+ */
+static pid_t startServer(const char *server, const char *dir, const char *key,
+                         const char *mode, const char *path) {
+  const char *format = (cacheOptions & MYC_OPT_PAGED)        ? "-P"
+                       : (cacheOptions & MYC_OPT_COMPRESSED) ? "-Z"
+                                                             : NULL;
+  fflush(stdout);
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    if (-1 == chdir(dir) || NULL == freopen("server.log", "w", stderr)) {
+      exit(EXIT_FAILURE);
+    }
+    execl(server, server, "-f", "-k", key, mode, path, format, (char *)NULL);
+    exit(EXIT_FAILURE);
+  } else if (pid < 0) {
+    debug_perror("Error starting the server in %s. ", dir);
+  }
+  return pid;
+}
+
+/**
+ * Wait for the server with the queue "key" to create it, then make a client
+ * of its own for it.
+ * @return The client, selected. NULL if the server did not start.
+ */
+static STORC_CLIENT_t *connectServer(const char *key) {
+  int step = 0;
+
+  while (-1 == msgget((key_t)strtol(key, NULL, 0), 0) && step++ < WAIT_STEPS) {
+    usleep(WAIT_STEP);
+  }
+
+  STORC_CLIENT_t *client = STORC_newClient();
+  if (client == NULL) {
+    return NULL;
+  }
+  STORC_select(client);
+  setenv(MYSTORE_KEY_ENV, key, 1);
+  if (STORC_init() != 0) {
+    STORC_select(NULL);
+    STORC_freeClient(client);
+    return NULL;
+  }
+  return client;
+}
+
+/**
+ * Wait for the selected server to read "index" as expected.
+ * @return -1 if it did not in time. 0 success.
+ */
+static int waitRecord(int index) {
+  MYRECORD_RECORD_t record;
+
+  for (int step = 0; step < WAIT_STEPS; step++) {
+    if (0 == STORC_read(index, &record) &&
+        0 == memcmp(&record, &expected[index], sizeof(MYRECORD_RECORD_t))) {
+      return 0;
+    }
+    usleep(WAIT_STEP);
+  }
+  return -1;
+}
+
+/**
+ * Stop a server and wait for it to close its tables.
+ * @return -1 if it failed. 0 success.
+ */
+static int stopServer(pid_t pid) {
+  int status;
+
+  kill(pid, SIGINT);
+  if (pid != waitpid(pid, &status, 0)) {
+    return -1;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/**
+ * Compare the table left in "dir" with the records expected, present and
+ * absent, in a process of its own for the cache it opens.
+ * @return -1 if they differ or in case of error. 0 success.
+ */
+static int checkTable(const char *dir) {
+  int status;
+
+  fflush(stdout);
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    debug_perror("Error creating the checking process. ");
+    return -1;
+  }
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+  }
+
+  unsigned int found = 0;
+  unsigned int holes = 0;
+  unsigned int wrong = 0;
+  MYRECORD_RECORD_t record;
+  int snapshot;
+  int i;
+
+  if (-1 == chdir(dir) || MYC_initCacheOpt(cacheOptions) != 0 ||
+      (snapshot = MYC_openSnapshot(0)) < 0) {
+    debug_error("Error opening the table in %s.", dir);
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0;; i++) {
+    int scanned = MYC_scanSnapshot(snapshot, i, &record);
+    if (scanned == -1) {
+      wrong++;
+      continue;
+    }
+    if (scanned == MYC_END) {
+      break;
+    }
+    if (i >= records || (scanned == MYC_ABSENT) == present[i] ||
+        0 != memcmp(&record, &expected[i], sizeof(MYRECORD_RECORD_t))) {
+      if (wrong++ < 10) {
+        debug_error("%s: record %d is %s, expected %s.", dir, i,
+                    scanned == MYC_ABSENT ? "absent" : "present",
+                    i >= records || !present[i] ? "absent"
+                    : scanned == 0              ? "other bytes"
+                                                : "present");
+      }
+    }
+    found += (scanned == 0);
+    holes += (scanned == MYC_ABSENT);
+  }
+  printf("%s: %u records, %u holes, last %d, %u wrong\n", dir, found, holes,
+         i - 1, wrong + (i != records));
+  MYC_closeSnapshot(snapshot);
+  MYC_closeCache();
+  exit(wrong == 0 && i == records ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  char *server = NULL;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 's':
+      server = realpath(optarg, NULL);
+      errorWithOptions |= (server == NULL);
+      break;
+    case 'k':
+      keys = atoi(optarg);
+      errorWithOptions |= (keys < 8);
+      break;
+    case 'P':
+      cacheOptions |= MYC_OPT_PAGED;
+      break;
+    case 'Z':
+      cacheOptions |= MYC_OPT_COMPRESSED;
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions ||
+      server == NULL || keys == 0 ||
+      cacheOptions == (MYC_OPT_PAGED | MYC_OPT_COMPRESSED)) {
+    debug_error("Incorrect parameters, from an empty directory where "
+                PRIMARY_DIR " and " STANDBY_DIR " are created provide:\n>\t-s "
+                "[path]: The test_store_server to run\n>\t-k [keys]: Indices "
+                "written, 8 at least\n>\t-P: Store the tables in slotted "
+                "pages\n>\t-Z: Store the tables in compressed blocks");
+    exit(1);
+  }
+
+  char socketPath[PATH_MAX];
+  char primaryKey[16];
+  char standbyKey[16];
+  if (NULL == getcwd(socketPath, sizeof(socketPath) - sizeof(SOCKET_NAME) - 1)) {
+    debug_perror("Error reading the current directory. ");
+    exit(1);
+  }
+  strcat(socketPath, "/" SOCKET_NAME);
+  snprintf(primaryKey, sizeof(primaryKey), "%d", (getpid() << 8) | 1);
+  snprintf(standbyKey, sizeof(standbyKey), "%d", (getpid() << 8) | 2);
+
+  records = keys + keys / 4 + 1;
+  expected = calloc(records, sizeof(MYRECORD_RECORD_t));
+  present = calloc(records, 1);
+  if (expected == NULL || present == NULL ||
+      -1 == mkdir(PRIMARY_DIR, S_IRWXU) || -1 == mkdir(STANDBY_DIR, S_IRWXU)) {
+    debug_perror("Error creating " PRIMARY_DIR " and " STANDBY_DIR ". ");
+    exit(1);
+  }
+
+  int errors = 0;
+  pid_t primary = startServer(server, PRIMARY_DIR, primaryKey, "-R", socketPath);
+  STORC_CLIENT_t *primaryClient = connectServer(primaryKey);
+  if (primary < 0 || primaryClient == NULL) {
+    debug_error("The primary did not start, see " PRIMARY_DIR "/server.log.");
+    exit(1);
+  }
+
+  /* Never written every third record, deleted every fifth. */
+  for (int i = 0; i < keys; i++) {
+    if (i % 3 != 0) {
+      errors += (0 != writeRecord(i, 1));
+    }
+  }
+  for (int i = 0; i < keys; i += 5) {
+    errors += (0 != deleteRecord(i));
+  }
+
+  pid_t standby = startServer(server, STANDBY_DIR, standbyKey, "-F", socketPath);
+  STORC_CLIENT_t *standbyClient = connectServer(standbyKey);
+  if (standby < 0 || standbyClient == NULL || -1 == waitRecord(1)) {
+    debug_error("The standby did not start, see " STANDBY_DIR "/server.log.");
+    errors++;
+  }
+
+  /* While it follows: overwrites, deletes and holes past the last record. */
+  STORC_select(primaryClient);
+  for (int i = 0; i < keys; i++) {
+    if (i % 4 == 0) {
+      errors += (0 != writeRecord(i, 2));
+    }
+    if (i % 7 == 0) {
+      errors += (0 != deleteRecord(i));
+    }
+  }
+  for (int i = keys; i < records - 1; i += 2) {
+    errors += (0 != writeRecord(i, 2));
+  }
+  errors += (0 != writeRecord(records - 1, 3));
+
+  STORC_select(standbyClient);
+  if (standbyClient != NULL && -1 == waitRecord(records - 1)) {
+    debug_error("The standby did not catch up with the primary.");
+    errors++;
+  }
+  STORC_select(NULL);
+
+  if (standby > 0 && -1 == stopServer(standby)) {
+    debug_error("The standby failed, see " STANDBY_DIR "/server.log.");
+    errors++;
+  }
+  if (-1 == stopServer(primary)) {
+    debug_error("The primary failed, see " PRIMARY_DIR "/server.log.");
+    errors++;
+  }
+  printf("keys=%d records=%d errors=%d\n", keys, records, errors);
+
+  errors += (-1 == checkTable(PRIMARY_DIR));
+  errors += (-1 == checkTable(STANDBY_DIR));
+  STORC_freeClient(primaryClient);
+  STORC_freeClient(standbyClient);
+  free(expected);
+  free(present);
+  free(server);
+
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,23 +1,44 @@
+#include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "debug.h"
 #include <getopt.h>
 #include <mycache.h>
+#include <mylog.h>
+#include <myreplica.h>
 #include <mystore_srv.h>
 
-#define OPTIONS_SET "vft:"
+#define OPTIONS_SET "vft:wWPZSUDA:T:m:k:R:F:p:b:B:I:O:"
 #define ADDITIONAL_ARGS 0
 
 static int debug_level = DEBUG_INIT;
 static int end = 0;
 static int printStats = 0;
+static int flushPending = 0;
+static int rotatePending = 0;
+static int promotePending = 0;
 static int flushTimeInSeconds = 15;
+static int cacheOptions = 0;
+static unsigned int cacheBudget = MYC_BUDGET;
+static char *tableNames[MYC_MAXTABLES];
+static int numTables = 0;
+static char *replicaSocket = NULL; /* -R: primary, standbys connect here. */
+static char *primarySocket = NULL; /* -F: standby of this primary. */
+static int readOnly = 0;
+static int partition = -1; /* -p: partition of a cluster it serves. */
+static char *restoreDir = NULL; /* -B: backup restored before starting. */
+static char *importDir = NULL;  /* -I: the only files a client can load. */
+static int importFd = -1;
+static char *backupRoot = NULL; /* -O: where the backups of clients go. */
+static int backupFd = -1;
 static FILE *logFile;
-static unsigned long int totalRequests = 0;
-static unsigned long int totalReadRequests = 0;
-static unsigned long int totalWriteRequests = 0;
+static MYSTORE_STATS_t stats;
 
 static void exit_handler(int sig_num) {
   switch (sig_num) {
@@ -36,12 +57,10 @@ static void exit_handler(int sig_num) {
   }
 }
 
+/* The flush is left to the main loop: the cache may be locked right now. */
 static void alarm_handler(int sig_num) {
   if (!end) {
-    debug_debug("Alarm is going to flush");
-    MYC_flushAll();
-    debug_debug("New alarm in %d seconds", flushTimeInSeconds);
-    alarm(flushTimeInSeconds);
+    flushPending = 1;
     signal(SIGALRM, alarm_handler);
   }
 }
@@ -62,6 +81,7 @@ static void daemon_debuglevel_rotate() {
   debuglevel_rotate();
   MYC_debuglevel_rotate();
   STORS_debuglevel_rotate();
+  STORR_debuglevel_rotate();
   debug_info("\033[0;33mRotating debug level in all my libraries. Current "
              "level=%d.\033[0m",
              debug_level);
@@ -69,49 +89,450 @@ static void daemon_debuglevel_rotate() {
 
 static void printStadistics() { printStats = 1; }
 
+/* Logging from a handler could interrupt a log call of the same thread. */
+static void rotate_handler(int sig_num) {
+  rotatePending = 1;
+  signal(SIGUSR2, rotate_handler);
+}
+
+/* A standby becomes a primary on SIGHUP, the main loop does the work. */
+static void promote_handler(int sig_num) {
+  promotePending = 1;
+  signal(SIGHUP, promote_handler);
+}
+
+/**
+ * Answer a MYSCOP_STATS request with the counters of the server and the cache,
+ * of a single table if "table" is not negative.
+ * @return Return 0 if OK. -1 in case of some error sending.
+ */
+static int sendStadistics(long client, int table) {
+  stats_message_t answer;
+
+  answer.mtype = client;
+  answer.refused = 0;
+  stats.busy = STORS_busy();
+  stats.expired = STORS_expired();
+  memcpy(&answer.stats, &stats, sizeof(MYSTORE_STATS_t));
+  if (table < 0) {
+    answer.status = MYC_getStats(&answer.stats.cache);
+  } else {
+    answer.status = MYC_getTableStats(table, &answer.stats.cache);
+  }
+
+  return STORS_sendstats(&answer);
+}
+
+/**
+ * Whether "name", sent by a client, names an entry of a directory of the
+ * server and cannot lead out of it.
+ */
+static int isPlainName(const char *name) {
+  return name[0] != '\0' && strchr(name, '/') == NULL &&
+         strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+/**
+ * Answer a MYSCOP_BLOBREAD with the payload of a record.
+ * @return Return 0 if OK. -1 in case of some error sending.
+ */
+static int sendPayload(long client, int table, int index) {
+  payload_message_t answer;
+
+  answer.mtype = client;
+  answer.refused = 0;
+  answer.status = MYC_readTableBlob(table, index, answer.payload, MYC_BLOBMAX);
+
+  return STORS_sendpayload(&answer);
+}
+
+/**
+ * Answer a MYSCOP_BLOBWRITE: store a payload in place of a record. Payloads
+ * are not shipped to a standby, so a primary refuses them.
+ * @return 0 if stored. -1 in case of error.
+ */
+static int writePayload(blob_message_t *blob) {
+  request_message_t *req = &blob->request;
+
+  if (readOnly || replicaSocket != NULL) {
+    debug_error("Payloads are not replicated, write refused.");
+    return -1;
+  }
+  if (blob->length < 0 || blob->length > MYC_BLOBMAX) {
+    debug_error("Invalid payload of %d bytes.", blob->length);
+    return -1;
+  }
+  int status = MYC_writeTableBlob(req->table, req->index, blob->payload,
+                                  blob->length);
+  if (status == 0) {
+    stats.invalidations +=
+        STORS_invalidate(req->table, req->index, req->return_to);
+  }
+  debug_debug("Payload (client=%ld, table=%d, idx=%d, length=%d) ret %d.",
+              req->return_to, req->table, req->index, blob->length, status);
+  return status;
+}
+
+/**
+ * Answer a MYSCOP_LOAD: import into a table the records of a file of the
+ * import directory, named by the client. Any other file is refused, the
+ * server could read what the client cannot. Loads are not shipped to a
+ * standby, so a primary refuses them.
+ * @return The number of records loaded. -1 in case of error.
+ */
+static int loadTable(load_message_t *load) {
+  request_message_t *req = &load->request;
+  struct stat st;
+
+  if (readOnly || replicaSocket != NULL) {
+    debug_error("Bulk loads are not replicated, load refused.");
+    return -1;
+  }
+
+  load->path[MYSTORE_PATHMAX - 1] = '\0';
+  if (importFd < 0 || !isPlainName(load->path)) {
+    debug_error("Load of %s refused, not a file of the import directory.",
+                load->path);
+    return -1;
+  }
+  /* O_NONBLOCK: opening a FIFO must not stop the server. */
+  int fd = openat(importFd, load->path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+  if (fd >= 0 && (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+    close(fd);
+    fd = -1;
+    errno = EINVAL;
+  }
+  if (fd < 0) {
+    debug_perror("Error opening %s to load. ", load->path);
+    return -1;
+  }
+  int loaded = MYC_loadTable(req->table, req->index, fd);
+  close(fd);
+
+  if (loaded > 0) {
+    stats.invalidations +=
+        STORS_invalidateRange(req->table, req->index, loaded, req->return_to);
+  }
+  debug_debug("Load (client=%ld, table=%d, idx=%d) ret %d.", req->return_to,
+              req->table, req->index, loaded);
+  return loaded;
+}
+
+/**
+ * Make the directory "name" in the directory "dirfd", or take the one there,
+ * but nothing else, a link to a directory neither. Only the owner can
+ * change what it holds.
+ * @return -1 in case of error. 0 OK.
+ */
+static int makeDirectoryAt(int dirfd, const char *name) {
+  struct stat st;
+
+  if (mkdirat(dirfd, name, S_IRWXU | S_IRGRP | S_IXGRP) != 0 &&
+      errno != EEXIST) {
+    return -1;
+  }
+  if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return -1;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Answer a MYSCOP_BACKUP: start a backup of a table into the directory named
+ * by the client in the backup root, creating it if needed, and in its
+ * subdirectory partition.N for a partition. Anything else is refused, the
+ * server could write where the client cannot. A standby can take it as
+ * well as a primary.
+ * @return 0 if the backup started. -1 in case of error.
+ */
+static int backupTable(load_message_t *backup) {
+  request_message_t *req = &backup->request;
+  char *name = backup->path;
+  char path[PATH_MAX];
+  char sub[32];
+
+  name[MYSTORE_PATHMAX - 1] = '\0';
+  if (backupFd < 0 || !isPlainName(name)) {
+    debug_error("Backup into %s refused, not a name in the backup root.",
+                name);
+    return -1;
+  }
+  /* Room left for "/partition.N". */
+  if (snprintf(path, sizeof(path), "%s/%s", backupRoot, name) >=
+      (int)(sizeof(path) - sizeof(sub))) {
+    debug_error("Backup into %s refused, its path is too long.", name);
+    return -1;
+  }
+  if (makeDirectoryAt(backupFd, name) != 0) {
+    debug_perror("Error creating the backup directory %s. ", name);
+    return -1;
+  }
+  if (partition >= 0) {
+    int fd = openat(backupFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    snprintf(sub, sizeof(sub), "partition.%d", partition);
+    if (fd < 0 || makeDirectoryAt(fd, sub) != 0) {
+      debug_perror("Error creating the backup directory %s/%s. ", name, sub);
+      if (fd >= 0) {
+        close(fd);
+      }
+      return -1;
+    }
+    close(fd);
+    strcat(path, "/");
+    strcat(path, sub);
+  }
+
+  int status = MYC_backupTable(req->table, path, req->index);
+  debug_debug("Backup (client=%ld, table=%d, path=%s) ret %d.",
+              req->return_to, req->table, path, status);
+  return status;
+}
+
+/**
+ * Put back the default table and the tables of -T from the backup in
+ * restoreDir, before they are opened.
+ * @return -1 if any of them could not be restored. 0 OK.
+ */
+static int restoreTables() {
+  char name[MYC_TABLENAMELENGTH];
+
+  if (MYC_restoreTable(MYC_DEFAULTTABLE, cacheOptions, restoreDir) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < numTables; i++) {
+    snprintf(name, sizeof(name), "%.*s",
+             (int)strcspn(tableNames[i], ":"), tableNames[i]);
+    if (MYC_restoreTable(name, cacheOptions, restoreDir) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 static void daemonServer() {
-  if (MYC_initCache() != 0) {
+  /* The files of every partition live in a directory of its own. */
+  if (partition >= 0) {
+    char directory[32];
+    snprintf(directory, sizeof(directory), "partition.%d", partition);
+    if ((mkdir(directory, S_IRWXU | S_IRWXG) != 0 && errno != EEXIST) ||
+        chdir(directory) != 0) {
+      debug_perror("Error entering the directory of partition %d. ",
+                   partition);
+      exit(1);
+    }
+  }
+
+  if (MYLOG_init() != 0) {
+    debug_error("Error starting the log drainer, logging synchronously.");
+  }
+
+  if (importDir != NULL &&
+      (importFd = open(importDir, O_RDONLY | O_DIRECTORY)) < 0) {
+    debug_perror("Error opening the import directory %s. ", importDir);
+    exit(1);
+  }
+
+  if (backupRoot != NULL &&
+      (backupFd = open(backupRoot, O_RDONLY | O_DIRECTORY)) < 0) {
+    debug_perror("Error opening the backup root %s. ", backupRoot);
+    exit(1);
+  }
+
+  if (restoreDir != NULL && restoreTables() != 0) {
+    debug_error("Error restoring the tables from %s.", restoreDir);
+    exit(1);
+  }
+
+  if (MYC_setBudget(cacheBudget) != 0 || MYC_initCacheOpt(cacheOptions) != 0) {
     debug_error("Error initializing cache.");
     exit(1);
   }
 
-  if (STORS_init() != 0) {
+  /* "-T name:quota" opens the table "name" with "quota" entries. */
+  for (int i = 0; i < numTables; i++) {
+    char *quota = strchr(tableNames[i], ':');
+    if (quota != NULL) {
+      *quota++ = '\0';
+    }
+    int table = MYC_openTable(tableNames[i], cacheOptions,
+                              quota ? strtoul(quota, NULL, 10) : 0);
+    if (table < 0) {
+      debug_error("Error opening table %s.", tableNames[i]);
+      MYC_closeCache();
+      exit(1);
+    }
+    debug_info("Table %s served as table %d.", tableNames[i], table);
+  }
+
+  if (replicaSocket != NULL && STORR_listen(replicaSocket, numTables + 1) != 0) {
+    debug_error("Error listening for a standby.");
+    MYC_closeCache();
+    exit(1);
+  }
+
+  /* A standby only reads until it is promoted, the primary writes for it. */
+  if (primarySocket != NULL) {
+    if (STORR_follow(primarySocket) != 0) {
+      debug_error("Error following the primary.");
+      STORR_closeListen();
+      MYC_closeCache();
+      exit(1);
+    }
+    readOnly = 1;
+  }
+
+  if ((partition < 0 ? STORS_init()
+                     : STORS_initKey(MYSTORE_PARTITION_KEY(partition))) != 0) {
     debug_error("Error initializing server side API.");
+    STORR_promote();
+    STORR_closeListen();
     MYC_closeCache();
     exit(1);
   }
 
-  debug_info("Test store server started OK.");
+  if (partition >= 0) {
+    debug_info("Test store server started OK as partition %d.", partition);
+  } else {
+    debug_info("Test store server started OK.");
+  }
 
   debug_debug("New alarm in %d seconds", flushTimeInSeconds);
   alarm(flushTimeInSeconds);
   while (!end) {
-    request_message_t req;
+    commit_message_t message;
+    request_message_t *req = &message.request;
     answer_message_t answer;
 
-    int status = STORS_readrequest(&req);
+    int status = STORS_nextrequest(&message);
     if (status == -1) {
       debug_info("No request received.");
     } else {
-      totalRequests++;
-      answer.mtype = req.return_to;
+      uint64_t start = myh_now();
+      if (req->sent != 0 && start > req->sent) {
+        myh_record(&stats.queueWait, start - req->sent);
+      }
 
-      switch (req.requested_op) {
+      stats.totalRequests++;
+      answer.mtype = req->return_to;
+      answer.refused = 0;
+      answer.lease = 0;
+      answer.retryAfter = 0;
+
+      switch (req->requested_op) {
       case MYSCOP_READ:
-        totalReadRequests++;
-        answer.status = MYC_readEntry(req.index, &(answer.data));
-        debug_debug("Read operation (client=%ld, idx=%d) ret %d.",
-                    req.return_to, req.index, status);
+        stats.totalReadRequests++;
+        answer.status = MYC_readTableEntry(req->table, req->index,
+                                           &(answer.data));
+        /* A standby takes no writes of its own to invalidate leases with. */
+        if (answer.status == 0 && (req->flags & MYSTORE_REQ_LEASE) &&
+            !readOnly &&
+            STORS_grantLease(req->table, req->index, req->return_to) == 0) {
+          answer.lease = 1;
+          stats.leases++;
+        }
+        debug_debug("Read operation (client=%ld, table=%d, idx=%d) ret %d.",
+                    req->return_to, req->table, req->index, status);
         debug_verbose("id: %u, age: %d, gender: %d, name: %s",
                       answer.data.registerid, answer.data.age,
                       answer.data.gender, answer.data.name);
         break;
 
       case MYSCOP_WRITE:
-        totalWriteRequests++;
-        answer.status = MYC_writeEntry(req.index, &(req.data));
-        debug_debug("Write operation (client=%ld, idx=%d) ret %d.",
-                    req.return_to, req.index, status);
+        stats.totalWriteRequests++;
+        if (readOnly) {
+          answer.status = -1;
+        } else {
+          answer.status = MYC_writeTableEntry(req->table, req->index,
+                                              &(req->data));
+          if (answer.status == 0) {
+            STORR_shipWrite(req->table, req->index, &(req->data));
+            stats.invalidations +=
+                STORS_invalidate(req->table, req->index, req->return_to);
+          }
+        }
+        debug_debug("Write operation (client=%ld, table=%d, idx=%d) ret %d.",
+                    req->return_to, req->table, req->index, status);
+        break;
+
+      case MYSCOP_DELETE:
+        stats.totalWriteRequests++;
+        if (readOnly) {
+          answer.status = -1;
+        } else {
+          answer.status = MYC_deleteTableEntry(req->table, req->index);
+          if (answer.status == 0) {
+            STORR_shipDelete(req->table, req->index);
+            stats.invalidations +=
+                STORS_invalidate(req->table, req->index, req->return_to);
+          }
+        }
+        debug_debug("Delete operation (client=%ld, table=%d, idx=%d) ret %d.",
+                    req->return_to, req->table, req->index, answer.status);
+        break;
+
+      case MYSCOP_COMMIT:
+        stats.totalWriteRequests++;
+        if (readOnly || message.count < 0 || message.count > MYSTORE_TXMAX) {
+          answer.status = -1;
+        } else {
+          answer.status = MYC_commit(req->table, message.entries,
+                                     message.count, &(answer.data));
+          if (answer.status == 0) {
+            STORR_shipCommit(req->table, message.entries, message.count);
+            for (int i = 0; i < message.count; i++) {
+              if (message.entries[i].op == MYC_TXWRITE) {
+                stats.invalidations += STORS_invalidate(
+                    req->table, message.entries[i].index, req->return_to);
+              }
+            }
+          }
+        }
+        debug_debug("Commit (client=%ld, table=%d, entries=%d) ret %d.",
+                    req->return_to, req->table, message.count, answer.status);
+        break;
+
+      case MYSCOP_LOAD:
+        stats.totalWriteRequests++;
+        answer.status = loadTable((load_message_t *)&message);
+        break;
+
+      case MYSCOP_COMPACT:
+        answer.status =
+            readOnly ? -1 : MYC_compactTable(req->table, req->index);
+        break;
+
+      case MYSCOP_BACKUP:
+        answer.status = backupTable((load_message_t *)&message);
+        break;
+
+      case MYSCOP_SNAPOPEN:
+        answer.status = MYC_openSnapshot(req->table);
+        break;
+
+      case MYSCOP_SNAPREAD:
+        stats.totalReadRequests++;
+        answer.status =
+            MYC_readSnapshot(req->snapshot, req->index, &(answer.data));
+        break;
+
+      case MYSCOP_SNAPCLOSE:
+        answer.status = MYC_closeSnapshot(req->snapshot);
+        break;
+
+      case MYSCOP_BLOBREAD:
+        stats.totalReadRequests++;
+        break;
+
+      case MYSCOP_BLOBWRITE:
+        stats.totalWriteRequests++;
+        answer.status = writePayload((blob_message_t *)&message);
+        break;
+
+      case MYSCOP_STATS:
         break;
 
       default:
@@ -120,16 +541,57 @@ static void daemonServer() {
         break;
       }
 
-      status = STORS_sendanswer(&answer);
+      if (req->requested_op == MYSCOP_STATS) {
+        status = sendStadistics(req->return_to, req->table);
+      } else if (req->requested_op == MYSCOP_BLOBREAD) {
+        status = sendPayload(req->return_to, req->table, req->index);
+        myh_record(&stats.service, myh_now() - start);
+      } else {
+        myh_record(&stats.service, myh_now() - start);
+        status = STORS_sendanswer(&answer);
+      }
       if (status != 0) {
         debug_error("Problems sending back an answer.");
         break;
       }
+      if (req->sent != 0) {
+        int class = req->priority == MYSPRIO_INTERACTIVE ? MYSPRIO_INTERACTIVE
+                                                         : MYSPRIO_BULK;
+        myh_record(&stats.latency[class], myh_now() - req->sent);
+      }
+    }
+
+    STORS_expireLeases();
+
+    if (flushPending) {
+      debug_debug("Alarm is going to flush");
+      MYC_flushAll();
+      flushPending = 0;
+      debug_debug("New alarm in %d seconds", flushTimeInSeconds);
+      alarm(flushTimeInSeconds);
+    }
+
+    if (rotatePending) {
+      daemon_debuglevel_rotate();
+      rotatePending = 0;
+    }
+
+    if (promotePending) {
+      if (readOnly && STORR_promote() == 0) {
+        readOnly = 0;
+        debug_info("Promoted to primary, taking writes.");
+      }
+      promotePending = 0;
     }
 
     if (printStats) {
-      debug_info("\033[0;32mprocessed:%lu reads:%lu writes:%lu\033[0m",
-                 totalRequests, totalReadRequests, totalWriteRequests);
+      MYC_STATS_t cache;
+      MYC_getStats(&cache);
+      debug_info("\033[0;32mprocessed:%lu reads:%lu writes:%lu hits:%lu "
+                 "misses:%lu dirty:%lu\033[0m",
+                 stats.totalRequests, stats.totalReadRequests,
+                 stats.totalWriteRequests, cache.hits, cache.misses,
+                 cache.dirty);
       printStats = 0;
     }
   }
@@ -140,12 +602,24 @@ static void daemonServer() {
   if (STORS_close() != 0) {
     debug_error("Error closing server API.");
   }
+  if (readOnly) {
+    STORR_promote();
+  }
+  STORR_closeListen();
   if (MYC_closeCache() != 0) {
     debug_error("Error closing cache.");
     exit(1);
   }
 
+  if (importFd >= 0) {
+    close(importFd);
+  }
+  if (backupFd >= 0) {
+    close(backupFd);
+  }
+
   debug_info("Test store server ended OK.");
+  MYLOG_close();
 
   if (logFile != NULL) {
     fclose(logFile);
@@ -172,6 +646,85 @@ int main(int argc, char **argv) {
     case 'f':
       detach = 0;
       break;
+    case 'w':
+      cacheOptions |= MYC_OPT_WARMSTART;
+      break;
+    case 'W':
+      cacheOptions |= MYC_OPT_SNAPPAYLOAD;
+      break;
+    case 'S':
+      cacheOptions |= MYC_OPT_SCRUB;
+      break;
+    case 'U':
+      cacheOptions |= MYC_OPT_URING;
+      break;
+    case 'D':
+      cacheOptions |= MYC_OPT_DIRECT;
+      break;
+    case 'A':
+      if (MYC_setHitTarget(strtoul(optarg, NULL, 10)) != 0) {
+        errorWithOptions = 1;
+      }
+      cacheOptions |= MYC_OPT_AUTOSIZE;
+      break;
+    case 'P':
+      cacheOptions |= MYC_OPT_PAGED;
+      break;
+    case 'Z':
+      cacheOptions |= MYC_OPT_COMPRESSED;
+      break;
+    case 'T':
+      if (numTables == MYC_MAXTABLES - 1) {
+        errorWithOptions = 1;
+      } else {
+        tableNames[numTables++] = optarg;
+      }
+      break;
+    case 'm':
+      cacheBudget = strtoul(optarg, NULL, 10);
+      if (cacheBudget == 0) {
+        errorWithOptions = 1;
+      }
+      break;
+    case 'k':
+      setenv(MYSTORE_KEY_ENV, optarg, 1);
+      break;
+    case 'R':
+      replicaSocket = optarg;
+      break;
+    case 'F':
+      primarySocket = optarg;
+      break;
+    case 'b':
+      if (STORS_setInflight(strtoul(optarg, NULL, 10)) != 0) {
+        errorWithOptions = 1;
+      }
+      break;
+    case 'B':
+      /* Made absolute now, a partition enters its own directory later. */
+      restoreDir = realpath(optarg, NULL);
+      if (restoreDir == NULL) {
+        errorWithOptions = 1;
+      }
+      break;
+    case 'I':
+      importDir = realpath(optarg, NULL);
+      if (importDir == NULL) {
+        errorWithOptions = 1;
+      }
+      break;
+    case 'O':
+      backupRoot = realpath(optarg, NULL);
+      if (backupRoot == NULL) {
+        errorWithOptions = 1;
+      }
+      break;
+    case 'p':
+      partition = atoi(optarg);
+      if (partition < 0 || partition >= MYSTORE_MAXPARTITIONS) {
+        errorWithOptions = 1;
+      }
+      break;
     case 't':
       flushTimeInSeconds = atoi(optarg);
       if (flushTimeInSeconds <= 0) {
@@ -194,16 +747,45 @@ int main(int argc, char **argv) {
     debug_error(
         "Incorrect parameters please provide any or none of these:\n>\t-v: "
         "Increase logging level\n>\t-t [time]: Set flush timer (time must be "
-        "greater than 0)\n>\t-f: Run the server in the foreground (no daemon)");
+        "greater than 0)\n>\t-f: Run the server in the foreground (no daemon)"
+        "\n>\t-w: Warm start the cache from the snapshot of the last run"
+        "\n>\t-W: Save the records too in the snapshot, not only indices"
+        "\n>\t-P: Store the table in slotted pages (" MYC_PAGEDFILENAME ")"
+        "\n>\t-Z: Store the table in compressed blocks "
+        "(" MYC_COMPRESSEDFILENAME ")"
+        "\n>\t-S: Check the table files against their checksums in the "
+        "background"
+        "\n>\t-U: Read and write the table files through io_uring"
+        "\n>\t-D: Read and write the table files with O_DIRECT, in blocks "
+        "kept by the cache instead of the page cache"
+        "\n>\t-A [percent]: Resize the caches to hit that percent of the "
+        "accesses, within the entries of -m"
+        "\n>\t-T [name[:quota]]: Serve the table \"name\" too, with \"quota\" "
+        "cache entries (repeatable)"
+        "\n>\t-m [entries]: Cache entries shared by all the tables"
+        "\n>\t-k [key]: Key of the IPC queue, instead of the user id"
+        "\n>\t-R [socket]: Stream the writes to a standby connecting there"
+        "\n>\t-F [socket]: Run as a read-only standby of that primary, "
+        "promoted by SIGHUP"
+        "\n>\t-p [partition]: Serve that partition of a cluster, from the "
+        "directory partition.N"
+        "\n>\t-b [requests]: Requests waiting in the server before new ones "
+        "are answered busy (default 128)"
+        "\n>\t-B [directory]: Restore the tables from the backup there "
+        "before serving them"
+        "\n>\t-I [directory]: Load the files of clients from there, and "
+        "from nowhere else"
+        "\n>\t-O [directory]: Make the backups of clients there, and "
+        "nowhere else");
     exit(1);
   }
   signal(SIGTERM, exit_handler);
   signal(SIGINT, exit_handler);
   signal(SIGQUIT, exit_handler);
   signal(SIGALRM, alarm_handler);
-  signal(SIGHUP, SIG_IGN);
+  signal(SIGHUP, promote_handler);
   signal(SIGUSR1, printStadistics);
-  signal(SIGUSR2, daemon_debuglevel_rotate);
+  signal(SIGUSR2, rotate_handler);
 
   if (detach) {
     if (fork() == 0) {
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include <getopt.h>
+#include <mystore_cli.h>
+
+#define OPTIONS_SET "i:n:t:"
+#define ADDITIONAL_ARGS 0
+
+static int debug_level = DEBUG_INIT;
+
+static void printHistogram(const char *name, const MYHISTO_t *h) {
+  printf("  %-11s n=%-10lu p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+         name, h->total, myh_percentile(h, 50.0) / 1000.0,
+         myh_percentile(h, 99.0) / 1000.0, myh_percentile(h, 99.9) / 1000.0,
+         h->max / 1000.0);
+}
+
+/** Hit ratio an LRU cache would have by entries, up to where it stops
+ * growing. */
+static void printCurve(const MYC_STATS_t *cache) {
+  double last = mymrc_hitRatio(&cache->mrc, MYMRC_SIZE(MYMRC_POINTS - 1));
+  int points = 0;
+
+  printf("  entries:%lu, estimated LRU hit ratio by entries:", cache->entries);
+  for (int i = 0; i < MYMRC_POINTS && cache->mrc.accesses > 0; i++) {
+    double ratio = mymrc_hitRatio(&cache->mrc, MYMRC_SIZE(i));
+
+    printf("%s %7lu:%5.1f%%", points++ % 6 ? "" : "\n   ", MYMRC_SIZE(i),
+           100.0 * ratio);
+    if (ratio >= last) {
+      break;
+    }
+  }
+  printf("\n");
+}
+
+static void printStadistics(const MYSTORE_STATS_t *stats,
+                            const MYSTORE_STATS_t *last, int interval) {
+  const MYC_STATS_t *cache = &stats->cache;
+  uint64_t accesses = cache->hits + cache->misses;
+
+  printf("requests:%lu (%.0f/s) reads:%lu writes:%lu\n", stats->totalRequests,
+         (double)(stats->totalRequests - last->totalRequests) / interval,
+         stats->totalReadRequests, stats->totalWriteRequests);
+  printf("  hits:%lu misses:%lu (hit ratio %.2f%%) evictions:%lu "
+         "writebacks:%lu dirty:%lu stalls:%lu\n",
+         cache->hits, cache->misses,
+         accesses ? 100.0 * cache->hits / accesses : 0.0, cache->evictions,
+         cache->writebacks, cache->dirty, cache->stalls);
+  printf("  commits:%lu conflicts:%lu versions:%lu deletes:%lu absent:%lu\n",
+         cache->commits, cache->conflicts, cache->versions, cache->deletes,
+         cache->absent);
+  printf("  leases:%lu invalidations:%lu busy:%lu expired:%lu\n",
+         stats->leases, stats->invalidations, stats->busy, stats->expired);
+  printf("  disk:%lu bytes for %lu bytes of table (ratio %.2f) "
+         "compacted:%lu backups:%lu\n",
+         cache->diskBytes, cache->tableBytes,
+         cache->diskBytes ? (double)cache->tableBytes / cache->diskBytes : 0.0,
+         cache->compacted, cache->backups);
+  printf("  corrupt:%lu scrubbed:%lu scrubCorrupt:%lu\n", cache->corrupt,
+         cache->scrubbed, cache->scrubCorrupt);
+  printCurve(cache);
+  printHistogram("queue wait", &stats->queueWait);
+  printHistogram("service", &stats->service);
+  printHistogram("interactive", &stats->latency[MYSPRIO_INTERACTIVE]);
+  printHistogram("bulk", &stats->latency[MYSPRIO_BULK]);
+  printHistogram("disk I/O", &cache->diskIO);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int errorWithOptions = 0;
+  int interval = 1;
+  int count = 1;
+  int table = -1;
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, OPTIONS_SET)) != EOF) {
+    switch (c) {
+    case 'i':
+      interval = atoi(optarg);
+      errorWithOptions |= (interval <= 0);
+      break;
+    case 'n':
+      count = atoi(optarg);
+      errorWithOptions |= (count < 0);
+      break;
+    case 't':
+      table = atoi(optarg);
+      errorWithOptions |= (table < 0);
+      break;
+    default:
+      errorWithOptions = 1;
+      break;
+    }
+  }
+
+  if ((argc - optind) != ADDITIONAL_ARGS || errorWithOptions) {
+    debug_error("Incorrect parameters please provide any or none of these:\n>\t"
+                "-i [seconds]: Time between polls (default 1)\n>\t-n [count]: "
+                "Number of polls, 0 polls until killed (default 1)\n>\t-t [table]: "
+                "Cache counters of a single table (default all)");
+    exit(1);
+  }
+
+  if (STORC_init() != 0) {
+    debug_error("Error initializing client API.");
+    exit(1);
+  }
+
+  MYSTORE_STATS_t stats;
+  MYSTORE_STATS_t last;
+  memset(&last, 0, sizeof(MYSTORE_STATS_t));
+
+  for (int i = 0; count == 0 || i < count; i++) {
+    if (i > 0) {
+      sleep(interval);
+    }
+    if (STORC_tableStats(table, &stats) != 0) {
+      debug_error("Error reading stats from server.");
+      exit(1);
+    }
+    printStadistics(&stats, &last, interval);
+    memcpy(&last, &stats, sizeof(MYSTORE_STATS_t));
+  }
+
+  if (STORC_close() != 0) {
+    debug_error("Error closing client.");
+    exit(1);
+  }
+
+  return (EXIT_SUCCESS);
+}